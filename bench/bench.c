@@ -0,0 +1,301 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+/* Benchmark for the opengx draw paths.
+ *
+ * Runs a set of scenarios against the host GX stand-in and, for each of them,
+ * reports the CPU time spent per vertex together with the amount of data
+ * produced for the GP: FIFO bytes per vertex and GX register writes per draw.
+ * Results are printed on stdout and written to a JSON file, so that runs can
+ * be compared automatically.
+ *
+ * Usage: opengx-bench [-o results.json] [-f frames] [-r repeats] [scenario...]
+ */
+
+#include "bench.h"
+
+#include <GL/gl.h>
+#include <gx_host.h>
+#include <ogc/gx.h>
+#include <opengx.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_FRAMES 30
+#define DEFAULT_REPEATS 5
+
+typedef struct {
+    const BenchScenario *scenario;
+    int frames;
+    BenchWork work; /* for all frames of one repeat */
+    GXHostStats stats; /* for all frames of one repeat */
+    double best_ns;
+    double median_ns;
+} BenchResult;
+
+/* Destination of the EFB copies; the host GX does not write into it */
+static u8 s_xfb[32] ATTRIBUTE_ALIGN(32);
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+    return da < db ? -1 : da > db;
+}
+
+static void run_frames(const BenchScenario *scenario, int first, int frames,
+                       BenchWork *work)
+{
+    for (int i = 0; i < frames; i++) {
+        bench_scenarios_set_frame(first + i);
+        scenario->frame(work);
+        /* Do what the integration libraries do */
+        ogx_prepare_swap_buffers();
+        GX_CopyDisp(s_xfb, GX_TRUE);
+    }
+}
+
+static void run_scenario(BenchResult *result, int frames, int repeats)
+{
+    const BenchScenario *scenario = result->scenario;
+    double *times = calloc(repeats, sizeof(double));
+    BenchWork work;
+
+    if (scenario->setup) scenario->setup();
+
+    /* Warm up: let the caches (ours and the CPU's) settle */
+    memset(&work, 0, sizeof(work));
+    run_frames(scenario, 0, 2, &work);
+
+    for (int r = 0; r < repeats; r++) {
+        memset(&work, 0, sizeof(work));
+        GX_HostResetStats();
+        uint64_t start = now_ns();
+        run_frames(scenario, 0, frames, &work);
+        times[r] = now_ns() - start;
+        if (r == 0) {
+            GX_HostGetStats(&result->stats);
+            result->work = work;
+        }
+    }
+
+    if (scenario->teardown) scenario->teardown();
+
+    qsort(times, repeats, sizeof(double), compare_doubles);
+    result->frames = frames;
+    result->best_ns = times[0];
+    result->median_ns = times[repeats / 2];
+    free(times);
+}
+
+/* The vertices sent to the FIFO must account for all the GL vertices, or
+ * the per vertex figures are meaningless: this catches draws whose vertex
+ * count overflows the 16 bit count of GX_Begin(). The vertices replayed from
+ * display lists are not counted by the host GX, and clearing or stencil
+ * drawing can add more, so only a shortfall without display lists is an
+ * error. */
+static bool check_vertex_count(const BenchResult *r)
+{
+    const GXHostStats *s = &r->stats;
+    if (s->displist_calls > 0 || s->vertices >= r->work.vertices) return true;
+
+    fprintf(stderr, "%s: %llu GL vertices, but only %llu GX vertices\n",
+            r->scenario->name, (unsigned long long)r->work.vertices,
+            (unsigned long long)s->vertices);
+    return false;
+}
+
+static double ratio(double a, uint64_t b)
+{
+    return b > 0 ? a / b : 0.0;
+}
+
+static void print_result(const BenchResult *r)
+{
+    const GXHostStats *s = &r->stats;
+    uint64_t reg_writes = s->bp_writes + s->cp_writes + s->xf_writes;
+
+    printf("%-22s %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+           r->scenario->name,
+           ratio(r->best_ns, r->work.vertices),
+           ratio(r->median_ns, r->work.vertices),
+           ratio(s->fifo_bytes, r->work.vertices),
+           ratio(s->fifo_bytes + s->displist_call_bytes, r->work.vertices),
+           ratio(reg_writes, r->work.draws));
+}
+
+static void write_json(FILE *out, const BenchResult *results, int count)
+{
+    fprintf(out, "{\n  \"benchmark\": \"opengx-draw\",\n");
+    fprintf(out, "  \"scenarios\": [\n");
+    for (int i = 0; i < count; i++) {
+        const BenchResult *r = &results[i];
+        const GXHostStats *s = &r->stats;
+        uint64_t reg_writes = s->bp_writes + s->cp_writes + s->xf_writes;
+
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"name\": \"%s\",\n", r->scenario->name);
+        fprintf(out, "      \"description\": \"%s\",\n",
+                r->scenario->description);
+        fprintf(out, "      \"frames\": %d,\n", r->frames);
+        fprintf(out, "      \"draws\": %llu,\n",
+                (unsigned long long)r->work.draws);
+        fprintf(out, "      \"vertices\": %llu,\n",
+                (unsigned long long)r->work.vertices);
+        fprintf(out, "      \"ns_per_vertex\": %.3f,\n",
+                ratio(r->best_ns, r->work.vertices));
+        fprintf(out, "      \"ns_per_vertex_median\": %.3f,\n",
+                ratio(r->median_ns, r->work.vertices));
+        fprintf(out, "      \"ns_per_frame\": %.1f,\n",
+                r->best_ns / r->frames);
+        fprintf(out, "      \"fifo_bytes_per_vertex\": %.3f,\n",
+                ratio(s->fifo_bytes, r->work.vertices));
+        fprintf(out, "      \"gp_bytes_per_vertex\": %.3f,\n",
+                ratio(s->fifo_bytes + s->displist_call_bytes,
+                      r->work.vertices));
+        fprintf(out, "      \"reg_writes_per_draw\": %.3f,\n",
+                ratio(reg_writes, r->work.draws));
+        fprintf(out, "      \"fifo_bytes\": %llu,\n",
+                (unsigned long long)s->fifo_bytes);
+        fprintf(out, "      \"displist_bytes\": %llu,\n",
+                (unsigned long long)s->displist_bytes);
+        fprintf(out, "      \"displist_call_bytes\": %llu,\n",
+                (unsigned long long)s->displist_call_bytes);
+        fprintf(out, "      \"array_fetch_bytes\": %llu,\n",
+                (unsigned long long)s->array_fetch_bytes);
+        fprintf(out, "      \"bp_writes\": %llu,\n",
+                (unsigned long long)s->bp_writes);
+        fprintf(out, "      \"cp_writes\": %llu,\n",
+                (unsigned long long)s->cp_writes);
+        fprintf(out, "      \"xf_writes\": %llu,\n",
+                (unsigned long long)s->xf_writes);
+        fprintf(out, "      \"gx_primitives\": %llu,\n",
+                (unsigned long long)s->primitives);
+        fprintf(out, "      \"gx_vertices\": %llu,\n",
+                (unsigned long long)s->vertices);
+        fprintf(out, "      \"draw_done_waits\": %llu,\n",
+                (unsigned long long)s->draw_done_waits);
+        fprintf(out, "      \"draw_sync_stalls\": %llu,\n",
+                (unsigned long long)s->draw_sync_stalls);
+        fprintf(out, "      \"vtx_cache_invalidations\": %llu,\n",
+                (unsigned long long)s->vtx_cache_invalidations);
+        fprintf(out, "      \"tex_invalidations\": %llu\n",
+                (unsigned long long)s->tex_invalidations);
+        fprintf(out, "    }%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static bool scenario_selected(const char *name, char **names, int num_names)
+{
+    if (num_names == 0) return true;
+    for (int i = 0; i < num_names; i++) {
+        if (strcmp(name, names[i]) == 0) return true;
+    }
+    return false;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-o results.json] [-f frames] [-r repeats] "
+            "[scenario...]\n\nScenarios:\n", argv0);
+    for (int i = 0; bench_scenarios[i]; i++) {
+        fprintf(stderr, "  %-22s %s\n", bench_scenarios[i]->name,
+                bench_scenarios[i]->description);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = "bench_results.json";
+    int frames = DEFAULT_FRAMES;
+    int repeats = DEFAULT_REPEATS;
+    char **names = calloc(argc, sizeof(char *));
+    int num_names = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            repeats = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return argv[i][1] == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        } else {
+            names[num_names++] = argv[i];
+        }
+    }
+    if (frames < 1) frames = 1;
+    if (repeats < 1) repeats = 1;
+
+    GX_Init(NULL, 0);
+    ogx_initialize();
+    ogx_enable_copy_clear(1);
+    glViewport(0, 0, 640, 480);
+
+    int num_scenarios = 0;
+    while (bench_scenarios[num_scenarios]) num_scenarios++;
+    BenchResult *results = calloc(num_scenarios, sizeof(BenchResult));
+
+    printf("%-22s %10s %10s %10s %10s %10s\n", "scenario", "ns/vtx",
+           "(median)", "fifo B/vtx", "gp B/vtx", "regs/draw");
+    int count = 0;
+    bool counts_ok = true;
+    for (int i = 0; i < num_scenarios; i++) {
+        if (!scenario_selected(bench_scenarios[i]->name, names, num_names))
+            continue;
+        BenchResult *r = &results[count++];
+        r->scenario = bench_scenarios[i];
+        run_scenario(r, frames, repeats);
+        print_result(r);
+        if (!check_vertex_count(r)) counts_ok = false;
+    }
+
+    FILE *out = fopen(output, "w");
+    if (!out) {
+        perror(output);
+        return EXIT_FAILURE;
+    }
+    write_json(out, results, count);
+    fclose(out);
+
+    free(results);
+    free(names);
+    return counts_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,61 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef OPENGX_BENCH_H
+#define OPENGX_BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Work submitted by one frame of a scenario, in GL terms: the scenario
+ * updates these counters itself, since the GX-level statistics cannot tell
+ * apart a GL vertex from, say, a vertex emitted by glClear(). */
+typedef struct {
+    uint64_t draws;
+    uint64_t vertices;
+} BenchWork;
+
+typedef struct {
+    const char *name;
+    const char *description;
+    /* Called once, before the timed runs; can be NULL */
+    void (*setup)(void);
+    /* Renders one frame, adding the submitted work to *work */
+    void (*frame)(BenchWork *work);
+    /* Called once, after the timed runs; must restore the GL state changed
+     * by setup(). Can be NULL. */
+    void (*teardown)(void);
+} BenchScenario;
+
+extern const BenchScenario *bench_scenarios[];
+
+/* Lets the scenarios animate their contents */
+void bench_scenarios_set_frame(int frame_number);
+
+#endif /* OPENGX_BENCH_H */
@@ -0,0 +1,513 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+/* Benchmark of the CMPR (DXT1) texture encoders.
+ *
+ * Compresses a corpus of generated textures with the previous encoder (kept
+ * in image_DXT.c for reference) and with the fast and high quality modes of
+ * the current one, and reports their throughput and the PSNR of the decoded
+ * textures. The PSNR is computed on the colours premultiplied by alpha, so
+ * that the colour of transparent pixels does not matter, while failing to
+ * make them transparent does.
+ *
+ * Usage: opengx-cmpr-bench [-o results.json] [-r repeats] [texture...]
+ */
+
+#include "image_DXT.h"
+
+#include <GL/gl.h>
+#include <math.h>
+#include <ogc/gx.h>
+#include <opengx.h>
+#include <pixels.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_REPEATS 5
+
+typedef struct {
+    const char *name;
+    const char *description;
+    int width, height;
+    bool has_alpha;
+    /* Fills the width x height RGBA pixels */
+    void (*generate)(uint8_t *rgba, int width, int height);
+} CorpusTexture;
+
+typedef enum {
+    ENCODER_OLD,
+    ENCODER_FAST,
+    ENCODER_HIGH_QUALITY,
+    ENCODER_COUNT,
+} Encoder;
+
+static const char *s_encoder_names[ENCODER_COUNT] = {
+    "old", "fast", "high_quality",
+};
+
+typedef struct {
+    const CorpusTexture *texture;
+    Encoder encoder;
+    bool supported;
+    double best_ns;
+    double psnr;
+} CmprResult;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Deterministic pseudo-random values, so that every run sees the same
+ * corpus */
+static uint32_t hash(uint32_t x, uint32_t y, uint32_t seed)
+{
+    uint32_t h = x * 374761393u + y * 668265263u + seed * 2246822519u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return h ^ (h >> 16);
+}
+
+static float lattice(int x, int y, uint32_t seed)
+{
+    return (hash(x, y, seed) & 0xffff) / 65535.0f;
+}
+
+/* Fractal value noise in [0, 1] */
+static float noise(float x, float y, uint32_t seed)
+{
+    float sum = 0, amplitude = 0.5f, total = 0;
+    for (int octave = 0; octave < 5; octave++) {
+        int ix = (int)floorf(x), iy = (int)floorf(y);
+        float fx = x - ix, fy = y - iy;
+        fx = fx * fx * (3 - 2 * fx);
+        fy = fy * fy * (3 - 2 * fy);
+        float top = lattice(ix, iy, seed) * (1 - fx) +
+            lattice(ix + 1, iy, seed) * fx;
+        float bottom = lattice(ix, iy + 1, seed) * (1 - fx) +
+            lattice(ix + 1, iy + 1, seed) * fx;
+        sum += amplitude * (top * (1 - fy) + bottom * fy);
+        total += amplitude;
+        amplitude *= 0.5f;
+        x *= 2;
+        y *= 2;
+        seed++;
+    }
+    return sum / total;
+}
+
+static uint8_t to_byte(float value)
+{
+    return value <= 0 ? 0 : value >= 1 ? 255 : (uint8_t)(value * 255 + 0.5f);
+}
+
+static void set_pixel(uint8_t *p, float r, float g, float b, uint8_t a)
+{
+    p[0] = to_byte(r);
+    p[1] = to_byte(g);
+    p[2] = to_byte(b);
+    p[3] = a;
+}
+
+static void generate_gradient(uint8_t *rgba, int width, int height)
+{
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float u = (float)x / width, v = (float)y / height;
+            set_pixel(rgba + (y * width + x) * 4,
+                      u, v, 0.5f + 0.5f * sinf(u * 6.28f) * v, 255);
+        }
+    }
+}
+
+/* Smooth, photo-like content: most blocks have colours close to a line */
+static void generate_clouds(uint8_t *rgba, int width, int height)
+{
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float n = noise(x / 32.0f, y / 32.0f, 1);
+            float haze = noise(x / 64.0f, y / 64.0f, 7);
+            set_pixel(rgba + (y * width + x) * 4,
+                      0.3f + 0.7f * n, 0.5f + 0.5f * n,
+                      0.9f - 0.3f * haze * (1 - n), 255);
+        }
+    }
+}
+
+/* Independent noise on each channel: the worst case for DXT1 */
+static void generate_rainbow_noise(uint8_t *rgba, int width, int height)
+{
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            set_pixel(rgba + (y * width + x) * 4,
+                      noise(x / 8.0f, y / 8.0f, 11),
+                      noise(x / 8.0f, y / 8.0f, 23),
+                      noise(x / 8.0f, y / 8.0f, 37), 255);
+        }
+    }
+}
+
+/* Sharp edges: dark "glyphs" on coloured panels */
+static void generate_text(uint8_t *rgba, int width, int height)
+{
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int panel = hash(x / 64, y / 64, 3) % 4;
+            static const float panels[4][3] = {
+                { 1, 1, 1 }, { 1, 0.9f, 0.6f }, { 0.7f, 0.85f, 1 },
+                { 0.2f, 0.2f, 0.25f },
+            };
+            /* Glyphs of 5x7 dots in 6x9 cells */
+            int cx = x % 6, cy = y % 9;
+            bool ink = cx < 5 && cy < 7 &&
+                (hash(x / 6 * 8 + cx, y / 9 * 8 + cy, 5) & 3) == 0;
+            const float *c = panels[panel];
+            float ink_color = panel == 3 ? 0.95f : 0.05f;
+            if (ink) {
+                set_pixel(rgba + (y * width + x) * 4,
+                          ink_color, ink_color, ink_color, 255);
+            } else {
+                set_pixel(rgba + (y * width + x) * 4, c[0], c[1], c[2], 255);
+            }
+        }
+    }
+}
+
+static void generate_bricks(uint8_t *rgba, int width, int height)
+{
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int row = y / 16;
+            int bx = (x + (row % 2) * 16) % 32, by = y % 16;
+            bool mortar = bx < 2 || by < 2;
+            float n = noise(x / 4.0f, y / 4.0f, 17);
+            float tint = lattice((x + (row % 2) * 16) / 32, row, 19) * 0.3f;
+            if (mortar) {
+                set_pixel(rgba + (y * width + x) * 4,
+                          0.7f + 0.1f * n, 0.7f + 0.1f * n, 0.65f, 255);
+            } else {
+                set_pixel(rgba + (y * width + x) * 4, 0.5f + tint + 0.2f * n,
+                          0.2f + 0.15f * n, 0.15f + 0.1f * n, 255);
+            }
+        }
+    }
+}
+
+/* Shaded balls on a transparent background, with garbage in the colour of
+ * the transparent pixels */
+static void generate_sprites(uint8_t *rgba, int width, int height)
+{
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t *p = rgba + (y * width + x) * 4;
+            float dx = (x % 32) - 15.5f, dy = (y % 32) - 15.5f;
+            float d2 = (dx * dx + dy * dy) / (13.0f * 13.0f);
+            if (d2 > 1) {
+                uint32_t h = hash(x, y, 29);
+                p[0] = h; p[1] = h >> 8; p[2] = h >> 16; p[3] = 0;
+                continue;
+            }
+            float light = 1 - d2 * 0.7f - (dx + dy) / 40.0f;
+            int ball = hash(x / 32, y / 32, 31) % 3;
+            set_pixel(p, light * (ball == 0 ? 1 : 0.3f),
+                      light * (ball == 1 ? 1 : 0.3f),
+                      light * (ball == 2 ? 1 : 0.3f), 255);
+        }
+    }
+}
+
+static const CorpusTexture s_corpus[] = {
+    { "gradient", "Smooth two dimensional gradient", 256, 256, false,
+        generate_gradient },
+    { "clouds", "Photo-like fractal noise", 256, 256, false,
+        generate_clouds },
+    { "rainbow_noise", "Uncorrelated noise on each channel", 256, 256, false,
+        generate_rainbow_noise },
+    { "text", "Sharp edged glyphs on coloured panels", 256, 256, false,
+        generate_text },
+    { "bricks", "Brick wall with noise shading", 256, 256, false,
+        generate_bricks },
+    { "sprites", "Shaded balls on a transparent background", 256, 256, true,
+        generate_sprites },
+    { "npot", "Photo-like, 100x60 pixels", 100, 60, false, generate_clouds },
+    { "npot_sprites", "Transparent sprites, 90x42 pixels", 90, 42, true,
+        generate_sprites },
+};
+#define CORPUS_SIZE (int)(sizeof(s_corpus) / sizeof(s_corpus[0]))
+
+static void unpack_565(uint16_t color, int *rgb)
+{
+    int r = color >> 11, g = (color >> 5) & 0x3f, b = color & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+/* Decodes a GX_TF_CMPR texture into RGBA pixels, as the GPU does */
+static void decode_cmpr(const uint8_t *cmpr, int width, int height,
+                        uint8_t *rgba)
+{
+    int tiles_x = (width + 7) / 8;
+    for (int y = 0; y < height; y += 4) {
+        for (int x = 0; x < width; x += 4) {
+            const uint8_t *block = cmpr + ((y / 8) * tiles_x + x / 8) * 32 +
+                ((y / 4) % 2 * 2 + (x / 4) % 2) * 8;
+            uint16_t c0 = (block[0] << 8) | block[1];
+            uint16_t c1 = (block[2] << 8) | block[3];
+            int palette[4][4];
+            unpack_565(c0, palette[0]);
+            unpack_565(c1, palette[1]);
+            for (int c = 0; c < 3; c++) {
+                int p0 = palette[0][c], p1 = palette[1][c];
+                if (c0 > c1) {
+                    palette[2][c] = (p0 * 5 + p1 * 3) >> 3;
+                    palette[3][c] = (p0 * 3 + p1 * 5) >> 3;
+                } else {
+                    palette[2][c] = palette[3][c] = (p0 + p1) >> 1;
+                }
+            }
+            palette[0][3] = palette[1][3] = palette[2][3] = 255;
+            palette[3][3] = c0 > c1 ? 255 : 0;
+
+            for (int ry = 0; ry < 4 && y + ry < height; ry++) {
+                for (int rx = 0; rx < 4 && x + rx < width; rx++) {
+                    int code = (block[4 + ry] >> (6 - rx * 2)) & 3;
+                    uint8_t *p = rgba + ((y + ry) * width + x + rx) * 4;
+                    for (int c = 0; c < 4; c++) p[c] = palette[code][c];
+                }
+            }
+        }
+    }
+}
+
+static double psnr(const uint8_t *original, const uint8_t *decoded,
+                   int num_pixels, bool has_alpha)
+{
+    double sum = 0;
+    for (int i = 0; i < num_pixels; i++) {
+        const uint8_t *a = original + i * 4, *b = decoded + i * 4;
+        int alpha_a = has_alpha ? a[3] : 255;
+        for (int c = 0; c < 3; c++) {
+            double d = a[c] * alpha_a / 255.0 - b[c] * b[3] / 255.0;
+            sum += d * d;
+        }
+    }
+    double mse = sum / (num_pixels * 3.0);
+    return mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+static void encode(Encoder encoder, const CorpusTexture *texture,
+                   const uint8_t *rgba, const uint8_t *rgb, uint8_t *cmpr)
+{
+    int width = texture->width, height = texture->height;
+    if (encoder == ENCODER_OLD) {
+        _ogx_convert_rgb_image_to_DXT1(rgb, cmpr, width, height, 0);
+        return;
+    }
+
+    /* Give the encoder the same input as the old one, unless there's alpha */
+    int padded_width = (width + 7) & ~7, padded_height = (height + 7) & ~7;
+    _ogx_bytes_to_cmpr(texture->has_alpha ? rgba : rgb,
+                       texture->has_alpha ? GL_RGBA : GL_RGB,
+                       GL_UNSIGNED_BYTE, width, height, cmpr, 0, 0,
+                       _ogx_pitch_for_width(GX_TF_CMPR, width),
+                       padded_width, padded_height, texture->has_alpha,
+                       encoder == ENCODER_HIGH_QUALITY);
+}
+
+static void run_encoder(CmprResult *result, const uint8_t *rgba,
+                        const uint8_t *rgb, uint8_t *cmpr, uint8_t *decoded,
+                        int repeats)
+{
+    const CorpusTexture *texture = result->texture;
+    int width = texture->width, height = texture->height;
+
+    /* The old encoder only handles whole 8x8 tiles */
+    result->supported = result->encoder != ENCODER_OLD ||
+        (width % 8 == 0 && height % 8 == 0);
+    if (!result->supported) return;
+
+    result->best_ns = 0;
+    for (int r = 0; r < repeats; r++) {
+        uint64_t start = now_ns();
+        encode(result->encoder, texture, rgba, rgb, cmpr);
+        double elapsed = now_ns() - start;
+        if (r == 0 || elapsed < result->best_ns) result->best_ns = elapsed;
+    }
+
+    if (result->encoder == ENCODER_OLD) {
+        /* It stores the colours in the host byte order */
+        int size = GX_GetTexBufferSize(width, height, GX_TF_CMPR, GX_FALSE, 0);
+        for (int i = 0; i < size; i += 8) {
+            uint16_t c0, c1;
+            memcpy(&c0, cmpr + i, 2);
+            memcpy(&c1, cmpr + i + 2, 2);
+            cmpr[i] = c0 >> 8; cmpr[i + 1] = c0;
+            cmpr[i + 2] = c1 >> 8; cmpr[i + 3] = c1;
+        }
+    }
+    decode_cmpr(cmpr, width, height, decoded);
+    result->psnr = psnr(rgba, decoded, width * height, texture->has_alpha);
+}
+
+static double mpixels_per_second(const CmprResult *r)
+{
+    return r->texture->width * r->texture->height * 1000.0 / r->best_ns;
+}
+
+static void print_result(const CmprResult *r)
+{
+    if (!r->supported) {
+        printf("%-14s %-13s %10s %10s\n", r->texture->name,
+               s_encoder_names[r->encoder], "n/a", "n/a");
+        return;
+    }
+    printf("%-14s %-13s %10.2f %10.2f\n", r->texture->name,
+           s_encoder_names[r->encoder], mpixels_per_second(r), r->psnr);
+}
+
+static void write_json(FILE *out, const CmprResult *results, int count)
+{
+    fprintf(out, "{\n  \"benchmark\": \"opengx-cmpr\",\n");
+    fprintf(out, "  \"results\": [\n");
+    for (int i = 0; i < count; i++) {
+        const CmprResult *r = &results[i];
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"texture\": \"%s\",\n", r->texture->name);
+        fprintf(out, "      \"description\": \"%s\",\n",
+                r->texture->description);
+        fprintf(out, "      \"width\": %d,\n", r->texture->width);
+        fprintf(out, "      \"height\": %d,\n", r->texture->height);
+        fprintf(out, "      \"encoder\": \"%s\",\n",
+                s_encoder_names[r->encoder]);
+        if (r->supported) {
+            fprintf(out, "      \"mpixels_per_s\": %.3f,\n",
+                    mpixels_per_second(r));
+            fprintf(out, "      \"psnr_db\": %.3f\n", r->psnr);
+        } else {
+            fprintf(out, "      \"supported\": false\n");
+        }
+        fprintf(out, "    }%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static bool texture_selected(const char *name, char **names, int num_names)
+{
+    if (num_names == 0) return true;
+    for (int i = 0; i < num_names; i++) {
+        if (strcmp(name, names[i]) == 0) return true;
+    }
+    return false;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-o results.json] [-r repeats] "
+            "[texture...]\n\nTextures:\n", argv0);
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        fprintf(stderr, "  %-14s %s\n", s_corpus[i].name,
+                s_corpus[i].description);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = "cmpr_results.json";
+    int repeats = DEFAULT_REPEATS;
+    char **names = calloc(argc, sizeof(char *));
+    int num_names = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            repeats = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return argv[i][1] == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        } else {
+            names[num_names++] = argv[i];
+        }
+    }
+    if (repeats < 1) repeats = 1;
+
+    /* The encoders read the pixel unpacking state */
+    GX_Init(NULL, 0);
+    ogx_initialize();
+
+    CmprResult *results = calloc(CORPUS_SIZE * ENCODER_COUNT,
+                                 sizeof(CmprResult));
+    printf("%-14s %-13s %10s %10s\n", "texture", "encoder", "MPix/s",
+           "PSNR (dB)");
+    int count = 0;
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        const CorpusTexture *texture = &s_corpus[i];
+        if (!texture_selected(texture->name, names, num_names)) continue;
+
+        int num_pixels = texture->width * texture->height;
+        uint8_t *rgba = malloc(num_pixels * 4);
+        uint8_t *rgb = malloc(num_pixels * 3);
+        uint8_t *decoded = malloc(num_pixels * 4);
+        uint8_t *cmpr = malloc(GX_GetTexBufferSize(texture->width,
+                                                   texture->height,
+                                                   GX_TF_CMPR, GX_FALSE, 0));
+        texture->generate(rgba, texture->width, texture->height);
+        for (int p = 0; p < num_pixels; p++) {
+            memcpy(rgb + p * 3, rgba + p * 4, 3);
+        }
+
+        for (int e = 0; e < ENCODER_COUNT; e++) {
+            CmprResult *r = &results[count++];
+            r->texture = texture;
+            r->encoder = e;
+            run_encoder(r, rgba, rgb, cmpr, decoded, repeats);
+            print_result(r);
+        }
+        free(rgba);
+        free(rgb);
+        free(decoded);
+        free(cmpr);
+    }
+
+    FILE *out = fopen(output, "w");
+    if (!out) {
+        perror(output);
+        return EXIT_FAILURE;
+    }
+    write_json(out, results, count);
+    fclose(out);
+
+    free(results);
+    free(names);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1052 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+/* The benchmark scenarios. Each of them stresses a different path through
+ * opengx; the geometry is generated procedurally, so that runs are
+ * deterministic and don't depend on external files. */
+
+#include "bench.h"
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <gx_host.h>
+#include <math.h>
+#include <opengx.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static BenchWork *s_work;
+static int s_frame_number;
+
+/* Wrappers for the immediate mode calls, so that we can count the work */
+static void begin(GLenum mode)
+{
+    glBegin(mode);
+    s_work->draws++;
+}
+
+static void vertex3f(GLfloat x, GLfloat y, GLfloat z)
+{
+    glVertex3f(x, y, z);
+    s_work->vertices++;
+}
+
+static void set_perspective(void)
+{
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glFrustum(-1.0, 1.0, -0.75, 0.75, 5.0, 60.0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glTranslatef(0.0f, 0.0f, -40.0f);
+}
+
+static void set_ortho(void)
+{
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0.0, 640.0, 480.0, 0.0, -1.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+}
+
+/*
+ * Gears: the geometry of the classic glxgears demo, drawn in immediate mode
+ * with lighting enabled.
+ */
+
+static void gear(GLfloat inner_radius, GLfloat outer_radius, GLfloat width,
+                 GLint teeth, GLfloat tooth_depth)
+{
+    GLfloat r0 = inner_radius;
+    GLfloat r1 = outer_radius - tooth_depth / 2.0f;
+    GLfloat r2 = outer_radius + tooth_depth / 2.0f;
+    GLfloat da = 2.0f * M_PI / teeth / 4.0f;
+    GLfloat angle, u, v, len;
+
+    glShadeModel(GL_FLAT);
+    glNormal3f(0.0f, 0.0f, 1.0f);
+
+    /* front face */
+    begin(GL_QUAD_STRIP);
+    for (int i = 0; i <= teeth; i++) {
+        angle = i * 2.0f * M_PI / teeth;
+        vertex3f(r0 * cosf(angle), r0 * sinf(angle), width * 0.5f);
+        vertex3f(r1 * cosf(angle), r1 * sinf(angle), width * 0.5f);
+        if (i < teeth) {
+            vertex3f(r0 * cosf(angle), r0 * sinf(angle), width * 0.5f);
+            vertex3f(r1 * cosf(angle + 3 * da), r1 * sinf(angle + 3 * da),
+                     width * 0.5f);
+        }
+    }
+    glEnd();
+
+    /* front sides of teeth */
+    begin(GL_QUADS);
+    for (int i = 0; i < teeth; i++) {
+        angle = i * 2.0f * M_PI / teeth;
+        vertex3f(r1 * cosf(angle), r1 * sinf(angle), width * 0.5f);
+        vertex3f(r2 * cosf(angle + da), r2 * sinf(angle + da), width * 0.5f);
+        vertex3f(r2 * cosf(angle + 2 * da), r2 * sinf(angle + 2 * da),
+                 width * 0.5f);
+        vertex3f(r1 * cosf(angle + 3 * da), r1 * sinf(angle + 3 * da),
+                 width * 0.5f);
+    }
+    glEnd();
+
+    glNormal3f(0.0f, 0.0f, -1.0f);
+
+    /* back face */
+    begin(GL_QUAD_STRIP);
+    for (int i = 0; i <= teeth; i++) {
+        angle = i * 2.0f * M_PI / teeth;
+        vertex3f(r1 * cosf(angle), r1 * sinf(angle), -width * 0.5f);
+        vertex3f(r0 * cosf(angle), r0 * sinf(angle), -width * 0.5f);
+        if (i < teeth) {
+            vertex3f(r1 * cosf(angle + 3 * da), r1 * sinf(angle + 3 * da),
+                     -width * 0.5f);
+            vertex3f(r0 * cosf(angle), r0 * sinf(angle), -width * 0.5f);
+        }
+    }
+    glEnd();
+
+    /* back sides of teeth */
+    begin(GL_QUADS);
+    for (int i = 0; i < teeth; i++) {
+        angle = i * 2.0f * M_PI / teeth;
+        vertex3f(r1 * cosf(angle + 3 * da), r1 * sinf(angle + 3 * da),
+                 -width * 0.5f);
+        vertex3f(r2 * cosf(angle + 2 * da), r2 * sinf(angle + 2 * da),
+                 -width * 0.5f);
+        vertex3f(r2 * cosf(angle + da), r2 * sinf(angle + da), -width * 0.5f);
+        vertex3f(r1 * cosf(angle), r1 * sinf(angle), -width * 0.5f);
+    }
+    glEnd();
+
+    /* outward faces of teeth */
+    begin(GL_QUAD_STRIP);
+    for (int i = 0; i < teeth; i++) {
+        angle = i * 2.0f * M_PI / teeth;
+
+        vertex3f(r1 * cosf(angle), r1 * sinf(angle), width * 0.5f);
+        vertex3f(r1 * cosf(angle), r1 * sinf(angle), -width * 0.5f);
+        u = r2 * cosf(angle + da) - r1 * cosf(angle);
+        v = r2 * sinf(angle + da) - r1 * sinf(angle);
+        len = sqrtf(u * u + v * v);
+        u /= len;
+        v /= len;
+        glNormal3f(v, -u, 0.0f);
+        vertex3f(r2 * cosf(angle + da), r2 * sinf(angle + da), width * 0.5f);
+        vertex3f(r2 * cosf(angle + da), r2 * sinf(angle + da), -width * 0.5f);
+        glNormal3f(cosf(angle), sinf(angle), 0.0f);
+        vertex3f(r2 * cosf(angle + 2 * da), r2 * sinf(angle + 2 * da),
+                 width * 0.5f);
+        vertex3f(r2 * cosf(angle + 2 * da), r2 * sinf(angle + 2 * da),
+                 -width * 0.5f);
+        u = r1 * cosf(angle + 3 * da) - r2 * cosf(angle + 2 * da);
+        v = r1 * sinf(angle + 3 * da) - r2 * sinf(angle + 2 * da);
+        glNormal3f(v, -u, 0.0f);
+        vertex3f(r1 * cosf(angle + 3 * da), r1 * sinf(angle + 3 * da),
+                 width * 0.5f);
+        vertex3f(r1 * cosf(angle + 3 * da), r1 * sinf(angle + 3 * da),
+                 -width * 0.5f);
+        glNormal3f(cosf(angle), sinf(angle), 0.0f);
+    }
+    vertex3f(r1 * cosf(0), r1 * sinf(0), width * 0.5f);
+    vertex3f(r1 * cosf(0), r1 * sinf(0), -width * 0.5f);
+    glEnd();
+
+    glShadeModel(GL_SMOOTH);
+
+    /* inside radius cylinder */
+    begin(GL_QUAD_STRIP);
+    for (int i = 0; i <= teeth; i++) {
+        angle = i * 2.0f * M_PI / teeth;
+        glNormal3f(-cosf(angle), -sinf(angle), 0.0f);
+        vertex3f(r0 * cosf(angle), r0 * sinf(angle), -width * 0.5f);
+        vertex3f(r0 * cosf(angle), r0 * sinf(angle), width * 0.5f);
+    }
+    glEnd();
+}
+
+static const GLfloat s_gear_colors[3][4] = {
+    { 0.8f, 0.1f, 0.0f, 1.0f },
+    { 0.0f, 0.8f, 0.2f, 1.0f },
+    { 0.2f, 0.2f, 1.0f, 1.0f },
+};
+
+static void draw_gear(int index)
+{
+    glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, s_gear_colors[index]);
+    switch (index) {
+    case 0:
+        gear(1.0f, 4.0f, 1.0f, 20, 0.7f);
+        break;
+    case 1:
+        gear(0.5f, 2.0f, 2.0f, 10, 0.7f);
+        break;
+    case 2:
+        gear(1.3f, 2.0f, 0.5f, 10, 0.7f);
+        break;
+    }
+}
+
+static void gears_setup(void)
+{
+    static const GLfloat pos[4] = { 5.0f, 5.0f, 10.0f, 0.0f };
+
+    set_perspective();
+    glLightfv(GL_LIGHT0, GL_POSITION, pos);
+    glEnable(GL_CULL_FACE);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_NORMALIZE);
+}
+
+static void gears_teardown(void)
+{
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_LIGHT0);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_NORMALIZE);
+}
+
+static void gears_position(int index)
+{
+    static const GLfloat offsets[3][2] = {
+        { -3.0f, -2.0f }, { 3.1f, -2.0f }, { -3.1f, 4.2f },
+    };
+    GLfloat angle = s_frame_number * 2.0f;
+    if (index == 1) angle = -2.0f * angle - 9.0f;
+    else if (index == 2) angle = -2.0f * angle - 25.0f;
+
+    glTranslatef(offsets[index][0], offsets[index][1], 0.0f);
+    glRotatef(angle, 0.0f, 0.0f, 1.0f);
+}
+
+static void gears_begin_frame(void)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glPushMatrix();
+    glRotatef(20.0f, 1.0f, 0.0f, 0.0f);
+    glRotatef(30.0f + s_frame_number, 0.0f, 1.0f, 0.0f);
+}
+
+static void gears_frame(BenchWork *work)
+{
+    s_work = work;
+    gears_begin_frame();
+    for (int i = 0; i < 3; i++) {
+        glPushMatrix();
+        gears_position(i);
+        draw_gear(i);
+        glPopMatrix();
+    }
+    glPopMatrix();
+}
+
+static const BenchScenario s_gears = {
+    "gears",
+    "glxgears geometry, immediate mode, lighting enabled",
+    gears_setup,
+    gears_frame,
+    gears_teardown,
+};
+
+/*
+ * Display list replay: same as above, but the gears are compiled into display
+ * lists once, and each frame just calls them.
+ */
+
+static GLuint s_gear_lists;
+static BenchWork s_gear_list_work[3];
+
+static void gears_lists_setup(void)
+{
+    BenchWork *saved_work = s_work;
+
+    gears_setup();
+    s_gear_lists = glGenLists(3);
+    for (int i = 0; i < 3; i++) {
+        /* Keep track of the work stored in each list, so that we can account
+         * for it when the list is called */
+        memset(&s_gear_list_work[i], 0, sizeof(BenchWork));
+        s_work = &s_gear_list_work[i];
+        glNewList(s_gear_lists + i, GL_COMPILE);
+        draw_gear(i);
+        glEndList();
+    }
+    s_work = saved_work;
+}
+
+static void gears_lists_frame(BenchWork *work)
+{
+    gears_begin_frame();
+    for (int i = 0; i < 3; i++) {
+        glPushMatrix();
+        gears_position(i);
+        glCallList(s_gear_lists + i);
+        work->draws += s_gear_list_work[i].draws;
+        work->vertices += s_gear_list_work[i].vertices;
+        glPopMatrix();
+    }
+    glPopMatrix();
+}
+
+static void gears_lists_teardown(void)
+{
+    glDeleteLists(s_gear_lists, 3);
+    gears_teardown();
+}
+
+static const BenchScenario s_gears_lists = {
+    "gears_display_lists",
+    "glxgears geometry compiled into display lists, replayed every frame",
+    gears_lists_setup,
+    gears_lists_frame,
+    gears_lists_teardown,
+};
+
+/*
+ * Indexed mesh: a 50000 triangles grid, with positions and normals as floats,
+ * colors as unsigned bytes and texture coordinates as floats, drawn with a
+ * few glDrawElements() calls: a GX primitive cannot have more than 0xffff
+ * vertices, so the grid is drawn in bands of rows.
+ */
+
+#define MESH_COLUMNS 200
+#define MESH_ROWS 125
+#define MESH_NUM_VERTICES ((MESH_COLUMNS + 1) * (MESH_ROWS + 1))
+#define MESH_NUM_INDICES (MESH_COLUMNS * MESH_ROWS * 6)
+#define MESH_ROW_INDICES (MESH_COLUMNS * 6)
+#define MESH_ROWS_PER_DRAW (0xffff / MESH_ROW_INDICES)
+
+typedef struct {
+    GLfloat pos[3];
+    GLfloat normal[3];
+    GLubyte color[4];
+    GLfloat texcoord[2];
+} MeshVertex;
+
+static MeshVertex *s_mesh_vertices;
+static GLushort *s_mesh_indices;
+static GLuint s_texture;
+
+static void create_texture(void)
+{
+    GLubyte texels[64 * 64 * 4];
+
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            GLubyte *t = &texels[(y * 64 + x) * 4];
+            bool on = ((x >> 3) ^ (y >> 3)) & 1;
+            t[0] = on ? 255 : x * 4;
+            t[1] = on ? 255 : y * 4;
+            t[2] = 128;
+            t[3] = 255;
+        }
+    }
+    glGenTextures(1, &s_texture);
+    glBindTexture(GL_TEXTURE_2D, s_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 64, 64, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, texels);
+}
+
+static void mesh_create(void)
+{
+    s_mesh_vertices = malloc(MESH_NUM_VERTICES * sizeof(MeshVertex));
+    s_mesh_indices = malloc(MESH_NUM_INDICES * sizeof(GLushort));
+
+    MeshVertex *v = s_mesh_vertices;
+    for (int row = 0; row <= MESH_ROWS; row++) {
+        for (int col = 0; col <= MESH_COLUMNS; col++) {
+            GLfloat x = col * 20.0f / MESH_COLUMNS - 10.0f;
+            GLfloat y = row * 15.0f / MESH_ROWS - 7.5f;
+            GLfloat z = sinf(x * 0.7f) * cosf(y * 0.9f);
+            v->pos[0] = x;
+            v->pos[1] = y;
+            v->pos[2] = z;
+            v->normal[0] = -0.7f * cosf(x * 0.7f) * cosf(y * 0.9f);
+            v->normal[1] = 0.9f * sinf(x * 0.7f) * sinf(y * 0.9f);
+            v->normal[2] = 1.0f;
+            v->color[0] = col * 255 / MESH_COLUMNS;
+            v->color[1] = row * 255 / MESH_ROWS;
+            v->color[2] = 128;
+            v->color[3] = 255;
+            v->texcoord[0] = col / 8.0f;
+            v->texcoord[1] = row / 8.0f;
+            v++;
+        }
+    }
+
+    GLushort *i = s_mesh_indices;
+    for (int row = 0; row < MESH_ROWS; row++) {
+        for (int col = 0; col < MESH_COLUMNS; col++) {
+            GLushort base = row * (MESH_COLUMNS + 1) + col;
+            *i++ = base;
+            *i++ = base + 1;
+            *i++ = base + MESH_COLUMNS + 1;
+            *i++ = base + 1;
+            *i++ = base + MESH_COLUMNS + 2;
+            *i++ = base + MESH_COLUMNS + 1;
+        }
+    }
+}
+
+static void mesh_enable_arrays(void)
+{
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), s_mesh_vertices->pos);
+    glNormalPointer(GL_FLOAT, sizeof(MeshVertex), s_mesh_vertices->normal);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(MeshVertex),
+                   s_mesh_vertices->color);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(MeshVertex),
+                      s_mesh_vertices->texcoord);
+}
+
+static void mesh_disable_arrays(void)
+{
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
+static void mesh_destroy(void)
+{
+    free(s_mesh_vertices);
+    free(s_mesh_indices);
+    s_mesh_vertices = NULL;
+    s_mesh_indices = NULL;
+}
+
+static void mesh_setup(void)
+{
+    static const GLfloat pos[4] = { 0.0f, 0.0f, 10.0f, 0.0f };
+
+    mesh_create();
+    create_texture();
+    set_perspective();
+    mesh_enable_arrays();
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_DEPTH_TEST);
+    glLightfv(GL_LIGHT0, GL_POSITION, pos);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+    glEnable(GL_COLOR_MATERIAL);
+}
+
+static void mesh_draw(BenchWork *work)
+{
+    for (int row = 0; row < MESH_ROWS; row += MESH_ROWS_PER_DRAW) {
+        int rows = MESH_ROWS - row < MESH_ROWS_PER_DRAW ?
+            MESH_ROWS - row : MESH_ROWS_PER_DRAW;
+        glDrawElements(GL_TRIANGLES, rows * MESH_ROW_INDICES,
+                       GL_UNSIGNED_SHORT,
+                       s_mesh_indices + row * MESH_ROW_INDICES);
+        work->draws++;
+        work->vertices += rows * MESH_ROW_INDICES;
+    }
+}
+
+static void mesh_frame(BenchWork *work)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glPushMatrix();
+    glRotatef(s_frame_number, 0.0f, 0.0f, 1.0f);
+    mesh_draw(work);
+    glPopMatrix();
+}
+
+static void mesh_teardown(void)
+{
+    mesh_disable_arrays();
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_LIGHT0);
+    glDisable(GL_COLOR_MATERIAL);
+    glDeleteTextures(1, &s_texture);
+    mesh_destroy();
+}
+
+static const BenchScenario s_indexed_mesh = {
+    "indexed_mesh",
+    "50k triangles, float pos/normal/texcoord + ubyte color, glDrawElements",
+    mesh_setup,
+    mesh_frame,
+    mesh_teardown,
+};
+
+/*
+ * The same mesh, with the vertex data stored in a GL_STATIC_DRAW buffer.
+ * Run with OPENGX_FAST_OPS=quantized_vbos to have it converted to fixed
+ * point.
+ */
+
+static GLuint s_mesh_vbo;
+
+static void vbo_mesh_setup(void)
+{
+    mesh_setup();
+    glGenBuffers(1, &s_mesh_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, s_mesh_vbo);
+    glBufferData(GL_ARRAY_BUFFER, MESH_NUM_VERTICES * sizeof(MeshVertex),
+                 s_mesh_vertices, GL_STATIC_DRAW);
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex),
+                    (void *)offsetof(MeshVertex, pos));
+    glNormalPointer(GL_FLOAT, sizeof(MeshVertex),
+                    (void *)offsetof(MeshVertex, normal));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(MeshVertex),
+                   (void *)offsetof(MeshVertex, color));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(MeshVertex),
+                      (void *)offsetof(MeshVertex, texcoord));
+}
+
+static void vbo_mesh_teardown(void)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDeleteBuffers(1, &s_mesh_vbo);
+    mesh_teardown();
+}
+
+static const BenchScenario s_vbo_mesh = {
+    "vbo_mesh",
+    "the indexed_mesh grid, with the vertex data in a GL_STATIC_DRAW VBO",
+    vbo_mesh_setup,
+    mesh_frame,
+    vbo_mesh_teardown,
+};
+
+/*
+ * Palette skinning: the vbo_mesh grid, split in horizontal bands which are
+ * each bound to one matrix of the GL_ARB_matrix_palette palette. Only the
+ * palette matrices change from frame to frame.
+ */
+
+#define PALETTE_BONES 8
+
+static GLuint s_palette_vbo;
+static GLubyte *s_palette_indices;
+
+static void palette_skinning_setup(void)
+{
+    vbo_mesh_setup();
+    s_palette_indices = malloc(MESH_NUM_VERTICES);
+    for (int i = 0; i < MESH_NUM_VERTICES; i++) {
+        int row = i / (MESH_COLUMNS + 1);
+        s_palette_indices[i] = row * PALETTE_BONES / (MESH_ROWS + 1);
+    }
+    glGenBuffers(1, &s_palette_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, s_palette_vbo);
+    glBufferData(GL_ARRAY_BUFFER, MESH_NUM_VERTICES, s_palette_indices,
+                 GL_STATIC_DRAW);
+    glMatrixIndexPointerARB(1, GL_UNSIGNED_BYTE, 0, NULL);
+    glBindBuffer(GL_ARRAY_BUFFER, s_mesh_vbo);
+    glEnableClientState(GL_MATRIX_INDEX_ARRAY_ARB);
+    glEnable(GL_MATRIX_PALETTE_ARB);
+}
+
+static void palette_skinning_frame(BenchWork *work)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glMatrixMode(GL_MATRIX_PALETTE_ARB);
+    for (int i = 0; i < PALETTE_BONES; i++) {
+        glCurrentPaletteMatrixARB(i);
+        glLoadIdentity();
+        glTranslatef(0.0f, 0.0f, -40.0f);
+        glRotatef((s_frame_number + i * 5) % 360, 0.0f, 1.0f, 0.0f);
+    }
+    glMatrixMode(GL_MODELVIEW);
+    mesh_draw(work);
+}
+
+static void palette_skinning_teardown(void)
+{
+    glDisable(GL_MATRIX_PALETTE_ARB);
+    glDisableClientState(GL_MATRIX_INDEX_ARRAY_ARB);
+    glDeleteBuffers(1, &s_palette_vbo);
+    free(s_palette_indices);
+    s_palette_indices = NULL;
+    vbo_mesh_teardown();
+}
+
+static const BenchScenario s_palette_skinning = {
+    "palette_skinning",
+    "the vbo_mesh grid, skinned with GL_ARB_matrix_palette (8 matrices)",
+    palette_skinning_setup,
+    palette_skinning_frame,
+    palette_skinning_teardown,
+};
+
+/*
+ * Instancing: a strip of the mesh grid drawn many times with a single
+ * glDrawElementsInstanced() call.
+ */
+
+#define INSTANCED_NUM_INSTANCES 200
+#define INSTANCED_INDICES (MESH_COLUMNS * 6)
+
+static void instanced_setup(void)
+{
+    mesh_setup();
+}
+
+static void instanced_frame(BenchWork *work)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glDrawElementsInstanced(GL_TRIANGLES, INSTANCED_INDICES,
+                            GL_UNSIGNED_SHORT, s_mesh_indices,
+                            INSTANCED_NUM_INSTANCES);
+    work->draws++;
+    work->vertices += INSTANCED_INDICES * INSTANCED_NUM_INSTANCES;
+}
+
+static const BenchScenario s_instanced = {
+    "instanced",
+    "200 instances of a 400 triangles strip, glDrawElementsInstanced",
+    instanced_setup,
+    instanced_frame,
+    mesh_teardown,
+};
+
+/*
+ * Multi draw: the mesh grid drawn one row at a time (as a terrain renderer
+ * would draw its patches), with a single glMultiDrawElements() call.
+ */
+
+#define MULTI_DRAW_INDICES (MESH_COLUMNS * 6)
+
+static GLsizei s_multi_draw_counts[MESH_ROWS];
+static const void *s_multi_draw_indices[MESH_ROWS];
+
+static void multi_draw_setup(void)
+{
+    mesh_setup();
+    for (int i = 0; i < MESH_ROWS; i++) {
+        s_multi_draw_counts[i] = MULTI_DRAW_INDICES;
+        s_multi_draw_indices[i] = s_mesh_indices + i * MULTI_DRAW_INDICES;
+    }
+}
+
+static void multi_draw_frame(BenchWork *work)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glMultiDrawElements(GL_TRIANGLES, s_multi_draw_counts, GL_UNSIGNED_SHORT,
+                        s_multi_draw_indices, MESH_ROWS);
+    work->draws++;
+    work->vertices += MESH_NUM_INDICES;
+}
+
+static const BenchScenario s_multi_draw = {
+    "multi_draw",
+    "the indexed_mesh grid in 125 row draws, one glMultiDrawElements call",
+    multi_draw_setup,
+    multi_draw_frame,
+    mesh_teardown,
+};
+
+/*
+ * Legacy mesh: the indexed_mesh grid, with positions and normals stored as
+ * doubles and colors as floats in separate client arrays, so that every
+ * attribute needs to be converted before reaching GX.
+ */
+
+static GLdouble *s_legacy_coords;
+static GLfloat *s_legacy_colors;
+
+static void legacy_mesh_setup(void)
+{
+    mesh_setup();
+    s_legacy_coords = malloc(MESH_NUM_VERTICES * 6 * sizeof(GLdouble));
+    s_legacy_colors = malloc(MESH_NUM_VERTICES * 4 * sizeof(GLfloat));
+    for (int i = 0; i < MESH_NUM_VERTICES; i++) {
+        const MeshVertex *v = &s_mesh_vertices[i];
+        for (int c = 0; c < 3; c++) {
+            s_legacy_coords[i * 6 + c] = v->pos[c];
+            s_legacy_coords[i * 6 + 3 + c] = v->normal[c];
+        }
+        for (int c = 0; c < 4; c++) {
+            s_legacy_colors[i * 4 + c] = v->color[c] / 255.0f;
+        }
+    }
+    glVertexPointer(3, GL_DOUBLE, 6 * sizeof(GLdouble), s_legacy_coords);
+    glNormalPointer(GL_DOUBLE, 6 * sizeof(GLdouble), s_legacy_coords + 3);
+    glColorPointer(4, GL_FLOAT, 0, s_legacy_colors);
+}
+
+static void legacy_mesh_teardown(void)
+{
+    mesh_teardown();
+    free(s_legacy_coords);
+    free(s_legacy_colors);
+}
+
+static const BenchScenario s_legacy_mesh = {
+    "legacy_mesh",
+    "the indexed_mesh grid, with double coordinates and float colors",
+    legacy_mesh_setup,
+    mesh_frame,
+    legacy_mesh_teardown,
+};
+
+/*
+ * Immediate mode sprites: many textured quads, each in its own
+ * glBegin()/glEnd() pair, as 2D games often do.
+ */
+
+#define NUM_SPRITES 2000
+
+static void sprites_setup(void)
+{
+    create_texture();
+    set_ortho();
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+static void sprites_frame(BenchWork *work)
+{
+    s_work = work;
+    glClear(GL_COLOR_BUFFER_BIT);
+    for (int i = 0; i < NUM_SPRITES; i++) {
+        GLfloat x = (i * 37 + s_frame_number) % 608;
+        GLfloat y = (i * 23) % 448;
+        glColor4ub(255, i & 0xff, (i >> 3) & 0xff, 255);
+        begin(GL_QUADS);
+        glTexCoord2f(0.0f, 0.0f);
+        vertex3f(x, y, 0.0f);
+        glTexCoord2f(1.0f, 0.0f);
+        vertex3f(x + 32.0f, y, 0.0f);
+        glTexCoord2f(1.0f, 1.0f);
+        vertex3f(x + 32.0f, y + 32.0f, 0.0f);
+        glTexCoord2f(0.0f, 1.0f);
+        vertex3f(x, y + 32.0f, 0.0f);
+        glEnd();
+    }
+}
+
+static void sprites_teardown(void)
+{
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_BLEND);
+    glDeleteTextures(1, &s_texture);
+    glColor4ub(255, 255, 255, 255);
+}
+
+static const BenchScenario s_sprites = {
+    "immediate_sprites",
+    "2000 textured quads, one glBegin()/glEnd() pair each",
+    sprites_setup,
+    sprites_frame,
+    sprites_teardown,
+};
+
+/*
+ * Stencil: a quad is drawn into the stencil buffer, then a section of the
+ * mesh is drawn (in several chunks) with the stencil test enabled.
+ */
+
+#define STENCIL_NUM_DRAWS 20
+#define STENCIL_INDICES_PER_DRAW (MESH_COLUMNS * 6)
+
+static void stencil_setup(void)
+{
+    mesh_create();
+    set_perspective();
+    ogx_stencil_create(OGX_STENCIL_NONE);
+    glEnable(GL_STENCIL_TEST);
+}
+
+static void stencil_frame(BenchWork *work)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    glStencilFunc(GL_ALWAYS, 1, 0xff);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    glBegin(GL_QUADS);
+    glVertex3f(-5.0f, -5.0f, 0.0f);
+    glVertex3f(5.0f, -5.0f, 0.0f);
+    glVertex3f(5.0f, 5.0f, 0.0f);
+    glVertex3f(-5.0f, 5.0f, 0.0f);
+    glEnd();
+    work->draws++;
+    work->vertices += 4;
+
+    glStencilFunc(GL_EQUAL, 1, 0xff);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    mesh_enable_arrays();
+    for (int i = 0; i < STENCIL_NUM_DRAWS; i++) {
+        glDrawElements(GL_TRIANGLES, STENCIL_INDICES_PER_DRAW,
+                       GL_UNSIGNED_SHORT,
+                       s_mesh_indices + i * STENCIL_INDICES_PER_DRAW);
+        work->draws++;
+        work->vertices += STENCIL_INDICES_PER_DRAW;
+    }
+    mesh_disable_arrays();
+}
+
+static void stencil_teardown(void)
+{
+    glDisable(GL_STENCIL_TEST);
+    mesh_destroy();
+}
+
+static const BenchScenario s_stencil = {
+    "stencil",
+    "stencil-tested glDrawElements() calls, 8000 triangles in 20 draws",
+    stencil_setup,
+    stencil_frame,
+    stencil_teardown,
+};
+
+/*
+ * CAD-style display lists: a part made of boxes, each placed with its own
+ * transformations and drawn one face at a time, with the material set before
+ * every box. The list is called many times per frame.
+ */
+
+#define CAD_BOXES 16
+#define CAD_CALLS 200
+
+typedef struct {
+    GLfloat pos[3];
+    GLfloat normal[3];
+} CadVertex;
+
+static CadVertex s_box_vertices[24];
+static GLuint s_cad_list;
+static BenchWork s_cad_list_work;
+
+static void cad_create_box(void)
+{
+    static const GLfloat normals[6][3] = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 },
+        { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+    };
+
+    for (int face = 0; face < 6; face++) {
+        const GLfloat *n = normals[face];
+        /* Two axes orthogonal to the normal */
+        GLfloat u[3] = { n[1] != 0 || n[2] != 0 ? 1 : 0, n[0] != 0 ? 1 : 0, 0 };
+        GLfloat v[3] = {
+            n[1] * u[2] - n[2] * u[1],
+            n[2] * u[0] - n[0] * u[2],
+            n[0] * u[1] - n[1] * u[0],
+        };
+        static const GLfloat corners[4][2] = {
+            { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 },
+        };
+        for (int i = 0; i < 4; i++) {
+            CadVertex *vertex = &s_box_vertices[face * 4 + i];
+            for (int c = 0; c < 3; c++) {
+                vertex->pos[c] = 0.5f * (n[c] + corners[i][0] * u[c] +
+                                         corners[i][1] * v[c]);
+                vertex->normal[c] = n[c];
+            }
+        }
+    }
+}
+
+static void cad_setup(void)
+{
+    static const GLfloat grey[4] = { 0.6f, 0.6f, 0.6f, 1.0f };
+    static const GLfloat blue[4] = { 0.2f, 0.3f, 0.8f, 1.0f };
+
+    gears_setup();
+    cad_create_box();
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(CadVertex), s_box_vertices[0].pos);
+    glNormalPointer(GL_FLOAT, sizeof(CadVertex), s_box_vertices[0].normal);
+
+    memset(&s_cad_list_work, 0, sizeof(BenchWork));
+    s_cad_list = glGenLists(1);
+    glNewList(s_cad_list, GL_COMPILE);
+    for (int box = 0; box < CAD_BOXES; box++) {
+        glPushMatrix();
+        glTranslatef(box % 4 - 1.5f, box / 4 - 1.5f, 0.0f);
+        glRotatef(box * 10.0f, 0.0f, 0.0f, 1.0f);
+        glScalef(0.8f, 0.8f, 0.2f + (box % 3) * 0.3f);
+        glEnable(GL_LIGHTING);
+        glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, box % 4 ? grey : blue);
+        for (int face = 0; face < 6; face++) {
+            glDrawArrays(GL_QUADS, face * 4, 4);
+            s_cad_list_work.draws++;
+            s_cad_list_work.vertices += 4;
+        }
+        glPopMatrix();
+    }
+    glEndList();
+}
+
+static void cad_frame(BenchWork *work)
+{
+    gears_begin_frame();
+    for (int i = 0; i < CAD_CALLS; i++) {
+        glPushMatrix();
+        glTranslatef((i % 20 - 10) * 1.5f, (i / 20 - 5) * 1.5f, 0.0f);
+        glCallList(s_cad_list);
+        work->draws += s_cad_list_work.draws;
+        work->vertices += s_cad_list_work.vertices;
+        glPopMatrix();
+    }
+    glPopMatrix();
+}
+
+static void cad_teardown(void)
+{
+    glDeleteLists(s_cad_list, 1);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    gears_teardown();
+}
+
+static const BenchScenario s_cad_lists = {
+    "cad_display_lists",
+    "small display list of 16 boxes drawn face by face, called 200 times",
+    cad_setup,
+    cad_frame,
+    cad_teardown,
+};
+
+/*
+ * Streaming VBO: a particle system whose vertices are rewritten into the
+ * same GL_STREAM_DRAW buffer before each of its draws. The simulated GPU
+ * latency makes the CPU wait whenever it writes into data still in use.
+ */
+
+#define STREAM_BATCHES 32
+#define STREAM_PARTICLES 64
+#define STREAM_VERTICES (STREAM_PARTICLES * 4)
+/* In bytes: about two draws */
+#define STREAM_GPU_LATENCY 2048
+
+typedef struct {
+    GLfloat x, y, z;
+    GLubyte color[4];
+} StreamVertex;
+
+static GLuint s_stream_vbo;
+static StreamVertex s_stream_vertices[STREAM_VERTICES];
+
+static void stream_setup(void)
+{
+    set_ortho();
+    glGenBuffers(1, &s_stream_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, s_stream_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(s_stream_vertices), NULL,
+                 GL_STREAM_DRAW);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(StreamVertex),
+                    (void *)offsetof(StreamVertex, x));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(StreamVertex),
+                   (void *)offsetof(StreamVertex, color));
+    GX_HostSetGpuLatency(STREAM_GPU_LATENCY);
+}
+
+static void stream_frame(BenchWork *work)
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+    for (int b = 0; b < STREAM_BATCHES; b++) {
+        for (int i = 0; i < STREAM_PARTICLES; i++) {
+            int n = b * STREAM_PARTICLES + i;
+            GLfloat x = (n * 37 + s_frame_number * 3) % 630;
+            GLfloat y = (n * 23 + s_frame_number * 5) % 470;
+            StreamVertex *v = &s_stream_vertices[i * 4];
+            for (int k = 0; k < 4; k++) {
+                v[k].x = x + ((k == 1 || k == 2) ? 8.0f : 0.0f);
+                v[k].y = y + (k >= 2 ? 8.0f : 0.0f);
+                v[k].z = 0.0f;
+                v[k].color[0] = 255;
+                v[k].color[1] = n & 0xff;
+                v[k].color[2] = (n >> 2) & 0xff;
+                v[k].color[3] = 255;
+            }
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(s_stream_vertices),
+                        s_stream_vertices);
+        glDrawArrays(GL_QUADS, 0, STREAM_VERTICES);
+        work->draws++;
+        work->vertices += STREAM_VERTICES;
+    }
+}
+
+static void stream_teardown(void)
+{
+    GX_HostSetGpuLatency(0);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDeleteBuffers(1, &s_stream_vbo);
+}
+
+static const BenchScenario s_stream = {
+    "stream_vbo",
+    "particles rewritten into a GL_STREAM_DRAW buffer before each of 32 draws",
+    stream_setup,
+    stream_frame,
+    stream_teardown,
+};
+
+const BenchScenario *bench_scenarios[] = {
+    &s_gears,
+    &s_indexed_mesh,
+    &s_sprites,
+    &s_stencil,
+    &s_gears_lists,
+    &s_cad_lists,
+    &s_stream,
+    &s_vbo_mesh,
+    &s_legacy_mesh,
+    &s_palette_skinning,
+    &s_instanced,
+    &s_multi_draw,
+    NULL,
+};
+
+void bench_scenarios_set_frame(int frame_number)
+{
+    s_frame_number = frame_number;
+}
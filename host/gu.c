@@ -0,0 +1,379 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+/* Plain C implementation of the libogc matrix and vector helpers. Like in
+ * libogc, the output matrix can be the same as one of the inputs. */
+
+#include <math.h>
+#include <ogc/gu.h>
+#include <string.h>
+
+void guFrustum(Mtx44 mt, f32 t, f32 b, f32 l, f32 r, f32 n, f32 f)
+{
+    f32 tmp;
+
+    memset(mt, 0, sizeof(Mtx44));
+    tmp = 1.0f / (r - l);
+    mt[0][0] = (2 * n) * tmp;
+    mt[0][2] = (r + l) * tmp;
+    tmp = 1.0f / (t - b);
+    mt[1][1] = (2 * n) * tmp;
+    mt[1][2] = (t + b) * tmp;
+    tmp = 1.0f / (f - n);
+    mt[2][2] = -n * tmp;
+    mt[2][3] = -(f * n) * tmp;
+    mt[3][2] = -1.0f;
+}
+
+void guPerspective(Mtx44 mt, f32 fovy, f32 aspect, f32 n, f32 f)
+{
+    f32 cot, tmp;
+
+    memset(mt, 0, sizeof(Mtx44));
+    cot = 1.0f / tanf(DegToRad(fovy * 0.5f));
+    mt[0][0] = cot / aspect;
+    mt[1][1] = cot;
+    tmp = 1.0f / (f - n);
+    mt[2][2] = -n * tmp;
+    mt[2][3] = -(f * n) * tmp;
+    mt[3][2] = -1.0f;
+}
+
+void guOrtho(Mtx44 mt, f32 t, f32 b, f32 l, f32 r, f32 n, f32 f)
+{
+    f32 tmp;
+
+    memset(mt, 0, sizeof(Mtx44));
+    tmp = 1.0f / (r - l);
+    mt[0][0] = 2.0f * tmp;
+    mt[0][3] = -(r + l) * tmp;
+    tmp = 1.0f / (t - b);
+    mt[1][1] = 2.0f * tmp;
+    mt[1][3] = -(t + b) * tmp;
+    tmp = 1.0f / (f - n);
+    mt[2][2] = -1.0f * tmp;
+    mt[2][3] = -f * tmp;
+    mt[3][3] = 1.0f;
+}
+
+void guLookAt(Mtx mt, guVector *camPos, guVector *camUp, guVector *target)
+{
+    guVector vLook, vRight, vUp;
+
+    vLook.x = camPos->x - target->x;
+    vLook.y = camPos->y - target->y;
+    vLook.z = camPos->z - target->z;
+    guVecNormalize(&vLook);
+    guVecCross(camUp, &vLook, &vRight);
+    guVecNormalize(&vRight);
+    guVecCross(&vLook, &vRight, &vUp);
+
+    mt[0][0] = vRight.x;
+    mt[0][1] = vRight.y;
+    mt[0][2] = vRight.z;
+    mt[0][3] = -guVecDotProduct(camPos, &vRight);
+    mt[1][0] = vUp.x;
+    mt[1][1] = vUp.y;
+    mt[1][2] = vUp.z;
+    mt[1][3] = -guVecDotProduct(camPos, &vUp);
+    mt[2][0] = vLook.x;
+    mt[2][1] = vLook.y;
+    mt[2][2] = vLook.z;
+    mt[2][3] = -guVecDotProduct(camPos, &vLook);
+}
+
+void guVecAdd(const guVector *a, const guVector *b, guVector *ab)
+{
+    ab->x = a->x + b->x;
+    ab->y = a->y + b->y;
+    ab->z = a->z + b->z;
+}
+
+void guVecSub(const guVector *a, const guVector *b, guVector *ab)
+{
+    ab->x = a->x - b->x;
+    ab->y = a->y - b->y;
+    ab->z = a->z - b->z;
+}
+
+void guVecScale(const guVector *src, guVector *dst, f32 scale)
+{
+    dst->x = src->x * scale;
+    dst->y = src->y * scale;
+    dst->z = src->z * scale;
+}
+
+void guVecNormalize(guVector *v)
+{
+    f32 m = sqrtf(v->x * v->x + v->y * v->y + v->z * v->z);
+    if (m == 0.0f) return;
+    v->x /= m;
+    v->y /= m;
+    v->z /= m;
+}
+
+void guVecCross(const guVector *a, const guVector *b, guVector *axb)
+{
+    guVector r;
+    r.x = a->y * b->z - a->z * b->y;
+    r.y = a->z * b->x - a->x * b->z;
+    r.z = a->x * b->y - a->y * b->x;
+    *axb = r;
+}
+
+f32 guVecDotProduct(const guVector *a, const guVector *b)
+{
+    return a->x * b->x + a->y * b->y + a->z * b->z;
+}
+
+void guVecMultiply(const Mtx mt, const guVector *src, guVector *dst)
+{
+    guVector r;
+    r.x = mt[0][0] * src->x + mt[0][1] * src->y + mt[0][2] * src->z + mt[0][3];
+    r.y = mt[1][0] * src->x + mt[1][1] * src->y + mt[1][2] * src->z + mt[1][3];
+    r.z = mt[2][0] * src->x + mt[2][1] * src->y + mt[2][2] * src->z + mt[2][3];
+    *dst = r;
+}
+
+void guVecMultiplySR(const Mtx mt, const guVector *src, guVector *dst)
+{
+    guVector r;
+    r.x = mt[0][0] * src->x + mt[0][1] * src->y + mt[0][2] * src->z;
+    r.y = mt[1][0] * src->x + mt[1][1] * src->y + mt[1][2] * src->z;
+    r.z = mt[2][0] * src->x + mt[2][1] * src->y + mt[2][2] * src->z;
+    *dst = r;
+}
+
+void guMtxIdentity(Mtx mt)
+{
+    memset(mt, 0, sizeof(Mtx));
+    mt[0][0] = mt[1][1] = mt[2][2] = 1.0f;
+}
+
+void guMtxCopy(const Mtx src, Mtx dst)
+{
+    if (src != (const f32(*)[4])dst) memcpy(dst, src, sizeof(Mtx));
+}
+
+void guMtxConcat(const Mtx a, const Mtx b, Mtx ab)
+{
+    Mtx tmp;
+
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 4; c++) {
+            tmp[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] +
+                        a[r][2] * b[2][c];
+        }
+        tmp[r][3] += a[r][3];
+    }
+    memcpy(ab, tmp, sizeof(Mtx));
+}
+
+void guMtxScale(Mtx mt, f32 xS, f32 yS, f32 zS)
+{
+    memset(mt, 0, sizeof(Mtx));
+    mt[0][0] = xS;
+    mt[1][1] = yS;
+    mt[2][2] = zS;
+}
+
+void guMtxScaleApply(const Mtx src, Mtx dst, f32 xS, f32 yS, f32 zS)
+{
+    for (int c = 0; c < 4; c++) {
+        dst[0][c] = src[0][c] * xS;
+        dst[1][c] = src[1][c] * yS;
+        dst[2][c] = src[2][c] * zS;
+    }
+}
+
+void guMtxApplyScale(const Mtx src, Mtx dst, f32 xS, f32 yS, f32 zS)
+{
+    for (int r = 0; r < 3; r++) {
+        dst[r][0] = src[r][0] * xS;
+        dst[r][1] = src[r][1] * yS;
+        dst[r][2] = src[r][2] * zS;
+        dst[r][3] = src[r][3];
+    }
+}
+
+void guMtxTrans(Mtx mt, f32 xT, f32 yT, f32 zT)
+{
+    guMtxIdentity(mt);
+    mt[0][3] = xT;
+    mt[1][3] = yT;
+    mt[2][3] = zT;
+}
+
+void guMtxTransApply(const Mtx src, Mtx dst, f32 xT, f32 yT, f32 zT)
+{
+    guMtxCopy(src, dst);
+    dst[0][3] += xT;
+    dst[1][3] += yT;
+    dst[2][3] += zT;
+}
+
+void guMtxApplyTrans(const Mtx src, Mtx dst, f32 xT, f32 yT, f32 zT)
+{
+    for (int r = 0; r < 3; r++) {
+        f32 t = src[r][0] * xT + src[r][1] * yT + src[r][2] * zT + src[r][3];
+        dst[r][0] = src[r][0];
+        dst[r][1] = src[r][1];
+        dst[r][2] = src[r][2];
+        dst[r][3] = t;
+    }
+}
+
+u32 guMtxInverse(const Mtx src, Mtx inv)
+{
+    Mtx m;
+    f32 det;
+
+    det = src[0][0] * src[1][1] * src[2][2] +
+          src[0][1] * src[1][2] * src[2][0] +
+          src[0][2] * src[1][0] * src[2][1] -
+          src[2][0] * src[1][1] * src[0][2] -
+          src[1][0] * src[0][1] * src[2][2] -
+          src[0][0] * src[2][1] * src[1][2];
+    if (det == 0.0f) return 0;
+    det = 1.0f / det;
+
+    m[0][0] = (src[1][1] * src[2][2] - src[2][1] * src[1][2]) * det;
+    m[0][1] = -(src[0][1] * src[2][2] - src[2][1] * src[0][2]) * det;
+    m[0][2] = (src[0][1] * src[1][2] - src[1][1] * src[0][2]) * det;
+    m[1][0] = -(src[1][0] * src[2][2] - src[2][0] * src[1][2]) * det;
+    m[1][1] = (src[0][0] * src[2][2] - src[2][0] * src[0][2]) * det;
+    m[1][2] = -(src[0][0] * src[1][2] - src[1][0] * src[0][2]) * det;
+    m[2][0] = (src[1][0] * src[2][1] - src[2][0] * src[1][1]) * det;
+    m[2][1] = -(src[0][0] * src[2][1] - src[2][0] * src[0][1]) * det;
+    m[2][2] = (src[0][0] * src[1][1] - src[1][0] * src[0][1]) * det;
+
+    for (int r = 0; r < 3; r++) {
+        m[r][3] = -m[r][0] * src[0][3] - m[r][1] * src[1][3] -
+                  m[r][2] * src[2][3];
+    }
+    memcpy(inv, m, sizeof(Mtx));
+    return 1;
+}
+
+void guMtxTranspose(const Mtx src, Mtx xPose)
+{
+    Mtx m;
+
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++)
+            m[r][c] = src[c][r];
+        m[r][3] = 0.0f;
+    }
+    memcpy(xPose, m, sizeof(Mtx));
+}
+
+void guMtxRotAxisRad(Mtx mt, const guVector *axis, f32 rad)
+{
+    guVector v = *axis;
+    f32 s = sinf(rad), c = cosf(rad), t = 1.0f - c;
+
+    guVecNormalize(&v);
+    mt[0][0] = t * v.x * v.x + c;
+    mt[0][1] = t * v.x * v.y - s * v.z;
+    mt[0][2] = t * v.x * v.z + s * v.y;
+    mt[0][3] = 0.0f;
+    mt[1][0] = t * v.x * v.y + s * v.z;
+    mt[1][1] = t * v.y * v.y + c;
+    mt[1][2] = t * v.y * v.z - s * v.x;
+    mt[1][3] = 0.0f;
+    mt[2][0] = t * v.x * v.z - s * v.y;
+    mt[2][1] = t * v.y * v.z + s * v.x;
+    mt[2][2] = t * v.z * v.z + c;
+    mt[2][3] = 0.0f;
+}
+
+void guMtx44Identity(Mtx44 mt)
+{
+    memset(mt, 0, sizeof(Mtx44));
+    mt[0][0] = mt[1][1] = mt[2][2] = mt[3][3] = 1.0f;
+}
+
+void guMtx44Copy(const Mtx44 src, Mtx44 dst)
+{
+    if (src != (const f32(*)[4])dst) memcpy(dst, src, sizeof(Mtx44));
+}
+
+void guMtx44Concat(const Mtx44 a, const Mtx44 b, Mtx44 ab)
+{
+    Mtx44 tmp;
+
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            tmp[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] +
+                        a[r][2] * b[2][c] + a[r][3] * b[3][c];
+        }
+    }
+    memcpy(ab, tmp, sizeof(Mtx44));
+}
+
+u32 guMtx44Inverse(const Mtx44 src, Mtx44 inv)
+{
+    f32 m[4][8];
+
+    /* Gauss-Jordan elimination with partial pivoting */
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            m[r][c] = src[r][c];
+            m[r][c + 4] = r == c ? 1.0f : 0.0f;
+        }
+    }
+
+    for (int c = 0; c < 4; c++) {
+        int pivot = c;
+        for (int r = c + 1; r < 4; r++) {
+            if (fabsf(m[r][c]) > fabsf(m[pivot][c])) pivot = r;
+        }
+        if (m[pivot][c] == 0.0f) return 0;
+        if (pivot != c) {
+            f32 tmp[8];
+            memcpy(tmp, m[c], sizeof(tmp));
+            memcpy(m[c], m[pivot], sizeof(tmp));
+            memcpy(m[pivot], tmp, sizeof(tmp));
+        }
+        f32 d = 1.0f / m[c][c];
+        for (int k = 0; k < 8; k++) m[c][k] *= d;
+        for (int r = 0; r < 4; r++) {
+            if (r == c) continue;
+            f32 f = m[r][c];
+            if (f == 0.0f) continue;
+            for (int k = 0; k < 8; k++) m[r][k] -= f * m[c][k];
+        }
+    }
+
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++)
+            inv[r][c] = m[r][c + 4];
+    }
+    return 1;
+}
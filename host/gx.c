@@ -0,0 +1,1299 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+/* Host implementation of the GX subset declared in <ogc/gx.h>.
+ *
+ * No rendering takes place: the functions encode their arguments into the
+ * same kind of commands that libogc would send to the GP (BP, CP and XF
+ * register loads, primitives, display list calls) and append them to an
+ * in-memory FIFO, updating the counters exposed via gx_host.h. Like in
+ * libogc, the vertex descriptor, the vertex attribute formats and a few other
+ * registers are written lazily, when the next primitive is started.
+ */
+
+#include "gx_host.h"
+
+#include <ogc/gx.h>
+#include <ogc/system.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FIFO_SIZE (4 * 1024 * 1024)
+
+#define DIRTY_VCD (1 << 0)
+#define DIRTY_GENMODE (1 << 1)
+#define DIRTY_MTXIDX (1 << 2)
+
+typedef struct {
+    u8 comptype;
+    u8 compsize;
+    u8 frac;
+} VtxAttrFmt;
+
+static u8 s_fifo[FIFO_SIZE] ATTRIBUTE_ALIGN(32);
+u8 *__gx_host_wptr = s_fifo;
+u8 *__gx_host_wend = s_fifo + FIFO_SIZE;
+static bool s_fifo_wrapped = false;
+static u64 s_fifo_flushed = 0;
+
+/* Display list being recorded */
+static u8 *s_dl_start = NULL;
+static bool s_dl_overflow = false;
+static u8 *s_saved_wptr;
+
+static GXHostStats s_stats;
+
+static u32 s_dirty = 0;
+static u8 s_dirty_vat = 0;
+static u8 s_vtxdesc[GX_VA_MAXATTR];
+static VtxAttrFmt s_vtxattrfmt[GX_MAXVTXFMT][GX_VA_MAXATTR];
+static u32 s_current_mtx = GX_PNMTX0;
+static u8 s_num_chans, s_num_texgens, s_num_tevstages = 1, s_cull_mode;
+
+static u16 s_draw_sync_token = 0;
+/* Simulated GPU latency: the GPU runs this many bytes behind the CPU */
+#define MAX_PENDING_TOKENS 64
+#define BYTES_PER_STALLED_POLL 32
+static u32 s_gpu_latency = 0;
+static u64 s_gpu_pos = 0;
+static struct {
+    u16 token;
+    u64 pos;
+} s_pending_tokens[MAX_PENDING_TOKENS];
+static int s_first_pending_token = 0;
+static int s_num_pending_tokens = 0;
+static void reach_all_draw_sync_tokens(void);
+static GXDrawSyncCallback s_draw_sync_cb = NULL;
+static GXDrawDoneCallback s_draw_done_cb = NULL;
+
+/* Like libogc, the default texture region callback hands out the eight TMEM
+ * cache regions in a round-robin fashion */
+static GXTexRegion s_tex_regions[8];
+static u8 s_next_tex_region;
+static GXTexRegionCallback s_tex_region_cb;
+
+static u16 s_copy_src[4];
+static u16 s_copy_dst[2];
+static u32 s_copy_fmt;
+
+static GXFifoObj s_fifo_obj;
+
+void __GX_HostFifoOverflow(void)
+{
+    if (s_dl_start) {
+        /* Like libogc, we just report the overflow when the list is closed;
+         * keep rewriting the same area in the meantime. */
+        s_dl_overflow = true;
+        __gx_host_wptr = s_dl_start;
+        return;
+    }
+
+    s_fifo_flushed += __gx_host_wptr - s_fifo;
+    s_fifo_wrapped = true;
+    __gx_host_wptr = s_fifo;
+}
+
+static void load_bp(u8 reg, u32 value)
+{
+    __GX_HostPut8(GX_LOAD_BP_REG);
+    __GX_HostPut32((reg << 24) | (value & 0x00ffffff));
+    s_stats.bp_writes++;
+}
+
+static void load_cp(u8 reg, u32 value)
+{
+    __GX_HostPut8(GX_LOAD_CP_REG);
+    __GX_HostPut8(reg);
+    __GX_HostPut32(value);
+    s_stats.cp_writes++;
+}
+
+static void load_xf(u16 addr, u32 count, const u32 *values)
+{
+    __GX_HostPut8(GX_LOAD_XF_REG);
+    __GX_HostPut32(((count - 1) << 16) | addr);
+    for (u32 i = 0; i < count; i++)
+        __GX_HostPut32(values[i]);
+    s_stats.xf_writes += count;
+}
+
+static void load_xf_f32(u16 addr, u32 count, const f32 *values)
+{
+    __GX_HostPut8(GX_LOAD_XF_REG);
+    __GX_HostPut32(((count - 1) << 16) | addr);
+    for (u32 i = 0; i < count; i++)
+        __GX_HostPutF32(values[i]);
+    s_stats.xf_writes += count;
+}
+
+static void load_xf_u32(u16 addr, u32 value)
+{
+    load_xf(addr, 1, &value);
+}
+
+static inline u32 pack_color(GXColor c)
+{
+    return (c.r << 24) | (c.g << 16) | (c.b << 8) | c.a;
+}
+
+static u32 pack_attr_fmt(const VtxAttrFmt *f, bool with_frac)
+{
+    u32 v = (f->comptype & 0x1) | ((f->compsize & 0x7) << 1);
+    if (with_frac)
+        v |= (f->frac & 0x1f) << 4;
+    return v;
+}
+
+static void flush_vcd()
+{
+    u32 lo = 0, hi = 0;
+
+    for (int i = GX_VA_PTNMTXIDX; i <= GX_VA_TEX7MTXIDX; i++) {
+        if (s_vtxdesc[i] != GX_NONE)
+            lo |= 1 << i;
+    }
+    lo |= (s_vtxdesc[GX_VA_POS] & 0x3) << 9;
+    lo |= (s_vtxdesc[GX_VA_NRM] & 0x3) << 11;
+    lo |= (s_vtxdesc[GX_VA_CLR0] & 0x3) << 13;
+    lo |= (s_vtxdesc[GX_VA_CLR1] & 0x3) << 15;
+    for (int i = 0; i < 8; i++)
+        hi |= (s_vtxdesc[GX_VA_TEX0 + i] & 0x3) << (i * 2);
+    load_cp(0x50, lo);
+    load_cp(0x60, hi);
+
+    u32 num_colors = (s_vtxdesc[GX_VA_CLR0] != GX_NONE) +
+                     (s_vtxdesc[GX_VA_CLR1] != GX_NONE);
+    u32 num_normals = s_vtxdesc[GX_VA_NRM] != GX_NONE ? 1 : 0;
+    u32 num_texcoords = 0;
+    for (int i = 0; i < 8; i++) {
+        if (s_vtxdesc[GX_VA_TEX0 + i] != GX_NONE)
+            num_texcoords++;
+    }
+    load_xf_u32(0x1008, num_colors | (num_normals << 2) | (num_texcoords << 4));
+}
+
+static void flush_vat(u8 fmt)
+{
+    const VtxAttrFmt *f = s_vtxattrfmt[fmt];
+    u32 a, b, c;
+
+    a = pack_attr_fmt(&f[GX_VA_POS], true) |
+        (pack_attr_fmt(&f[GX_VA_NRM], false) << 9) |
+        (pack_attr_fmt(&f[GX_VA_CLR0], false) << 13) |
+        (pack_attr_fmt(&f[GX_VA_CLR1], false) << 17) |
+        (pack_attr_fmt(&f[GX_VA_TEX0], true) << 21);
+    b = pack_attr_fmt(&f[GX_VA_TEX1], true) |
+        (pack_attr_fmt(&f[GX_VA_TEX2], true) << 9) |
+        (pack_attr_fmt(&f[GX_VA_TEX3], true) << 18) |
+        (pack_attr_fmt(&f[GX_VA_TEX4], false) << 27);
+    c = (f[GX_VA_TEX4].frac & 0x1f) |
+        (pack_attr_fmt(&f[GX_VA_TEX5], true) << 5) |
+        (pack_attr_fmt(&f[GX_VA_TEX6], true) << 14) |
+        (pack_attr_fmt(&f[GX_VA_TEX7], true) << 23);
+    load_cp(0x70 + fmt, a);
+    load_cp(0x80 + fmt, b);
+    load_cp(0x90 + fmt, c);
+}
+
+static void flush_dirty_state()
+{
+    if (s_dirty & DIRTY_GENMODE) {
+        load_bp(0x00, s_num_texgens | (s_num_chans << 4) |
+                          ((s_num_tevstages - 1) << 10) |
+                          (s_cull_mode << 14));
+    }
+    if (s_dirty & DIRTY_VCD) {
+        flush_vcd();
+    }
+    if (s_dirty_vat) {
+        for (int i = 0; i < GX_MAXVTXFMT; i++) {
+            if (s_dirty_vat & (1 << i))
+                flush_vat(i);
+        }
+        s_dirty_vat = 0;
+    }
+    if (s_dirty & DIRTY_MTXIDX) {
+        load_cp(0x30, s_current_mtx);
+        load_xf_u32(0x1018, s_current_mtx);
+    }
+    s_dirty = 0;
+}
+
+void SYS_Report(const char *msg, ...)
+{
+    va_list args;
+    va_start(args, msg);
+    vfprintf(stderr, msg, args);
+    va_end(args);
+}
+
+void GX_HostGetStats(GXHostStats *stats)
+{
+    u8 *wptr = s_dl_start ? s_saved_wptr : __gx_host_wptr;
+    *stats = s_stats;
+    stats->fifo_bytes = s_fifo_flushed + (wptr - s_fifo);
+}
+
+void GX_HostResetStats(void)
+{
+    /* The GPU positions are relative to the FIFO contents */
+    reach_all_draw_sync_tokens();
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_fifo_flushed = 0;
+    s_fifo_wrapped = false;
+    if (s_dl_start) {
+        s_saved_wptr = s_fifo;
+    } else {
+        __gx_host_wptr = s_fifo;
+    }
+}
+
+const u8 *GX_HostGetFifo(u32 *size, bool *wrapped)
+{
+    u8 *wptr = s_dl_start ? s_saved_wptr : __gx_host_wptr;
+    *size = wptr - s_fifo;
+    if (wrapped) *wrapped = s_fifo_wrapped;
+    return s_fifo;
+}
+
+static GXTexRegion *default_tex_region_cb(const GXTexObj *obj, u8 mapid)
+{
+    return &s_tex_regions[s_next_tex_region++ & 7];
+}
+
+GXFifoObj *GX_Init(void *base, u32 size)
+{
+    memset(s_vtxdesc, 0, sizeof(s_vtxdesc));
+    memset(s_vtxattrfmt, 0, sizeof(s_vtxattrfmt));
+    s_dirty = DIRTY_VCD | DIRTY_GENMODE | DIRTY_MTXIDX;
+    s_dirty_vat = 0xff;
+    s_current_mtx = GX_PNMTX0;
+    s_num_chans = s_num_texgens = 0;
+    s_num_tevstages = 1;
+    s_cull_mode = GX_CULL_BACK;
+    for (int i = 0; i < 8; i++) {
+        GX_InitTexCacheRegion(&s_tex_regions[i], GX_FALSE,
+                              i * 0x8000, GX_TEXCACHE_32K,
+                              0x80000 + i * 0x8000, GX_TEXCACHE_32K);
+    }
+    s_next_tex_region = 0;
+    s_tex_region_cb = default_tex_region_cb;
+    return &s_fifo_obj;
+}
+
+void GX_Flush(void) {}
+
+void GX_AbortFrame(void) {}
+
+void GX_SetDrawDone(void)
+{
+    load_bp(0x45, 0x02);
+}
+
+/* Bytes the GPU has been asked to process */
+static u64 gpu_work_submitted(void)
+{
+    u8 *wptr = s_dl_start ? s_saved_wptr : __gx_host_wptr;
+    return s_fifo_flushed + (wptr - s_fifo) + s_stats.displist_call_bytes;
+}
+
+static void reach_draw_sync_token(u16 token)
+{
+    s_draw_sync_token = token;
+    if (s_draw_sync_cb) s_draw_sync_cb(token);
+}
+
+/* Lets the simulated GPU process the given amount of bytes, on top of those
+ * it must have processed to stay within the latency from the CPU. */
+static void advance_gpu(u64 bytes)
+{
+    u64 submitted = gpu_work_submitted();
+    if (s_gpu_latency == 0 || submitted < s_gpu_pos) {
+        s_gpu_pos = submitted;
+    } else {
+        if (submitted - s_gpu_pos > s_gpu_latency)
+            s_gpu_pos = submitted - s_gpu_latency;
+        s_gpu_pos += bytes;
+        if (s_gpu_pos > submitted) s_gpu_pos = submitted;
+    }
+
+    while (s_num_pending_tokens > 0 &&
+           s_pending_tokens[s_first_pending_token].pos <= s_gpu_pos) {
+        reach_draw_sync_token(s_pending_tokens[s_first_pending_token].token);
+        s_first_pending_token =
+            (s_first_pending_token + 1) % MAX_PENDING_TOKENS;
+        s_num_pending_tokens--;
+    }
+}
+
+static void reach_all_draw_sync_tokens(void)
+{
+    s_gpu_pos = gpu_work_submitted();
+    while (s_num_pending_tokens > 0) {
+        reach_draw_sync_token(s_pending_tokens[s_first_pending_token].token);
+        s_first_pending_token =
+            (s_first_pending_token + 1) % MAX_PENDING_TOKENS;
+        s_num_pending_tokens--;
+    }
+}
+
+void GX_WaitDrawDone(void)
+{
+    s_stats.draw_done_waits++;
+    reach_all_draw_sync_tokens();
+    if (s_draw_done_cb) s_draw_done_cb();
+}
+
+void GX_DrawDone(void)
+{
+    GX_SetDrawDone();
+    GX_WaitDrawDone();
+}
+
+void GX_SetDrawSync(u16 token)
+{
+    load_bp(0x48, token);
+    load_bp(0x47, token);
+    s_stats.draw_sync_tokens++;
+    if (s_gpu_latency == 0) {
+        /* There's no GP running asynchronously: the token is reached at
+         * once */
+        reach_draw_sync_token(token);
+        return;
+    }
+
+    if (s_num_pending_tokens == MAX_PENDING_TOKENS) {
+        reach_draw_sync_token(s_pending_tokens[s_first_pending_token].token);
+        s_first_pending_token =
+            (s_first_pending_token + 1) % MAX_PENDING_TOKENS;
+        s_num_pending_tokens--;
+    }
+    int i = (s_first_pending_token + s_num_pending_tokens++) %
+        MAX_PENDING_TOKENS;
+    s_pending_tokens[i].token = token;
+    s_pending_tokens[i].pos = gpu_work_submitted();
+    advance_gpu(0);
+}
+
+u16 GX_GetDrawSync(void)
+{
+    advance_gpu(0);
+    if (s_num_pending_tokens > 0) {
+        /* Time passes while the CPU polls */
+        s_stats.draw_sync_stalls++;
+        advance_gpu(BYTES_PER_STALLED_POLL);
+    }
+    return s_draw_sync_token;
+}
+
+void GX_HostSetGpuLatency(u32 bytes)
+{
+    s_gpu_latency = bytes;
+    if (bytes == 0) reach_all_draw_sync_tokens();
+}
+
+GXDrawSyncCallback GX_SetDrawSyncCallback(GXDrawSyncCallback cb)
+{
+    GXDrawSyncCallback old = s_draw_sync_cb;
+    s_draw_sync_cb = cb;
+    return old;
+}
+
+GXDrawDoneCallback GX_SetDrawDoneCallback(GXDrawDoneCallback cb)
+{
+    GXDrawDoneCallback old = s_draw_done_cb;
+    s_draw_done_cb = cb;
+    return old;
+}
+
+void GX_PixModeSync(void)
+{
+    load_bp(0x63, 0);
+}
+
+void GX_TexModeSync(void)
+{
+    load_bp(0x63, 0);
+}
+
+void GX_ClearVtxDesc(void)
+{
+    memset(s_vtxdesc, 0, sizeof(s_vtxdesc));
+    s_dirty |= DIRTY_VCD;
+}
+
+void GX_SetVtxDesc(u8 attr, u8 type)
+{
+    if (attr >= GX_VA_MAXATTR) return;
+    s_vtxdesc[attr] = type;
+    s_dirty |= DIRTY_VCD;
+}
+
+void GX_SetVtxAttrFmt(u8 vtxfmt, u32 vtxattr, u32 comptype, u32 compsize,
+                      u32 frac)
+{
+    if (vtxfmt >= GX_MAXVTXFMT || vtxattr >= GX_VA_MAXATTR) return;
+    VtxAttrFmt *f = &s_vtxattrfmt[vtxfmt][vtxattr];
+    f->comptype = comptype;
+    f->compsize = compsize;
+    f->frac = frac;
+    s_dirty_vat |= 1 << vtxfmt;
+}
+
+void GX_SetArray(u32 attr, void *ptr, u8 stride)
+{
+    u8 idx = attr == GX_VA_NBT ? GX_VA_NRM - GX_VA_POS : attr - GX_VA_POS;
+    load_cp(0xa0 + idx, (u32)(uintptr_t)ptr);
+    load_cp(0xb0 + idx, stride);
+}
+
+void GX_InvVtxCache(void)
+{
+    __GX_HostPut8(GX_CMD_INVL_VC);
+    s_stats.vtx_cache_invalidations++;
+}
+
+/* Size of one element of an attribute array, in bytes */
+static u32 array_element_size(u32 attr, const VtxAttrFmt *f)
+{
+    u32 num_components, component_size;
+
+    if (attr == GX_VA_CLR0 || attr == GX_VA_CLR1) {
+        switch (f->compsize) {
+        case GX_RGB565:
+        case GX_RGBA4: return 2;
+        case GX_RGB8:
+        case GX_RGBA6: return 3;
+        default: return 4;
+        }
+    }
+
+    if (attr == GX_VA_POS) {
+        num_components = f->comptype == GX_POS_XY ? 2 : 3;
+    } else if (attr == GX_VA_NRM) {
+        num_components = f->comptype == GX_NRM_NBT ? 9 : 3;
+    } else {
+        num_components = f->comptype == GX_TEX_S ? 1 : 2;
+    }
+    switch (f->compsize) {
+    case GX_U8:
+    case GX_S8: component_size = 1; break;
+    case GX_U16:
+    case GX_S16: component_size = 2; break;
+    default: component_size = 4;
+    }
+    return num_components * component_size;
+}
+
+void GX_Begin(u8 primitve, u8 vtxfmt, u16 vtxcnt)
+{
+    if (s_dirty || s_dirty_vat) flush_dirty_state();
+    __GX_HostPut8(primitve | (vtxfmt & 0x7));
+    __GX_HostPut16(vtxcnt);
+    if (!s_dl_start) {
+        s_stats.primitives++;
+        s_stats.vertices += vtxcnt;
+        for (u32 attr = GX_VA_POS; attr <= GX_VA_TEX7; attr++) {
+            if (s_vtxdesc[attr] != GX_INDEX8 && s_vtxdesc[attr] != GX_INDEX16)
+                continue;
+            s_stats.array_fetch_bytes += (u64)vtxcnt *
+                array_element_size(attr, &s_vtxattrfmt[vtxfmt & 0x7][attr]);
+        }
+    }
+}
+
+void GX_BeginDispList(void *list, u32 size)
+{
+    if (s_dirty || s_dirty_vat) flush_dirty_state();
+    s_saved_wptr = __gx_host_wptr;
+    s_dl_start = list;
+    s_dl_overflow = false;
+    __gx_host_wptr = list;
+    __gx_host_wend = (u8 *)list + size;
+}
+
+u32 GX_EndDispList(void)
+{
+    if (s_dirty || s_dirty_vat) flush_dirty_state();
+    /* Display lists are executed in blocks of 32 bytes */
+    while ((__gx_host_wptr - s_dl_start) & 31) {
+        if (__gx_host_wptr >= __gx_host_wend) break;
+        *__gx_host_wptr++ = GX_NOP;
+    }
+    u32 size = __gx_host_wptr - s_dl_start;
+    if (size & 31) s_dl_overflow = true;
+
+    __gx_host_wptr = s_saved_wptr;
+    __gx_host_wend = s_fifo + FIFO_SIZE;
+    s_dl_start = NULL;
+    if (s_dl_overflow) return 0;
+    s_stats.displist_bytes += size;
+    return size;
+}
+
+void GX_CallDispList(void *list, u32 nbytes)
+{
+    if (s_dirty || s_dirty_vat) flush_dirty_state();
+    __GX_HostPut8(GX_CMD_CALL_DL);
+    __GX_HostPut32((u32)(uintptr_t)list);
+    __GX_HostPut32(nbytes);
+    s_stats.displist_calls++;
+    s_stats.displist_call_bytes += nbytes;
+}
+
+void GX_LoadPosMtxImm(const Mtx mt, u32 pnidx)
+{
+    load_xf_f32(pnidx << 2, 12, &mt[0][0]);
+}
+
+void GX_LoadNrmMtxImm(const Mtx mt, u32 pnidx)
+{
+    f32 m[9];
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+            m[r * 3 + c] = mt[r][c];
+    load_xf_f32(0x400 + pnidx * 3, 9, m);
+}
+
+void GX_LoadTexMtxImm(const Mtx mt, u32 texidx, u8 type)
+{
+    u16 addr = texidx >= GX_DTTMTX0 ?
+        0x500 + ((texidx - GX_DTTMTX0) << 2) : texidx << 2;
+    load_xf_f32(addr, type == GX_MTX2x4 ? 8 : 12, &mt[0][0]);
+}
+
+void GX_LoadProjectionMtx(const Mtx44 mt, u8 type)
+{
+    f32 p[7];
+    p[0] = mt[0][0];
+    p[2] = mt[1][1];
+    p[4] = mt[2][2];
+    p[5] = mt[2][3];
+    p[6] = type;
+    if (type == GX_PERSPECTIVE) {
+        p[1] = mt[0][2];
+        p[3] = mt[1][2];
+    } else {
+        p[1] = mt[0][3];
+        p[3] = mt[1][3];
+    }
+    load_xf_f32(0x1020, 7, p);
+}
+
+void GX_SetCurrentMtx(u32 mtx)
+{
+    s_current_mtx = mtx;
+    s_dirty |= DIRTY_MTXIDX;
+}
+
+void GX_SetViewport(f32 xOrig, f32 yOrig, f32 wd, f32 ht, f32 nearZ,
+                    f32 farZ)
+{
+    f32 v[6] = {
+        wd * 0.5f, -ht * 0.5f, (farZ - nearZ) * 16777215.0f,
+        xOrig + wd * 0.5f + 342.0f, yOrig + ht * 0.5f + 342.0f,
+        farZ * 16777215.0f,
+    };
+    load_xf_f32(0x101a, 6, v);
+}
+
+void GX_SetScissor(u32 xOrigin, u32 yOrigin, u32 wd, u32 ht)
+{
+    u32 top = yOrigin + 342, left = xOrigin + 342;
+    load_bp(0x20, top | (left << 12));
+    load_bp(0x21, (top + ht - 1) | ((left + wd - 1) << 12));
+}
+
+void GX_SetCullMode(u8 mode)
+{
+    s_cull_mode = mode;
+    s_dirty |= DIRTY_GENMODE;
+}
+
+void GX_SetClipMode(u8 mode)
+{
+    load_xf_u32(0x1005, mode);
+}
+
+void GX_SetNumChans(u8 num)
+{
+    s_num_chans = num;
+    load_xf_u32(0x1009, num);
+    s_dirty |= DIRTY_GENMODE;
+}
+
+void GX_SetChanCtrl(s32 channel, u8 enable, u8 ambsrc, u8 matsrc, u8 litmask,
+                    u8 diff_fn, u8 attn_fn)
+{
+    u32 val = (matsrc & 1) | ((enable & 1) << 1) | ((litmask & 0x0f) << 2) |
+              ((ambsrc & 1) << 6) | (diff_fn << 7) | ((attn_fn != GX_AF_NONE) << 9) |
+              ((attn_fn != GX_AF_SPEC) << 10) | ((litmask >> 4) << 11);
+    u32 chan = channel & 0x3;
+    load_xf_u32(0x100e + chan, val);
+    if (channel == GX_COLOR0A0 || channel == GX_COLOR1A1)
+        load_xf_u32(0x1010 + chan, val);
+}
+
+void GX_SetChanAmbColor(s32 channel, GXColor color)
+{
+    load_xf_u32(0x100a + (channel & 0x1), pack_color(color));
+}
+
+void GX_SetChanMatColor(s32 channel, GXColor color)
+{
+    load_xf_u32(0x100c + (channel & 0x1), pack_color(color));
+}
+
+void GX_InitLightPos(GXLightObj *lit_obj, f32 x, f32 y, f32 z)
+{
+    lit_obj->pos[0] = x;
+    lit_obj->pos[1] = y;
+    lit_obj->pos[2] = z;
+}
+
+void GX_InitLightDir(GXLightObj *lit_obj, f32 nx, f32 ny, f32 nz)
+{
+    lit_obj->dir[0] = -nx;
+    lit_obj->dir[1] = -ny;
+    lit_obj->dir[2] = -nz;
+}
+
+void GX_InitLightColor(GXLightObj *lit_obj, GXColor col)
+{
+    lit_obj->color = col;
+}
+
+void GX_InitLightAttn(GXLightObj *lit_obj, f32 a0, f32 a1, f32 a2, f32 k0,
+                      f32 k1, f32 k2)
+{
+    lit_obj->a[0] = a0;
+    lit_obj->a[1] = a1;
+    lit_obj->a[2] = a2;
+    lit_obj->k[0] = k0;
+    lit_obj->k[1] = k1;
+    lit_obj->k[2] = k2;
+}
+
+void GX_InitSpecularDir(GXLightObj *lit_obj, f32 nx, f32 ny, f32 nz)
+{
+    /* The half-angle computation is irrelevant here; just store something
+     * deterministic. */
+    lit_obj->pos[0] = -nx * 1048576.0f;
+    lit_obj->pos[1] = -ny * 1048576.0f;
+    lit_obj->pos[2] = -nz * 1048576.0f;
+    lit_obj->dir[0] = nx;
+    lit_obj->dir[1] = ny;
+    lit_obj->dir[2] = nz + 1.0f;
+}
+
+void GX_LoadLightObj(GXLightObj *lit_obj, u8 lit_id)
+{
+    u32 idx = 0;
+    while (idx < 7 && !(lit_id & (1 << idx))) idx++;
+
+    u32 v[16];
+    memset(v, 0, 3 * sizeof(u32));
+    v[3] = pack_color(lit_obj->color);
+    memcpy(&v[4], lit_obj->a, 3 * sizeof(f32));
+    memcpy(&v[7], lit_obj->k, 3 * sizeof(f32));
+    memcpy(&v[10], lit_obj->pos, 3 * sizeof(f32));
+    memcpy(&v[13], lit_obj->dir, 3 * sizeof(f32));
+    load_xf(0x600 + (idx << 4), 16, v);
+}
+
+void GX_SetNumTexGens(u32 nr)
+{
+    s_num_texgens = nr;
+    load_xf_u32(0x103f, nr);
+    s_dirty |= DIRTY_GENMODE;
+}
+
+void GX_SetTexCoordGen2(u16 texcoord, u32 tgen_typ, u32 tgen_src, u32 mtxsrc,
+                        u32 normalize, u32 postmtx)
+{
+    if (texcoord >= GX_MAXCOORD) return;
+    load_xf_u32(0x1040 + texcoord,
+                (tgen_typ << 4) | (tgen_src << 7) | (mtxsrc << 12));
+    load_xf_u32(0x1050 + texcoord,
+                ((postmtx - GX_DTTMTX0) & 0x3f) | ((normalize & 1) << 8));
+}
+
+void GX_EnableTexOffsets(u8 coord, u8 line_enable, u8 point_enable)
+{
+    if (coord >= GX_MAXCOORD) return;
+    load_bp(0x30 + coord * 2, (line_enable << 18) | (point_enable << 19));
+}
+
+void GX_InitTexObj(GXTexObj *obj, void *img_ptr, u16 wd, u16 ht, u8 fmt,
+                   u8 wrap_s, u8 wrap_t, u8 mipmap)
+{
+    if (!obj) return;
+    memset(obj, 0, sizeof(*obj));
+    obj->img_ptr = img_ptr;
+    obj->width = wd;
+    obj->height = ht;
+    obj->format = fmt;
+    obj->wrap_s = wrap_s;
+    obj->wrap_t = wrap_t;
+    obj->mipmap = mipmap;
+    obj->min_filter = mipmap ? GX_LIN_MIP_LIN : GX_LINEAR;
+    obj->mag_filter = GX_LINEAR;
+    obj->max_lod = mipmap ? 10.0f : 0.0f;
+    obj->edge_lod = 1;
+}
+
+void GX_InitTexObjCI(GXTexObj *obj, void *img_ptr, u16 wd, u16 ht, u8 fmt,
+                     u8 wrap_s, u8 wrap_t, u8 mipmap, u32 tlut_name)
+{
+    GX_InitTexObj(obj, img_ptr, wd, ht, fmt, wrap_s, wrap_t, mipmap);
+    obj->tlut_name = tlut_name;
+}
+
+void GX_InitTexObjLOD(GXTexObj *obj, u8 minfilt, u8 magfilt, f32 minlod,
+                      f32 maxlod, f32 lodbias, u8 biasclamp, u8 edgelod,
+                      u8 maxaniso)
+{
+    obj->min_filter = minfilt;
+    obj->mag_filter = magfilt;
+    obj->min_lod = minlod;
+    obj->max_lod = maxlod;
+    obj->lod_bias = lodbias;
+    obj->bias_clamp = biasclamp;
+    obj->edge_lod = edgelod;
+    obj->max_aniso = maxaniso;
+}
+
+void GX_InitTexObjFilterMode(GXTexObj *obj, u8 minfilt, u8 magfilt)
+{
+    obj->min_filter = minfilt;
+    obj->mag_filter = magfilt;
+}
+
+void GX_InitTexObjWrapMode(GXTexObj *obj, u8 wrap_s, u8 wrap_t)
+{
+    obj->wrap_s = wrap_s;
+    obj->wrap_t = wrap_t;
+}
+
+void GX_InitTexObjData(GXTexObj *obj, void *img_ptr)
+{
+    obj->img_ptr = img_ptr;
+}
+
+void GX_InitTexObjTlut(GXTexObj *obj, u32 tlut_name)
+{
+    obj->tlut_name = tlut_name;
+}
+
+void GX_InitTexObjUserData(GXTexObj *obj, void *userdata)
+{
+    obj->user_data = userdata;
+}
+
+void *GX_GetTexObjUserData(const GXTexObj *obj)
+{
+    return obj->user_data;
+}
+
+void GX_GetTexObjAll(const GXTexObj *obj, void **image_ptr, u16 *width,
+                     u16 *height, u8 *format, u8 *wrap_s, u8 *wrap_t,
+                     u8 *mipmap)
+{
+    *image_ptr = obj->img_ptr;
+    *width = obj->width;
+    *height = obj->height;
+    *format = obj->format;
+    *wrap_s = obj->wrap_s;
+    *wrap_t = obj->wrap_t;
+    *mipmap = obj->mipmap;
+}
+
+void *GX_GetTexObjData(const GXTexObj *obj)
+{
+    return obj->img_ptr;
+}
+
+u16 GX_GetTexObjWidth(const GXTexObj *obj)
+{
+    return obj->width;
+}
+
+u16 GX_GetTexObjHeight(const GXTexObj *obj)
+{
+    return obj->height;
+}
+
+u32 GX_GetTexObjFmt(const GXTexObj *obj)
+{
+    return obj->format;
+}
+
+u8 GX_GetTexObjWrapS(const GXTexObj *obj)
+{
+    return obj->wrap_s;
+}
+
+u8 GX_GetTexObjWrapT(const GXTexObj *obj)
+{
+    return obj->wrap_t;
+}
+
+u8 GX_GetTexObjMipMap(const GXTexObj *obj)
+{
+    return obj->mipmap;
+}
+
+void GX_GetTexObjFilterMode(const GXTexObj *obj, u8 *minfilt, u8 *magfilt)
+{
+    *minfilt = obj->min_filter;
+    *magfilt = obj->mag_filter;
+}
+
+void GX_GetTexObjLOD(const GXTexObj *obj, f32 *minlod, f32 *maxlod)
+{
+    *minlod = obj->min_lod;
+    *maxlod = obj->max_lod;
+}
+
+u32 GX_GetTexObjTlut(const GXTexObj *obj)
+{
+    return obj->tlut_name;
+}
+
+void GX_LoadTexObj(GXTexObj *obj, u8 mapid)
+{
+    static const u8 reg_base[8] = { 0x80, 0x81, 0x82, 0x83,
+                                    0xa0, 0xa1, 0xa2, 0xa3 };
+    if (mapid >= GX_MAX_TEXMAP) return;
+    GXTexRegion *region = s_tex_region_cb(obj, mapid);
+    u8 base = reg_base[mapid];
+    load_bp(base, obj->wrap_s | (obj->wrap_t << 2) |
+                      (obj->mag_filter << 4) | (obj->min_filter << 5));
+    load_bp(base + 0x04, (u32)(obj->min_lod * 16) |
+                             ((u32)(obj->max_lod * 16) << 8));
+    load_bp(base + 0x08, (obj->width - 1) | ((obj->height - 1) << 10) |
+                             (obj->format << 20));
+    load_bp(base + 0x0c, (region->tmem_even >> 5) |
+                             (region->size_even << 15) |
+                             (region->size_even << 18) |
+                             (region->is_cached ? 0 : 1 << 21));
+    load_bp(base + 0x10, (region->tmem_odd >> 5) |
+                             (region->size_odd << 15) |
+                             (region->size_odd << 18));
+    load_bp(base + 0x14, (u32)(uintptr_t)obj->img_ptr >> 5);
+    if (obj->format == GX_TF_CI4 || obj->format == GX_TF_CI8 ||
+        obj->format == GX_TF_CI14) {
+        load_bp(base + 0x18, obj->tlut_name);
+    }
+}
+
+u32 GX_GetTexBufferSize(u16 wd, u16 ht, u32 fmt, u8 mipmap, u8 maxlod)
+{
+    u32 xshift, yshift, xtiles, ytiles, bitsize, size;
+
+    switch (fmt) {
+    case GX_TF_I4:
+    case GX_TF_CI4:
+    case GX_TF_CMPR:
+    case GX_CTF_R4:
+    case GX_CTF_RA4:
+    case GX_CTF_Z4:
+        xshift = 3;
+        yshift = 3;
+        break;
+    case GX_TF_Z8:
+    case GX_TF_I8:
+    case GX_TF_IA4:
+    case GX_TF_CI8:
+    case GX_CTF_A8:
+    case GX_CTF_R8:
+    case GX_CTF_G8:
+    case GX_CTF_B8:
+    case GX_CTF_RG8:
+    case GX_CTF_GB8:
+    case GX_CTF_Z8M:
+    case GX_CTF_Z8L:
+        xshift = 3;
+        yshift = 2;
+        break;
+    default:
+        xshift = 2;
+        yshift = 2;
+        break;
+    }
+
+    bitsize = 32;
+    if (fmt == GX_TF_RGBA8 || fmt == GX_TF_Z24X8) bitsize = 64;
+
+    size = 0;
+    if (mipmap) {
+        u32 cnt = maxlod;
+        u32 w = wd, h = ht;
+        while (cnt) {
+            xtiles = (w + (1 << xshift) - 1) >> xshift;
+            ytiles = (h + (1 << yshift) - 1) >> yshift;
+            size += xtiles * ytiles * bitsize;
+            if (w == 1 && h == 1) return size;
+            w = w > 1 ? w >> 1 : 1;
+            h = h > 1 ? h >> 1 : 1;
+            cnt--;
+        }
+        return size;
+    }
+
+    xtiles = (wd + (1 << xshift) - 1) >> xshift;
+    ytiles = (ht + (1 << yshift) - 1) >> yshift;
+    return xtiles * ytiles * bitsize;
+}
+
+void GX_InvalidateTexAll(void)
+{
+    load_bp(0x0f, 0);
+    load_bp(0x66, 0x1000);
+    load_bp(0x66, 0x1100);
+    s_stats.tex_invalidations++;
+}
+
+void GX_InitTexCacheRegion(GXTexRegion *region, u8 is32bmipmap,
+                           u32 tmem_even, u8 size_even, u32 tmem_odd,
+                           u8 size_odd)
+{
+    region->tmem_even = tmem_even;
+    region->tmem_odd = tmem_odd;
+    region->size_even = size_even;
+    region->size_odd = size_odd;
+    region->is_32b_mipmap = is32bmipmap;
+    region->is_cached = 1;
+}
+
+void GX_InvalidateTexRegion(GXTexRegion *region)
+{
+    load_bp(0x0f, 0);
+    load_bp(0x66, (region->tmem_even >> 5) | (region->size_even << 9));
+    load_bp(0x66, (region->tmem_odd >> 5) | (region->size_odd << 9));
+    s_stats.tex_invalidations++;
+}
+
+GXTexRegionCallback GX_SetTexRegionCallback(GXTexRegionCallback cb)
+{
+    GXTexRegionCallback old = s_tex_region_cb;
+    s_tex_region_cb = cb;
+    return old;
+}
+
+void GX_InitTlutObj(GXTlutObj *obj, void *lut, u8 fmt, u16 entries)
+{
+    obj->lut_ptr = lut;
+    obj->format = fmt;
+    obj->entries = entries;
+}
+
+void GX_LoadTlut(GXTlutObj *obj, u32 tlut_name)
+{
+    load_bp(0x0f, 0);
+    load_bp(0x64, (u32)(uintptr_t)obj->lut_ptr >> 5);
+    load_bp(0x65, tlut_name | (obj->entries << 10));
+    load_bp(0x0f, 0);
+}
+
+void GX_SetZTexture(u8 op, u8 fmt, u32 bias)
+{
+    load_bp(0xf4, bias);
+    load_bp(0xf5, fmt | (op << 2));
+}
+
+void GX_SetNumTevStages(u8 num)
+{
+    s_num_tevstages = num;
+    s_dirty |= DIRTY_GENMODE;
+}
+
+void GX_SetTevOp(u8 tevstage, u8 mode)
+{
+    u8 defcolor = tevstage == GX_TEVSTAGE0 ? GX_CC_RASC : GX_CC_CPREV;
+    u8 defalpha = tevstage == GX_TEVSTAGE0 ? GX_CA_RASA : GX_CA_APREV;
+
+    switch (mode) {
+    case GX_MODULATE:
+        GX_SetTevColorIn(tevstage, GX_CC_ZERO, GX_CC_TEXC, defcolor,
+                         GX_CC_ZERO);
+        GX_SetTevAlphaIn(tevstage, GX_CA_ZERO, GX_CA_TEXA, defalpha,
+                         GX_CA_ZERO);
+        break;
+    case GX_DECAL:
+        GX_SetTevColorIn(tevstage, defcolor, GX_CC_TEXC, GX_CC_TEXA,
+                         GX_CC_ZERO);
+        GX_SetTevAlphaIn(tevstage, GX_CA_ZERO, GX_CA_ZERO, GX_CA_ZERO,
+                         defalpha);
+        break;
+    case GX_BLEND:
+        GX_SetTevColorIn(tevstage, defcolor, GX_CC_ONE, GX_CC_TEXC,
+                         GX_CC_ZERO);
+        GX_SetTevAlphaIn(tevstage, GX_CA_ZERO, GX_CA_TEXA, defalpha,
+                         GX_CA_ZERO);
+        break;
+    case GX_REPLACE:
+        GX_SetTevColorIn(tevstage, GX_CC_ZERO, GX_CC_ZERO, GX_CC_ZERO,
+                         GX_CC_TEXC);
+        GX_SetTevAlphaIn(tevstage, GX_CA_ZERO, GX_CA_ZERO, GX_CA_ZERO,
+                         GX_CA_TEXA);
+        break;
+    case GX_PASSCLR:
+    default:
+        GX_SetTevColorIn(tevstage, GX_CC_ZERO, GX_CC_ZERO, GX_CC_ZERO,
+                         defcolor);
+        GX_SetTevAlphaIn(tevstage, GX_CA_ZERO, GX_CA_ZERO, GX_CA_ZERO,
+                         defalpha);
+        break;
+    }
+    GX_SetTevColorOp(tevstage, GX_TEV_ADD, GX_TB_ZERO, GX_CS_SCALE_1,
+                     GX_TRUE, GX_TEVPREV);
+    GX_SetTevAlphaOp(tevstage, GX_TEV_ADD, GX_TB_ZERO, GX_CS_SCALE_1,
+                     GX_TRUE, GX_TEVPREV);
+}
+
+void GX_SetTevColorIn(u8 tevstage, u8 a, u8 b, u8 c, u8 d)
+{
+    load_bp(0xc0 + tevstage * 2, (a << 12) | (b << 8) | (c << 4) | d);
+}
+
+void GX_SetTevAlphaIn(u8 tevstage, u8 a, u8 b, u8 c, u8 d)
+{
+    load_bp(0xc1 + tevstage * 2, (a << 13) | (b << 10) | (c << 7) | (d << 4));
+}
+
+void GX_SetTevColorOp(u8 tevstage, u8 tevop, u8 tevbias, u8 tevscale,
+                      u8 clamp, u8 tevregid)
+{
+    load_bp(0xc0 + tevstage * 2, (tevbias << 16) | ((tevop & 1) << 18) |
+                                     (clamp << 19) | (tevscale << 20) |
+                                     (tevregid << 22));
+}
+
+void GX_SetTevAlphaOp(u8 tevstage, u8 tevop, u8 tevbias, u8 tevscale,
+                      u8 clamp, u8 tevregid)
+{
+    load_bp(0xc1 + tevstage * 2, (tevbias << 16) | ((tevop & 1) << 18) |
+                                     (clamp << 19) | (tevscale << 20) |
+                                     (tevregid << 22));
+}
+
+void GX_SetTevOrder(u8 tevstage, u8 texcoord, u32 texmap, u8 color)
+{
+    load_bp(0x28 + (tevstage >> 1),
+            (texmap & 0x7) | ((texcoord & 0x7) << 3) |
+                ((texmap != GX_TEXMAP_NULL && !(texmap & GX_TEXMAP_DISABLE))
+                 << 6) |
+                ((color & 0x7) << 7));
+}
+
+void GX_SetTevColor(u8 tev_regid, GXColor color)
+{
+    u32 ra = (color.a << 12) | color.r;
+    u32 bg = (color.g << 12) | color.b;
+    load_bp(0xe0 + (tev_regid << 1), ra);
+    /* libogc writes this register three times, to work around a hardware
+     * bug */
+    load_bp(0xe1 + (tev_regid << 1), bg);
+    load_bp(0xe1 + (tev_regid << 1), bg);
+    load_bp(0xe1 + (tev_regid << 1), bg);
+}
+
+void GX_SetTevColorS10(u8 tev_regid, GXColorS10 color)
+{
+    u32 ra = ((color.a & 0x7ff) << 12) | (color.r & 0x7ff);
+    u32 bg = ((color.g & 0x7ff) << 12) | (color.b & 0x7ff);
+    load_bp(0xe0 + (tev_regid << 1), ra);
+    load_bp(0xe1 + (tev_regid << 1), bg);
+    load_bp(0xe1 + (tev_regid << 1), bg);
+    load_bp(0xe1 + (tev_regid << 1), bg);
+}
+
+void GX_SetTevKColor(u8 sel, GXColor col)
+{
+    load_bp(0xe0 + (sel << 1), (col.a << 12) | col.r | 0x800000);
+    load_bp(0xe1 + (sel << 1), (col.g << 12) | col.b | 0x800000);
+}
+
+void GX_SetTevKColorSel(u8 tevstage, u8 sel)
+{
+    load_bp(0xf6 + (tevstage >> 1), sel << ((tevstage & 1) ? 14 : 4));
+}
+
+void GX_SetTevKAlphaSel(u8 tevstage, u8 sel)
+{
+    load_bp(0xf6 + (tevstage >> 1), sel << ((tevstage & 1) ? 19 : 9));
+}
+
+void GX_SetFog(u8 type, f32 startz, f32 endz, f32 nearz, f32 farz,
+               GXColor col)
+{
+    union {
+        f32 f;
+        u32 u;
+    } a = { endz - startz }, b = { farz - nearz };
+    load_bp(0xee, a.u >> 12);
+    load_bp(0xef, b.u >> 12);
+    load_bp(0xf0, (u32)nearz);
+    load_bp(0xf1, (u32)farz | (type << 21));
+    load_bp(0xf2, (col.r << 16) | (col.g << 8) | col.b);
+}
+
+void GX_SetZMode(u8 enable, u8 func, u8 update_enable)
+{
+    load_bp(0x40, (enable & 1) | ((func & 7) << 1) | ((update_enable & 1) << 4));
+}
+
+void GX_SetZCompLoc(u8 before_tex)
+{
+    load_bp(0x43, (before_tex & 1) << 6);
+}
+
+void GX_SetBlendMode(u8 type, u8 src_fact, u8 dst_fact, u8 op)
+{
+    load_bp(0x41, (type == GX_BM_BLEND || type == GX_BM_SUBTRACT) |
+                      ((type == GX_BM_LOGIC) << 1) | (dst_fact << 5) |
+                      (src_fact << 8) | ((type == GX_BM_SUBTRACT) << 11) |
+                      (op << 12));
+}
+
+void GX_SetAlphaCompare(u8 comp0, u8 ref0, u8 aop, u8 comp1, u8 ref1)
+{
+    load_bp(0xf3, ref0 | (ref1 << 8) | (comp0 << 16) | (comp1 << 19) |
+                      (aop << 22));
+}
+
+void GX_SetColorUpdate(u8 enable)
+{
+    load_bp(0x41, (enable & 1) << 3);
+}
+
+void GX_SetAlphaUpdate(u8 enable)
+{
+    load_bp(0x41, (enable & 1) << 4);
+}
+
+void GX_SetDstAlpha(u8 enable, u8 a)
+{
+    load_bp(0x42, a | ((enable & 1) << 8));
+}
+
+void GX_SetPixelFmt(u8 pix_fmt, u8 z_fmt)
+{
+    load_bp(0x43, pix_fmt | (z_fmt << 3));
+}
+
+void GX_SetPointSize(u8 width, u8 fmt)
+{
+    load_bp(0x22, (width << 8) | (fmt << 19));
+}
+
+void GX_SetLineWidth(u8 width, u8 fmt)
+{
+    load_bp(0x22, width | (fmt << 16));
+}
+
+void GX_ClearBoundingBox(void)
+{
+    load_bp(0x55, 0x3ff);
+    load_bp(0x56, 0x3ff);
+}
+
+void GX_ReadBoundingBox(u16 *top, u16 *bottom, u16 *left, u16 *right)
+{
+    /* Nothing is rasterized, so the box is always empty */
+    *top = *left = 1023;
+    *bottom = *right = 0;
+}
+
+void GX_SetCopyClear(GXColor color, u32 zvalue)
+{
+    load_bp(0x4f, (color.a << 8) | color.r);
+    load_bp(0x50, (color.g << 8) | color.b);
+    load_bp(0x51, zvalue & 0x00ffffff);
+}
+
+void GX_SetCopyFilter(u8 aa, u8 sample_pattern[12][2], u8 vf, u8 vfilter[7])
+{
+    for (int i = 0; i < 4; i++)
+        load_bp(0x01 + i, aa ? sample_pattern[i * 3][0] : 0x666666);
+    load_bp(0x53, vf ? vfilter[0] : 0x595000);
+    load_bp(0x54, vf ? vfilter[4] : 0x000015);
+}
+
+void GX_SetDispCopyGamma(u8 gamma) {}
+
+void GX_SetDispCopySrc(u16 left, u16 top, u16 wd, u16 ht)
+{
+    load_bp(0x49, left | (top << 10));
+    load_bp(0x4a, (wd - 1) | ((ht - 1) << 10));
+}
+
+void GX_SetDispCopyDst(u16 wd, u16 ht)
+{
+    load_bp(0x4d, wd >> 4);
+}
+
+void GX_CopyDisp(void *dest, u8 clear)
+{
+    load_bp(0x4b, (u32)(uintptr_t)dest >> 5);
+    load_bp(0x52, 0x4003 | (clear << 11));
+    s_stats.efb_copies++;
+}
+
+void GX_SetTexCopySrc(u16 left, u16 top, u16 wd, u16 ht)
+{
+    s_copy_src[0] = left;
+    s_copy_src[1] = top;
+    s_copy_src[2] = wd;
+    s_copy_src[3] = ht;
+}
+
+void GX_SetTexCopyDst(u16 wd, u16 ht, u32 fmt, u8 mipmap)
+{
+    s_copy_dst[0] = wd;
+    s_copy_dst[1] = ht;
+    s_copy_fmt = fmt;
+}
+
+void GX_CopyTex(void *dest, u8 clear)
+{
+    load_bp(0x49, s_copy_src[0] | (s_copy_src[1] << 10));
+    load_bp(0x4a, (s_copy_src[2] - 1) | ((s_copy_src[3] - 1) << 10));
+    load_bp(0x4d, GX_GetTexBufferSize(s_copy_dst[0], 4, s_copy_fmt, 0, 0) >> 5);
+    load_bp(0x4b, (u32)(uintptr_t)dest >> 5);
+    load_bp(0x52, ((s_copy_fmt & 0xf) << 4) | (clear << 11));
+    if (clear) {
+        /* libogc restores the Z mode and the blend mode after a clear */
+        load_bp(0x40, 0);
+        load_bp(0x41, 0);
+    }
+    s_stats.efb_copies++;
+}
@@ -0,0 +1,97 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+/* Inspection API of the host GX stand-in.
+ *
+ * Everything that opengx sends to the GX goes through the functions declared
+ * in <ogc/gx.h>; the host implementation appends the resulting command stream
+ * to an in-memory FIFO and keeps count of what was written. The functions in
+ * this file expose those counters and the recorded bytes, so that tools (like
+ * the benchmark) can measure the cost of the GL calls.
+ */
+
+#ifndef GX_HOST_H
+#define GX_HOST_H
+
+#include <gctypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    /* Bytes written to the GP FIFO (display list contents excluded) */
+    u64 fifo_bytes;
+    /* Bytes recorded into display lists */
+    u64 displist_bytes;
+    /* Register loads; XF writes are counted per register */
+    u64 bp_writes;
+    u64 cp_writes;
+    u64 xf_writes;
+    /* Number of GX_Begin() calls and of vertices they announced */
+    u64 primitives;
+    u64 vertices;
+    u64 displist_calls;
+    /* Size of the display lists executed via GX_CallDispList() */
+    u64 displist_call_bytes;
+    /* Bytes the GPU reads from the vertex arrays set with GX_SetArray(), for
+     * the indexed attributes (display lists excluded) */
+    u64 array_fetch_bytes;
+    /* Number of times the CPU waited for the GPU (GX_DrawDone() and
+     * GX_WaitDrawDone()) */
+    u64 draw_done_waits;
+    u64 draw_sync_tokens;
+    /* Calls to GX_GetDrawSync() made while the GPU had not yet reached the
+     * last token sent (only happens if a GPU latency has been set) */
+    u64 draw_sync_stalls;
+    u64 vtx_cache_invalidations;
+    u64 tex_invalidations;
+    u64 efb_copies;
+} GXHostStats;
+
+void GX_HostGetStats(GXHostStats *stats);
+void GX_HostResetStats(void);
+
+/* Returns the bytes written to the FIFO since the last call to
+ * GX_HostResetStats(), or the last part of them if the recording buffer
+ * wrapped around (in which case *wrapped is set). */
+const u8 *GX_HostGetFifo(u32 *size, bool *wrapped);
+
+/* Simulates a GPU running behind the CPU: a draw sync token is reached once
+ * the given amount of bytes has been sent to the GPU after it. While tokens
+ * are pending, each call to GX_GetDrawSync() lets the GPU advance by a few
+ * bytes, and GX_DrawDone() lets it catch up. 0, the default, means that
+ * tokens are reached as soon as they are sent. */
+void GX_HostSetGpuLatency(u32 bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GX_HOST_H */
@@ -0,0 +1,98 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+/* Host stand-in for libogc's <ogc/gu.h>: plain C versions of the matrix and
+ * vector helpers (libogc maps most of these to paired-single assembly). */
+
+#ifndef GX_HOST_OGC_GU_H
+#define GX_HOST_OGC_GU_H
+
+#include <gctypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define M_DTOR (3.14159265358979323846 / 180.0)
+#define DegToRad(a) ((a) * 0.01745329252f)
+#define RadToDeg(a) ((a) * 57.29577951f)
+
+typedef struct _vecf {
+    f32 x, y, z;
+} guVector;
+
+typedef struct _qrtn {
+    f32 x, y, z, w;
+} guQuaternion;
+
+typedef f32 Mtx[3][4];
+typedef f32 (*MtxP)[4];
+typedef f32 Mtx33[3][3];
+typedef f32 Mtx44[4][4];
+typedef f32 (*Mtx44P)[4];
+
+void guFrustum(Mtx44 mt, f32 t, f32 b, f32 l, f32 r, f32 n, f32 f);
+void guPerspective(Mtx44 mt, f32 fovy, f32 aspect, f32 n, f32 f);
+void guOrtho(Mtx44 mt, f32 t, f32 b, f32 l, f32 r, f32 n, f32 f);
+void guLookAt(Mtx mt, guVector *camPos, guVector *camUp, guVector *target);
+
+void guVecAdd(const guVector *a, const guVector *b, guVector *ab);
+void guVecSub(const guVector *a, const guVector *b, guVector *ab);
+void guVecScale(const guVector *src, guVector *dst, f32 scale);
+void guVecNormalize(guVector *v);
+void guVecCross(const guVector *a, const guVector *b, guVector *axb);
+f32 guVecDotProduct(const guVector *a, const guVector *b);
+void guVecMultiply(const Mtx mt, const guVector *src, guVector *dst);
+void guVecMultiplySR(const Mtx mt, const guVector *src, guVector *dst);
+
+void guMtxIdentity(Mtx mt);
+void guMtxCopy(const Mtx src, Mtx dst);
+void guMtxConcat(const Mtx a, const Mtx b, Mtx ab);
+void guMtxScale(Mtx mt, f32 xS, f32 yS, f32 zS);
+void guMtxScaleApply(const Mtx src, Mtx dst, f32 xS, f32 yS, f32 zS);
+void guMtxApplyScale(const Mtx src, Mtx dst, f32 xS, f32 yS, f32 zS);
+void guMtxTrans(Mtx mt, f32 xT, f32 yT, f32 zT);
+void guMtxTransApply(const Mtx src, Mtx dst, f32 xT, f32 yT, f32 zT);
+void guMtxApplyTrans(const Mtx src, Mtx dst, f32 xT, f32 yT, f32 zT);
+u32 guMtxInverse(const Mtx src, Mtx inv);
+void guMtxTranspose(const Mtx src, Mtx xPose);
+void guMtxRotAxisRad(Mtx mt, const guVector *axis, f32 rad);
+
+#define guMtxRotAxisDeg(mt, axis, deg) guMtxRotAxisRad(mt, axis, DegToRad(deg))
+
+void guMtx44Identity(Mtx44 mt);
+void guMtx44Copy(const Mtx44 src, Mtx44 dst);
+void guMtx44Concat(const Mtx44 a, const Mtx44 b, Mtx44 ab);
+u32 guMtx44Inverse(const Mtx44 src, Mtx44 inv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GX_HOST_OGC_GU_H */
@@ -0,0 +1,1091 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+/* Host stand-in for libogc's <ogc/gx.h>.
+ *
+ * Only the subset of the GX API used by opengx is provided. The constants
+ * have the same values as in libogc, so that the command stream produced on
+ * the host is byte-compatible with the one produced on the console; the
+ * functions are implemented in host/gx.c, where they write the commands into
+ * a recorded FIFO and keep count of the register writes (see gx_host.h).
+ */
+
+#ifndef GX_HOST_OGC_GX_H
+#define GX_HOST_OGC_GX_H
+
+#include <gctypes.h>
+#include <ogc/gu.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GX_FALSE 0
+#define GX_TRUE 1
+#define GX_DISABLE 0
+#define GX_ENABLE 1
+
+#define GX_FIFO_MINSIZE (64 * 1024)
+
+#define GX_CLIP_DISABLE 1
+#define GX_CLIP_ENABLE 0
+
+/* Primitives */
+#define GX_POINTS 0xB8
+#define GX_LINES 0xA8
+#define GX_LINESTRIP 0xB0
+#define GX_TRIANGLES 0x90
+#define GX_TRIANGLESTRIP 0x98
+#define GX_TRIANGLEFAN 0xA0
+#define GX_QUADS 0x80
+
+#define GX_SRC_REG 0
+#define GX_SRC_VTX 1
+
+#define GX_LIGHT0 0x001
+#define GX_LIGHT1 0x002
+#define GX_LIGHT2 0x004
+#define GX_LIGHT3 0x008
+#define GX_LIGHT4 0x010
+#define GX_LIGHT5 0x020
+#define GX_LIGHT6 0x040
+#define GX_LIGHT7 0x080
+#define GX_MAXLIGHT 0x100
+#define GX_LIGHTNULL 0x000
+
+#define GX_DF_NONE 0
+#define GX_DF_SIGNED 1
+#define GX_DF_CLAMP 2
+
+#define GX_AF_SPEC 0
+#define GX_AF_SPOT 1
+#define GX_AF_NONE 2
+
+#define GX_PNMTX0 0
+#define GX_PNMTX1 3
+#define GX_PNMTX2 6
+#define GX_PNMTX3 9
+#define GX_PNMTX4 12
+#define GX_PNMTX5 15
+#define GX_PNMTX6 18
+#define GX_PNMTX7 21
+#define GX_PNMTX8 24
+#define GX_PNMTX9 27
+
+#define GX_TEXMTX0 30
+#define GX_TEXMTX1 33
+#define GX_TEXMTX2 36
+#define GX_TEXMTX3 39
+#define GX_TEXMTX4 42
+#define GX_TEXMTX5 45
+#define GX_TEXMTX6 48
+#define GX_TEXMTX7 51
+#define GX_TEXMTX8 54
+#define GX_TEXMTX9 57
+#define GX_IDENTITY 60
+
+#define GX_DTTMTX0 64
+#define GX_DTTMTX1 67
+#define GX_DTTMTX2 70
+#define GX_DTTMTX3 73
+#define GX_DTTMTX4 76
+#define GX_DTTMTX5 79
+#define GX_DTTMTX6 82
+#define GX_DTTMTX7 85
+#define GX_DTTMTX8 88
+#define GX_DTTMTX9 91
+#define GX_DTTMTX10 94
+#define GX_DTTMTX11 97
+#define GX_DTTMTX12 100
+#define GX_DTTMTX13 103
+#define GX_DTTMTX14 106
+#define GX_DTTMTX15 109
+#define GX_DTTMTX16 112
+#define GX_DTTMTX17 115
+#define GX_DTTMTX18 118
+#define GX_DTTMTX19 121
+#define GX_DTTIDENTITY 125
+
+#define GX_MTX3x4 0
+#define GX_MTX2x4 1
+
+/* Vertex attributes */
+#define GX_VA_PTNMTXIDX 0
+#define GX_VA_TEX0MTXIDX 1
+#define GX_VA_TEX1MTXIDX 2
+#define GX_VA_TEX2MTXIDX 3
+#define GX_VA_TEX3MTXIDX 4
+#define GX_VA_TEX4MTXIDX 5
+#define GX_VA_TEX5MTXIDX 6
+#define GX_VA_TEX6MTXIDX 7
+#define GX_VA_TEX7MTXIDX 8
+#define GX_VA_POS 9
+#define GX_VA_NRM 10
+#define GX_VA_CLR0 11
+#define GX_VA_CLR1 12
+#define GX_VA_TEX0 13
+#define GX_VA_TEX1 14
+#define GX_VA_TEX2 15
+#define GX_VA_TEX3 16
+#define GX_VA_TEX4 17
+#define GX_VA_TEX5 18
+#define GX_VA_TEX6 19
+#define GX_VA_TEX7 20
+#define GX_POSMTXARRAY 21
+#define GX_NRMMTXARRAY 22
+#define GX_TEXMTXARRAY 23
+#define GX_LIGHTARRAY 24
+#define GX_VA_NBT 25
+#define GX_VA_MAXATTR 26
+#define GX_VA_NULL 0xff
+
+#define GX_NONE 0
+#define GX_DIRECT 1
+#define GX_INDEX8 2
+#define GX_INDEX16 3
+
+#define GX_U8 0
+#define GX_S8 1
+#define GX_U16 2
+#define GX_S16 3
+#define GX_F32 4
+#define GX_RGB565 0
+#define GX_RGB8 1
+#define GX_RGBX8 2
+#define GX_RGBA4 3
+#define GX_RGBA6 4
+#define GX_RGBA8 5
+
+#define GX_POS_XY 0
+#define GX_POS_XYZ 1
+#define GX_NRM_XYZ 0
+#define GX_NRM_NBT 1
+#define GX_NRM_NBT3 2
+#define GX_CLR_RGB 0
+#define GX_CLR_RGBA 1
+#define GX_TEX_S 0
+#define GX_TEX_ST 1
+
+#define GX_VTXFMT0 0
+#define GX_VTXFMT1 1
+#define GX_VTXFMT2 2
+#define GX_VTXFMT3 3
+#define GX_VTXFMT4 4
+#define GX_VTXFMT5 5
+#define GX_VTXFMT6 6
+#define GX_VTXFMT7 7
+#define GX_MAXVTXFMT 8
+
+/* Texture coordinate generation */
+#define GX_TG_MTX3x4 0
+#define GX_TG_MTX2x4 1
+#define GX_TG_BUMP0 2
+#define GX_TG_BUMP1 3
+#define GX_TG_BUMP2 4
+#define GX_TG_BUMP3 5
+#define GX_TG_BUMP4 6
+#define GX_TG_BUMP5 7
+#define GX_TG_BUMP6 8
+#define GX_TG_BUMP7 9
+#define GX_TG_SRTG 10
+
+#define GX_TG_POS 0
+#define GX_TG_NRM 1
+#define GX_TG_BINRM 2
+#define GX_TG_TANGENT 3
+#define GX_TG_TEX0 4
+#define GX_TG_TEX1 5
+#define GX_TG_TEX2 6
+#define GX_TG_TEX3 7
+#define GX_TG_TEX4 8
+#define GX_TG_TEX5 9
+#define GX_TG_TEX6 10
+#define GX_TG_TEX7 11
+#define GX_TG_TEXCOORD0 12
+#define GX_TG_TEXCOORD1 13
+#define GX_TG_TEXCOORD2 14
+#define GX_TG_TEXCOORD3 15
+#define GX_TG_TEXCOORD4 16
+#define GX_TG_TEXCOORD5 17
+#define GX_TG_TEXCOORD6 18
+#define GX_TG_COLOR0 19
+#define GX_TG_COLOR1 20
+
+#define GX_TEXCOORD0 0x0
+#define GX_TEXCOORD1 0x1
+#define GX_TEXCOORD2 0x2
+#define GX_TEXCOORD3 0x3
+#define GX_TEXCOORD4 0x4
+#define GX_TEXCOORD5 0x5
+#define GX_TEXCOORD6 0x6
+#define GX_TEXCOORD7 0x7
+#define GX_MAXCOORD 0x8
+#define GX_TEXCOORDNULL 0xff
+
+#define GX_TEXMAP0 0
+#define GX_TEXMAP1 1
+#define GX_TEXMAP2 2
+#define GX_TEXMAP3 3
+#define GX_TEXMAP4 4
+#define GX_TEXMAP5 5
+#define GX_TEXMAP6 6
+#define GX_TEXMAP7 7
+#define GX_MAX_TEXMAP 8
+#define GX_TEXCACHE_32K 0x00
+#define GX_TEXCACHE_128K 0x01
+#define GX_TEXCACHE_512K 0x02
+#define GX_TEXCACHE_NONE 0x03
+#define GX_TEXMAP_NULL 0xff
+#define GX_TEXMAP_DISABLE 0x100
+
+/* Lighting channels */
+#define GX_COLOR0 0
+#define GX_COLOR1 1
+#define GX_ALPHA0 2
+#define GX_ALPHA1 3
+#define GX_COLOR0A0 4
+#define GX_COLOR1A1 5
+#define GX_COLORZERO 6
+#define GX_ALPHA_BUMP 7
+#define GX_ALPHA_BUMPN 8
+#define GX_COLORNULL 0xff
+
+/* Texture formats */
+#define _GX_TF_ZTF 0x10
+#define _GX_TF_CTF 0x20
+
+#define GX_TF_I4 0x0
+#define GX_TF_I8 0x1
+#define GX_TF_IA4 0x2
+#define GX_TF_IA8 0x3
+#define GX_TF_RGB565 0x4
+#define GX_TF_RGB5A3 0x5
+#define GX_TF_RGBA8 0x6
+#define GX_TF_CI4 0x8
+#define GX_TF_CI8 0x9
+#define GX_TF_CI14 0xa
+#define GX_TF_CMPR 0xE
+
+#define GX_TL_IA8 0x00
+#define GX_TL_RGB565 0x01
+#define GX_TL_RGB5A3 0x02
+
+#define GX_CTF_R4 (0x0 | _GX_TF_CTF)
+#define GX_CTF_RA4 (0x2 | _GX_TF_CTF)
+#define GX_CTF_RA8 (0x3 | _GX_TF_CTF)
+#define GX_CTF_YUVA8 (0x6 | _GX_TF_CTF)
+#define GX_CTF_A8 (0x7 | _GX_TF_CTF)
+#define GX_CTF_R8 (0x8 | _GX_TF_CTF)
+#define GX_CTF_G8 (0x9 | _GX_TF_CTF)
+#define GX_CTF_B8 (0xA | _GX_TF_CTF)
+#define GX_CTF_RG8 (0xB | _GX_TF_CTF)
+#define GX_CTF_GB8 (0xC | _GX_TF_CTF)
+
+#define GX_TF_Z8 (0x1 | _GX_TF_ZTF)
+#define GX_TF_Z16 (0x3 | _GX_TF_ZTF)
+#define GX_TF_Z24X8 (0x6 | _GX_TF_ZTF)
+
+#define GX_CTF_Z4 (0x0 | _GX_TF_ZTF | _GX_TF_CTF)
+#define GX_CTF_Z8M (0x9 | _GX_TF_ZTF | _GX_TF_CTF)
+#define GX_CTF_Z8L (0xA | _GX_TF_ZTF | _GX_TF_CTF)
+#define GX_CTF_Z16L (0xC | _GX_TF_ZTF | _GX_TF_CTF)
+
+#define GX_TF_A8 GX_CTF_A8
+
+#define GX_TLUT0 0
+#define GX_TLUT1 1
+#define GX_TLUT2 2
+#define GX_TLUT3 3
+#define GX_TLUT4 4
+#define GX_TLUT5 5
+#define GX_TLUT6 6
+#define GX_TLUT7 7
+#define GX_TLUT8 8
+#define GX_TLUT9 9
+#define GX_TLUT10 10
+#define GX_TLUT11 11
+#define GX_TLUT12 12
+#define GX_TLUT13 13
+#define GX_TLUT14 14
+#define GX_TLUT15 15
+#define GX_BIGTLUT0 16
+#define GX_BIGTLUT1 17
+#define GX_BIGTLUT2 18
+#define GX_BIGTLUT3 19
+
+#define GX_TLUT_16 1
+#define GX_TLUT_32 2
+#define GX_TLUT_64 4
+#define GX_TLUT_128 8
+#define GX_TLUT_256 16
+#define GX_TLUT_512 32
+#define GX_TLUT_1K 64
+#define GX_TLUT_2K 128
+#define GX_TLUT_4K 256
+#define GX_TLUT_8K 512
+#define GX_TLUT_16K 1024
+
+#define GX_ZT_DISABLE 0
+#define GX_ZT_ADD 1
+#define GX_ZT_REPLACE 2
+#define GX_MAX_ZTEXOP 3
+
+#define GX_CLAMP 0
+#define GX_REPEAT 1
+#define GX_MIRROR 2
+#define GX_MAXTEXWRAPMODE 3
+
+#define GX_NEAR 0
+#define GX_LINEAR 1
+#define GX_NEAR_MIP_NEAR 2
+#define GX_LIN_MIP_NEAR 3
+#define GX_NEAR_MIP_LIN 4
+#define GX_LIN_MIP_LIN 5
+
+#define GX_ANISO_1 0
+#define GX_ANISO_2 1
+#define GX_ANISO_4 2
+#define GX_MAX_ANISOTROPY 3
+
+/* Pixel engine */
+#define GX_PF_RGB8_Z24 0
+#define GX_PF_RGBA6_Z24 1
+#define GX_PF_RGB565_Z16 2
+#define GX_PF_Z24 3
+#define GX_PF_Y8 4
+#define GX_PF_U8 5
+#define GX_PF_V8 6
+#define GX_PF_YUV420 7
+
+#define GX_ZC_LINEAR 0
+#define GX_ZC_NEAR 1
+#define GX_ZC_MID 2
+#define GX_ZC_FAR 3
+
+#define GX_PERSPECTIVE 0
+#define GX_ORTHOGRAPHIC 1
+
+#define GX_GM_1_0 0
+#define GX_GM_1_7 1
+#define GX_GM_2_2 2
+
+#define GX_TO_ZERO 0
+#define GX_TO_SIXTEENTH 1
+#define GX_TO_EIGHTH 2
+#define GX_TO_FOURTH 3
+#define GX_TO_HALF 4
+#define GX_TO_ONE 5
+#define GX_MAX_TEXOFFSET 6
+
+#define GX_NEVER 0
+#define GX_LESS 1
+#define GX_EQUAL 2
+#define GX_LEQUAL 3
+#define GX_GREATER 4
+#define GX_NEQUAL 5
+#define GX_GEQUAL 6
+#define GX_ALWAYS 7
+
+#define GX_AOP_AND 0
+#define GX_AOP_OR 1
+#define GX_AOP_XOR 2
+#define GX_AOP_XNOR 3
+#define GX_MAX_ALPHAOP 4
+
+#define GX_BM_NONE 0
+#define GX_BM_BLEND 1
+#define GX_BM_LOGIC 2
+#define GX_BM_SUBTRACT 3
+#define GX_MAX_BLENDMODE 4
+
+#define GX_BL_ZERO 0
+#define GX_BL_ONE 1
+#define GX_BL_SRCCLR 2
+#define GX_BL_INVSRCCLR 3
+#define GX_BL_SRCALPHA 4
+#define GX_BL_INVSRCALPHA 5
+#define GX_BL_DSTALPHA 6
+#define GX_BL_INVDSTALPHA 7
+#define GX_BL_DSTCLR GX_BL_SRCCLR
+#define GX_BL_INVDSTCLR GX_BL_INVSRCCLR
+
+#define GX_LO_CLEAR 0
+#define GX_LO_AND 1
+#define GX_LO_REVAND 2
+#define GX_LO_COPY 3
+#define GX_LO_INVAND 4
+#define GX_LO_NOOP 5
+#define GX_LO_XOR 6
+#define GX_LO_OR 7
+#define GX_LO_NOR 8
+#define GX_LO_EQUIV 9
+#define GX_LO_INV 10
+#define GX_LO_REVOR 11
+#define GX_LO_INVCOPY 12
+#define GX_LO_INVOR 13
+#define GX_LO_NAND 14
+#define GX_LO_SET 15
+
+#define GX_CULL_NONE 0
+#define GX_CULL_FRONT 1
+#define GX_CULL_BACK 2
+#define GX_CULL_ALL 3
+
+#define GX_FOG_NONE 0
+#define GX_FOG_PERSP_LIN 2
+#define GX_FOG_PERSP_EXP 4
+#define GX_FOG_PERSP_EXP2 5
+#define GX_FOG_PERSP_REVEXP 6
+#define GX_FOG_PERSP_REVEXP2 7
+#define GX_FOG_ORTHO_LIN 10
+#define GX_FOG_ORTHO_EXP 12
+#define GX_FOG_ORTHO_EXP2 13
+#define GX_FOG_ORTHO_REVEXP 14
+#define GX_FOG_ORTHO_REVEXP2 15
+#define GX_FOG_LIN GX_FOG_PERSP_LIN
+#define GX_FOG_EXP GX_FOG_PERSP_EXP
+#define GX_FOG_EXP2 GX_FOG_PERSP_EXP2
+#define GX_FOG_REVEXP GX_FOG_PERSP_REVEXP
+#define GX_FOG_REVEXP2 GX_FOG_PERSP_REVEXP2
+
+/* Texture environment */
+#define GX_MODULATE 0
+#define GX_DECAL 1
+#define GX_BLEND 2
+#define GX_REPLACE 3
+#define GX_PASSCLR 4
+
+#define GX_CC_CPREV 0
+#define GX_CC_APREV 1
+#define GX_CC_C0 2
+#define GX_CC_A0 3
+#define GX_CC_C1 4
+#define GX_CC_A1 5
+#define GX_CC_C2 6
+#define GX_CC_A2 7
+#define GX_CC_TEXC 8
+#define GX_CC_TEXA 9
+#define GX_CC_RASC 10
+#define GX_CC_RASA 11
+#define GX_CC_ONE 12
+#define GX_CC_HALF 13
+#define GX_CC_KONST 14
+#define GX_CC_ZERO 15
+
+#define GX_CA_APREV 0
+#define GX_CA_A0 1
+#define GX_CA_A1 2
+#define GX_CA_A2 3
+#define GX_CA_TEXA 4
+#define GX_CA_RASA 5
+#define GX_CA_KONST 6
+#define GX_CA_ZERO 7
+
+#define GX_TEVSTAGE0 0
+#define GX_TEVSTAGE1 1
+#define GX_TEVSTAGE2 2
+#define GX_TEVSTAGE3 3
+#define GX_TEVSTAGE4 4
+#define GX_TEVSTAGE5 5
+#define GX_TEVSTAGE6 6
+#define GX_TEVSTAGE7 7
+#define GX_TEVSTAGE8 8
+#define GX_TEVSTAGE9 9
+#define GX_TEVSTAGE10 10
+#define GX_TEVSTAGE11 11
+#define GX_TEVSTAGE12 12
+#define GX_TEVSTAGE13 13
+#define GX_TEVSTAGE14 14
+#define GX_TEVSTAGE15 15
+#define GX_MAX_TEVSTAGE 16
+
+#define GX_TEV_ADD 0
+#define GX_TEV_SUB 1
+#define GX_TEV_COMP_R8_GT 8
+#define GX_TEV_COMP_R8_EQ 9
+#define GX_TEV_COMP_GR16_GT 10
+#define GX_TEV_COMP_GR16_EQ 11
+#define GX_TEV_COMP_BGR24_GT 12
+#define GX_TEV_COMP_BGR24_EQ 13
+#define GX_TEV_COMP_RGB8_GT 14
+#define GX_TEV_COMP_RGB8_EQ 15
+#define GX_TEV_COMP_A8_GT GX_TEV_COMP_RGB8_GT
+#define GX_TEV_COMP_A8_EQ GX_TEV_COMP_RGB8_EQ
+
+#define GX_TB_ZERO 0
+#define GX_TB_ADDHALF 1
+#define GX_TB_SUBHALF 2
+#define GX_MAX_TEVBIAS 3
+
+#define GX_CS_SCALE_1 0
+#define GX_CS_SCALE_2 1
+#define GX_CS_SCALE_4 2
+#define GX_CS_DIVIDE_2 3
+#define GX_MAX_TEVSCALE 4
+
+#define GX_TEVPREV 0
+#define GX_TEVREG0 1
+#define GX_TEVREG1 2
+#define GX_TEVREG2 3
+#define GX_MAX_TEVREG 4
+
+#define GX_KCOLOR0 0
+#define GX_KCOLOR1 1
+#define GX_KCOLOR2 2
+#define GX_KCOLOR3 3
+#define GX_KCOLOR_MAX 4
+
+#define GX_TEV_KCSEL_1 0x00
+#define GX_TEV_KCSEL_7_8 0x01
+#define GX_TEV_KCSEL_3_4 0x02
+#define GX_TEV_KCSEL_5_8 0x03
+#define GX_TEV_KCSEL_1_2 0x04
+#define GX_TEV_KCSEL_3_8 0x05
+#define GX_TEV_KCSEL_1_4 0x06
+#define GX_TEV_KCSEL_1_8 0x07
+#define GX_TEV_KCSEL_K0 0x0C
+#define GX_TEV_KCSEL_K1 0x0D
+#define GX_TEV_KCSEL_K2 0x0E
+#define GX_TEV_KCSEL_K3 0x0F
+#define GX_TEV_KCSEL_K0_R 0x10
+#define GX_TEV_KCSEL_K1_R 0x11
+#define GX_TEV_KCSEL_K2_R 0x12
+#define GX_TEV_KCSEL_K3_R 0x13
+#define GX_TEV_KCSEL_K0_G 0x14
+#define GX_TEV_KCSEL_K1_G 0x15
+#define GX_TEV_KCSEL_K2_G 0x16
+#define GX_TEV_KCSEL_K3_G 0x17
+#define GX_TEV_KCSEL_K0_B 0x18
+#define GX_TEV_KCSEL_K1_B 0x19
+#define GX_TEV_KCSEL_K2_B 0x1A
+#define GX_TEV_KCSEL_K3_B 0x1B
+#define GX_TEV_KCSEL_K0_A 0x1C
+#define GX_TEV_KCSEL_K1_A 0x1D
+#define GX_TEV_KCSEL_K2_A 0x1E
+#define GX_TEV_KCSEL_K3_A 0x1F
+
+#define GX_TEV_KASEL_1 0x00
+#define GX_TEV_KASEL_7_8 0x01
+#define GX_TEV_KASEL_3_4 0x02
+#define GX_TEV_KASEL_5_8 0x03
+#define GX_TEV_KASEL_1_2 0x04
+#define GX_TEV_KASEL_3_8 0x05
+#define GX_TEV_KASEL_1_4 0x06
+#define GX_TEV_KASEL_1_8 0x07
+#define GX_TEV_KASEL_K0_R 0x10
+#define GX_TEV_KASEL_K1_R 0x11
+#define GX_TEV_KASEL_K2_R 0x12
+#define GX_TEV_KASEL_K3_R 0x13
+#define GX_TEV_KASEL_K0_G 0x14
+#define GX_TEV_KASEL_K1_G 0x15
+#define GX_TEV_KASEL_K2_G 0x16
+#define GX_TEV_KASEL_K3_G 0x17
+#define GX_TEV_KASEL_K0_B 0x18
+#define GX_TEV_KASEL_K1_B 0x19
+#define GX_TEV_KASEL_K2_B 0x1A
+#define GX_TEV_KASEL_K3_B 0x1B
+#define GX_TEV_KASEL_K0_A 0x1C
+#define GX_TEV_KASEL_K1_A 0x1D
+#define GX_TEV_KASEL_K2_A 0x1E
+#define GX_TEV_KASEL_K3_A 0x1F
+
+/* Command processor opcodes, as they appear in the FIFO */
+#define GX_NOP 0x00
+#define GX_LOAD_BP_REG 0x61
+#define GX_LOAD_CP_REG 0x08
+#define GX_LOAD_XF_REG 0x10
+#define GX_LOAD_INDX_A 0x20
+#define GX_LOAD_INDX_B 0x28
+#define GX_LOAD_INDX_C 0x30
+#define GX_LOAD_INDX_D 0x38
+#define GX_CMD_CALL_DL 0x40
+#define GX_CMD_INVL_VC 0x48
+
+typedef struct _gx_color {
+    u8 r;
+    u8 g;
+    u8 b;
+    u8 a;
+} GXColor;
+
+typedef struct _gx_colors10 {
+    s16 r;
+    s16 g;
+    s16 b;
+    s16 a;
+} GXColorS10;
+
+/* On the console these are opaque blobs of packed register values; here we
+ * keep the parameters in plain form, since we need to store host pointers. */
+typedef struct _gx_texobj {
+    void *img_ptr;
+    void *user_data;
+    u16 width, height;
+    u8 format, wrap_s, wrap_t, mipmap;
+    u8 min_filter, mag_filter;
+    u8 bias_clamp, edge_lod, max_aniso;
+    u8 tlut_name;
+    f32 min_lod, max_lod, lod_bias;
+} GXTexObj;
+
+typedef struct _gx_tlutobj {
+    void *lut_ptr;
+    u8 format;
+    u16 entries;
+} GXTlutObj;
+
+typedef struct _gx_texreg {
+    u32 tmem_even, tmem_odd;
+    u8 size_even, size_odd;
+    u8 is_32b_mipmap, is_cached;
+} GXTexRegion;
+
+typedef struct _gx_litobj {
+    f32 pos[3];
+    f32 dir[3];
+    f32 a[3];
+    f32 k[3];
+    GXColor color;
+} GXLightObj;
+
+typedef struct _gx_fifoobj {
+    u8 pad[128];
+} GXFifoObj;
+
+typedef void (*GXDrawSyncCallback)(u16 token);
+typedef void (*GXDrawDoneCallback)(void);
+typedef GXTexRegion *(*GXTexRegionCallback)(const GXTexObj *obj, u8 mapid);
+
+/* FIFO writers. These are what the inline vertex functions (and, in C++,
+ * wgPipe) use to emit data; the stream is big-endian, like on the console. */
+extern u8 *__gx_host_wptr;
+extern u8 *__gx_host_wend;
+void __GX_HostFifoOverflow(void);
+
+static inline void __GX_HostPut8(u8 v)
+{
+    if (__builtin_expect(__gx_host_wptr >= __gx_host_wend, 0))
+        __GX_HostFifoOverflow();
+    *__gx_host_wptr++ = v;
+}
+
+/* On the console a FIFO write is a single store; check the space only once
+ * per value, so that the benchmark is not dominated by the writers. */
+static inline void __GX_HostPut16(u16 v)
+{
+    if (__builtin_expect(__gx_host_wend - __gx_host_wptr < 2, 0))
+        __GX_HostFifoOverflow();
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap16(v);
+#endif
+    memcpy(__gx_host_wptr, &v, 2);
+    __gx_host_wptr += 2;
+}
+
+static inline void __GX_HostPut32(u32 v)
+{
+    if (__builtin_expect(__gx_host_wend - __gx_host_wptr < 4, 0))
+        __GX_HostFifoOverflow();
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    memcpy(__gx_host_wptr, &v, 4);
+    __gx_host_wptr += 4;
+}
+
+static inline void __GX_HostPutF32(f32 v)
+{
+    union {
+        f32 f;
+        u32 u;
+    } c;
+    c.f = v;
+    __GX_HostPut32(c.u);
+}
+
+GXFifoObj *GX_Init(void *base, u32 size);
+void GX_Flush(void);
+void GX_AbortFrame(void);
+
+void GX_SetDrawDone(void);
+void GX_WaitDrawDone(void);
+void GX_DrawDone(void);
+void GX_SetDrawSync(u16 token);
+u16 GX_GetDrawSync(void);
+GXDrawSyncCallback GX_SetDrawSyncCallback(GXDrawSyncCallback cb);
+GXDrawDoneCallback GX_SetDrawDoneCallback(GXDrawDoneCallback cb);
+void GX_PixModeSync(void);
+void GX_TexModeSync(void);
+
+/* Vertex format */
+void GX_ClearVtxDesc(void);
+void GX_SetVtxDesc(u8 attr, u8 type);
+void GX_SetVtxAttrFmt(u8 vtxfmt, u32 vtxattr, u32 comptype, u32 compsize,
+                      u32 frac);
+void GX_SetArray(u32 attr, void *ptr, u8 stride);
+void GX_InvVtxCache(void);
+
+void GX_Begin(u8 primitve, u8 vtxfmt, u16 vtxcnt);
+static inline void GX_End(void) {}
+
+/* Display lists */
+void GX_BeginDispList(void *list, u32 size);
+u32 GX_EndDispList(void);
+void GX_CallDispList(void *list, u32 nbytes);
+
+/* Transform unit */
+void GX_LoadPosMtxImm(const Mtx mt, u32 pnidx);
+void GX_LoadNrmMtxImm(const Mtx mt, u32 pnidx);
+void GX_LoadTexMtxImm(const Mtx mt, u32 texidx, u8 type);
+void GX_LoadProjectionMtx(const Mtx44 mt, u8 type);
+void GX_SetCurrentMtx(u32 mtx);
+void GX_SetViewport(f32 xOrig, f32 yOrig, f32 wd, f32 ht, f32 nearZ,
+                    f32 farZ);
+void GX_SetScissor(u32 xOrigin, u32 yOrigin, u32 wd, u32 ht);
+void GX_SetCullMode(u8 mode);
+void GX_SetClipMode(u8 mode);
+
+/* Lighting */
+void GX_SetNumChans(u8 num);
+void GX_SetChanCtrl(s32 channel, u8 enable, u8 ambsrc, u8 matsrc, u8 litmask,
+                    u8 diff_fn, u8 attn_fn);
+void GX_SetChanAmbColor(s32 channel, GXColor color);
+void GX_SetChanMatColor(s32 channel, GXColor color);
+void GX_InitLightPos(GXLightObj *lit_obj, f32 x, f32 y, f32 z);
+void GX_InitLightDir(GXLightObj *lit_obj, f32 nx, f32 ny, f32 nz);
+void GX_InitLightColor(GXLightObj *lit_obj, GXColor col);
+void GX_InitLightAttn(GXLightObj *lit_obj, f32 a0, f32 a1, f32 a2, f32 k0,
+                      f32 k1, f32 k2);
+void GX_InitSpecularDir(GXLightObj *lit_obj, f32 nx, f32 ny, f32 nz);
+void GX_LoadLightObj(GXLightObj *lit_obj, u8 lit_id);
+
+#define GX_InitLightPosv(lo, vec) \
+    (GX_InitLightPos((lo), ((f32 *)(vec))[0], ((f32 *)(vec))[1], \
+                     ((f32 *)(vec))[2]))
+#define GX_InitLightDirv(lo, vec) \
+    (GX_InitLightDir((lo), ((f32 *)(vec))[0], ((f32 *)(vec))[1], \
+                     ((f32 *)(vec))[2]))
+#define GX_InitSpecularDirv(lo, vec) \
+    (GX_InitSpecularDir((lo), ((f32 *)(vec))[0], ((f32 *)(vec))[1], \
+                        ((f32 *)(vec))[2]))
+#define GX_InitLightShininess(lobj, shininess) \
+    (GX_InitLightAttn(lobj, 0.0F, 0.0F, 1.0F, (shininess) / 2.0F, 0.0F, \
+                      1.0F - (shininess) / 2.0F))
+
+/* Texture coordinate generation */
+void GX_SetNumTexGens(u32 nr);
+void GX_SetTexCoordGen2(u16 texcoord, u32 tgen_typ, u32 tgen_src, u32 mtxsrc,
+                        u32 normalize, u32 postmtx);
+#define GX_SetTexCoordGen(texcoord, tgen_typ, tgen_src, mtxsrc) \
+    GX_SetTexCoordGen2((texcoord), (tgen_typ), (tgen_src), (mtxsrc), \
+                       GX_FALSE, GX_DTTIDENTITY)
+void GX_EnableTexOffsets(u8 coord, u8 line_enable, u8 point_enable);
+
+/* Textures */
+void GX_InitTexObj(GXTexObj *obj, void *img_ptr, u16 wd, u16 ht, u8 fmt,
+                   u8 wrap_s, u8 wrap_t, u8 mipmap);
+void GX_InitTexObjCI(GXTexObj *obj, void *img_ptr, u16 wd, u16 ht, u8 fmt,
+                     u8 wrap_s, u8 wrap_t, u8 mipmap, u32 tlut_name);
+void GX_InitTexObjLOD(GXTexObj *obj, u8 minfilt, u8 magfilt, f32 minlod,
+                      f32 maxlod, f32 lodbias, u8 biasclamp, u8 edgelod,
+                      u8 maxaniso);
+void GX_InitTexObjFilterMode(GXTexObj *obj, u8 minfilt, u8 magfilt);
+void GX_InitTexObjWrapMode(GXTexObj *obj, u8 wrap_s, u8 wrap_t);
+void GX_InitTexObjData(GXTexObj *obj, void *img_ptr);
+void GX_InitTexObjTlut(GXTexObj *obj, u32 tlut_name);
+void GX_InitTexObjUserData(GXTexObj *obj, void *userdata);
+void *GX_GetTexObjUserData(const GXTexObj *obj);
+void GX_GetTexObjAll(const GXTexObj *obj, void **image_ptr, u16 *width,
+                     u16 *height, u8 *format, u8 *wrap_s, u8 *wrap_t,
+                     u8 *mipmap);
+void *GX_GetTexObjData(const GXTexObj *obj);
+u16 GX_GetTexObjWidth(const GXTexObj *obj);
+u16 GX_GetTexObjHeight(const GXTexObj *obj);
+u32 GX_GetTexObjFmt(const GXTexObj *obj);
+u8 GX_GetTexObjWrapS(const GXTexObj *obj);
+u8 GX_GetTexObjWrapT(const GXTexObj *obj);
+u8 GX_GetTexObjMipMap(const GXTexObj *obj);
+void GX_GetTexObjFilterMode(const GXTexObj *obj, u8 *minfilt, u8 *magfilt);
+void GX_GetTexObjLOD(const GXTexObj *obj, f32 *minlod, f32 *maxlod);
+u32 GX_GetTexObjTlut(const GXTexObj *obj);
+void GX_LoadTexObj(GXTexObj *obj, u8 mapid);
+u32 GX_GetTexBufferSize(u16 wd, u16 ht, u32 fmt, u8 mipmap, u8 maxlod);
+void GX_InvalidateTexAll(void);
+void GX_InitTexCacheRegion(GXTexRegion *region, u8 is32bmipmap,
+                           u32 tmem_even, u8 size_even, u32 tmem_odd,
+                           u8 size_odd);
+void GX_InvalidateTexRegion(GXTexRegion *region);
+GXTexRegionCallback GX_SetTexRegionCallback(GXTexRegionCallback cb);
+void GX_InitTlutObj(GXTlutObj *obj, void *lut, u8 fmt, u16 entries);
+void GX_LoadTlut(GXTlutObj *obj, u32 tlut_name);
+void GX_SetZTexture(u8 op, u8 fmt, u32 bias);
+
+/* Texture environment */
+void GX_SetNumTevStages(u8 num);
+void GX_SetTevOp(u8 tevstage, u8 mode);
+void GX_SetTevColorIn(u8 tevstage, u8 a, u8 b, u8 c, u8 d);
+void GX_SetTevAlphaIn(u8 tevstage, u8 a, u8 b, u8 c, u8 d);
+void GX_SetTevColorOp(u8 tevstage, u8 tevop, u8 tevbias, u8 tevscale,
+                      u8 clamp, u8 tevregid);
+void GX_SetTevAlphaOp(u8 tevstage, u8 tevop, u8 tevbias, u8 tevscale,
+                      u8 clamp, u8 tevregid);
+void GX_SetTevOrder(u8 tevstage, u8 texcoord, u32 texmap, u8 color);
+void GX_SetTevColor(u8 tev_regid, GXColor color);
+void GX_SetTevColorS10(u8 tev_regid, GXColorS10 color);
+void GX_SetTevKColor(u8 sel, GXColor col);
+void GX_SetTevKColorSel(u8 tevstage, u8 sel);
+void GX_SetTevKAlphaSel(u8 tevstage, u8 sel);
+
+/* Pixel engine */
+void GX_SetFog(u8 type, f32 startz, f32 endz, f32 nearz, f32 farz,
+               GXColor col);
+void GX_SetZMode(u8 enable, u8 func, u8 update_enable);
+void GX_SetZCompLoc(u8 before_tex);
+void GX_SetBlendMode(u8 type, u8 src_fact, u8 dst_fact, u8 op);
+void GX_SetAlphaCompare(u8 comp0, u8 ref0, u8 aop, u8 comp1, u8 ref1);
+void GX_SetColorUpdate(u8 enable);
+void GX_SetAlphaUpdate(u8 enable);
+void GX_SetDstAlpha(u8 enable, u8 a);
+void GX_SetPixelFmt(u8 pix_fmt, u8 z_fmt);
+void GX_SetPointSize(u8 width, u8 fmt);
+void GX_SetLineWidth(u8 width, u8 fmt);
+void GX_ClearBoundingBox(void);
+void GX_ReadBoundingBox(u16 *top, u16 *bottom, u16 *left, u16 *right);
+
+/* EFB copies */
+void GX_SetCopyClear(GXColor color, u32 zvalue);
+void GX_SetCopyFilter(u8 aa, u8 sample_pattern[12][2], u8 vf,
+                      u8 vfilter[7]);
+void GX_SetDispCopyGamma(u8 gamma);
+void GX_SetDispCopySrc(u16 left, u16 top, u16 wd, u16 ht);
+void GX_SetDispCopyDst(u16 wd, u16 ht);
+void GX_CopyDisp(void *dest, u8 clear);
+void GX_SetTexCopySrc(u16 left, u16 top, u16 wd, u16 ht);
+void GX_SetTexCopyDst(u16 wd, u16 ht, u32 fmt, u8 mipmap);
+void GX_CopyTex(void *dest, u8 clear);
+
+/* Vertex data */
+static inline void GX_Position3f32(f32 x, f32 y, f32 z)
+{
+    __GX_HostPutF32(x);
+    __GX_HostPutF32(y);
+    __GX_HostPutF32(z);
+}
+
+static inline void GX_Position3u16(u16 x, u16 y, u16 z)
+{
+    __GX_HostPut16(x);
+    __GX_HostPut16(y);
+    __GX_HostPut16(z);
+}
+
+static inline void GX_Position3s16(s16 x, s16 y, s16 z)
+{
+    __GX_HostPut16(x);
+    __GX_HostPut16(y);
+    __GX_HostPut16(z);
+}
+
+static inline void GX_Position3u8(u8 x, u8 y, u8 z)
+{
+    __GX_HostPut8(x);
+    __GX_HostPut8(y);
+    __GX_HostPut8(z);
+}
+
+static inline void GX_Position3s8(s8 x, s8 y, s8 z)
+{
+    __GX_HostPut8(x);
+    __GX_HostPut8(y);
+    __GX_HostPut8(z);
+}
+
+static inline void GX_Position2f32(f32 x, f32 y)
+{
+    __GX_HostPutF32(x);
+    __GX_HostPutF32(y);
+}
+
+static inline void GX_Position2u16(u16 x, u16 y)
+{
+    __GX_HostPut16(x);
+    __GX_HostPut16(y);
+}
+
+static inline void GX_Position2s16(s16 x, s16 y)
+{
+    __GX_HostPut16(x);
+    __GX_HostPut16(y);
+}
+
+static inline void GX_Position2u8(u8 x, u8 y)
+{
+    __GX_HostPut8(x);
+    __GX_HostPut8(y);
+}
+
+static inline void GX_Position2s8(s8 x, s8 y)
+{
+    __GX_HostPut8(x);
+    __GX_HostPut8(y);
+}
+
+static inline void GX_Position1x8(u8 index) { __GX_HostPut8(index); }
+static inline void GX_Position1x16(u16 index) { __GX_HostPut16(index); }
+
+static inline void GX_Normal3f32(f32 nx, f32 ny, f32 nz)
+{
+    __GX_HostPutF32(nx);
+    __GX_HostPutF32(ny);
+    __GX_HostPutF32(nz);
+}
+
+static inline void GX_Normal3s16(s16 nx, s16 ny, s16 nz)
+{
+    __GX_HostPut16(nx);
+    __GX_HostPut16(ny);
+    __GX_HostPut16(nz);
+}
+
+static inline void GX_Normal3s8(s8 nx, s8 ny, s8 nz)
+{
+    __GX_HostPut8(nx);
+    __GX_HostPut8(ny);
+    __GX_HostPut8(nz);
+}
+
+static inline void GX_Normal1x8(u8 index) { __GX_HostPut8(index); }
+static inline void GX_Normal1x16(u16 index) { __GX_HostPut16(index); }
+
+static inline void GX_Color4u8(u8 r, u8 g, u8 b, u8 a)
+{
+    __GX_HostPut8(r);
+    __GX_HostPut8(g);
+    __GX_HostPut8(b);
+    __GX_HostPut8(a);
+}
+
+static inline void GX_Color3u8(u8 r, u8 g, u8 b)
+{
+    __GX_HostPut8(r);
+    __GX_HostPut8(g);
+    __GX_HostPut8(b);
+}
+
+static inline void GX_Color1u32(u32 clr) { __GX_HostPut32(clr); }
+static inline void GX_Color1u16(u16 clr) { __GX_HostPut16(clr); }
+static inline void GX_Color1x8(u8 index) { __GX_HostPut8(index); }
+static inline void GX_Color1x16(u16 index) { __GX_HostPut16(index); }
+
+static inline void GX_TexCoord2f32(f32 s, f32 t)
+{
+    __GX_HostPutF32(s);
+    __GX_HostPutF32(t);
+}
+
+static inline void GX_TexCoord2u16(u16 s, u16 t)
+{
+    __GX_HostPut16(s);
+    __GX_HostPut16(t);
+}
+
+static inline void GX_TexCoord2s16(s16 s, s16 t)
+{
+    __GX_HostPut16(s);
+    __GX_HostPut16(t);
+}
+
+static inline void GX_TexCoord2u8(u8 s, u8 t)
+{
+    __GX_HostPut8(s);
+    __GX_HostPut8(t);
+}
+
+static inline void GX_TexCoord2s8(s8 s, s8 t)
+{
+    __GX_HostPut8(s);
+    __GX_HostPut8(t);
+}
+
+static inline void GX_TexCoord1f32(f32 s) { __GX_HostPutF32(s); }
+static inline void GX_TexCoord1u16(u16 s) { __GX_HostPut16(s); }
+static inline void GX_TexCoord1s16(s16 s) { __GX_HostPut16(s); }
+static inline void GX_TexCoord1u8(u8 s) { __GX_HostPut8(s); }
+static inline void GX_TexCoord1s8(s8 s) { __GX_HostPut8(s); }
+static inline void GX_TexCoord1x8(u8 index) { __GX_HostPut8(index); }
+static inline void GX_TexCoord1x16(u16 index) { __GX_HostPut16(index); }
+
+static inline void GX_MatrixIndex1x8(u8 index) { __GX_HostPut8(index); }
+
+#ifdef __cplusplus
+} /* extern "C" */
+
+extern "C++" {
+/* libogc exposes the write-gather pipe as a union of volatile members, so
+ * that "wgPipe->U16 = x" turns into a store to the FIFO; on the host every
+ * member is a proxy object whose assignment operator does the same. */
+template <typename T>
+struct __GXHostPipeReg;
+
+template <>
+struct __GXHostPipeReg<u8> {
+    void operator=(u8 v) { __GX_HostPut8(v); }
+};
+
+template <>
+struct __GXHostPipeReg<u16> {
+    void operator=(u16 v) { __GX_HostPut16(v); }
+};
+
+template <>
+struct __GXHostPipeReg<u32> {
+    void operator=(u32 v) { __GX_HostPut32(v); }
+};
+
+template <>
+struct __GXHostPipeReg<f32> {
+    void operator=(f32 v) { __GX_HostPutF32(v); }
+};
+
+struct __GXHostPipe {
+    __GXHostPipeReg<u8> U8;
+    __GXHostPipeReg<u8> S8;
+    __GXHostPipeReg<u16> U16;
+    __GXHostPipeReg<u16> S16;
+    __GXHostPipeReg<u32> U32;
+    __GXHostPipeReg<u32> S32;
+    __GXHostPipeReg<f32> F32;
+};
+
+extern __GXHostPipe *const wgPipe;
+} /* extern "C++" */
+#endif
+
+#endif /* GX_HOST_OGC_GX_H */
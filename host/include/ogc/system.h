@@ -0,0 +1,65 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+/* Host stand-in for libogc's <ogc/system.h> and <ogc/cache.h>. There is no
+ * split between cached and uncached memory on the host, so the address
+ * translation macros are the identity and the cache operations do nothing.
+ */
+
+#ifndef GX_HOST_OGC_SYSTEM_H
+#define GX_HOST_OGC_SYSTEM_H
+
+#include <gctypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MEM_VIRTUAL_TO_PHYSICAL(x) ((void *)(x))
+#define MEM_PHYSICAL_TO_K0(x) ((void *)(x))
+#define MEM_PHYSICAL_TO_K1(x) ((void *)(x))
+#define MEM_K0_TO_PHYSICAL(x) ((void *)(x))
+#define MEM_K1_TO_PHYSICAL(x) ((void *)(x))
+#define MEM_K0_TO_K1(x) ((void *)(x))
+#define MEM_K1_TO_K0(x) ((void *)(x))
+
+static inline void DCFlushRange(void *startaddress, u32 len) {}
+static inline void DCFlushRangeNoSync(void *startaddress, u32 len) {}
+static inline void DCStoreRange(void *startaddress, u32 len) {}
+static inline void DCStoreRangeNoSync(void *startaddress, u32 len) {}
+static inline void DCInvalidateRange(void *startaddress, u32 len) {}
+static inline void ICInvalidateRange(void *startaddress, u32 len) {}
+
+void SYS_Report(const char *msg, ...) __attribute__((format(printf, 1, 2)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GX_HOST_OGC_SYSTEM_H */
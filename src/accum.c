@@ -36,6 +36,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "efb.h"
 #include "state.h"
 #include "utils.h"
+#include "vertex_desc.h"
 
 #include <GL/gl.h>
 #include <malloc.h>
@@ -49,13 +50,11 @@ static void draw_screen(GXTexObj *texture, float value)
     u16 width = glparamstate.viewport[2];
     u16 height = glparamstate.viewport[3];
 
-    GX_ClearVtxDesc();
-    GX_SetVtxDesc(GX_VA_POS, GX_DIRECT);
-    GX_SetVtxDesc(GX_VA_CLR0, GX_DIRECT);
-    GX_SetVtxDesc(GX_VA_TEX0, GX_DIRECT);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_POS, GX_POS_XY, GX_U16, 0);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_CLR0, GX_CLR_RGBA, GX_RGBA8, 0);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_TEX0, GX_TEX_ST, GX_U8, 0);
+    _ogx_vtxdesc_begin();
+    _ogx_vtxdesc_add(GX_VA_POS, GX_DIRECT, GX_POS_XY, GX_U16, 0);
+    _ogx_vtxdesc_add(GX_VA_CLR0, GX_DIRECT, GX_CLR_RGBA, GX_RGBA8, 0);
+    _ogx_vtxdesc_add(GX_VA_TEX0, GX_DIRECT, GX_TEX_ST, GX_U8, 0);
+    u8 vtxfmt = _ogx_vtxdesc_commit();
     if (texture) {
         GX_SetTexCoordGen(GX_TEXCOORD0, GX_TG_MTX2x4, GX_TG_TEX0, GX_IDENTITY);
         GX_SetTevOp(GX_TEVSTAGE0, GX_MODULATE);
@@ -87,7 +86,7 @@ static void draw_screen(GXTexObj *texture, float value)
     glparamstate.dirty.bits.dirty_color_update = 1;
 
     u8 intensity = (u8)(value * 255.0f);
-    GX_Begin(GX_QUADS, GX_VTXFMT0, 4);
+    GX_Begin(GX_QUADS, vtxfmt, 4);
     GX_Position2u16(0, 0);
     GX_Color4u8(intensity, intensity, intensity, intensity);
     GX_TexCoord2u8(0, 0);
@@ -167,6 +166,7 @@ void glAccum(GLenum op, GLfloat value)
     GXTexObj *texture = NULL;
     bool must_draw = false;
 
+    _ogx_immediate_flush();
     _ogx_efb_buffer_prepare(&s_accum_buffer, GX_TF_RGBA8);
     if (op == GL_ACCUM || op == GL_LOAD) {
         scene_buffer = save_scene_into_texture();
@@ -0,0 +1,266 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "array_cache.h"
+
+#include "debug.h"
+#include "murmurhash3.h"
+#include "utils.h"
+
+#include <malloc.h>
+#include <string.h>
+
+/* Number of consecutive frames in which an array must be found unchanged
+ * before we make a GX-native copy of it */
+#define PROMOTE_FRAMES 3
+/* The hashed memory area is split into this many chunks; after the first
+ * complete hash, only one of them is verified at every draw */
+#define NUM_CHUNKS 8
+#define MAX_ENTRIES 64
+/* Entries which have not been used for this many frames are dropped */
+#define EXPIRE_FRAMES 60
+/* An array found to be changing is not tracked again for 2^misses frames, up
+ * to this limit */
+#define MAX_BACKOFF_SHIFT 6
+/* The copies start with a header used to link them in the retired list */
+#define COPY_HEADER_SIZE 32
+
+typedef struct _CacheEntry CacheEntry;
+struct _CacheEntry {
+    CacheEntry *next;
+    OgxArrayCacheKey key;
+    /* Number of elements covered by the hashes (and by the copy) */
+    int count;
+    uint32_t chunk_hashes[NUM_CHUNKS];
+    uint32_t last_frame;
+    uint32_t skip_until;
+    uint8_t stable_frames;
+    uint8_t misses;
+    uint8_t next_chunk;
+    char *copy;
+};
+
+typedef struct _RetiredCopy RetiredCopy;
+struct _RetiredCopy {
+    RetiredCopy *next;
+};
+
+/* Most recently used entries come first */
+static CacheEntry *s_entries = NULL;
+static int s_num_entries = 0;
+/* Copies which the GPU might still be reading; freed at the end of the
+ * frame */
+static RetiredCopy *s_retired_copies = NULL;
+static uint32_t s_frame = 0;
+
+static bool same_key(const OgxArrayCacheKey *a, const OgxArrayCacheKey *b)
+{
+    return a->pointer == b->pointer && a->stride == b->stride &&
+        a->element_size == b->element_size && a->type == b->type &&
+        a->attribute == b->attribute &&
+        a->num_components == b->num_components;
+}
+
+static void retire_copy(CacheEntry *entry)
+{
+    if (!entry->copy) return;
+    RetiredCopy *retired = (RetiredCopy *)(entry->copy - COPY_HEADER_SIZE);
+    retired->next = s_retired_copies;
+    s_retired_copies = retired;
+    entry->copy = NULL;
+}
+
+static void chunk_bounds(const CacheEntry *entry, int chunk,
+                         int *start, int *end)
+{
+    int size = entry->key.stride * (entry->count - 1) +
+        entry->key.element_size;
+    *start = size * chunk / NUM_CHUNKS;
+    *end = size * (chunk + 1) / NUM_CHUNKS;
+}
+
+static uint32_t hash_chunk(const CacheEntry *entry, int chunk)
+{
+    int start, end;
+    uint32_t hash;
+    chunk_bounds(entry, chunk, &start, &end);
+    MurmurHash3_x86_32((const char *)entry->key.pointer + start, end - start,
+                       0, &hash);
+    return hash;
+}
+
+static void hash_all(const CacheEntry *entry, uint32_t *hashes)
+{
+    for (int i = 0; i < NUM_CHUNKS; i++) {
+        hashes[i] = hash_chunk(entry, i);
+    }
+}
+
+/* Starts tracking the array from scratch */
+static void reset_entry(CacheEntry *entry, int count)
+{
+    retire_copy(entry);
+    entry->count = count;
+    hash_all(entry, entry->chunk_hashes);
+    entry->stable_frames = 0;
+    entry->next_chunk = 0;
+}
+
+/* Called when the array contents changed: stop using the copy, and back off
+ * for a while, in order not to waste time hashing a dynamic array */
+static void demote_entry(CacheEntry *entry)
+{
+    retire_copy(entry);
+    entry->count = 0;
+    if (entry->misses < MAX_BACKOFF_SHIFT) entry->misses++;
+    entry->skip_until = s_frame + (1 << entry->misses);
+}
+
+static CacheEntry *find_entry(const OgxArrayCacheKey *key)
+{
+    CacheEntry **prev = &s_entries;
+    for (CacheEntry *entry = s_entries; entry; entry = entry->next) {
+        if (same_key(&entry->key, key)) {
+            /* Move it to the front */
+            *prev = entry->next;
+            entry->next = s_entries;
+            s_entries = entry;
+            return entry;
+        }
+        prev = &entry->next;
+    }
+    return NULL;
+}
+
+static CacheEntry *add_entry(const OgxArrayCacheKey *key)
+{
+    CacheEntry *entry;
+    if (s_num_entries < MAX_ENTRIES) {
+        entry = malloc(sizeof(CacheEntry));
+        if (!entry) return NULL;
+        s_num_entries++;
+    } else {
+        /* Recycle the least recently used entry */
+        CacheEntry **prev = &s_entries;
+        while ((*prev)->next) prev = &(*prev)->next;
+        entry = *prev;
+        *prev = NULL;
+        retire_copy(entry);
+    }
+    memset(entry, 0, sizeof(CacheEntry));
+    entry->key = *key;
+    entry->next = s_entries;
+    s_entries = entry;
+    return entry;
+}
+
+static char *make_copy(int count, int dest_stride,
+                       OgxArrayCacheConvert convert, void *user_data)
+{
+    int size = count * dest_stride;
+    char *block = memalign(32, COPY_HEADER_SIZE + size);
+    if (!block) {
+        warning("Out of memory for the cached array copy");
+        return NULL;
+    }
+    char *copy = block + COPY_HEADER_SIZE;
+    convert(copy, count, user_data);
+    DCFlushRange(copy, size);
+    return copy;
+}
+
+const void *_ogx_array_cache_lookup(const OgxArrayCacheKey *key, int count,
+                                    int dest_stride,
+                                    OgxArrayCacheConvert convert,
+                                    void *user_data)
+{
+    CacheEntry *entry = find_entry(key);
+    if (!entry) {
+        entry = add_entry(key);
+        if (!entry) return NULL;
+    }
+
+    bool new_frame = entry->last_frame != s_frame;
+    entry->last_frame = s_frame;
+    if (s_frame < entry->skip_until) return NULL;
+
+    if (count > entry->count) {
+        /* We don't know anything about the new elements */
+        reset_entry(entry, count);
+        return NULL;
+    }
+
+    if (new_frame && !entry->copy) {
+        uint32_t hashes[NUM_CHUNKS];
+        hash_all(entry, hashes);
+        if (memcmp(hashes, entry->chunk_hashes, sizeof(hashes)) != 0) {
+            demote_entry(entry);
+            return NULL;
+        }
+        if (entry->stable_frames < PROMOTE_FRAMES &&
+            ++entry->stable_frames < PROMOTE_FRAMES) return NULL;
+        entry->copy = make_copy(entry->count, dest_stride, convert, user_data);
+        return entry->copy;
+    }
+
+    /* Catch arrays which are modified between draws in the same frame (or
+     * which are modified after having been promoted) by checking a different
+     * chunk each time. */
+    int chunk = entry->next_chunk;
+    entry->next_chunk = (chunk + 1) % NUM_CHUNKS;
+    if (hash_chunk(entry, chunk) != entry->chunk_hashes[chunk]) {
+        demote_entry(entry);
+        return NULL;
+    }
+    return entry->copy;
+}
+
+void _ogx_array_cache_frame_done()
+{
+    CacheEntry **prev = &s_entries;
+    while (*prev) {
+        CacheEntry *entry = *prev;
+        if (s_frame - entry->last_frame > EXPIRE_FRAMES) {
+            *prev = entry->next;
+            retire_copy(entry);
+            free(entry);
+            s_num_entries--;
+        } else {
+            prev = &entry->next;
+        }
+    }
+
+    /* The GPU is done with the previous frame */
+    while (s_retired_copies) {
+        RetiredCopy *retired = s_retired_copies;
+        s_retired_copies = retired->next;
+        free(retired);
+    }
+    s_frame++;
+}
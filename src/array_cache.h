@@ -0,0 +1,68 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef OPENGX_ARRAY_CACHE_H
+#define OPENGX_ARRAY_CACHE_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Identifies a client-side vertex array */
+typedef struct {
+    const void *pointer;
+    uint16_t stride;
+    /* Number of bytes read from each element */
+    uint16_t element_size;
+    GLenum type;
+    uint8_t attribute;
+    uint8_t num_components;
+} OgxArrayCacheKey;
+
+/* Writes the first `count` elements of the array into `dest`, in the GX
+ * format chosen by the caller */
+typedef void (*OgxArrayCacheConvert)(void *dest, int count, void *user_data);
+
+/* Returns a GX-native copy of the first `count` elements of the array, or NULL
+ * if the array has not (yet) been found to be unchanging across frames. The
+ * conversion callback is only invoked when a new copy needs to be made. The
+ * returned memory stays valid until the next ogx_prepare_swap_buffers(). */
+const void *_ogx_array_cache_lookup(const OgxArrayCacheKey *key, int count,
+                                    int dest_stride,
+                                    OgxArrayCacheConvert convert,
+                                    void *user_data);
+void _ogx_array_cache_frame_done(void);
+
+#ifdef __cplusplus
+} // extern C
+#endif
+
+#endif /* OPENGX_ARRAY_CACHE_H */
@@ -30,17 +30,23 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "arrays.h"
 
+#include "array_cache.h"
 #include "debug.h"
 #include "state.h"
 #include "utils.h"
 #include "vbo.h"
+#include "vertex_desc.h"
 
+#include <algorithm>
 #include <cassert>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 #include <limits>
 #include <ogc/gx.h>
 #include <new>
+#include <type_traits>
+#include <utility>
 
 #define MAX_TEXCOORDS 8 /* GX_VA_TEX7 - GX_VA_TEX8 */
 
@@ -59,6 +65,10 @@ static char s_num_tex_coords = 0;
 
 static bool s_has_normals = false;
 static uint8_t s_num_colors = 0;
+/* The matrix indices come before all the other attributes, so they are kept
+ * out of s_readers */
+static OgxArrayReader s_matrix_index_reader;
+static bool s_has_matrix_indices = false;
 static OgxDrawFlags s_draw_flags = OGX_DRAW_FLAG_NONE;
 
 static inline int count_attributes() {
@@ -70,6 +80,7 @@ struct GxVertexFormat {
     char num_components;
     uint8_t type;
     uint8_t size;
+    uint8_t frac;
 
     int stride() const {
         int component_size;
@@ -217,17 +228,150 @@ static void to_tex2f(const T *components, int num_components, Tex2f tex) {
     }
 }
 
+/* How a reader emits its vertex data, when this can be done without calling
+ * into the reader. This is used to select a specialized emitter function for
+ * the whole draw operation. */
+enum class EmitKind: uint8_t {
+    None, /* The reader does not emit anything */
+    Generic, /* Only process_element() knows what to emit */
+    /* Plain copy of the array data */
+    F32x3,
+    F32x2,
+    S16x3,
+    U8x4,
+    U8x3,
+    /* The array is bound with GX_SetArray() */
+    Index8,
+    Index16,
+};
+
+struct EmitSource {
+    const char *data;
+    uint16_t stride;
+};
+
+/* Typed view over the indices of a glDrawElements() call */
+template <typename T>
+struct IndexArray {
+    IndexArray(const void *indices, int count):
+        indices(static_cast<const T *>(indices)),
+        count(count),
+        /* The restart index only applies if it can be represented by T */
+        has_restart(glparamstate.primitive_restart_enabled &&
+                    glparamstate.primitive_restart_index <=
+                    std::numeric_limits<T>::max()),
+        restart(glparamstate.primitive_restart_index) {}
+
+    void scan_range(int *min, int *max) const {
+        T lo = std::numeric_limits<T>::max(), hi = 0;
+        for (int i = 0; i < count; i++) {
+            T index = indices[i];
+            if (has_restart && index == restart) continue;
+            if (index < lo) lo = index;
+            if (index > hi) hi = index;
+        }
+        if (lo > hi) return; /* No indices at all */
+        *min = lo;
+        /* Larger indices cannot be used with GX anyway */
+        *max = hi > INT_MAX ? INT_MAX : hi;
+    }
+
+    /* Calls f(indices, count) for every batch delimited by restart indices */
+    template <typename F>
+    void for_each_batch(F f) const {
+        if (!has_restart) {
+            f(indices, count);
+            return;
+        }
+        int start = 0;
+        for (int i = 0; i < count; i++) {
+            if (indices[i] != restart) continue;
+            if (i > start) f(indices + start, i - start);
+            start = i + 1;
+        }
+        if (count > start) f(indices + start, count - start);
+    }
+
+    const T *indices;
+    int count;
+    bool has_restart;
+    T restart;
+};
+
+template <typename F>
+static void with_index_array(GLenum type, const void *indices, int count, F f)
+{
+    switch (type) {
+    case GL_UNSIGNED_BYTE:
+        f(IndexArray<uint8_t>(indices, count)); break;
+    case GL_UNSIGNED_SHORT:
+        f(IndexArray<uint16_t>(indices, count)); break;
+    case GL_UNSIGNED_INT:
+        f(IndexArray<uint32_t>(indices, count)); break;
+    }
+}
+
+static const void *resolve_indices(const void *indices)
+{
+    return glparamstate.bound_vbo_element_array ?
+        _ogx_vbo_get_data(glparamstate.bound_vbo_element_array, indices) :
+        indices;
+}
+
+/* Information about the draw operation being set up, shared by all the
+ * readers. The index range is only computed if some reader asks for it. */
+struct DrawSetup {
+    DrawSetup(const OgxDrawData *draw_data): draw_data(draw_data) {}
+
+    bool index_range(int *min, int *max) {
+        if (!range_computed) {
+            compute_range();
+            range_computed = true;
+        }
+        *min = min_index;
+        *max = max_index;
+        return min_index <= max_index;
+    }
+
+private:
+    void compute_range() {
+        int count = draw_data->count;
+        if (count <= 0) return;
+        if (draw_data->type == 0) { /* glDrawArrays() */
+            min_index = draw_data->first;
+            max_index = draw_data->first + count - 1;
+        } else if (draw_data->has_range) { /* glDrawRangeElements() */
+            min_index = draw_data->start;
+            max_index = draw_data->end > INT_MAX ? INT_MAX : draw_data->end;
+        } else {
+            with_index_array(draw_data->type,
+                             resolve_indices(draw_data->indices), count,
+                             [this](const auto &array) {
+                array.scan_range(&min_index, &max_index);
+            });
+        }
+    }
+
+    const OgxDrawData *draw_data;
+    bool range_computed = false;
+    int min_index = 0;
+    int max_index = -1;
+};
+
 struct AbstractVertexReader {
     AbstractVertexReader(GxVertexFormat format): format(format) {}
 
-    virtual void setup_draw() {
-        GX_SetVtxDesc(format.attribute, GX_DIRECT);
-        GX_SetVtxAttrFmt(GX_VTXFMT0, format.attribute,
+    virtual void setup_draw(DrawSetup &setup) {
+        _ogx_vtxdesc_add(format.attribute, GX_DIRECT,
                          format.type, format.size, 0);
     }
 
     virtual void draw_done() {};
 
+    virtual EmitKind emit_kind(EmitSource *source) const {
+        return EmitKind::Generic;
+    }
+
     virtual void get_format(uint8_t *attribute, uint8_t *inputmode,
                             uint8_t *type, uint8_t *size) const {
         *attribute = format.attribute;
@@ -343,7 +487,10 @@ struct TexCoordProxyVertexReader: public AbstractVertexReader {
     /* On these methods we do nothing, since we are just referencing data
      * already sent by another array */
     void process_element(int index) override {}
-    void setup_draw() override {}
+    void setup_draw(DrawSetup &setup) override {}
+    EmitKind emit_kind(EmitSource *source) const override {
+        return EmitKind::None;
+    }
     void get_format(uint8_t *attribute, uint8_t *inputmode,
                     uint8_t *type, uint8_t *size) const override {
         *inputmode = GX_NONE;
@@ -398,14 +545,22 @@ struct DirectVboReader: public VertexReaderBase {
     {
     }
 
-    void setup_draw() override {
+    void setup_draw(DrawSetup &setup) override {
+        int min, max;
         GX_SetArray(format.attribute, const_cast<char*>(data), stride);
-        GX_SetVtxDesc(format.attribute, GX_INDEX16);
-        GX_SetVtxAttrFmt(GX_VTXFMT0, format.attribute,
-                         format.type, format.size, 0);
+        inputmode = setup.index_range(&min, &max) && max < 0xff ?
+            GX_INDEX8 : GX_INDEX16;
+        _ogx_vtxdesc_add(format.attribute, inputmode,
+                         format.type, format.size, format.frac);
+    }
+
+    EmitKind emit_kind(EmitSource *source) const override {
+        return inputmode == GX_INDEX8 ? EmitKind::Index8 : EmitKind::Index16;
     }
 
     void draw_done() override {
+        /* Display lists don't know the index range */
+        inputmode = GX_INDEX16;
         if (vbo != s_last_used_vbo) {
             _ogx_vbo_set_in_use(vbo);
             s_last_used_vbo = vbo;
@@ -415,11 +570,15 @@ struct DirectVboReader: public VertexReaderBase {
     void get_format(uint8_t *attribute, uint8_t *inputmode,
                     uint8_t *type, uint8_t *size) const override {
         VertexReaderBase::get_format(attribute, inputmode, type, size);
-        *inputmode = GX_INDEX16;
+        *inputmode = this->inputmode;
     }
 
     void process_element(int index) {
-        GX_Position1x16(index);
+        if (inputmode == GX_INDEX8) {
+            GX_Position1x8(index);
+        } else {
+            GX_Position1x16(index);
+        }
     }
     template<typename T> const T *elemAt(int index) const {
         return reinterpret_cast<const T*>(data + stride * index);
@@ -428,10 +587,11 @@ struct DirectVboReader: public VertexReaderBase {
     template<typename T>
     void read_floats(int index, float *out) const {
         const T *ptr = elemAt<T>(index);
-        out[0] = *ptr++;
-        out[1] = *ptr++;
+        float scale = 1.0f / (1u << format.frac);
+        out[0] = *ptr++ * scale;
+        out[1] = *ptr++ * scale;
         if (format.num_components >= 3) {
-            out[2] = *ptr++;
+            out[2] = *ptr++ * scale;
         } else {
             out[2] = 0.0f;
         }
@@ -461,6 +621,7 @@ struct DirectVboReader: public VertexReaderBase {
     void read_tex2f(int index, Tex2f tex) const override {}
 
     VboType vbo;
+    uint8_t inputmode = GX_INDEX16;
     static VboType s_last_used_vbo;
 };
 
@@ -558,6 +719,76 @@ struct SameTypeVertexReader: public GenericVertexReader<T> {
     }
 };
 
+/* Reader for client-side arrays whose layout can be read by GX as it is. If
+ * the OGX_HINT_INDEXED_CLIENT_ARRAYS hint is set, the array is bound with
+ * GX_SetArray() and only the vertex indices go through the FIFO; the GPU's
+ * vertex cache then takes care of vertices referenced more than once. */
+template <typename T>
+struct ClientArrayReader: public SameTypeVertexReader<T> {
+    using SameTypeVertexReader<T>::SameTypeVertexReader;
+    using SameTypeVertexReader<T>::data;
+    using SameTypeVertexReader<T>::format;
+    using SameTypeVertexReader<T>::stride;
+
+    void setup_draw(DrawSetup &setup) override {
+        int min, max;
+        inputmode = GX_DIRECT;
+        /* The stride is an 8-bit register, and the 0xff/0xffff indices are
+         * reserved by the hardware. The glBegin()/glEnd() vertex buffer is
+         * reused as soon as glEnd() returns, so it must be copied. */
+        if ((glparamstate.hints & OGX_HINT_INDEXED_CLIENT_ARRAYS) &&
+            !glparamstate.imm_mode.in_gl_begin && stride <= 0xff &&
+            setup.index_range(&min, &max) && max < 0xffff) {
+            /* Only the referenced part of the array needs to be flushed */
+            DCStoreRange(const_cast<char*>(data + stride * min),
+                         stride * (max - min) + format.stride());
+            GX_SetArray(format.attribute, const_cast<char*>(data), stride);
+            inputmode = max < 0xff ? GX_INDEX8 : GX_INDEX16;
+        }
+        _ogx_vtxdesc_add(format.attribute, inputmode,
+                         format.type, format.size, 0);
+    }
+
+    /* Display lists must not reference client memory, so we always go back to
+     * direct mode once the draw is over */
+    void draw_done() override { inputmode = GX_DIRECT; }
+
+    EmitKind emit_kind(EmitSource *source) const override {
+        if (inputmode == GX_INDEX16) return EmitKind::Index16;
+        if (inputmode == GX_INDEX8) return EmitKind::Index8;
+        source->data = data;
+        source->stride = stride;
+        if constexpr (std::is_same_v<T, float>) {
+            if (format.num_components == 3) return EmitKind::F32x3;
+            if (format.num_components == 2) return EmitKind::F32x2;
+        } else if constexpr (std::is_same_v<T, int16_t>) {
+            if (format.num_components == 3) return EmitKind::S16x3;
+        } else if constexpr (sizeof(T) == 1) {
+            if (format.num_components == 4) return EmitKind::U8x4;
+            if (format.num_components == 3) return EmitKind::U8x3;
+        }
+        return EmitKind::Generic;
+    }
+
+    void get_format(uint8_t *attribute, uint8_t *inputmode,
+                    uint8_t *type, uint8_t *size) const override {
+        SameTypeVertexReader<T>::get_format(attribute, inputmode, type, size);
+        *inputmode = this->inputmode;
+    }
+
+    void process_element(int index) override {
+        if (inputmode == GX_INDEX16) {
+            wgPipe->U16 = index;
+        } else if (inputmode == GX_INDEX8) {
+            wgPipe->U8 = index;
+        } else {
+            SameTypeVertexReader<T>::process_element(index);
+        }
+    }
+
+    uint8_t inputmode = GX_DIRECT;
+};
+
 template <typename T>
 struct ColorVertexReader: public GenericVertexReader<T> {
     using GenericVertexReader<T>::GenericVertexReader;
@@ -613,15 +844,381 @@ struct CoordVertexReader: public GenericVertexReader<T> {
     }
 };
 
+/* Reader for the GL_ARB_matrix_palette matrix indices: GX takes the address of
+ * the position/normal matrix, which must be sent directly. */
+template <typename T>
+struct MatrixIndexReader: public GenericVertexReader<T> {
+    using GenericVertexReader<T>::elemAt;
+    using GenericVertexReader<T>::GenericVertexReader;
+
+    void process_element(int index) override {
+        T matrix = *elemAt(index);
+        if (matrix >= T(matrix_palette_size())) matrix = 0;
+        wgPipe->U8 = matrix_palette_pnmtx(matrix);
+    }
+};
+
+/* Wrapper for the readers of client-side arrays, used when the
+ * OGX_HINT_CACHE_CLIENT_ARRAYS hint is set: arrays which are found not to
+ * change across frames are converted once into a GX-native copy, which is
+ * then bound with GX_SetArray() and drawn indexed (see array_cache.c). */
+template <typename Reader, bool same_type>
+struct CachingReader: public Reader {
+    using Reader::data;
+    using Reader::format;
+    using Reader::stride;
+
+    CachingReader(GxVertexFormat format, const void *data, int stride,
+                  GLenum type, int num_components):
+        Reader(format, data, stride),
+        type(type),
+        element_size(num_components * sizeof_gl_type(type)) {}
+
+    int native_components() const {
+        switch (format.attribute) {
+        case GX_VA_POS: return format.type == GX_POS_XY ? 2 : 3;
+        case GX_VA_NRM: return 3;
+        case GX_VA_CLR0:
+        case GX_VA_CLR1: return format.size == GX_RGB8 ? 3 : 4;
+        default: return format.type == GX_TEX_S ? 1 : 2;
+        }
+    }
+
+    /* Colors are always RGB8 or RGBA8; the other attributes, unless they
+     * already are in a GX type, are converted to floats */
+    uint8_t native_size() const {
+        if (same_type || format.attribute == GX_VA_CLR0 ||
+            format.attribute == GX_VA_CLR1) return format.size;
+        return GX_F32;
+    }
+
+    int native_stride() const {
+        if constexpr (same_type) return format.stride();
+        if (format.attribute == GX_VA_CLR0 ||
+            format.attribute == GX_VA_CLR1) return native_components();
+        return native_components() * sizeof(float);
+    }
+
+    void write_native(char *dest, int count) const {
+        int dest_stride = native_stride();
+        for (int i = 0; i < count; i++, dest += dest_stride) {
+            if constexpr (same_type) {
+                memcpy(dest, data + stride * i, dest_stride);
+                continue;
+            }
+            switch (format.attribute) {
+            case GX_VA_POS:
+            case GX_VA_NRM: {
+                    float v[3];
+                    if (format.attribute == GX_VA_POS) {
+                        this->read_pos3f(i, v);
+                    } else {
+                        this->read_norm3f(i, v);
+                    }
+                    memcpy(dest, v, dest_stride);
+                }
+                break;
+            case GX_VA_CLR0:
+            case GX_VA_CLR1: {
+                    GXColor color;
+                    this->read_color(i, &color);
+                    memcpy(dest, &color, dest_stride);
+                }
+                break;
+            default: {
+                    Tex2f tex;
+                    this->read_tex2f(i, tex);
+                    memcpy(dest, tex, dest_stride);
+                }
+            }
+        }
+    }
+
+    static void convert(void *dest, int count, void *user_data) {
+        auto reader = static_cast<const CachingReader *>(user_data);
+        reader->write_native(static_cast<char *>(dest), count);
+    }
+
+    bool can_use_cache() const {
+        /* Display lists might outlive the copy, and the glBegin()/glEnd()
+         * buffer is rewritten at every call */
+        if (glparamstate.imm_mode.in_gl_begin ||
+            glparamstate.current_call_list.index >= 0) return false;
+        /* GenericVertexReader::read_color() needs at least 3 components */
+        if ((format.attribute == GX_VA_CLR0 ||
+             format.attribute == GX_VA_CLR1) && format.num_components < 3)
+            return false;
+        return true;
+    }
+
+    void setup_draw(DrawSetup &setup) override {
+        int min, max;
+        cached = nullptr;
+        if (can_use_cache() && setup.index_range(&min, &max) && max < 0xffff) {
+            OgxArrayCacheKey key = {
+                data, stride, element_size, type,
+                format.attribute, uint8_t(format.num_components),
+            };
+            cached = static_cast<const char *>(
+                _ogx_array_cache_lookup(&key, max + 1, native_stride(),
+                                        convert, this));
+        }
+        if (!cached) {
+            Reader::setup_draw(setup);
+            return;
+        }
+
+        GX_SetArray(format.attribute, const_cast<char*>(cached),
+                    native_stride());
+        inputmode = max < 0xff ? GX_INDEX8 : GX_INDEX16;
+        _ogx_vtxdesc_add(format.attribute, inputmode,
+                         format.type, native_size(), 0);
+    }
+
+    void draw_done() override {
+        cached = nullptr;
+        Reader::draw_done();
+    }
+
+    EmitKind emit_kind(EmitSource *source) const override {
+        if (!cached) return Reader::emit_kind(source);
+        return inputmode == GX_INDEX8 ? EmitKind::Index8 : EmitKind::Index16;
+    }
+
+    void get_format(uint8_t *attribute, uint8_t *inputmode,
+                    uint8_t *type, uint8_t *size) const override {
+        Reader::get_format(attribute, inputmode, type, size);
+        if (cached) {
+            *inputmode = this->inputmode;
+            *size = native_size();
+        }
+    }
+
+    void process_element(int index) override {
+        if (!cached) {
+            Reader::process_element(index);
+        } else if (inputmode == GX_INDEX8) {
+            wgPipe->U8 = index;
+        } else {
+            wgPipe->U16 = index;
+        }
+    }
+
+    const char *cached = nullptr;
+    uint16_t type;
+    uint8_t element_size;
+    uint8_t inputmode = GX_INDEX16;
+};
+
 static inline VertexReaderBase *get_reader(OgxArrayReader *reader)
 {
     return reinterpret_cast<VertexReaderBase *>(reader);
 }
 
+/* Specialized vertex emitters.
+ *
+ * Instead of calling the virtual process_element() method of every reader for
+ * each vertex, at setup time we pick a function which has been compiled for
+ * the exact set of attributes being drawn, and which reads the array data
+ * directly. Draws using attribute types not covered here fall back to
+ * generic_emitter(). */
+#define MAX_EMITTER_ATTRIBUTES (sizeof(s_readers) / sizeof(s_readers[0]))
+#define MAX_EMITTER_TEXCOORDS 3
+
+static EmitSource s_emit_sources[MAX_EMITTER_ATTRIBUTES];
+
+template <EmitKind kind>
+static inline void emit_attribute(const EmitSource &source, int index)
+{
+    const char *ptr = source.data + source.stride * index;
+    if constexpr (kind == EmitKind::F32x3 || kind == EmitKind::F32x2) {
+        const float *v = reinterpret_cast<const float *>(ptr);
+        wgPipe->F32 = v[0];
+        wgPipe->F32 = v[1];
+        if constexpr (kind == EmitKind::F32x3) wgPipe->F32 = v[2];
+    } else if constexpr (kind == EmitKind::S16x3) {
+        const int16_t *v = reinterpret_cast<const int16_t *>(ptr);
+        wgPipe->S16 = v[0];
+        wgPipe->S16 = v[1];
+        wgPipe->S16 = v[2];
+    } else if constexpr (kind == EmitKind::U8x4) {
+        /* Send the color as a single word */
+        const uint8_t *v = reinterpret_cast<const uint8_t *>(ptr);
+        wgPipe->U32 = (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
+    } else if constexpr (kind == EmitKind::U8x3) {
+        wgPipe->U8 = ptr[0];
+        wgPipe->U8 = ptr[1];
+        wgPipe->U8 = ptr[2];
+    }
+}
+
+template <EmitKind pos, bool normal, EmitKind color, int num_colors,
+          int num_texcoords>
+static void direct_emitter(int index)
+{
+    const EmitSource *source = s_emit_sources;
+    emit_attribute<pos>(*source++, index);
+    if constexpr (normal) emit_attribute<EmitKind::F32x3>(*source++, index);
+    for (int i = 0; i < num_colors; i++)
+        emit_attribute<color>(*source++, index);
+    for (int i = 0; i < num_texcoords; i++)
+        emit_attribute<EmitKind::F32x2>(*source++, index);
+}
+
+template <typename T, int num_attributes>
+static void indexed_emitter(int index)
+{
+    for (int i = 0; i < num_attributes; i++) {
+        if constexpr (sizeof(T) == 1) {
+            wgPipe->U8 = index;
+        } else {
+            wgPipe->U16 = index;
+        }
+    }
+}
+
+static void generic_emitter(int index)
+{
+    int num_arrays = s_draw_flags & OGX_DRAW_FLAG_FLAT ?
+        1 : count_attributes();
+
+    for (int i = 0; i < num_arrays; i++) {
+        get_reader(&s_readers[i])->process_element(index);
+    }
+}
+
+template <typename T, size_t... n>
+static OgxVertexEmitter pick_indexed_emitter(int num_attributes,
+                                             std::index_sequence<n...>)
+{
+    static constexpr OgxVertexEmitter emitters[] = {
+        indexed_emitter<T, n>...
+    };
+    return emitters[num_attributes];
+}
+
+template <EmitKind pos, bool normal, EmitKind color, int num_colors,
+          size_t... n>
+static OgxVertexEmitter pick_direct_emitter(int num_texcoords,
+                                            std::index_sequence<n...>)
+{
+    static constexpr OgxVertexEmitter emitters[] = {
+        direct_emitter<pos, normal, color, num_colors, n>...
+    };
+    return emitters[num_texcoords];
+}
+
+template <EmitKind pos, bool normal>
+static OgxVertexEmitter pick_direct_emitter(EmitKind color, int num_colors,
+                                            int num_texcoords)
+{
+    auto texcoords = std::make_index_sequence<MAX_EMITTER_TEXCOORDS + 1>();
+    if (num_colors == 0) {
+        return pick_direct_emitter<pos, normal, EmitKind::None, 0>(
+            num_texcoords, texcoords);
+    } else if (color == EmitKind::U8x4) {
+        return num_colors == 1 ?
+            pick_direct_emitter<pos, normal, EmitKind::U8x4, 1>(
+                num_texcoords, texcoords) :
+            pick_direct_emitter<pos, normal, EmitKind::U8x4, 2>(
+                num_texcoords, texcoords);
+    } else {
+        return num_colors == 1 ?
+            pick_direct_emitter<pos, normal, EmitKind::U8x3, 1>(
+                num_texcoords, texcoords) :
+            pick_direct_emitter<pos, normal, EmitKind::U8x3, 2>(
+                num_texcoords, texcoords);
+    }
+}
+
+template <EmitKind pos>
+static OgxVertexEmitter pick_direct_emitter(bool normal, EmitKind color,
+                                            int num_colors, int num_texcoords)
+{
+    return normal ?
+        pick_direct_emitter<pos, true>(color, num_colors, num_texcoords) :
+        pick_direct_emitter<pos, false>(color, num_colors, num_texcoords);
+}
+
+static OgxVertexEmitter select_emitter(int num_arrays)
+{
+    EmitKind kinds[MAX_EMITTER_ATTRIBUTES];
+    int num_emitting = 0, num_index8 = 0, num_index16 = 0;
+    int num_colors = 0, num_texcoords = 0;
+    bool normal = false;
+    EmitKind color = EmitKind::None;
+
+    int first_color = 1 + s_has_normals;
+    int first_texcoord = first_color + s_num_colors;
+    for (int i = 0; i < num_arrays; i++) {
+        EmitSource *source = &s_emit_sources[num_emitting];
+        EmitKind kind = get_reader(&s_readers[i])->emit_kind(source);
+        if (kind == EmitKind::None) continue;
+        if (kind == EmitKind::Generic) return generic_emitter;
+
+        if (kind == EmitKind::Index8) num_index8++;
+        else if (kind == EmitKind::Index16) num_index16++;
+        else if (i == 0) {
+            if (kind != EmitKind::F32x3 && kind != EmitKind::F32x2 &&
+                kind != EmitKind::S16x3) return generic_emitter;
+        } else if (i < first_color) {
+            if (kind != EmitKind::F32x3) return generic_emitter;
+            normal = true;
+        } else if (i < first_texcoord) {
+            if (kind != EmitKind::U8x4 && kind != EmitKind::U8x3) {
+                return generic_emitter;
+            }
+            /* All colors must be of the same kind */
+            if (num_colors > 0 && kind != color) return generic_emitter;
+            color = kind;
+            num_colors++;
+        } else {
+            if (kind != EmitKind::F32x2 ||
+                num_texcoords == MAX_EMITTER_TEXCOORDS) return generic_emitter;
+            num_texcoords++;
+        }
+        kinds[num_emitting++] = kind;
+    }
+
+    auto attributes = std::make_index_sequence<MAX_EMITTER_ATTRIBUTES + 1>();
+    if (num_index8 == num_emitting) {
+        return pick_indexed_emitter<uint8_t>(num_emitting, attributes);
+    } else if (num_index16 == num_emitting) {
+        return pick_indexed_emitter<uint16_t>(num_emitting, attributes);
+    } else if (num_index8 + num_index16 > 0) {
+        /* Mixing direct and indexed attributes is not common enough to
+         * deserve its own emitters */
+        return generic_emitter;
+    }
+
+    switch (kinds[0]) {
+    case EmitKind::F32x3:
+        return pick_direct_emitter<EmitKind::F32x3>(normal, color,
+                                                    num_colors, num_texcoords);
+    case EmitKind::F32x2:
+        return pick_direct_emitter<EmitKind::F32x2>(normal, color,
+                                                    num_colors, num_texcoords);
+    default:
+        return pick_direct_emitter<EmitKind::S16x3>(normal, color,
+                                                    num_colors, num_texcoords);
+    }
+}
+
+OgxVertexEmitter _ogx_arrays_emitter = generic_emitter;
+/* The emitter for the attributes following the matrix index */
+static OgxVertexEmitter s_attributes_emitter = generic_emitter;
+
+static void matrix_index_emitter(int index)
+{
+    get_reader(&s_matrix_index_reader)->process_element(index);
+    s_attributes_emitter(index);
+}
+
 void _ogx_arrays_setup_draw(const OgxDrawData *draw_data,
                             OgxDrawFlags flags)
 {
-    GX_ClearVtxDesc();
+    DrawSetup setup(draw_data);
+    _ogx_vtxdesc_begin();
 
     s_draw_flags = flags;
 
@@ -630,17 +1227,269 @@ void _ogx_arrays_setup_draw(const OgxDrawData *draw_data,
 
     for (int i = 0; i < num_arrays; i++) {
         VertexReaderBase *r = get_reader(&s_readers[i]);
-        r->setup_draw();
+        r->setup_draw(setup);
+    }
+    /* Also flat draws need the matrix index, to transform the positions */
+    if (s_has_matrix_indices) {
+        get_reader(&s_matrix_index_reader)->setup_draw(setup);
+    }
+
+    _ogx_vtxdesc_commit();
+    _ogx_arrays_emitter = select_emitter(num_arrays);
+    if (s_has_matrix_indices) {
+        s_attributes_emitter = _ogx_arrays_emitter;
+        _ogx_arrays_emitter = matrix_index_emitter;
     }
 }
 
-void _ogx_arrays_process_element(int index)
+/* Number of vertices per primitive for the primitive types where consecutive
+ * draws can be concatenated into a single GX_Begin() block, 0 otherwise. */
+static int list_primitive_size(OgxDrawMode gxmode)
 {
-    int num_arrays = s_draw_flags & OGX_DRAW_FLAG_FLAT ?
-        1 : count_attributes();
+    if (gxmode.loop) return 0;
+    switch (gxmode.mode) {
+    case GX_POINTS: return 1;
+    case GX_LINES: return 2;
+    case GX_TRIANGLES: return 3;
+    case GX_QUADS: return 4;
+    }
+    return 0;
+}
 
-    for (int i = 0; i < num_arrays; i++) {
-        get_reader(&s_readers[i])->process_element(index);
+/* Draws a primitive of count vertices, where emit(k) emits the k-th one. The
+ * vertex count of GX_Begin() is 16 bit: longer primitives are split into
+ * several, repeating the vertices which the parts share. */
+template <typename EMIT>
+static void draw_split(OgxDrawMode gxmode, int count, EMIT emit)
+{
+    if (count <= 0) return;
+
+    /* Line loops are drawn as strips going back to the first vertex */
+    int total = count + gxmode.loop;
+    auto emit_range = [&](int start, int n) {
+        for (int k = start; k < start + n; k++) emit(k % count);
+    };
+    if (total <= 0xffff) {
+        GX_Begin(gxmode.mode, _ogx_vtxdesc_vtxfmt, total);
+        emit_range(0, total);
+        GX_End();
+        return;
+    }
+
+    int prim_size = list_primitive_size(gxmode);
+    if (prim_size > 0) {
+        int max_count = 0xffff - 0xffff % prim_size;
+        total -= total % prim_size;
+        for (int start = 0; start < total; start += max_count) {
+            int n = std::min(max_count, total - start);
+            GX_Begin(gxmode.mode, _ogx_vtxdesc_vtxfmt, n);
+            emit_range(start, n);
+            GX_End();
+        }
+        return;
+    }
+
+    /* The following part starts from the last vertices of the previous one;
+     * strips advance by an even number of vertices, to keep the winding */
+    bool fan = gxmode.mode == GX_TRIANGLEFAN;
+    int max_count = gxmode.mode == GX_TRIANGLESTRIP ? 0xfffe : 0xffff;
+    int overlap = gxmode.mode == GX_LINESTRIP ? 1 : 2;
+    for (int start = 0; ; start += max_count - overlap) {
+        int n = std::min(max_count, total - start);
+        GX_Begin(gxmode.mode, _ogx_vtxdesc_vtxfmt, n);
+        if (fan && start > 0) {
+            /* All the triangles of a fan share its first vertex */
+            emit(0);
+            emit_range(start + 1, n - 1);
+        } else {
+            emit_range(start, n);
+        }
+        GX_End();
+        if (start + n >= total) break;
+    }
+}
+
+template <typename T>
+static void draw_batch(OgxDrawMode gxmode, const T *indices, int count,
+                       int base = 0)
+{
+    OgxVertexEmitter emit = _ogx_arrays_emitter;
+    draw_split(gxmode, count, [emit, indices, base](int k) {
+        emit(indices[k] + base);
+    });
+}
+
+/* Draws the optimized version of the triangle list, if there is one */
+static bool draw_optimized_elements(const OgxDrawData *draw_data)
+{
+    VboType vbo = glparamstate.bound_vbo_element_array;
+    if (!vbo || !(glparamstate.hints & OGX_HINT_REORDER_INDICES) ||
+        draw_data->gxmode.mode != GX_TRIANGLES ||
+        /* Blending depends on the order of the triangles */
+        glparamstate.blendenabled ||
+        glparamstate.primitive_restart_enabled) return false;
+
+    OgxOptimizedIndices optimized;
+    if (!_ogx_vbo_get_optimized_indices(vbo, draw_data->indices,
+                                        draw_data->type, draw_data->count,
+                                        &optimized)) return false;
+
+    const uint16_t *indices = optimized.indices;
+    for (int i = 0; i < optimized.num_batches; i++) {
+        const OgxIndexBatch &batch = optimized.batches[i];
+        draw_batch(OgxDrawMode{ batch.mode, false }, indices, batch.count);
+        indices += batch.count;
+    }
+    return true;
+}
+
+void _ogx_arrays_draw_elements(const OgxDrawData *draw_data)
+{
+    if (draw_optimized_elements(draw_data)) return;
+
+    with_index_array(draw_data->type, resolve_indices(draw_data->indices),
+                     draw_data->count, [draw_data](const auto &array) {
+        array.for_each_batch([draw_data](const auto *indices, int count) {
+            draw_batch(draw_data->gxmode, indices, count);
+        });
+    });
+}
+
+bool _ogx_arrays_setup_multi_draw_data(OgxMultiDrawData *md)
+{
+    OgxDrawData *draw_data = &md->draw_data;
+    int min_index = INT_MAX, max_index = -1;
+    int first_draw = -1;
+
+    for (int i = 0; i < md->drawcount; i++) {
+        int count = md->count[i];
+        if (count <= 0) continue;
+        if (first_draw < 0) first_draw = i;
+        int min = 0, max = -1;
+        if (draw_data->type == 0) {
+            min = md->first[i];
+            max = min + count - 1;
+        } else {
+            with_index_array(draw_data->type, resolve_indices(md->indices[i]),
+                             count, [&min, &max](const auto &array) {
+                array.scan_range(&min, &max);
+            });
+            if (md->basevertex) {
+                min += md->basevertex[i];
+                max += md->basevertex[i];
+            }
+        }
+        if (min > max) continue;
+        if (min < min_index) min_index = min;
+        if (max > max_index) max_index = max;
+    }
+    if (min_index > max_index) return false;
+
+    if (draw_data->type == 0) {
+        draw_data->first = min_index;
+        draw_data->count = max_index - min_index + 1;
+    } else {
+        /* The index arrays are not contiguous: only describe the first one,
+         * while the range covers them all */
+        draw_data->count = md->count[first_draw];
+        draw_data->indices = md->indices[first_draw];
+        draw_data->has_range = true;
+        draw_data->start = min_index;
+        draw_data->end = max_index;
+    }
+    return true;
+}
+
+/* Emits count vertices of the i-th sub-draw, starting from the offset-th */
+static void emit_sub_draw(const OgxMultiDrawData *md, int i, int offset,
+                          int count)
+{
+    OgxVertexEmitter emit = _ogx_arrays_emitter;
+    if (md->draw_data.type == 0) {
+        int first = md->first[i];
+        for (int j = offset; j < offset + count; j++) {
+            emit(first + j);
+        }
+        return;
+    }
+
+    int base = md->basevertex ? md->basevertex[i] : 0;
+    with_index_array(md->draw_data.type, resolve_indices(md->indices[i]),
+                     offset + count, [emit, base, offset](const auto &array) {
+        for (int j = offset; j < array.count; j++) {
+            emit(array.indices[j] + base);
+        }
+    });
+}
+
+static void draw_sub_draw(const OgxMultiDrawData *md, int i)
+{
+    OgxDrawMode gxmode = md->draw_data.gxmode;
+    int count = md->count[i];
+    if (md->draw_data.type == 0) {
+        OgxVertexEmitter emit = _ogx_arrays_emitter;
+        int first = md->first[i];
+        draw_split(gxmode, count, [emit, first](int k) { emit(first + k); });
+        return;
+    }
+
+    int base = md->basevertex ? md->basevertex[i] : 0;
+    with_index_array(md->draw_data.type, resolve_indices(md->indices[i]),
+                     count, [gxmode, base](const auto &array) {
+        array.for_each_batch([gxmode, base](const auto *indices, int count) {
+            draw_batch(gxmode, indices, count, base);
+        });
+    });
+}
+
+void _ogx_arrays_multi_draw(const OgxMultiDrawData *md)
+{
+    int prim_size = list_primitive_size(md->draw_data.gxmode);
+    if (prim_size == 0 ||
+        (md->draw_data.type != 0 && glparamstate.primitive_restart_enabled)) {
+        for (int i = 0; i < md->drawcount; i++) {
+            if (md->count[i] > 0) draw_sub_draw(md, i);
+        }
+        return;
+    }
+
+    /* Incomplete primitives are dropped, or they would shift the vertices of
+     * the following sub-draws */
+    auto complete_count = [md, prim_size](int i) {
+        int count = md->count[i];
+        return count > 0 ? count - count % prim_size : 0;
+    };
+    /* The vertex count of GX_Begin() is 16 bit: sub-draws not fitting in the
+     * current GX primitive are split, at a multiple of the primitive size */
+    int max_count = 0xffff - 0xffff % prim_size;
+    int i = 0, offset = 0;
+    while (i < md->drawcount) {
+        /* Collect the sub-draws (or parts of them) filling a GX primitive;
+         * it ends at vertex end_offset of sub-draw end */
+        int total = 0, end = i, end_offset = offset;
+        while (end < md->drawcount && total < max_count) {
+            int count = std::min(complete_count(end) - end_offset,
+                                 max_count - total);
+            total += count;
+            end_offset += count;
+            if (end_offset == complete_count(end)) {
+                end++;
+                end_offset = 0;
+            }
+        }
+        if (total == 0) break;
+
+        GX_Begin(md->draw_data.gxmode.mode, _ogx_vtxdesc_vtxfmt, total);
+        while (i < end) {
+            emit_sub_draw(md, i, offset, complete_count(i) - offset);
+            i++;
+            offset = 0;
+        }
+        if (end_offset > offset) {
+            emit_sub_draw(md, i, offset, end_offset - offset);
+            offset = end_offset;
+        }
+        GX_End();
     }
 }
 
@@ -712,12 +1561,16 @@ static OgxArrayReader *allocate_reader_for_format(GxVertexFormat *format)
         format->attribute += s_num_tex_coords;
         attr = 1 + s_has_normals + s_num_colors;
         return &s_readers[attr + s_num_tex_arrays++];
+    case GX_VA_PTNMTXIDX:
+        s_has_matrix_indices = true;
+        return &s_matrix_index_reader;
     }
     return NULL;
 }
 
 void _ogx_arrays_reset()
 {
+    s_has_matrix_indices = false;
     s_has_normals = 0;
     s_num_colors = 0;
     s_num_tex_arrays = 0;
@@ -747,8 +1600,51 @@ OgxArrayReader *_ogx_array_add_constant_fv(uint8_t attribute, int size,
     return reader;
 }
 
+template <typename Reader, bool same_type = false>
+static OgxArrayReader *new_array_reader(OgxArrayReader *reader,
+                                        const OgxVertexAttribArray *array,
+                                        GxVertexFormat format,
+                                        const void *data)
+{
+    using Caching = CachingReader<Reader, same_type>;
+    static_assert(sizeof(Caching) <= sizeof(OgxArrayReader));
+    if (!array->vbo && (glparamstate.hints & OGX_HINT_CACHE_CLIENT_ARRAYS)) {
+        new (reader) Caching(format, data, array->stride,
+                             array->type, array->size);
+    } else {
+        new (reader) Reader(format, data, array->stride);
+    }
+    return reader;
+}
+
+static OgxArrayReader *add_matrix_index_array(const OgxVertexAttribArray *array)
+{
+    GxVertexFormat format = {
+        GX_VA_PTNMTXIDX, char(array->size), 0, 0, 0
+    };
+    OgxArrayReader *reader = allocate_reader_for_format(&format);
+    const void *data = array->vbo ?
+        _ogx_vbo_get_data(array->vbo, array->pointer) : array->pointer;
+
+    /* The type has been validated by glMatrixIndexPointerARB() */
+    switch (array->type) {
+    case GL_UNSIGNED_BYTE:
+        new (reader) MatrixIndexReader<uint8_t>(format, data, array->stride);
+        break;
+    case GL_UNSIGNED_SHORT:
+        new (reader) MatrixIndexReader<uint16_t>(format, data, array->stride);
+        break;
+    default:
+        new (reader) MatrixIndexReader<uint32_t>(format, data, array->stride);
+        break;
+    }
+    return reader;
+}
+
 OgxArrayReader *_ogx_array_add(uint8_t attribute, const OgxVertexAttribArray *array)
 {
+    if (attribute == GX_VA_PTNMTXIDX) return add_matrix_index_array(array);
+
     TemplateSelectionInfo info =
         select_template(array->type, attribute, array->size);
     OgxArrayReader *reader = allocate_reader_for_format(&info.format);
@@ -790,6 +1686,22 @@ OgxArrayReader *_ogx_array_add(uint8_t attribute, const OgxVertexAttribArray *ar
     const void *data = array->vbo ?
         _ogx_vbo_get_data(array->vbo, array->pointer) : array->pointer;
 
+    /* Display lists don't record the fractional bits of the format */
+    if (array->vbo && info.same_type && type == GL_FLOAT &&
+        (glparamstate.hints & OGX_HINT_QUANTIZE_STATIC_VBOS) &&
+        glparamstate.current_call_list.index < 0) {
+        OgxQuantizedArray quantized;
+        if (_ogx_vbo_get_quantized(array->vbo, array->pointer,
+                                   compute_array_stride(array), attribute,
+                                   info.format.num_components, &quantized)) {
+            info.format.size = quantized.size;
+            info.format.frac = quantized.frac;
+            new (reader) DirectVboReader(array->vbo, info.format,
+                                         quantized.data, quantized.stride);
+            return reader;
+        }
+    }
+
     if (info.same_type) {
         /* No conversions needed, just dump the data from the array directly
          * into the GX pipe. */
@@ -799,21 +1711,17 @@ OgxArrayReader *_ogx_array_add(uint8_t attribute, const OgxVertexAttribArray *ar
         }
         switch (type) {
         case GL_UNSIGNED_BYTE:
-            new (reader) SameTypeVertexReader<int8_t>(
-                info.format, data, stride);
-            return reader;
+            return new_array_reader<ClientArrayReader<int8_t>, true>(
+                reader, array, info.format, data);
         case GL_SHORT:
-            new (reader) SameTypeVertexReader<int16_t>(
-                info.format, data, stride);
-            return reader;
+            return new_array_reader<ClientArrayReader<int16_t>, true>(
+                reader, array, info.format, data);
         case GL_INT:
-            new (reader) SameTypeVertexReader<int32_t>(
-                info.format, data, stride);
-            return reader;
+            return new_array_reader<ClientArrayReader<int32_t>, true>(
+                reader, array, info.format, data);
         case GL_FLOAT:
-            new (reader) SameTypeVertexReader<float>(
-                info.format, data, stride);
-            return reader;
+            return new_array_reader<ClientArrayReader<float>, true>(
+                reader, array, info.format, data);
         }
     }
 
@@ -821,20 +1729,20 @@ OgxArrayReader *_ogx_array_add(uint8_t attribute, const OgxVertexAttribArray *ar
         switch (type) {
         /* The case GL_UNSIGNED_BYTE is handled by the SameTypeVertexReader */
         case GL_BYTE:
-            new (reader) ColorVertexReader<char>(info.format, data, stride);
-            return reader;
+            return new_array_reader<ColorVertexReader<char>>(
+                reader, array, info.format, data);
         case GL_SHORT:
-            new (reader) ColorVertexReader<int16_t>(info.format, data, stride);
-            return reader;
+            return new_array_reader<ColorVertexReader<int16_t>>(
+                reader, array, info.format, data);
         case GL_INT:
-            new (reader) ColorVertexReader<int32_t>(info.format, data, stride);
-            return reader;
+            return new_array_reader<ColorVertexReader<int32_t>>(
+                reader, array, info.format, data);
         case GL_FLOAT:
-            new (reader) ColorVertexReader<float>(info.format, data, stride);
-            return reader;
+            return new_array_reader<ColorVertexReader<float>>(
+                reader, array, info.format, data);
         case GL_DOUBLE:
-            new (reader) ColorVertexReader<double>(info.format, data, stride);
-            return reader;
+            return new_array_reader<ColorVertexReader<double>>(
+                reader, array, info.format, data);
         }
     }
 
@@ -845,20 +1753,20 @@ OgxArrayReader *_ogx_array_add(uint8_t attribute, const OgxVertexAttribArray *ar
      * GX_TexCoord2f32()). */
     switch (type) {
     case GL_BYTE:
-        new (reader) CoordVertexReader<char>(info.format, data, stride);
-        return reader;
+        return new_array_reader<CoordVertexReader<char>>(
+            reader, array, info.format, data);
     case GL_SHORT:
-        new (reader) CoordVertexReader<int16_t>(info.format, data, stride);
-        return reader;
+        return new_array_reader<CoordVertexReader<int16_t>>(
+            reader, array, info.format, data);
     case GL_INT:
-        new (reader) CoordVertexReader<int32_t>(info.format, data, stride);
-        return reader;
+        return new_array_reader<CoordVertexReader<int32_t>>(
+            reader, array, info.format, data);
     case GL_FLOAT:
-        new (reader) CoordVertexReader<float>(info.format, data, stride);
-        return reader;
+        return new_array_reader<CoordVertexReader<float>>(
+            reader, array, info.format, data);
     case GL_DOUBLE:
-        new (reader) CoordVertexReader<double>(info.format, data, stride);
-        return reader;
+        return new_array_reader<CoordVertexReader<double>>(
+            reader, array, info.format, data);
     }
 
     warning("Unknown array data type %x for attribute %d\n",
@@ -891,6 +1799,8 @@ OgxArrayReader *_ogx_array_reader_for_attribute(uint8_t attribute)
 {
     int n;
     switch (attribute) {
+    case GX_VA_PTNMTXIDX:
+        return s_has_matrix_indices ? &s_matrix_index_reader : NULL;
     case GX_VA_POS: return &s_readers[0];
     case GX_VA_NRM: return s_has_normals ? &s_readers[1] : NULL;
     case GX_VA_CLR0:
@@ -44,7 +44,7 @@ extern "C" {
 
 typedef struct {
     /* Opaque struct */
-    uint32_t reader[6];
+    uintptr_t reader[8];
 } OgxArrayReader;
 
 typedef enum {
@@ -54,7 +54,41 @@ typedef enum {
 
 void _ogx_arrays_setup_draw(const OgxDrawData *draw_data, OgxDrawFlags flags);
 
-void _ogx_arrays_process_element(int index);
+typedef void (*OgxVertexEmitter)(int index);
+/* Emits the vertex data for one element; this is selected by
+ * _ogx_arrays_setup_draw() according to the active arrays. */
+extern OgxVertexEmitter _ogx_arrays_emitter;
+static inline void _ogx_arrays_process_element(int index)
+{
+    _ogx_arrays_emitter(index);
+}
+/* Draws the elements using the current emitter. If primitive restart is
+ * enabled, a separate GX primitive is started for each batch of indices. */
+void _ogx_arrays_draw_elements(const OgxDrawData *draw_data);
+
+/* A glMultiDrawArrays() or glMultiDrawElements() call. The vertex arrays are
+ * set up once with draw_data, which covers the index range of all the
+ * sub-draws; draw_data.type is 0 when drawing arrays. When drawing elements,
+ * draw_data.count and draw_data.indices are those of the first non-empty
+ * sub-draw, since the index arrays are not contiguous. */
+typedef struct {
+    OgxDrawData draw_data;
+    GLsizei drawcount;
+    const GLsizei *count;
+    /* for drawing arrays: */
+    const GLint *first;
+    /* for drawing elements (basevertex can be NULL): */
+    const void *const *indices;
+    const GLint *basevertex;
+} OgxMultiDrawData;
+
+/* Fills draw_data with the union of the sub-draws; returns false if there's
+ * nothing to draw. */
+bool _ogx_arrays_setup_multi_draw_data(OgxMultiDrawData *md);
+/* Draws all the sub-draws using the current emitter. Consecutive sub-draws
+ * of list primitives (points, lines, triangles, quads) are concatenated into
+ * the same GX primitive. */
+void _ogx_arrays_multi_draw(const OgxMultiDrawData *md);
 /* Any memory allocated by the OgxArrayReader objects can be released. */
 void _ogx_arrays_draw_done();
 void _ogx_array_reader_process_element(OgxArrayReader *reader, int index);
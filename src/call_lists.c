@@ -37,18 +37,21 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "opengx.h"
 #include "stencil.h"
 #include "utils.h"
+#include "vertex_desc.h"
 
 #include <GL/gl.h>
-#include <assert.h>
 #include <malloc.h>
 #include <stdarg.h>
 #include <stdlib.h>
 
-#define MAX_COMMANDS_PER_BUFFER 4
+#define MIN_COMMANDS_PER_LIST 8
 #define MAX_CALL_LISTS 1536
-/* The glut teapot can take more than 300KB, for reference */
-#define MAX_GXLIST_SIZE (1024 * 1024)
+/* Size of the chunks where GX lists are recorded while a display list is
+ * being built. Larger GX lists (the glut teapot can take more than 300KB, for
+ * reference) get a chunk of their own. */
+#define LIST_CHUNK_SIZE (64 * 1024)
 #define CALL_LIST_START_ID 1
+#define ALIGN32(size) (((size) + 31) & ~31)
 
 typedef struct
 {
@@ -104,6 +107,11 @@ typedef struct
         struct DrawGeometry {
             GLenum mode;
             uint16_t count;
+            /* For COMMAND_MATRIX_BATCH: the number of commands following the
+             * batch which it replaces, and the number of modelview matrices
+             * indexed by its vertices */
+            uint16_t num_commands;
+            uint8_t num_matrices;
             union client_state cs;
             u32 list_size;
             void *gxlist;
@@ -113,7 +121,8 @@ typedef struct
                 unsigned inputmode : 3;
                 unsigned comptype : 4;
                 unsigned compsize : 4;
-            } formats[4 + MAX_TEXTURE_UNITS]; /* 4: pos, norm, clr1 and clr2 */
+            } formats[5 + MAX_TEXTURE_UNITS]; /* 5: matrix index, pos, norm,
+                                                 clr1 and clr2 */
             #define CALL_LIST_DRAW_FORMATS(fmt) (sizeof(fmt) / sizeof(fmt[0]))
         } draw_geometry;
 
@@ -125,18 +134,36 @@ typedef struct
     } c;
 } Command;
 
-typedef struct CommandBuffer
+typedef struct
 {
-    Command commands[MAX_COMMANDS_PER_BUFFER];
-    struct CommandBuffer *next;
-} CommandBuffer;
+    Command *commands;
+    int num_commands;
+    int max_commands;
+    /* All the GX lists of the draw commands, in a single 32-byte aligned
+     * block */
+    void *gxlists;
+} CallList;
+
+/* While a list is being built, the GX lists are recorded into a chain of
+ * chunks; in glEndList() they are then copied into a block of the exact size,
+ * and the chunks are released (except for the first one, which is kept for
+ * the next list). */
+typedef struct ListChunk
+{
+    struct ListChunk *next;
+    u32 size;
+    u32 used;
+    u8 *data;
+} ListChunk;
 
 typedef struct
 {
-    CommandBuffer *head;
-} CallList;
+    ListChunk *head;
+    ListChunk *tail;
+} ListArena;
 
 static CallList call_lists[MAX_CALL_LISTS];
+static ListArena s_arena;
 static GXColor s_current_color;
 static float s_current_normal[3];
 static bool s_last_draw_used_indexed_data = false;
@@ -144,71 +171,192 @@ static uint16_t s_last_draw_sync_token = 0;
 static union client_state s_last_client_state;
 static bool s_last_client_state_is_valid = false;
 
-#define BUFFER_IS_VALID(buffer) (((uint32_t)buffer) > 1)
-#define LIST_IS_USED(index) BUFFER_IS_VALID(call_lists[index].head)
-#define LIST_IS_RESERVED_OR_USED(index) (call_lists[index].head != NULL)
-#define LIST_RESERVE(index) call_lists[index].head = (void*)1
-#define LIST_UNRESERVE(index) call_lists[index].head = NULL
+#define BUFFER_IS_VALID(buffer) (((uintptr_t)buffer) > 1)
+#define LIST_IS_USED(index) BUFFER_IS_VALID(call_lists[index].commands)
+#define LIST_IS_RESERVED_OR_USED(index) (call_lists[index].commands != NULL)
+#define LIST_RESERVE(index) call_lists[index].commands = (void*)1
+#define LIST_UNRESERVE(index) call_lists[index].commands = NULL
 
-static inline int last_command(CommandBuffer **buffer)
+static Command *new_command(CallList *list)
 {
-    CommandBuffer *next;
+    if (!BUFFER_IS_VALID(list->commands)) {
+        list->commands = NULL;
+        list->num_commands = list->max_commands = 0;
+    }
 
-    while (BUFFER_IS_VALID(*buffer)) {
-        next = (*buffer)->next;
-        if (!next) {
-            for (int i = 0; i < MAX_COMMANDS_PER_BUFFER; i++) {
-                Command *curr = &(*buffer)->commands[i];
-                if (curr->type == COMMAND_NONE) {
-                    return i - 1;
-                }
-            }
-            return MAX_COMMANDS_PER_BUFFER - 1;
+    if (list->num_commands == list->max_commands) {
+        int max_commands = list->max_commands > 0 ?
+            list->max_commands * 2 : MIN_COMMANDS_PER_LIST;
+        Command *commands = realloc(list->commands,
+                                    max_commands * sizeof(Command));
+        if (!commands) {
+            warning("Failed to allocate memory for call-list buffer (%d)", errno);
+            return NULL;
         }
-
-        *buffer = next;
+        list->commands = commands;
+        list->max_commands = max_commands;
     }
 
-    return -1;
+    /* Zero the command, so that commands can be compared with memcmp() */
+    Command *command = &list->commands[list->num_commands++];
+    memset(command, 0, sizeof(Command));
+    return command;
 }
 
-static Command *new_command(CommandBuffer **head)
+static ListChunk *arena_new_chunk(u32 size)
 {
-    int last_index = -1;
-    CommandBuffer *last_buffer = NULL;
+    ListChunk *chunk = malloc(sizeof(ListChunk));
+    if (!chunk) return NULL;
 
-    if (BUFFER_IS_VALID(*head)) {
-        last_buffer = *head;
-        last_index = last_command(&last_buffer);
+    chunk->data = memalign(32, size);
+    if (!chunk->data) {
+        free(chunk);
+        return NULL;
     }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
 
-    if (last_index < 0 || last_index == MAX_COMMANDS_PER_BUFFER - 1) {
-        CommandBuffer *new_buffer = malloc(sizeof(CommandBuffer));
-        if (!new_buffer) {
-            warning("Failed to allocate memory for call-list buffer (%d)", errno);
-            return NULL;
+/* Returns a pointer to at least `size` bytes of free space in the arena; the
+ * space actually available is returned in `available`. */
+static u8 *arena_reserve(u32 size, u32 *available)
+{
+    ListChunk *chunk = s_arena.tail;
+    if (!chunk || chunk->size - chunk->used < size) {
+        u32 chunk_size = size > LIST_CHUNK_SIZE ? size : LIST_CHUNK_SIZE;
+        chunk = arena_new_chunk(chunk_size);
+        if (!chunk) return NULL;
+
+        if (s_arena.tail) {
+            s_arena.tail->next = chunk;
+        } else {
+            s_arena.head = chunk;
         }
+        s_arena.tail = chunk;
+    }
 
-        for (int i = 0; i < MAX_COMMANDS_PER_BUFFER; i++) {
-            new_buffer->commands[i].type = COMMAND_NONE;
+    *available = chunk->size - chunk->used;
+    return chunk->data + chunk->used;
+}
+
+static inline void arena_commit(u32 size)
+{
+    s_arena.tail->used += size;
+}
+
+static void arena_reset()
+{
+    ListChunk *chunk = s_arena.head;
+    if (!chunk) return;
+
+    /* Keep the first chunk around, if it has the default size */
+    ListChunk *next = chunk->next;
+    if (chunk->size == LIST_CHUNK_SIZE) {
+        chunk->next = NULL;
+        chunk->used = 0;
+        s_arena.tail = chunk;
+        chunk = next;
+    } else {
+        s_arena.head = s_arena.tail = NULL;
+    }
+
+    while (chunk) {
+        next = chunk->next;
+        free(chunk->data);
+        free(chunk);
+        chunk = next;
+    }
+}
+
+static bool command_has_gxlist(const Command *command)
+{
+    return command->type == COMMAND_DRAW_ARRAYS ||
+        command->type == COMMAND_DRAW_ELEMENTS ||
+        command->type == COMMAND_MATRIX_BATCH;
+}
+
+/* Move all the GX lists recorded in the arena into a single memory block owned
+ * by the list, and trim the command array. */
+static void compact_list(CallList *list)
+{
+    if (!BUFFER_IS_VALID(list->commands)) return;
+
+    if (list->num_commands == 0) {
+        /* Keep the list reserved */
+        free(list->commands);
+        list->commands = (void*)1;
+        list->max_commands = 0;
+        return;
+    }
+
+    if (list->num_commands < list->max_commands) {
+        Command *commands = realloc(list->commands,
+                                    list->num_commands * sizeof(Command));
+        if (commands) {
+            list->commands = commands;
+            list->max_commands = list->num_commands;
         }
-        new_buffer->next = NULL;
+    }
 
-        if (last_buffer) {
-            last_buffer->next = new_buffer;
+    u32 total_size = 0;
+    for (int i = 0; i < list->num_commands; i++) {
+        if (!command_has_gxlist(&list->commands[i])) continue;
+        total_size += list->commands[i].c.draw_geometry.list_size;
+    }
+    if (total_size == 0) return;
+
+    u8 *block = memalign(32, total_size);
+    if (!block) {
+        warning("Failed to allocate %u bytes for the GX lists", total_size);
+    }
+
+    u32 offset = 0;
+    for (int i = 0; i < list->num_commands; i++) {
+        if (!command_has_gxlist(&list->commands[i])) continue;
+
+        struct DrawGeometry *dg = &list->commands[i].c.draw_geometry;
+        if (!dg->gxlist) continue;
+        if (block) {
+            memcpy(block + offset, dg->gxlist, dg->list_size);
+            dg->gxlist = block + offset;
+            offset += dg->list_size;
         } else {
-            *head = new_buffer;
+            dg->gxlist = NULL;
         }
-        return &new_buffer->commands[0];
-    } else {
-        return &last_buffer->commands[last_index + 1];
     }
+    if (block) DCFlushRange(block, total_size);
+    list->gxlists = block;
+}
+
+static u8 setup_vertex_desc(const struct DrawGeometry *dg)
+{
+    /* Setup the same vertex attribute descriptions that were in place when the
+     * list was created */
+    _ogx_vtxdesc_begin();
+    if (dg->num_matrices > 0) {
+        _ogx_vtxdesc_add(GX_VA_PTNMTXIDX, GX_DIRECT, 0, 0, 0);
+    }
+    for (int i = 0; i < CALL_LIST_DRAW_FORMATS(dg->formats); i++) {
+        if (dg->formats[i].inputmode == GX_NONE) continue;
+        _ogx_vtxdesc_add(dg->formats[i].attribute, dg->formats[i].inputmode,
+                         dg->formats[i].comptype, dg->formats[i].compsize, 0);
+    }
+
+    if (!dg->cs.normal_enabled) {
+        _ogx_vtxdesc_add(GX_VA_NRM, GX_INDEX8, GX_NRM_XYZ, GX_F32, 0);
+    }
+    if (!dg->cs.color_enabled) {
+        _ogx_vtxdesc_add(GX_VA_CLR0, GX_INDEX8, GX_CLR_RGBA, GX_RGB8, 0);
+        _ogx_vtxdesc_add(GX_VA_CLR1, GX_INDEX8, GX_CLR_RGBA, GX_RGB8, 0);
+    }
+    return _ogx_vtxdesc_commit();
 }
 
 static void setup_draw_geometry(struct DrawGeometry *dg,
                                 bool uses_indexed_data)
 {
-    u8 vtxindex = GX_VTXFMT0;
     GXColor current_color;
 
     if (uses_indexed_data && s_last_draw_used_indexed_data) {
@@ -233,36 +381,13 @@ static void setup_draw_geometry(struct DrawGeometry *dg,
         }
     }
 
-    OgxDrawMode gxmode = _ogx_draw_mode(dg->mode);
-    OgxDrawData draw_data = {
-        gxmode,
-        dg->count,
-        /* The remaining fields are not used when drawing through lists */
-    };
-    /* Setup the same vertex attribute descriptions that were in place when the
-     * list was created */
-    GX_ClearVtxDesc();
-    for (int i = 0; i < CALL_LIST_DRAW_FORMATS(dg->formats); i++) {
-        if (dg->formats[i].inputmode == GX_NONE) continue;
-        uint8_t attribute = dg->formats[i].attribute;
-        GX_SetVtxDesc(attribute, dg->formats[i].inputmode);
-        GX_SetVtxAttrFmt(GX_VTXFMT0, attribute,
-                         dg->formats[i].comptype, dg->formats[i].compsize, 0);
-    }
-
     if (!dg->cs.normal_enabled) {
-        GX_SetVtxDesc(GX_VA_NRM, GX_INDEX8);
-        GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_NRM, GX_NRM_XYZ, GX_F32, 0);
         GX_SetArray(GX_VA_NRM, s_current_normal, 12);
         floatcpy(s_current_normal, glparamstate.imm_mode.current_normal, 3);
         /* Not needed on Dolphin, but it is on a Wii */
         DCStoreRange(s_current_normal, 12);
     }
     if (!dg->cs.color_enabled) {
-        GX_SetVtxDesc(GX_VA_CLR0, GX_INDEX8);
-        GX_SetVtxDesc(GX_VA_CLR1, GX_INDEX8);
-        GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_CLR0, GX_CLR_RGBA, GX_RGB8, 0);
-        GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_CLR1, GX_CLR_RGBA, GX_RGB8, 0);
         s_current_color = current_color;
         GX_SetArray(GX_VA_CLR0, &s_current_color, 4);
         GX_SetArray(GX_VA_CLR1, &s_current_color, 4);
@@ -275,9 +400,31 @@ static void setup_draw_geometry(struct DrawGeometry *dg,
     GX_InvVtxCache();
 }
 
+static void update_list_opcode(struct DrawGeometry *dg, u8 vtxfmt)
+{
+    /* Update the drawing mode and the vertex format on the list. This
+     * required peeping into GX_Begin() code. */
+    OgxDrawMode gxmode = _ogx_draw_mode(dg->mode);
+    u8 *fifo_ptr = dg->gxlist;
+    u8 mode_opcode = gxmode.mode | (vtxfmt & 0x7);
+    if (*fifo_ptr != mode_opcode) {
+        /* Before altering the list, we need to make sure that it's not in use
+         * by the GP.
+         * TODO: find a better criterium, to minimize waits */
+        GX_DrawDone();
+        *fifo_ptr = mode_opcode;
+        DCStoreRange(fifo_ptr, 32); // min size is 32
+    }
+}
+
 static void execute_draw_geometry_list(struct DrawGeometry *dg)
 {
     bool uses_indexed_data = !dg->cs.normal_enabled || !dg->cs.color_enabled;
+    if (!dg->gxlist) return;
+
+    /* This is cheap when the descriptor has not changed, so we don't bother
+     * checking the client state */
+    u8 vtxfmt = setup_vertex_desc(dg);
     if (!s_last_client_state_is_valid ||
         s_last_client_state.as_int != dg->cs.as_int) {
         setup_draw_geometry(dg, uses_indexed_data);
@@ -285,6 +432,7 @@ static void execute_draw_geometry_list(struct DrawGeometry *dg)
         s_last_client_state_is_valid = true;
     }
 
+    update_list_opcode(dg, vtxfmt);
     GX_CallDispList(dg->gxlist, dg->list_size);
 
     if (uses_indexed_data) {
@@ -301,34 +449,24 @@ static void flat_draw_geometry(void *cb_data)
     execute_draw_geometry_list(dg);
 }
 
-static void run_draw_geometry(struct DrawGeometry *dg)
+static void apply_draw_state(const struct DrawGeometry *dg)
 {
     union client_state cs;
 
-    /* Update the drawing mode on the list. This required peeping into
-     * GX_Begin() code. */
-    OgxDrawMode gxmode = _ogx_draw_mode(dg->mode);
-    u8 *fifo_ptr = dg->gxlist;
-    u8 mode_opcode = gxmode.mode | (GX_VTXFMT0 & 0x7);
-    if (*fifo_ptr != mode_opcode) {
-        /* Before altering the list, we need to make sure that it's not in use
-         * by the GP.
-         * TODO: find a better criterium, to minimize waits */
-        GX_DrawDone();
-        *fifo_ptr = mode_opcode;
-        DCStoreRange(fifo_ptr, 32); // min size is 32
-    }
-
-    _ogx_efb_set_content_type(OGX_EFB_SCENE);
-
-    _ogx_gpu_resources_push();
     cs = glparamstate.cs;
     glparamstate.cs = dg->cs;
     _ogx_update_matrices();
     _ogx_apply_state();
     _ogx_setup_render_stages();
     glparamstate.cs = cs;
+}
 
+static void run_draw_geometry(struct DrawGeometry *dg)
+{
+    _ogx_efb_set_content_type(OGX_EFB_SCENE);
+
+    _ogx_gpu_resources_push();
+    apply_draw_state(dg);
     execute_draw_geometry_list(dg);
     _ogx_gpu_resources_pop();
 
@@ -383,6 +521,9 @@ static void run_command(Command *cmd)
     case COMMAND_LOAD_IDENTITY:
         glLoadIdentity();
         break;
+    case COMMAND_LOAD_MATRIX:
+        glLoadMatrixf(cmd->c.matrix);
+        break;
     case COMMAND_PUSH_MATRIX:
         glPushMatrix();
         break;
@@ -411,9 +552,77 @@ static void run_command(Command *cmd)
     case COMMAND_NORMAL:
         glNormal3fv(cmd->c.normal);
         break;
+    case COMMAND_MATRIX_BATCH:
+        /* Handled in glCallList() */
+        break;
     }
 }
 
+/* The modelview matrices of a batch are loaded into GX_PNMTX0 and into the
+ * position/normal matrix slots following it, which must all be available */
+#define MAX_BATCH_MATRICES 10
+
+static bool can_run_matrix_batch(const struct DrawGeometry *dg)
+{
+    /* The matrix operations must affect the modelview matrix, and nothing but
+     * the vertex transformation must depend on it: texture coordinate
+     * generation and clip planes use matrices derived from the modelview
+     * matrix, and stencil drawing replays the draws on its own. */
+    if (glparamstate.matrixmode != 1 ||
+        glparamstate.matrix_palette.enabled ||
+        glparamstate.current_program != 0 ||
+        glparamstate.stencil.enabled ||
+        glparamstate.clip_plane_mask != 0) return false;
+
+    for (int tex = 0; tex < MAX_TEXTURE_UNITS; tex++) {
+        if (glparamstate.texture_unit[tex].gen_enabled) return false;
+    }
+
+    return ogx_gpu_resources->pnmtx_first == 1 &&
+        ogx_gpu_resources->pnmtx_end >= dg->num_matrices;
+}
+
+/* Returns false if the batch could not be used, in which case the commands it
+ * replaces must be run instead */
+static bool run_matrix_batch(Command *batch)
+{
+    struct DrawGeometry *dg = &batch->c.draw_geometry;
+    if (!dg->gxlist || !can_run_matrix_batch(dg)) return false;
+
+    /* Run the matrix operations, collecting the modelview matrix in effect
+     * at each of the replaced draws */
+    Mtx matrices[MAX_BATCH_MATRICES];
+    int num_matrices = 0;
+    Command *cmds = batch + 1;
+    for (int i = 0; i < dg->num_commands; i++) {
+        if (command_has_gxlist(&cmds[i])) {
+            memcpy(matrices[num_matrices++], glparamstate.modelview_matrix,
+                   sizeof(Mtx));
+        } else {
+            run_command(&cmds[i]);
+        }
+    }
+
+    _ogx_efb_set_content_type(OGX_EFB_SCENE);
+
+    _ogx_gpu_resources_push();
+    ogx_gpu_resources->pnmtx_first = num_matrices;
+    apply_draw_state(dg);
+    for (int i = 0; i < num_matrices; i++) {
+        _ogx_load_modelview_matrix(matrices[i], GX_PNMTX0 + i * 3);
+    }
+    /* GX_PNMTX0 no longer holds the current modelview matrix */
+    glparamstate.dirty.bits.dirty_matrices = 1;
+    /* Neither do the palette slots */
+    glparamstate.matrix_palette.dirty_mask = (1 << MAX_PALETTE_MATRICES) - 1;
+
+    execute_draw_geometry_list(dg);
+    _ogx_gpu_resources_pop();
+
+    glparamstate.draw_count++;
+    return true;
+}
+
 typedef int (*IndexCallback)(int i, void *index_data);
 
 static int draw_array_index_cb(int i, void *index_data)
@@ -433,6 +642,58 @@ static int draw_elements_index_cb(int i, void *index_data)
     return read_index(id->indices, id->type, i);
 }
 
+static u32 attribute_size(const struct AttribFormat *format)
+{
+    /* Component sizes, indexed by GX_U8 ... GX_F32 */
+    static const u8 component_sizes[] = { 1, 1, 2, 2, 4 };
+    /* Color sizes, indexed by GX_RGB565 ... GX_RGBA8 */
+    static const u8 color_sizes[] = { 2, 3, 4, 2, 3, 4 };
+    int num_components;
+
+    if (format->inputmode == GX_INDEX8) return 1;
+    if (format->inputmode == GX_INDEX16) return 2;
+
+    switch (format->attribute) {
+    case GX_VA_PTNMTXIDX:
+        return 1;
+    case GX_VA_POS:
+        num_components = format->comptype == GX_POS_XY ? 2 : 3;
+        break;
+    case GX_VA_NRM:
+        num_components = format->comptype == GX_NRM_XYZ ? 3 : 9;
+        break;
+    case GX_VA_CLR0:
+    case GX_VA_CLR1:
+        return color_sizes[format->compsize];
+    default:
+        num_components = format->comptype == GX_TEX_S ? 1 : 2;
+    }
+    return num_components * component_sizes[format->compsize];
+}
+
+static u32 draw_geometry_vertex_size(const struct DrawGeometry *dg)
+{
+    u32 vertex_size = 0;
+    for (int i = 0; i < CALL_LIST_DRAW_FORMATS(dg->formats); i++) {
+        if (dg->formats[i].inputmode == GX_NONE) continue;
+        vertex_size += attribute_size(&dg->formats[i]);
+    }
+    /* Indexes for the normal and colors taken from the current state */
+    if (!dg->cs.normal_enabled) vertex_size += 1;
+    /* Position/normal matrix index */
+    if (dg->num_matrices > 0) vertex_size += 1;
+    if (!dg->cs.color_enabled) vertex_size += 2;
+    return vertex_size;
+}
+
+/* Returns the number of bytes required to store the GX list for the given
+ * draw operation */
+static u32 draw_geometry_list_size(const struct DrawGeometry *dg)
+{
+    /* 3 bytes for the GX_Begin() opcode and vertex count */
+    return ALIGN32(3 + dg->count * draw_geometry_vertex_size(dg));
+}
+
 static void queue_draw_geometry(struct DrawGeometry *dg,
                                 GLenum mode, GLsizei count,
                                 IndexCallback index_cb,
@@ -446,8 +707,8 @@ static void queue_draw_geometry(struct DrawGeometry *dg,
      * attributes: this will allow us to set the value of the indexed attribute
      * at the time when the list is executed. */
     dg->mode = mode;
-    dg->gxlist = memalign(32, MAX_GXLIST_SIZE);
-    DCInvalidateRange(dg->gxlist, MAX_GXLIST_SIZE);
+    dg->gxlist = NULL;
+    dg->list_size = 0;
     dg->cs = glparamstate.cs;
     OgxDrawMode gxmode = _ogx_draw_mode(mode);
     dg->count = count + gxmode.loop;
@@ -458,12 +719,23 @@ static void queue_draw_geometry(struct DrawGeometry *dg,
     OgxArrayReader *vertex_reader = NULL;
     OgxArrayReader *normal_reader = NULL;
     OgxArrayReader *color_reader = NULL;
+    int num_colors = 0;
     OgxArrayReader *texcoord_reader[MAX_TEXTURE_UNITS] = { NULL };
 
     /* Get the GX formats used right now */
     OgxArrayReader *reader = NULL;
     int format_index = 0;
     memset(dg->formats, 0, sizeof(dg->formats));
+    OgxArrayReader *matrix_reader =
+        _ogx_array_reader_for_attribute(GX_VA_PTNMTXIDX);
+    if (matrix_reader) {
+        uint8_t attribute, inputmode, size, type;
+        _ogx_array_reader_get_format(matrix_reader, &attribute, &inputmode,
+                                     &type, &size);
+        dg->formats[0].attribute = attribute;
+        dg->formats[0].inputmode = inputmode;
+        format_index++;
+    }
     while (reader = _ogx_array_reader_next(reader)) {
         uint8_t attribute, inputmode, size, type;
         _ogx_array_reader_get_format(reader, &attribute, &inputmode,
@@ -478,53 +750,76 @@ static void queue_draw_geometry(struct DrawGeometry *dg,
             vertex_reader = reader;
         } else if (attribute == GX_VA_NRM) {
             normal_reader = reader;
-        } else if (attribute == GX_VA_CLR0) {
-            /* Ignore CLR1, since, if present, it's identical */
+        } else if (attribute == GX_VA_CLR0 || attribute == GX_VA_CLR1) {
+            /* If CLR1 is present, it's identical to CLR0 */
             color_reader = reader;
+            num_colors++;
         } else if (attribute >= GX_VA_TEX0 &&
                    attribute < GX_VA_TEX0 + MAX_TEXTURE_UNITS) {
             texcoord_reader[attribute - GX_VA_TEX0] = reader;
         }
     }
 
-    GX_BeginDispList(dg->gxlist, MAX_GXLIST_SIZE);
+    /* Pick the vertex format now, so that the list will most likely not need
+     * to be patched when executed */
+    u8 vtxfmt = setup_vertex_desc(dg);
+
+    /* The size computation should be exact, but should the list overflow we
+     * retry with a larger buffer */
+    u32 size = 0, needed = draw_geometry_list_size(dg);
+    u8 *gxlist;
+    while (size == 0) {
+        u32 available;
+        gxlist = arena_reserve(needed, &available);
+        if (!gxlist) {
+            warning("Failed to allocate %u bytes for the GX list", needed);
+            return;
+        }
 
-    /* Note that the drawing mode set here will be overwritten when executing the list */
+        DCInvalidateRange(gxlist, available);
+        GX_BeginDispList(gxlist, available);
 
-    GX_Begin(gxmode.mode, GX_VTXFMT0, dg->count);
-    for (int i = 0; i < dg->count; i++) {
-        int index = index_cb(i % count, index_data);
-        float value[4];
-        _ogx_array_reader_process_element(vertex_reader, index);
+        /* Note that the drawing mode and vertex format set here will be
+         * overwritten when executing the list, if needed */
+        GX_Begin(gxmode.mode, vtxfmt, dg->count);
+        for (int i = 0; i < dg->count; i++) {
+            int index = index_cb(i % count, index_data);
+            if (matrix_reader) {
+                _ogx_array_reader_process_element(matrix_reader, index);
+            }
+            _ogx_array_reader_process_element(vertex_reader, index);
 
-        if (normal_reader) {
-            _ogx_array_reader_process_element(normal_reader, index);
-        } else {
-            GX_Normal1x8(0);
-        }
+            if (normal_reader) {
+                _ogx_array_reader_process_element(normal_reader, index);
+            } else {
+                GX_Normal1x8(0);
+            }
 
-        /* The color data is duplicated to CLR0 and CLR1 */
-        if (color_reader) {
-            _ogx_array_reader_process_element(color_reader, index);
-            _ogx_array_reader_process_element(color_reader, index);
-        } else {
-            GX_Color1x8(0);
-            GX_Color1x8(0);
-        }
+            /* The color data is duplicated to CLR0 and CLR1 */
+            if (color_reader) {
+                for (int c = 0; c < num_colors; c++) {
+                    _ogx_array_reader_process_element(color_reader, index);
+                }
+            } else {
+                GX_Color1x8(0);
+                GX_Color1x8(0);
+            }
 
-        for (int tex = 0; tex < MAX_TEXTURE_UNITS; tex++) {
-            if (texcoord_reader[tex]) {
-                _ogx_array_reader_process_element(texcoord_reader[tex], index);
+            for (int tex = 0; tex < MAX_TEXTURE_UNITS; tex++) {
+                if (texcoord_reader[tex]) {
+                    _ogx_array_reader_process_element(texcoord_reader[tex],
+                                                      index);
+                }
             }
         }
+        GX_End();
+
+        size = GX_EndDispList();
+        needed = available * 2;
     }
-    GX_End();
 
-    u32 size = GX_EndDispList();
-    fprintf(stderr, "Created draw list %u\n", size);
-    /* Free any excess memory */
-    void *new_ptr = realloc(dg->gxlist, size);
-    assert(new_ptr == dg->gxlist);
+    arena_commit(size);
+    dg->gxlist = gxlist;
     dg->list_size = size;
 }
 
@@ -540,27 +835,510 @@ static void queue_draw_elements(struct DrawGeometry *dg,
                                 const GLvoid *indices)
 {
     DrawElementsIndexData id = { type, indices };
+    if (glparamstate.primitive_restart_enabled) {
+        warning("Primitive restart is not supported in display lists");
+    }
     queue_draw_geometry(dg, mode, count,
                         draw_elements_index_cb, &id);
 }
 
-static void destroy_buffer(CommandBuffer *buffer)
+/* Display list optimizer: when a list is closed, state changes which are
+ * redundant or whose effects are overridden before being used are dropped,
+ * consecutive matrix operations are folded into one and adjacent draws which
+ * can be combined into a single GX primitive are merged, also when they are
+ * separated by modelview matrix changes. */
+
+#define MAX_TRACKED_STATES 64
+
+typedef struct {
+    uint64_t key;
+    /* Last command setting this state, if no draw used it yet; or -1 */
+    int setter;
+    /* Command defining the current value of the state, or -1 if unknown */
+    int known;
+} StateSlot;
+
+static bool state_key(const Command *cmd, uint64_t *key)
+{
+    uint32_t a = 0, b = 0;
+
+    switch (cmd->type) {
+    case COMMAND_ENABLE:
+    case COMMAND_DISABLE:
+        *key = (uint64_t)COMMAND_ENABLE << 48 | cmd->c.cap;
+        return true;
+    case COMMAND_LIGHT:
+        /* The position and direction are transformed by the modelview
+         * matrix: never consider them redundant */
+        if (cmd->c.light.pname == GL_POSITION ||
+            cmd->c.light.pname == GL_SPOT_DIRECTION) return false;
+        a = cmd->c.light.light;
+        b = cmd->c.light.pname;
+        break;
+    case COMMAND_MATERIAL:
+        a = cmd->c.material.face;
+        b = cmd->c.material.pname;
+        break;
+    case COMMAND_BIND_TEXTURE:
+        a = cmd->c.bound_texture.target;
+        break;
+    case COMMAND_TEX_ENV:
+        a = cmd->c.tex_env.target;
+        b = cmd->c.tex_env.pname;
+        break;
+    case COMMAND_BLEND_FUNC:
+    case COMMAND_FRONT_FACE:
+    case COMMAND_COLOR:
+    case COMMAND_NORMAL:
+        break;
+    default:
+        return false;
+    }
+    *key = (uint64_t)cmd->type << 48 | (uint64_t)a << 24 | b;
+    return true;
+}
+
+static inline bool same_state_value(const Command *a, const Command *b)
+{
+    return a->type == b->type && memcmp(&a->c, &b->c, sizeof(a->c)) == 0;
+}
+
+static void forget_known_values(StateSlot *slots, int num_slots,
+                                CommandType type, uint64_t except_key)
+{
+    for (int i = 0; i < num_slots; i++) {
+        if (slots[i].key >> 48 == type && slots[i].key != except_key)
+            slots[i].known = -1;
+    }
+}
+
+static void drop_redundant_state(CallList *list)
+{
+    StateSlot slots[MAX_TRACKED_STATES];
+    int num_slots = 0;
+
+    for (int i = 0; i < list->num_commands; i++) {
+        Command *cmd = &list->commands[i];
+
+        if (command_has_gxlist(cmd)) {
+            for (int s = 0; s < num_slots; s++) slots[s].setter = -1;
+            continue;
+        }
+        if (cmd->type == COMMAND_CALL_LIST) {
+            /* We don't know what the called list will change */
+            num_slots = 0;
+            continue;
+        }
+
+        uint64_t key;
+        if (!state_key(cmd, &key)) continue;
+
+        /* Materials can be specified for the front, back or both faces, and
+         * with GL_COLOR_MATERIAL they also follow the current color */
+        if (cmd->type == COMMAND_MATERIAL) {
+            forget_known_values(slots, num_slots, COMMAND_MATERIAL, key);
+        } else if (cmd->type == COMMAND_COLOR ||
+                   ((cmd->type == COMMAND_ENABLE ||
+                     cmd->type == COMMAND_DISABLE) &&
+                    cmd->c.cap == GL_COLOR_MATERIAL)) {
+            forget_known_values(slots, num_slots, COMMAND_MATERIAL, 0);
+        }
+
+        StateSlot *slot = NULL;
+        for (int s = 0; s < num_slots; s++) {
+            if (slots[s].key == key) {
+                slot = &slots[s];
+                break;
+            }
+        }
+        if (!slot) {
+            if (num_slots == MAX_TRACKED_STATES) continue;
+            slot = &slots[num_slots++];
+            slot->key = key;
+            slot->setter = slot->known = -1;
+        }
+
+        if (slot->known >= 0 &&
+            same_state_value(&list->commands[slot->known], cmd)) {
+            cmd->type = COMMAND_NONE;
+            continue;
+        }
+
+        if (slot->setter >= 0) {
+            list->commands[slot->setter].type = COMMAND_NONE;
+        }
+        slot->setter = slot->known = i;
+    }
+}
+
+static bool is_foldable_matrix_op(const Command *cmd)
+{
+    const float *m = cmd->c.matrix;
+
+    switch (cmd->type) {
+    case COMMAND_LOAD_IDENTITY:
+    case COMMAND_TRANSLATE:
+    case COMMAND_ROTATE:
+    case COMMAND_SCALE:
+        return true;
+    case COMMAND_LOAD_MATRIX:
+    case COMMAND_MULT_MATRIX:
+        /* For projective matrices the result would differ from the one
+         * obtained by applying them one by one to the modelview matrix,
+         * since this is stored as a 3x4 matrix */
+        return m[3] == 0.0f && m[7] == 0.0f && m[11] == 0.0f && m[15] == 1.0f;
+    default:
+        return false;
+    }
+}
+
+static void matrix_for_op(const Command *cmd, float *m)
+{
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = m[5] = m[10] = m[15] = 1.0f;
+
+    switch (cmd->type) {
+    case COMMAND_TRANSLATE:
+        m[12] = cmd->c.xyz.x;
+        m[13] = cmd->c.xyz.y;
+        m[14] = cmd->c.xyz.z;
+        break;
+    case COMMAND_SCALE:
+        m[0] = cmd->c.xyz.x;
+        m[5] = cmd->c.xyz.y;
+        m[10] = cmd->c.xyz.z;
+        break;
+    case COMMAND_ROTATE:
+        {
+            float axis[3] = { cmd->c.rotate.x, cmd->c.rotate.y, cmd->c.rotate.z };
+            if (cmd->c.rotate.angle == 0.0f ||
+                (axis[0] == 0.0f && axis[1] == 0.0f && axis[2] == 0.0f))
+                break;
+            normalize(axis);
+            float x = axis[0], y = axis[1], z = axis[2];
+            float radians = cmd->c.rotate.angle * M_PI / 180.0f;
+            float c = cosf(radians), s = sinf(radians), t = 1.0f - c;
+            m[0] = x * x * t + c;
+            m[1] = y * x * t + z * s;
+            m[2] = x * z * t - y * s;
+            m[4] = x * y * t - z * s;
+            m[5] = y * y * t + c;
+            m[6] = y * z * t + x * s;
+            m[8] = x * z * t + y * s;
+            m[9] = y * z * t - x * s;
+            m[10] = z * z * t + c;
+        }
+        break;
+    case COMMAND_LOAD_MATRIX:
+    case COMMAND_MULT_MATRIX:
+        floatcpy(m, cmd->c.matrix, 16);
+        break;
+    default:
+        break;
+    }
+}
+
+static void fold_matrix_ops(Command *cmds, int count)
 {
-    if (buffer->next) {
-        destroy_buffer(buffer->next);
+    /* Everything before the last load is overwritten by it */
+    int first = 0;
+    for (int i = count - 1; i >= 0; i--) {
+        if (cmds[i].type == COMMAND_LOAD_IDENTITY ||
+            cmds[i].type == COMMAND_LOAD_MATRIX) {
+            first = i;
+            break;
+        }
+    }
+    for (int i = 0; i < first; i++) {
+        cmds[i].type = COMMAND_NONE;
+    }
+    if (first == count - 1) return;
+
+    float m[16], op[16], tmp[16];
+    matrix_for_op(&cmds[first], m);
+    for (int i = first + 1; i < count; i++) {
+        matrix_for_op(&cmds[i], op);
+        gl_matrix_multiply(tmp, m, op);
+        floatcpy(m, tmp, 16);
+        cmds[i].type = COMMAND_NONE;
     }
 
-    for (int i =0; i < MAX_COMMANDS_PER_BUFFER; i++) {
-        Command *command = &buffer->commands[i];
-        if (command->type == COMMAND_NONE) break;
+    if (cmds[first].type == COMMAND_LOAD_IDENTITY ||
+        cmds[first].type == COMMAND_LOAD_MATRIX) {
+        cmds[first].type = COMMAND_LOAD_MATRIX;
+    } else {
+        cmds[first].type = COMMAND_MULT_MATRIX;
+    }
+    floatcpy(cmds[first].c.matrix, m, 16);
+}
 
-        /* Free the memory for those commands who allocated it */
-        if (command->type == COMMAND_DRAW_ELEMENTS ||
-            command->type == COMMAND_DRAW_ARRAYS) {
-            free(command->c.draw_geometry.gxlist);
+static void fold_matrices(CallList *list)
+{
+    Command *cmds = list->commands;
+    int i = 0;
+    while (i < list->num_commands) {
+        if (!is_foldable_matrix_op(&cmds[i])) {
+            i++;
+            continue;
         }
+
+        int end = i + 1;
+        while (end < list->num_commands && is_foldable_matrix_op(&cmds[end]))
+            end++;
+        if (end - i > 1) fold_matrix_ops(cmds + i, end - i);
+        i = end;
+    }
+}
+
+/* Returns the GX primitive of draws that can be concatenated into a single
+ * primitive, or 0 */
+static u8 mergeable_primitive(const struct DrawGeometry *dg)
+{
+    if (!dg->gxlist ||
+        dg->list_size != draw_geometry_list_size(dg)) return 0;
+
+    u8 primitive = *(u8 *)dg->gxlist & ~0x7;
+    switch (dg->mode) {
+    case GL_POINTS: return primitive == GX_POINTS ? primitive : 0;
+    case GL_LINES: return primitive == GX_LINES ? primitive : 0;
+    case GL_TRIANGLES: return primitive == GX_TRIANGLES ? primitive : 0;
+    case GL_QUADS: return primitive == GX_QUADS ? primitive : 0;
+    default: return 0;
     }
-    free(buffer);
+}
+
+static bool can_merge_draws(const struct DrawGeometry *a,
+                            const struct DrawGeometry *b)
+{
+    return a->mode == b->mode &&
+        a->cs.as_int == b->cs.as_int &&
+        memcmp(a->formats, b->formats, sizeof(a->formats)) == 0 &&
+        mergeable_primitive(a) != 0 &&
+        mergeable_primitive(a) == mergeable_primitive(b);
+}
+
+/* Concatenate the vertex data of the given draws into a new GX list, stored
+ * in the arena and assigned to the first draw */
+static void merge_draws(Command *cmds, int count, u32 total_vertices)
+{
+    struct DrawGeometry *first = &cmds[0].c.draw_geometry;
+    u32 vertex_size = draw_geometry_vertex_size(first);
+    u32 size = ALIGN32(3 + total_vertices * vertex_size);
+    u32 available;
+    u8 *gxlist = arena_reserve(size, &available);
+    if (!gxlist) return;
+
+    u8 *ptr = gxlist;
+    *ptr++ = *(u8 *)first->gxlist;
+    *ptr++ = total_vertices >> 8;
+    *ptr++ = total_vertices & 0xff;
+    for (int i = 0; i < count; i++) {
+        struct DrawGeometry *dg = &cmds[i].c.draw_geometry;
+        u32 data_size = dg->count * vertex_size;
+        memcpy(ptr, (u8 *)dg->gxlist + 3, data_size);
+        ptr += data_size;
+        if (i > 0) cmds[i].type = COMMAND_NONE;
+    }
+    memset(ptr, GX_NOP, gxlist + size - ptr);
+    arena_commit(size);
+
+    first->gxlist = gxlist;
+    first->list_size = size;
+    first->count = total_vertices;
+}
+
+static void merge_adjacent_draws(CallList *list)
+{
+    Command *cmds = list->commands;
+    int i = 0;
+    while (i < list->num_commands) {
+        if (!command_has_gxlist(&cmds[i])) {
+            i++;
+            continue;
+        }
+
+        const struct DrawGeometry *first = &cmds[i].c.draw_geometry;
+        u32 total_vertices = first->count;
+        int end = i + 1;
+        while (end < list->num_commands && command_has_gxlist(&cmds[end])) {
+            const struct DrawGeometry *dg = &cmds[end].c.draw_geometry;
+            if (!can_merge_draws(first, dg) ||
+                total_vertices + dg->count > 0xffff) break;
+            total_vertices += dg->count;
+            end++;
+        }
+        if (end - i > 1) merge_draws(cmds + i, end - i, total_vertices);
+        i = end;
+    }
+}
+
+/* Draws separated only by modelview matrix changes can be merged as well, if
+ * each vertex carries the index of the position/normal matrix holding its
+ * modelview matrix. The merged draw is stored in a COMMAND_MATRIX_BATCH placed
+ * before the commands it replaces, which are kept for when the batch cannot
+ * be used (see can_run_matrix_batch()). */
+
+/* Larger draws don't gain much from being batched */
+#define MAX_BATCHED_DRAW_VERTICES 256
+
+static bool is_modelview_op(const Command *cmd)
+{
+    switch (cmd->type) {
+    case COMMAND_LOAD_IDENTITY:
+    case COMMAND_LOAD_MATRIX:
+    case COMMAND_PUSH_MATRIX:
+    case COMMAND_POP_MATRIX:
+    case COMMAND_MULT_MATRIX:
+    case COMMAND_TRANSLATE:
+    case COMMAND_ROTATE:
+    case COMMAND_SCALE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool can_batch_draw(const struct DrawGeometry *first,
+                           const struct DrawGeometry *dg)
+{
+    /* Draws with GL_ARB_matrix_palette indices already have their own */
+    bool has_matrix_indices = dg->formats[0].attribute == GX_VA_PTNMTXIDX &&
+        dg->formats[0].inputmode != GX_NONE;
+    return dg->count <= MAX_BATCHED_DRAW_VERTICES && !has_matrix_indices &&
+        can_merge_draws(first, dg);
+}
+
+/* Returns the end of the batch starting at the draw `start`, or `start` if
+ * no batch can be formed there */
+static int find_matrix_batch(const Command *cmds, int num_commands, int start,
+                             int *num_matrices, u32 *total_vertices)
+{
+    if (!command_has_gxlist(&cmds[start])) return start;
+
+    const struct DrawGeometry *first = &cmds[start].c.draw_geometry;
+    if (!can_batch_draw(first, first)) return start;
+
+    int end = start + 1;
+    *num_matrices = 1;
+    *total_vertices = first->count;
+    while (end < num_commands && *num_matrices < MAX_BATCH_MATRICES) {
+        int next = end;
+        while (next < num_commands && is_modelview_op(&cmds[next])) next++;
+        /* Adjacent draws which could not be merged cannot be batched either */
+        if (next == end || next == num_commands ||
+            !command_has_gxlist(&cmds[next]) ||
+            next + 1 - start > 0xffff) break;
+
+        const struct DrawGeometry *dg = &cmds[next].c.draw_geometry;
+        if (!can_batch_draw(first, dg) ||
+            *total_vertices + dg->count > 0xffff) break;
+        *total_vertices += dg->count;
+        (*num_matrices)++;
+        end = next + 1;
+    }
+    return *num_matrices > 1 ? end : start;
+}
+
+/* Builds the GX list of the batch replacing the given commands, where the
+ * vertices of the n-th draw use GX_PNMTX0 + n * 3 */
+static bool build_matrix_batch(Command *batch, const Command *cmds, int count,
+                               int num_matrices, u32 total_vertices)
+{
+    const struct DrawGeometry *first = &cmds[0].c.draw_geometry;
+    u32 vertex_size = draw_geometry_vertex_size(first);
+    u32 size = ALIGN32(3 + total_vertices * (vertex_size + 1));
+    u32 available;
+    u8 *gxlist = arena_reserve(size, &available);
+    if (!gxlist) return false;
+
+    u8 *ptr = gxlist;
+    *ptr++ = *(u8 *)first->gxlist;
+    *ptr++ = total_vertices >> 8;
+    *ptr++ = total_vertices & 0xff;
+    u8 pnmtx = GX_PNMTX0;
+    for (int i = 0; i < count; i++) {
+        if (!command_has_gxlist(&cmds[i])) continue;
+
+        const struct DrawGeometry *dg = &cmds[i].c.draw_geometry;
+        const u8 *vertex = (u8 *)dg->gxlist + 3;
+        for (int v = 0; v < dg->count; v++) {
+            *ptr++ = pnmtx;
+            memcpy(ptr, vertex, vertex_size);
+            ptr += vertex_size;
+            vertex += vertex_size;
+        }
+        pnmtx += 3;
+    }
+    memset(ptr, GX_NOP, gxlist + size - ptr);
+    arena_commit(size);
+
+    memset(batch, 0, sizeof(Command));
+    batch->type = COMMAND_MATRIX_BATCH;
+    struct DrawGeometry *dg = &batch->c.draw_geometry;
+    *dg = *first;
+    dg->gxlist = gxlist;
+    dg->list_size = size;
+    dg->count = total_vertices;
+    dg->num_commands = count;
+    dg->num_matrices = num_matrices;
+    return true;
+}
+
+static void batch_matrix_draws(CallList *list)
+{
+    /* A batch replaces at least three commands */
+    int max_commands = list->num_commands + list->num_commands / 3;
+    Command *commands = malloc(max_commands * sizeof(Command));
+    if (!commands) return;
+
+    Command *cmds = list->commands;
+    int count = 0;
+    int i = 0;
+    while (i < list->num_commands) {
+        int num_matrices;
+        u32 total_vertices;
+        int end = find_matrix_batch(cmds, list->num_commands, i,
+                                    &num_matrices, &total_vertices);
+        if (end > i &&
+            build_matrix_batch(&commands[count], cmds + i, end - i,
+                               num_matrices, total_vertices)) {
+            debug(OGX_LOG_CALL_LISTS, "Batched %d draws (%u vertices)",
+                  num_matrices, total_vertices);
+            count++;
+        } else {
+            end = i + 1;
+        }
+        while (i < end) commands[count++] = cmds[i++];
+    }
+
+    free(list->commands);
+    list->commands = commands;
+    list->num_commands = count;
+    list->max_commands = max_commands;
+}
+
+static void remove_dropped_commands(CallList *list)
+{
+    int count = 0;
+    for (int i = 0; i < list->num_commands; i++) {
+        if (list->commands[i].type == COMMAND_NONE) continue;
+        if (i != count) list->commands[count] = list->commands[i];
+        count++;
+    }
+    list->num_commands = count;
+}
+
+static void optimize_list(CallList *list)
+{
+    if (!BUFFER_IS_VALID(list->commands)) return;
+
+    drop_redundant_state(list);
+    remove_dropped_commands(list);
+    fold_matrices(list);
+    remove_dropped_commands(list);
+    merge_adjacent_draws(list);
+    remove_dropped_commands(list);
+    if (list->num_commands >= 3) batch_matrix_draws(list);
 }
 
 static void destroy_list(int index)
@@ -568,10 +1346,13 @@ static void destroy_list(int index)
     CallList *list = &call_lists[index];
     if (!LIST_IS_RESERVED_OR_USED(index)) return;
 
-    if (BUFFER_IS_VALID(list->head)) {
-        destroy_buffer(list->head);
+    if (BUFFER_IS_VALID(list->commands)) {
+        free(list->commands);
     }
-    list->head = NULL;
+    free(list->gxlists);
+    list->commands = NULL;
+    list->gxlists = NULL;
+    list->num_commands = list->max_commands = 0;
 }
 
 /* This function returns true if the caller's code needs to be executed now,
@@ -584,7 +1365,6 @@ static void destroy_list(int index)
 bool _ogx_call_list_append(CommandType op, ...)
 {
     CallList *list = &call_lists[glparamstate.current_call_list.index];
-    CommandBuffer *buffer = list->head;
     Command *command;
     va_list ap;
     int count;
@@ -592,7 +1372,9 @@ bool _ogx_call_list_append(CommandType op, ...)
     debug(OGX_LOG_CALL_LISTS, "Adding command %d to list %d",
           op, glparamstate.current_call_list.index);
 
-    command = new_command(&list->head);
+    command = new_command(list);
+    if (!command) return glparamstate.current_call_list.must_execute;
+
     command->type = op;
     va_start(ap, op);
     switch (op) {
@@ -671,6 +1453,7 @@ bool _ogx_call_list_append(CommandType op, ...)
         command->c.tex_env.pname = va_arg(ap, GLenum);
         command->c.tex_env.param = va_arg(ap, GLint);
         break;
+    case COMMAND_LOAD_MATRIX:
     case COMMAND_MULT_MATRIX:
         floatcpy(command->c.matrix, va_arg(ap, GLfloat *), 16);
         break;
@@ -789,6 +1572,8 @@ void glNewList(GLuint list, GLenum mode)
         destroy_list(list);
     }
     LIST_RESERVE(list);
+    /* Some vertex readers are not suitable for display lists */
+    glparamstate.dirty.bits.dirty_attributes = 1;
 }
 
 void glEndList(void)
@@ -798,9 +1583,13 @@ void glEndList(void)
         return;
     }
 
-    GLuint list = glparamstate.current_call_list.index + CALL_LIST_START_ID;
+    CallList *list = &call_lists[glparamstate.current_call_list.index];
+    optimize_list(list);
+    compact_list(list);
+    arena_reset();
     glparamstate.current_call_list.index = -1;
     glparamstate.current_call_list.execution_depth = 0;
+    glparamstate.dirty.bits.dirty_attributes = 1;
 }
 
 void glCallList(GLuint id)
@@ -813,6 +1602,8 @@ void glCallList(GLuint id)
 
     HANDLE_CALL_LIST(CALL_LIST, id);
 
+    _ogx_immediate_flush();
+
     debug(OGX_LOG_CALL_LISTS, "Calling list %d", id - CALL_LIST_START_ID);
 
     bool must_decrement = false;
@@ -824,18 +1615,18 @@ void glCallList(GLuint id)
     }
 
     CallList *list = &call_lists[id - CALL_LIST_START_ID];
-    for (CommandBuffer *buffer = list->head;
-         BUFFER_IS_VALID(buffer);
-         buffer = buffer->next) {
-        for (int i =0; i < MAX_COMMANDS_PER_BUFFER; i++) {
-            Command *command = &buffer->commands[i];
-            if (command->type == COMMAND_NONE) goto done;
-
-            run_command(command);
+    if (BUFFER_IS_VALID(list->commands)) {
+        for (int i = 0; i < list->num_commands; i++) {
+            Command *cmd = &list->commands[i];
+            if (cmd->type == COMMAND_MATRIX_BATCH) {
+                /* Otherwise, the replaced commands get run one by one */
+                if (run_matrix_batch(cmd)) i += cmd->c.draw_geometry.num_commands;
+                continue;
+            }
+            run_command(cmd);
         }
     }
 
-done:
     /* Until we find a reliable mechanism to ensure that the client state has
      * been preserved, avoid reusing it across different lists. */
     s_last_client_state_is_valid = false;
@@ -56,6 +56,7 @@ typedef enum {
     COMMAND_BIND_TEXTURE,
     COMMAND_TEX_ENV,
     COMMAND_LOAD_IDENTITY,
+    COMMAND_LOAD_MATRIX,
     COMMAND_PUSH_MATRIX,
     COMMAND_POP_MATRIX,
     COMMAND_MULT_MATRIX,
@@ -65,6 +66,8 @@ typedef enum {
     COMMAND_FRONT_FACE,
     COMMAND_COLOR,
     COMMAND_NORMAL,
+    COMMAND_MATRIX_BATCH, /* Created by the list optimizer: draws separated
+                             by modelview matrix changes only, merged */
 } CommandType;
 
 #define HANDLE_CALL_LIST(operation, ...) \
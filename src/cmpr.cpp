@@ -0,0 +1,327 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "cmpr.h"
+
+#include <algorithm>
+#include <climits>
+#include <math.h>
+
+namespace {
+
+/* The colours of the block which take part in the fit, that is all but the
+ * transparent ones */
+struct BlockColors {
+    int rgb[16][3];
+    int count;
+};
+
+/* In the three colour mode, the last code is for transparent pixels */
+constexpr uint8_t transparent_code = 3;
+
+inline int clamp_component(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+/* value * max / 255, rounded, without a division */
+inline int scale_component(int value, int max)
+{
+    int t = clamp_component(value) * max + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+inline uint16_t pack_565(const int *rgb)
+{
+    return (scale_component(rgb[0], 31) << 11) |
+        (scale_component(rgb[1], 63) << 5) | scale_component(rgb[2], 31);
+}
+
+inline void unpack_565(uint16_t color, int *rgb)
+{
+    int r = color >> 11, g = (color >> 5) & 0x3f, b = color & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+/* The palette as decoded by the GPU: unlike DXT1, the intermediate colours of
+ * the four colour mode (c0 > c1) lie at 3/8 and 5/8 of the way between the
+ * endpoints. The three colour mode has their average, and transparency. */
+void build_palette(uint16_t c0, uint16_t c1, int palette[4][3])
+{
+    unpack_565(c0, palette[0]);
+    unpack_565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        int p0 = palette[0][c], p1 = palette[1][c];
+        if (c0 > c1) {
+            palette[2][c] = (p0 * 5 + p1 * 3) >> 3;
+            palette[3][c] = (p0 * 3 + p1 * 5) >> 3;
+        } else {
+            palette[2][c] = palette[3][c] = (p0 + p1) >> 1;
+        }
+    }
+}
+
+/* The endpoints must be ordered as the mode requires; if they are equal, the
+ * three colour mode is used anyway, which is fine as long as the transparent
+ * code is not used for opaque pixels. */
+inline void order_endpoints(uint16_t &c0, uint16_t &c1, bool three_colors)
+{
+    if (three_colors ? c0 > c1 : c0 < c1) std::swap(c0, c1);
+}
+
+/* Takes the endpoints from the corners of the bounding box of the colours,
+ * picking the diagonal which follows their correlation */
+void range_fit(const BlockColors &colors, int *e0, int *e1)
+{
+    int lo_r = 255, lo_g = 255, lo_b = 255, hi_r = 0, hi_g = 0, hi_b = 0;
+    int sr = 0, sg = 0, sb = 0, srg = 0, srb = 0, sgb = 0;
+    for (int i = 0; i < colors.count; i++) {
+        int r = colors.rgb[i][0], g = colors.rgb[i][1], b = colors.rgb[i][2];
+        lo_r = std::min(lo_r, r);
+        lo_g = std::min(lo_g, g);
+        lo_b = std::min(lo_b, b);
+        hi_r = std::max(hi_r, r);
+        hi_g = std::max(hi_g, g);
+        hi_b = std::max(hi_b, b);
+        sr += r; sg += g; sb += b;
+        srg += r * g; srb += r * b; sgb += g * b;
+    }
+
+    /* Swap the ends of the components which decrease when the widest one
+     * increases (the covariances are scaled by the count) */
+    int n = colors.count;
+    int cov_rg = n * srg - sr * sg;
+    int cov_rb = n * srb - sr * sb;
+    int cov_gb = n * sgb - sg * sb;
+    int range_r = hi_r - lo_r, range_g = hi_g - lo_g, range_b = hi_b - lo_b;
+    if (range_g >= range_r && range_g >= range_b) {
+        if (cov_rg < 0) std::swap(lo_r, hi_r);
+        if (cov_gb < 0) std::swap(lo_b, hi_b);
+    } else if (range_r >= range_b) {
+        if (cov_rg < 0) std::swap(lo_g, hi_g);
+        if (cov_rb < 0) std::swap(lo_b, hi_b);
+    } else {
+        if (cov_rb < 0) std::swap(lo_r, hi_r);
+        if (cov_gb < 0) std::swap(lo_g, hi_g);
+    }
+
+    e0[0] = hi_r; e0[1] = hi_g; e0[2] = hi_b;
+    e1[0] = lo_r; e1[1] = lo_g; e1[2] = lo_b;
+}
+
+/* Picks the codes by projecting the colours on the line between the
+ * endpoints: cheaper than searching the nearest palette entry, and as good
+ * when the colours lie close to that line */
+void project_codes(const BlockColors &colors, const int palette[4][3],
+                   bool four_colors, uint8_t *codes)
+{
+    int dir[3], length2 = 0;
+    for (int c = 0; c < 3; c++) {
+        dir[c] = palette[1][c] - palette[0][c];
+        length2 += dir[c] * dir[c];
+    }
+    if (length2 == 0) {
+        std::fill(codes, codes + colors.count, 0);
+        return;
+    }
+
+    for (int i = 0; i < colors.count; i++) {
+        int t = 0;
+        for (int c = 0; c < 3; c++) {
+            t += (colors.rgb[i][c] - palette[0][c]) * dir[c];
+        }
+        /* Count the thresholds halfway between the palette entries (in
+         * units of length2 / 16) which the colour is past, without
+         * branching: the colours of a block are hardly predictable */
+        t *= 16;
+        if (four_colors) {
+            int step = (t >= 3 * length2) + (t >= 8 * length2) +
+                (t >= 13 * length2);
+            codes[i] = (0x78 >> (step * 2)) & 3; /* 0, 2, 3, 1 */
+        } else {
+            int step = (t >= 4 * length2) + (t >= 12 * length2);
+            codes[i] = (0x18 >> (step * 2)) & 3; /* 0, 2, 1 */
+        }
+    }
+}
+
+/* Picks the nearest palette entry for each colour, and returns the total
+ * squared error */
+int nearest_codes(const BlockColors &colors, const int palette[4][3],
+                  int num_codes, uint8_t *codes)
+{
+    int total = 0;
+    for (int i = 0; i < colors.count; i++) {
+        const int *rgb = colors.rgb[i];
+        int best = INT_MAX, code = 0;
+        for (int k = 0; k < num_codes; k++) {
+            int dr = rgb[0] - palette[k][0];
+            int dg = rgb[1] - palette[k][1];
+            int db = rgb[2] - palette[k][2];
+            int error = dr * dr + dg * dg + db * db;
+            /* Written to be compiled without branches */
+            bool better = error < best;
+            best = better ? error : best;
+            code = better ? k : code;
+        }
+        codes[i] = code;
+        total += best;
+    }
+    return total;
+}
+
+/* Solves for the endpoints minimizing the squared error of the colours, given
+ * the codes assigned to them. Returns false if the codes do not determine
+ * both endpoints. */
+bool least_squares_fit(const BlockColors &colors, const uint8_t *codes,
+                       bool four_colors, float *e0, float *e1)
+{
+    /* Weight of the first endpoint in each palette entry */
+    static const float weights4[4] = { 1.0f, 0.0f, 5 / 8.0f, 3 / 8.0f };
+    static const float weights3[4] = { 1.0f, 0.0f, 0.5f, 0.0f };
+    const float *weights = four_colors ? weights4 : weights3;
+
+    float aa = 0, bb = 0, ab = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+    for (int i = 0; i < colors.count; i++) {
+        float a = weights[codes[i]], b = 1.0f - a;
+        aa += a * a;
+        bb += b * b;
+        ab += a * b;
+        for (int c = 0; c < 3; c++) {
+            ax[c] += a * colors.rgb[i][c];
+            bx[c] += b * colors.rgb[i][c];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+    if (det < 1e-4f) return false;
+    for (int c = 0; c < 3; c++) {
+        e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+        e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+    }
+    return true;
+}
+
+void encode_fast(const BlockColors &colors, bool three_colors,
+                 uint16_t &c0, uint16_t &c1, uint8_t *codes)
+{
+    int e0[3], e1[3];
+    range_fit(colors, e0, e1);
+    c0 = pack_565(e0);
+    c1 = pack_565(e1);
+    order_endpoints(c0, c1, three_colors);
+
+    int palette[4][3];
+    build_palette(c0, c1, palette);
+    project_codes(colors, palette, c0 > c1, codes);
+}
+
+/* Starts from the fast fit, then alternates between picking the nearest
+ * palette entries and refitting the endpoints to them */
+void encode_high_quality(const BlockColors &colors, bool three_colors,
+                         uint16_t &c0, uint16_t &c1, uint8_t *codes)
+{
+    encode_fast(colors, three_colors, c0, c1, codes);
+
+    int palette[4][3];
+    build_palette(c0, c1, palette);
+    int best_error = nearest_codes(colors, palette, c0 > c1 ? 4 : 3, codes);
+    for (int iter = 0; iter < 2 && best_error > 0; iter++) {
+        float e0[3], e1[3];
+        if (!least_squares_fit(colors, codes, c0 > c1, e0, e1)) break;
+
+        int i0[3], i1[3];
+        for (int c = 0; c < 3; c++) {
+            i0[c] = int(floorf(e0[c] + 0.5f));
+            i1[c] = int(floorf(e1[c] + 0.5f));
+        }
+        uint16_t q0 = pack_565(i0), q1 = pack_565(i1);
+        order_endpoints(q0, q1, three_colors);
+        if (q0 == c0 && q1 == c1) break;
+
+        uint8_t candidate[16];
+        build_palette(q0, q1, palette);
+        int error = nearest_codes(colors, palette, q0 > q1 ? 4 : 3, candidate);
+        if (error >= best_error) break;
+        best_error = error;
+        c0 = q0;
+        c1 = q1;
+        std::copy(candidate, candidate + colors.count, codes);
+    }
+}
+
+} // anonymous namespace
+
+void _ogx_cmpr_encode_block(const GXColor *pixels, bool alpha,
+                            bool high_quality, uint8_t *out)
+{
+    BlockColors colors;
+    int8_t slots[16];
+    colors.count = 0;
+    for (int i = 0; i < 16; i++) {
+        if (alpha && pixels[i].a < 128) {
+            slots[i] = -1;
+            continue;
+        }
+        slots[i] = colors.count;
+        int *rgb = colors.rgb[colors.count++];
+        rgb[0] = pixels[i].r;
+        rgb[1] = pixels[i].g;
+        rgb[2] = pixels[i].b;
+    }
+
+    /* Blocks with transparent pixels need the three colour mode */
+    bool three_colors = colors.count < 16;
+    uint16_t c0 = 0, c1 = 0;
+    uint8_t codes[16];
+    if (colors.count > 0) {
+        if (high_quality) {
+            encode_high_quality(colors, three_colors, c0, c1, codes);
+        } else {
+            encode_fast(colors, three_colors, c0, c1, codes);
+        }
+    }
+
+    /* The colours are stored as big endian words, followed by a byte for each
+     * row of codes, the leftmost in the top bits */
+    out[0] = c0 >> 8;
+    out[1] = c0;
+    out[2] = c1 >> 8;
+    out[3] = c1;
+    for (int row = 0; row < 4; row++) {
+        uint8_t byte = 0;
+        for (int col = 0; col < 4; col++) {
+            int slot = slots[row * 4 + col];
+            byte = (byte << 2) | (slot < 0 ? transparent_code : codes[slot]);
+        }
+        out[4 + row] = byte;
+    }
+}
@@ -35,6 +35,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "debug.h"
 #include "state.h"
 #include "utils.h"
+#include "vertex_desc.h"
 
 #include <GL/gl.h>
 #include <malloc.h>
@@ -86,11 +87,10 @@ void _ogx_efb_restore_texobj(GXTexObj *texobj)
     u16 height = GX_GetTexObjHeight(texobj);
     GX_LoadTexObj(texobj, GX_TEXMAP0);
 
-    GX_ClearVtxDesc();
-    GX_SetVtxDesc(GX_VA_POS, GX_DIRECT);
-    GX_SetVtxDesc(GX_VA_TEX0, GX_DIRECT);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_POS, GX_POS_XY, GX_U16, 0);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_TEX0, GX_TEX_ST, GX_U8, 0);
+    _ogx_vtxdesc_begin();
+    _ogx_vtxdesc_add(GX_VA_POS, GX_DIRECT, GX_POS_XY, GX_U16, 0);
+    _ogx_vtxdesc_add(GX_VA_TEX0, GX_DIRECT, GX_TEX_ST, GX_U8, 0);
+    u8 vtxfmt = _ogx_vtxdesc_commit();
     GX_SetTexCoordGen(GX_TEXCOORD0, GX_TG_MTX2x4, GX_TG_TEX0, GX_IDENTITY);
     GX_SetNumTexGens(1);
     GX_SetNumTevStages(1);
@@ -117,7 +117,7 @@ void _ogx_efb_restore_texobj(GXTexObj *texobj)
     GX_SetColorUpdate(GX_TRUE);
     glparamstate.dirty.bits.dirty_color_update = 1;
 
-    GX_Begin(GX_QUADS, GX_VTXFMT0, 4);
+    GX_Begin(GX_QUADS, vtxfmt, 4);
     GX_Position2u16(0, 0);
     GX_TexCoord2u8(0, 0);
     GX_Position2u16(0, height);
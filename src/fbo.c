@@ -82,6 +82,8 @@ static inline OgxFramebuffer *framebuffer_from_name(GLuint name)
 static void attach_texture(GLenum target, GLenum attachment,
                            int attachment_type, GLuint texture, GLint level)
 {
+    _ogx_immediate_flush();
+
     if (target == GL_FRAMEBUFFER) target = GL_DRAW_FRAMEBUFFER;
 
     FboType fbo = target == GL_DRAW_FRAMEBUFFER ?
@@ -236,6 +238,8 @@ GLboolean glIsFramebuffer(GLuint framebuffer)
 
 void glBindFramebuffer(GLenum target, GLuint framebuffer)
 {
+    _ogx_immediate_flush();
+
     if (framebuffer == 0) {
     } else {
         OgxFramebuffer *fb = framebuffer_from_name(framebuffer);
@@ -39,6 +39,8 @@ POSSIBILITY OF SUCH DAMAGE.
 int _ogx_functions_c = 0; /* referenced by gc_gl.c, see the comment in there */
 
 #define PROC(name) { #name, name }
+/* For functions only available as extensions */
+#define PROC_ARB(name) { #name, name##ARB }
 static const OgxProcMap s_proc_map[] = {
     PROC(glAccum),
     PROC(glActiveTexture), /* OpenGL 1.3 */
@@ -99,12 +101,14 @@ static const OgxProcMap s_proc_map[] = {
     PROC(glColorMask),
     PROC(glColorMaterial),
     PROC(glColorPointer),
+    PROC(glColorTableEXT), /* GL_EXT_paletted_texture */
     PROC(glCopyPixels),
     //PROC(glCopyTexImage1D),
     //PROC(glCopyTexImage2D),
     //PROC(glCopyTexSubImage1D),
     //PROC(glCopyTexSubImage2D),
     PROC(glCullFace),
+    PROC_ARB(glCurrentPaletteMatrix), /* GL_ARB_matrix_palette */
     PROC(glDeleteBuffers), /* OpenGL 1.5 */
     PROC(glDeleteLists),
     //PROC(glDeleteQueries), /* OpenGL 1.5 */
@@ -115,9 +119,12 @@ static const OgxProcMap s_proc_map[] = {
     PROC(glDisable),
     PROC(glDisableClientState),
     PROC(glDrawArrays),
+    PROC(glDrawArraysInstanced), /* OpenGL 3.1 */
     PROC(glDrawBuffer),
     PROC(glDrawElements),
+    PROC(glDrawElementsInstanced), /* OpenGL 3.1 */
     PROC(glDrawPixels),
+    PROC(glDrawRangeElements), /* OpenGL 1.2 */
     //PROC(glEdgeFlag),
     //PROC(glEdgeFlagPointer),
     //PROC(glEdgeFlagv),
@@ -141,6 +148,7 @@ static const OgxProcMap s_proc_map[] = {
     //PROC(glFeedbackBuffer),
     PROC(glFinish),
     PROC(glFlush),
+    PROC(glFlushMappedBufferRange), /* OpenGL 3.0 */
     PROC(glFogf),
     PROC(glFogfv),
     PROC(glFogi),
@@ -156,6 +164,8 @@ static const OgxProcMap s_proc_map[] = {
     PROC(glGetBufferPointerv), /* OpenGL 1.5 */
     PROC(glGetBufferSubData), /* OpenGL 1.5 */
     //PROC(glGetClipPlane),
+    PROC(glGetColorTableEXT), /* GL_EXT_paletted_texture */
+    PROC(glGetColorTableParameterivEXT), /* GL_EXT_paletted_texture */
     PROC(glGetDoublev),
     PROC(glGetError),
     PROC(glGetFloatv),
@@ -228,6 +238,7 @@ static const OgxProcMap s_proc_map[] = {
     //PROC(glMap2d),
     //PROC(glMap2f),
     PROC(glMapBuffer), /* OpenGL 1.5 */
+    PROC(glMapBufferRange), /* OpenGL 3.0 */
     //PROC(glMapGrid1d),
     //PROC(glMapGrid1f),
     //PROC(glMapGrid2d),
@@ -236,9 +247,16 @@ static const OgxProcMap s_proc_map[] = {
     PROC(glMaterialfv),
     //PROC(glMateriali),
     //PROC(glMaterialiv),
+    PROC_ARB(glMatrixIndexPointer), /* GL_ARB_matrix_palette */
+    PROC_ARB(glMatrixIndexubv), /* GL_ARB_matrix_palette */
+    PROC_ARB(glMatrixIndexuiv), /* GL_ARB_matrix_palette */
+    PROC_ARB(glMatrixIndexusv), /* GL_ARB_matrix_palette */
     PROC(glMatrixMode),
     PROC(glMultMatrixd),
     PROC(glMultMatrixf),
+    PROC(glMultiDrawArrays), /* OpenGL 1.4 */
+    PROC(glMultiDrawElements), /* OpenGL 1.4 */
+    PROC(glMultiDrawElementsBaseVertex), /* OpenGL 3.2 */
     PROC(glMultiTexCoord1d), /* OpenGL 1.3 */
     PROC(glMultiTexCoord1dv), /* OpenGL 1.3 */
     PROC(glMultiTexCoord1f), /* OpenGL 1.3 */
@@ -301,6 +319,7 @@ static const OgxProcMap s_proc_map[] = {
     PROC(glPopClientAttrib),
     PROC(glPopMatrix),
     PROC(glPopName),
+    PROC(glPrimitiveRestartIndex), /* OpenGL 3.1 */
     //PROC(glPrioritizeTextures),
     PROC(glPushAttrib),
     PROC(glPushClientAttrib),
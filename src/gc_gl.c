@@ -46,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 *****************************************************************************/
 
 #include "accum.h"
+#include "array_cache.h"
 #include "call_lists.h"
 #include "clip.h"
 #include "debug.h"
@@ -56,10 +57,12 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "shader.h"
 #include "state.h"
 #include "stencil.h"
+#include "texture.h"
 #include "texture_gen_sw.h"
 #include "texture_unit.h"
 #include "utils.h"
 #include "vbo.h"
+#include "vertex_desc.h"
 
 #include <GL/gl.h>
 #include <gctypes.h>
@@ -84,6 +87,13 @@ uint16_t _ogx_draw_sync_token_received = 0;
 static OgxEfbBuffer *s_efb_scene_buffer = NULL;
 static GXTexObj s_zbuffer_texture;
 static uint8_t s_zbuffer_texels[2 * 32] ATTRIBUTE_ALIGN(32);
+/* The values used by the last EFB copy to clear the EFB */
+static struct {
+    GXColor color;
+    float clearz;
+    int draw_count;
+    bool pending;
+} s_copy_clear;
 static bool s_point_sprites_was_enabled = false;
 /* Force the inclusion of functions.c's TU in the build when GL functions are
  * used. In this way, if a client library (such as SDL) defines weak symbols
@@ -158,12 +168,17 @@ static inline void update_projection_matrix()
     _ogx_set_projection(*glparamstate.proj_ptr);
 }
 
-static inline void update_normal_matrix()
+static inline void load_normal_matrix(Mtx modelview, u32 pnidx)
 {
     Mtx mvinverse, normalm;
-    guMtxInverse(glparamstate.modelview_matrix, mvinverse);
+    guMtxInverse(modelview, mvinverse);
     guMtxTranspose(mvinverse, normalm);
-    GX_LoadNrmMtxImm(normalm, GX_PNMTX0);
+    GX_LoadNrmMtxImm(normalm, pnidx);
+}
+
+static inline void update_normal_matrix()
+{
+    load_normal_matrix(glparamstate.modelview_matrix, GX_PNMTX0);
 }
 
 static void setup_cull_mode()
@@ -232,12 +247,40 @@ int ogx_enable_double_buffering(int double_buffering)
     return had_double_buffering;
 }
 
+static inline uint32_t clear_depth_value()
+{
+    /* Our z-buffer depth is 24 bits */
+    return glparamstate.clearz * ((1 << 24) - 1);
+}
+
+int ogx_enable_copy_clear(int copy_clear)
+{
+    int had_copy_clear = glparamstate.copy_clear_enabled;
+    glparamstate.copy_clear_enabled = copy_clear;
+    s_copy_clear.pending = false;
+    return had_copy_clear;
+}
+
 int ogx_prepare_swap_buffers()
 {
     if (glparamstate.render_mode != GL_RENDER) return -1;
+    _ogx_immediate_flush();
+    if (glparamstate.copy_clear_enabled) {
+        /* The EFB copy will clear the scene with these values */
+        GX_SetCopyClear(glparamstate.clear_color, clear_depth_value());
+        s_copy_clear.color = glparamstate.clear_color;
+        s_copy_clear.clearz = glparamstate.clearz;
+        s_copy_clear.draw_count = glparamstate.draw_count;
+        s_copy_clear.pending = _ogx_efb_content_type == OGX_EFB_SCENE &&
+            _ogx_fbo_state.draw_target == 0;
+    }
     _ogx_draw_sync_token = 0;
     GX_SetDrawSync(0);
     _ogx_vbo_clear_unbound_buffers();
+    _ogx_texture_clear_retired();
+    _ogx_array_cache_frame_done();
+    /* The integration library might draw with GX between frames */
+    _ogx_vtxdesc_invalidate();
     return 0;
 }
 
@@ -252,6 +295,18 @@ static int parse_hints()
     if (env) {
         if (strstr(env, "sphere_map") != NULL)
             hints |= OGX_HINT_FAST_SPHERE_MAP;
+        if (strstr(env, "indexed_arrays") != NULL)
+            hints |= OGX_HINT_INDEXED_CLIENT_ARRAYS;
+        if (strstr(env, "quantized_vbos") != NULL)
+            hints |= OGX_HINT_QUANTIZE_STATIC_VBOS;
+        if (strstr(env, "cached_arrays") != NULL)
+            hints |= OGX_HINT_CACHE_CLIENT_ARRAYS;
+        if (strstr(env, "reordered_indices") != NULL)
+            hints |= OGX_HINT_REORDER_INDICES;
+        if (strstr(env, "batch_immediate") != NULL)
+            hints |= OGX_HINT_BATCH_IMMEDIATE;
+        if (strstr(env, "palettized_textures") != NULL)
+            hints |= OGX_HINT_PALETTIZE_TEXTURES;
     }
 
     glparamstate.hints = hints;
@@ -267,6 +322,7 @@ void ogx_initialize()
     _ogx_log_init();
 
     _ogx_gpu_resources_init();
+    _ogx_texture_init();
     parse_hints();
 
     glparamstate.current_call_list.index = -1;
@@ -331,6 +387,8 @@ void ogx_initialize()
     glparamstate.active_texture = 0;
     glparamstate.point_sprites_enabled = 0;
     glparamstate.point_sprites_coord_replace = 0;
+    glparamstate.primitive_restart_enabled = 0;
+    glparamstate.primitive_restart_index = 0;
 
     glparamstate.cur_proj_mat = -1;
     glparamstate.cur_modv_mat = -1;
@@ -338,6 +396,13 @@ void ogx_initialize()
     glLoadIdentity();
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
+    for (int i = 0; i < MAX_PALETTE_MATRICES; i++) {
+        guMtxIdentity(glparamstate.matrix_palette.matrices[i]);
+    }
+    glparamstate.matrix_palette.dirty_mask = (1 << MAX_PALETTE_MATRICES) - 1;
+    glparamstate.matrix_palette.current = 0;
+    glparamstate.matrix_palette.current_index = 0;
+    glparamstate.matrix_palette.enabled = false;
     glparamstate.mv_ptr = &glparamstate.modelview_matrix;
     glparamstate.proj_ptr = &glparamstate.projection_matrix;
     glparamstate.update_matrices = _ogx_update_matrices_fixed_pipeline;
@@ -358,6 +423,9 @@ void ogx_initialize()
     glparamstate.imm_mode.current_normal[2] = 1.0f;
     glparamstate.imm_mode.current_numverts = 0;
     glparamstate.imm_mode.in_gl_begin = 0;
+    glparamstate.imm_mode.can_stream = 0;
+    glparamstate.imm_mode.streaming = 0;
+    glparamstate.imm_mode.batch_numverts = 0;
 
     glparamstate.cs.as_int = 0; // DisableClientState on everything
 
@@ -487,13 +555,8 @@ void ogx_initialize()
     glparamstate.error = GL_NO_ERROR;
     glparamstate.draw_count = 0;
 
-    // Setup data types for every possible attribute
-
-    // Typical straight float
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_POS, GX_POS_XYZ, GX_F32, 0);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_NRM, GX_NRM_XYZ, GX_F32, 0);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_TEX0, GX_TEX_ST, GX_F32, 0);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_CLR0, GX_CLR_RGBA, GX_RGBA8, 0);
+    /* The vertex formats are programmed on demand, at draw time */
+    _ogx_vtxdesc_invalidate();
 
     // Mark all the hardware data as dirty, so it will be recalculated
     // and uploaded again to the hardware
@@ -690,6 +753,17 @@ void glEnable(GLenum cap)
         glparamstate.point_sprites_enabled = 1;
         glparamstate.dirty.bits.dirty_attributes = 1;
         break;
+    case GL_PRIMITIVE_RESTART:
+        glparamstate.primitive_restart_enabled = 1;
+        break;
+    case GL_MATRIX_PALETTE_ARB:
+        glparamstate.matrix_palette.enabled = true;
+        /* The slots might have been used for something else meanwhile */
+        glparamstate.matrix_palette.dirty_mask =
+            (1 << MAX_PALETTE_MATRICES) - 1;
+        glparamstate.dirty.bits.dirty_matrices = 1;
+        glparamstate.dirty.bits.dirty_attributes = 1;
+        break;
     case GL_POLYGON_OFFSET_FILL:
         glparamstate.polygon_offset_fill = 1;
         glparamstate.dirty.bits.dirty_matrices = 1;
@@ -769,6 +843,14 @@ void glDisable(GLenum cap)
     case GL_POINT_SPRITE:
         glparamstate.point_sprites_enabled = 0;
         break;
+    case GL_PRIMITIVE_RESTART:
+        glparamstate.primitive_restart_enabled = 0;
+        break;
+    case GL_MATRIX_PALETTE_ARB:
+        glparamstate.matrix_palette.enabled = false;
+        glparamstate.dirty.bits.dirty_matrices = 1;
+        glparamstate.dirty.bits.dirty_attributes = 1;
+        break;
     case GL_POLYGON_OFFSET_FILL:
         glparamstate.polygon_offset_fill = 0;
         glparamstate.dirty.bits.dirty_matrices = 1;
@@ -1022,67 +1104,6 @@ void glFrontFace(GLenum mode)
     }
 }
 
-void glBegin(GLenum mode)
-{
-    // Just discard all the data!
-    glparamstate.imm_mode.current_numverts = 0;
-    glparamstate.imm_mode.prim_type = mode;
-    glparamstate.imm_mode.in_gl_begin = 1;
-    glparamstate.imm_mode.has_color = 0;
-    glparamstate.imm_mode.has_normal = 0;
-    glparamstate.imm_mode.has_texcoord = 0;
-    if (!glparamstate.imm_mode.current_vertices) {
-        int count = 64;
-        warning("First malloc %d", errno);
-        void *buffer = malloc(count * sizeof(VertexData));
-        if (buffer) {
-            glparamstate.imm_mode.current_vertices = buffer;
-            glparamstate.imm_mode.current_vertices_size = count;
-        } else {
-            warning("Failed to allocate memory for vertex buffer (%d)", errno);
-            set_error(GL_OUT_OF_MEMORY);
-        }
-    }
-}
-
-void glEnd()
-{
-    union client_state cs_backup = glparamstate.cs;
-    VertexData *base = glparamstate.imm_mode.current_vertices;
-    int stride = sizeof(VertexData);
-
-    OgxVertexAttribArray arrays_backup[OGX_ATTR_INDEX_COUNT];
-    memcpy(arrays_backup, glparamstate.arrays, sizeof(arrays_backup));
-
-    glVertexPointer(3, GL_FLOAT, stride, base->pos);
-
-    if (glparamstate.imm_mode.has_normal) {
-        glNormalPointer(GL_FLOAT, stride, base->norm);
-    }
-
-    if (glparamstate.imm_mode.has_color) {
-        glColorPointer(4, GL_UNSIGNED_BYTE, stride, &base->color);
-    }
-
-    for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
-        if (glparamstate.imm_mode.has_texcoord & (1 << i)) {
-            glparamstate.cs.active_texture = i;
-            glTexCoordPointer(2, GL_FLOAT, stride, base->tex[i]);
-        }
-    }
-
-    glparamstate.cs.texcoord_enabled = glparamstate.imm_mode.has_texcoord;
-    glparamstate.cs.color_enabled = glparamstate.imm_mode.has_color;
-    glparamstate.cs.normal_enabled = glparamstate.imm_mode.has_normal;
-    glparamstate.cs.vertex_enabled = 1;
-    glDrawArrays(glparamstate.imm_mode.prim_type, 0, glparamstate.imm_mode.current_numverts);
-    glparamstate.cs = cs_backup;
-    memcpy(glparamstate.arrays, arrays_backup, sizeof(arrays_backup));
-    glparamstate.imm_mode.in_gl_begin = 0;
-
-    glparamstate.dirty.bits.dirty_attributes = 1;
-}
-
 void glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
 {
     if (_ogx_fbo_state.draw_target == 0 && width > 640)
@@ -1125,11 +1146,23 @@ void glMatrixMode(GLenum mode)
     case GL_TEXTURE:
         glparamstate.matrixmode = 2;
         break;
+    case GL_MATRIX_PALETTE_ARB:
+        glparamstate.matrixmode = 3;
+        break;
     default:
         glparamstate.matrixmode = -1;
         break;
     }
 }
+
+void glCurrentPaletteMatrixARB(GLint index)
+{
+    if (index < 0 || index >= matrix_palette_size()) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+    glparamstate.matrix_palette.current = index;
+}
 void glPopMatrix(void)
 {
     HANDLE_CALL_LIST(POP_MATRIX);
@@ -1162,6 +1195,10 @@ void glPopMatrix(void)
         }
         glparamstate.dirty.bits.dirty_tev = 1;
         break;
+    case 3:
+        /* The palette matrices have no stack */
+        set_error(GL_STACK_UNDERFLOW);
+        return;
     default:
         break;
     }
@@ -1200,6 +1237,10 @@ void glPushMatrix(void)
                    tu->matrix[tu->matrix_index], sizeof(Mtx));
             tu->matrix_index++;
         }
+        break;
+    case 3:
+        set_error(GL_STACK_OVERFLOW);
+        return;
     default:
         break;
     }
@@ -1207,6 +1248,8 @@ void glPushMatrix(void)
 
 void glLoadMatrixf(const GLfloat *m)
 {
+    HANDLE_CALL_LIST(LOAD_MATRIX, m);
+
     switch (glparamstate.matrixmode) {
     case 0:
         gl_matrix_to_gx44(m, glparamstate.projection_matrix);
@@ -1221,6 +1264,9 @@ void glLoadMatrixf(const GLfloat *m)
         }
         glparamstate.dirty.bits.dirty_tev = 1;
         break;
+    case 3:
+        gl_matrix_to_gx(m, *current_palette_matrix());
+        break;
     default:
         return;
     }
@@ -1256,6 +1302,9 @@ void glMultMatrixf(const GLfloat *m)
         target = current_tex_matrix();
         glparamstate.dirty.bits.dirty_tev = 1;
         break;
+    case 3:
+        target = current_palette_matrix();
+        break;
     default:
         break;
     }
@@ -1285,6 +1334,9 @@ void glLoadIdentity()
         }
         glparamstate.dirty.bits.dirty_tev = 1;
         break;
+    case 3:
+        guMtxIdentity(*current_palette_matrix());
+        break;
     default:
         return;
     }
@@ -1310,6 +1362,9 @@ void glScalef(GLfloat x, GLfloat y, GLfloat z)
         target = current_tex_matrix();
         glparamstate.dirty.bits.dirty_tev = 1;
         break;
+    case 3:
+        target = current_palette_matrix();
+        break;
     default:
         break;
     }
@@ -1349,6 +1404,9 @@ void glTranslatef(GLfloat x, GLfloat y, GLfloat z)
         target = current_tex_matrix();
         glparamstate.dirty.bits.dirty_tev = 1;
         break;
+    case 3:
+        target = current_palette_matrix();
+        break;
     default:
         break;
     }
@@ -1382,6 +1440,9 @@ void glRotatef(GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
         target = current_tex_matrix();
         glparamstate.dirty.bits.dirty_tev = 1;
         break;
+    case 3:
+        target = current_palette_matrix();
+        break;
     default:
         break;
     }
@@ -1415,12 +1476,39 @@ void glClearDepth(GLclampd depth)
 
 // Clearing is simulated by rendering a big square with the depth value
 // and the desired color
+/* Tells whether the EFB still holds what the last EFB copy (with the clear
+ * flag) left there, and that matches what glClear() would draw */
+static bool efb_cleared_by_copy(GLbitfield mask)
+{
+    if (!s_copy_clear.pending ||
+        s_copy_clear.draw_count != glparamstate.draw_count ||
+        _ogx_efb_content_type != OGX_EFB_SCENE ||
+        _ogx_fbo_state.draw_target != 0 ||
+        glparamstate.scissor_enabled) return false;
+
+    const GXColor *color = &glparamstate.clear_color;
+    if ((mask & GL_COLOR_BUFFER_BIT) &&
+        (color->r != s_copy_clear.color.r ||
+         color->g != s_copy_clear.color.g ||
+         color->b != s_copy_clear.color.b ||
+         color->a != s_copy_clear.color.a)) return false;
+
+    if ((mask & GL_DEPTH_BUFFER_BIT) &&
+        glparamstate.clearz != s_copy_clear.clearz) return false;
+
+    return true;
+}
+
 void glClear(GLbitfield mask)
 {
+    _ogx_immediate_flush();
     if (glparamstate.render_mode == GL_SELECT) {
         return;
     }
 
+    bool cleared_by_copy = efb_cleared_by_copy(mask);
+    s_copy_clear.pending = false;
+
     /* Since this function is typically called at the beginning of a frame, and
      * the integration library might have draw something on the screen right
      * before (typically, a mouse cursor), we assume the scissor to be dirty
@@ -1440,6 +1528,12 @@ void glClear(GLbitfield mask)
         _ogx_accum_clear();
     }
 
+    if (cleared_by_copy || !(mask & (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT))) {
+        /* Nothing to draw */
+        glparamstate.draw_count++;
+        return;
+    }
+
     if (mask & GL_DEPTH_BUFFER_BIT) {
         GX_SetZMode(GX_TRUE, GX_ALWAYS, GX_TRUE);
         GX_SetZCompLoc(GX_DISABLE);
@@ -1448,8 +1542,7 @@ void glClear(GLbitfield mask)
 
         /* Create a 1x1 Z-texture to set the desired depth */
         if (glparamstate.dirty.bits.dirty_clearz) {
-            /* Our z-buffer depth is 24 bits */
-            uint32_t depth = glparamstate.clearz * ((1 << 24) - 1);
+            uint32_t depth = clear_depth_value();
             s_zbuffer_texels[0] = 0xff; // ignored
             s_zbuffer_texels[1] = (depth >> 16) & 0xff;
             s_zbuffer_texels[32] = (depth >> 8) & 0xff;
@@ -1483,13 +1576,11 @@ void glClear(GLbitfield mask)
     GX_SetTevOp(GX_TEVSTAGE0, GX_PASSCLR);
     GX_SetChanCtrl(GX_COLOR0A0, GX_DISABLE, GX_SRC_VTX, GX_SRC_VTX, 0, GX_DF_NONE, GX_AF_NONE);
 
-    GX_ClearVtxDesc();
-    GX_SetVtxDesc(GX_VA_POS, GX_DIRECT);
-    GX_SetVtxDesc(GX_VA_CLR0, GX_DIRECT);
-    GX_SetVtxDesc(GX_VA_TEX0, GX_DIRECT);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_POS, GX_POS_XY, GX_U16, 0);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_CLR0, GX_CLR_RGBA, GX_RGBA8, 0);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_TEX0, GX_TEX_ST, GX_U8, 0);
+    _ogx_vtxdesc_begin();
+    _ogx_vtxdesc_add(GX_VA_POS, GX_DIRECT, GX_POS_XY, GX_U16, 0);
+    _ogx_vtxdesc_add(GX_VA_CLR0, GX_DIRECT, GX_CLR_RGBA, GX_RGBA8, 0);
+    _ogx_vtxdesc_add(GX_VA_TEX0, GX_DIRECT, GX_TEX_ST, GX_U8, 0);
+    u8 vtxfmt = _ogx_vtxdesc_commit();
     GX_SetTexCoordGen(GX_TEXCOORD0, GX_TG_MTX2x4, GX_TG_TEX0, GX_IDENTITY);
     GX_InvVtxCache();
 
@@ -1499,7 +1590,7 @@ void glClear(GLbitfield mask)
         glparamstate.dirty.bits.dirty_fog = 1;
     }
 
-    GX_Begin(GX_QUADS, GX_VTXFMT0, 4);
+    GX_Begin(GX_QUADS, vtxfmt, 4);
     GX_Position2u16(0, 0);
     GX_Color4u8(glparamstate.clear_color.r, glparamstate.clear_color.g, glparamstate.clear_color.b, glparamstate.clear_color.a);
     GX_TexCoord2u8(0, 0);
@@ -1554,6 +1645,8 @@ GLint glRenderMode(GLenum mode)
 {
     int hit_count;
 
+    _ogx_immediate_flush();
+
     switch (mode) {
     case GL_RENDER:
     case GL_SELECT:
@@ -1567,11 +1660,16 @@ GLint glRenderMode(GLenum mode)
     return hit_count;
 }
 
-void glFlush() {} // All commands are sent immediately to draw, no queue, so pointless
+// Apart from the immediate mode batch, all commands are sent immediately
+void glFlush()
+{
+    _ogx_immediate_flush();
+}
 
 // Waits for all the commands to be successfully executed
 void glFinish()
 {
+    _ogx_immediate_flush();
     GX_DrawDone(); // Be careful, WaitDrawDone waits for the DD command, this sends AND waits for it
 }
 
@@ -1674,11 +1772,14 @@ void glPointSize(GLfloat size)
 {
     unsigned int gxsize = size;
     if (gxsize > 255) gxsize = 255;
+    /* The pending batch must be drawn with the old size */
+    _ogx_immediate_flush();
     GX_SetPointSize(gxsize, GX_TO_ONE);
 }
 
 void glLineWidth(GLfloat width)
 {
+    _ogx_immediate_flush();
     GX_SetLineWidth((unsigned int)(width * 16), GX_TO_ZERO);
 }
 
@@ -1733,6 +1834,9 @@ void glDisableClientState(GLenum cap)
     case GL_VERTEX_ARRAY:
         glparamstate.cs.vertex_enabled = 0;
         break;
+    case GL_MATRIX_INDEX_ARRAY_ARB:
+        glparamstate.cs.matrix_index_enabled = 0;
+        break;
     case GL_EDGE_FLAG_ARRAY:
     case GL_FOG_COORD_ARRAY:
     case GL_SECONDARY_COLOR_ARRAY:
@@ -1761,6 +1865,9 @@ void glEnableClientState(GLenum cap)
     case GL_VERTEX_ARRAY:
         glparamstate.cs.vertex_enabled = 1;
         break;
+    case GL_MATRIX_INDEX_ARRAY_ARB:
+        glparamstate.cs.matrix_index_enabled = 1;
+        break;
     case GL_EDGE_FLAG_ARRAY:
     case GL_FOG_COORD_ARRAY:
     case GL_SECONDARY_COLOR_ARRAY:
@@ -1810,6 +1917,57 @@ void glTexCoordPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *po
     glparamstate.dirty.bits.dirty_attributes = 1;
 }
 
+void glMatrixIndexPointerARB(GLint size, GLenum type, GLsizei stride,
+                             const GLvoid *pointer)
+{
+    /* GX can only select one matrix per vertex */
+    if (size != 1 || stride < 0) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+    if (type != GL_UNSIGNED_BYTE && type != GL_UNSIGNED_SHORT &&
+        type != GL_UNSIGNED_INT) {
+        set_error(GL_INVALID_ENUM);
+        return;
+    }
+
+    STATE_ARRAY(MTX).vbo = glparamstate.bound_vbo_array;
+    STATE_ARRAY(MTX).size = size;
+    STATE_ARRAY(MTX).type = type;
+    STATE_ARRAY(MTX).stride = stride;
+    STATE_ARRAY(MTX).pointer = pointer;
+    glparamstate.dirty.bits.dirty_attributes = 1;
+}
+
+static void set_current_matrix_index(GLint size, GLuint index)
+{
+    if (size != 1) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+    if (index >= (GLuint)matrix_palette_size()) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+    glparamstate.matrix_palette.current_index = index;
+    glparamstate.dirty.bits.dirty_matrices = 1;
+}
+
+void glMatrixIndexubvARB(GLint size, const GLubyte *indices)
+{
+    set_current_matrix_index(size, indices[0]);
+}
+
+void glMatrixIndexusvARB(GLint size, const GLushort *indices)
+{
+    set_current_matrix_index(size, indices[0]);
+}
+
+void glMatrixIndexuivARB(GLint size, const GLuint *indices)
+{
+    set_current_matrix_index(size, indices[0]);
+}
+
 void glInterleavedArrays(GLenum format, GLsizei stride, const GLvoid *pointer)
 {
     OgxVertexAttribArray *vertex = &STATE_ARRAY(POS);
@@ -2156,6 +2314,11 @@ static inline bool point_sprites_changed(uint8_t gxmode)
 /* "fp" stands for "fixed pipeline" */
 void _ogx_fp_update_vertex_array_readers(OgxDrawMode mode)
 {
+    if (glparamstate.matrix_palette.enabled &&
+        glparamstate.cs.matrix_index_enabled) {
+        _ogx_array_add(GX_VA_PTNMTXIDX, &STATE_ARRAY(MTX));
+    }
+
     if (glparamstate.cs.vertex_enabled) {
         _ogx_array_add(GX_VA_POS, &STATE_ARRAY(POS));
     }
@@ -2492,11 +2655,31 @@ bool _ogx_setup_render_stages()
     return should_draw;
 }
 
+static void update_palette_matrices()
+{
+    uint16_t loaded = (1 << matrix_palette_size()) - 1;
+    uint16_t mask = glparamstate.matrix_palette.dirty_mask & loaded;
+    for (int i = 0; mask != 0; i++, mask >>= 1) {
+        if (!(mask & 1)) continue;
+        _ogx_load_modelview_matrix(glparamstate.matrix_palette.matrices[i],
+                                   matrix_palette_pnmtx(i));
+    }
+    glparamstate.matrix_palette.dirty_mask &= ~loaded;
+    /* Used by the vertices not carrying their own matrix index */
+    int current = glparamstate.matrix_palette.current_index;
+    GX_SetCurrentMtx(matrix_palette_pnmtx(current));
+}
+
 void _ogx_update_matrices_fixed_pipeline()
 {
-    update_modelview_matrix();
+    if (glparamstate.matrix_palette.enabled) {
+        /* The palette matrices replace the modelview matrix */
+        update_palette_matrices();
+    } else {
+        update_modelview_matrix();
+        update_normal_matrix();
+    }
     update_projection_matrix();
-    update_normal_matrix();
 }
 
 void _ogx_apply_state()
@@ -2572,7 +2755,7 @@ static void draw_arrays_general(const OgxDrawData *draw_data)
     GX_InvVtxCache();
 
     bool loop = draw_data->gxmode.loop;
-    GX_Begin(draw_data->gxmode.mode, GX_VTXFMT0, count + loop);
+    GX_Begin(draw_data->gxmode.mode, _ogx_vtxdesc_vtxfmt, count + loop);
     int i;
     for (i = 0; i < count + loop; i++) {
         int j = i % count + first;
@@ -2586,31 +2769,15 @@ static void flat_draw_geometry(void *cb_data)
     OgxDrawData *data = cb_data;
 
     _ogx_arrays_setup_draw(data, OGX_DRAW_FLAG_FLAT);
-    /* TODO: we could use C++ templates here too, to build more effective
-     * drawing functions that only process the data we need. */
     draw_arrays_general(data);
 }
 
 static void draw_elements_general(const OgxDrawData *draw_data)
 {
-    const GLvoid *indices = draw_data->indices;
-    GLsizei count = draw_data->count;
-
     // Invalidate vertex data as may have been modified by the user
     GX_InvVtxCache();
 
-    if (glparamstate.bound_vbo_element_array) {
-        indices = _ogx_vbo_get_data(glparamstate.bound_vbo_element_array,
-                                    indices);
-    }
-
-    bool loop = draw_data->gxmode.loop;
-    GX_Begin(draw_data->gxmode.mode, GX_VTXFMT0, count + loop);
-    for (int i = 0; i < count + loop; i++) {
-        int index = read_index(indices, draw_data->type, i % count);
-        _ogx_arrays_process_element(index);
-    }
-    GX_End();
+    _ogx_arrays_draw_elements(draw_data);
 }
 
 static void flat_draw_elements(void *cb_data)
@@ -2625,6 +2792,9 @@ void glArrayElement(GLint i)
 {
     float value[3];
 
+    /* The vertex arrays readers are needed to read the client arrays */
+    _ogx_immediate_stream_stop();
+
     if (glparamstate.dirty.bits.dirty_attributes) {
         /* The draw mode is not really relevant here, since the actual drawing
          * is performed in glEnd(), at which time we'll take care of handling
@@ -2681,6 +2851,12 @@ static bool setup_draw(const OgxDrawData *draw_data)
     return true;
 }
 
+void _ogx_load_modelview_matrix(Mtx modelview, u32 pnidx)
+{
+    GX_LoadPosMtxImm(modelview, pnidx);
+    load_normal_matrix(modelview, pnidx);
+}
+
 void _ogx_update_matrices()
 {
     if (glparamstate.dirty.bits.dirty_matrices) {
@@ -2695,8 +2871,104 @@ static void draw_done()
     _ogx_shader_draw_done();
 }
 
-void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+/* The GX lists where the geometry of instanced draws is recorded, so that it
+ * can be replayed once per instance. They are used in turn, so that recording
+ * a list rarely needs to wait for the GP to be done with its previous use. */
+#define INSTANCE_LIST_SLOTS 4
+typedef struct {
+    void *data;
+    u32 capacity;
+    u32 size; /* of the recorded list */
+    /* Token signalling that the GP is done with the last replay */
+    uint16_t sync_token;
+} InstanceList;
+static InstanceList s_instance_lists[INSTANCE_LIST_SLOTS];
+static int s_instance_list_next;
+
+typedef void (*DrawFunc)(const OgxDrawData *draw_data);
+
+static InstanceList *record_instance_list(DrawFunc draw,
+                                          const OgxDrawData *draw_data)
+{
+    InstanceList *list = &s_instance_lists[s_instance_list_next];
+    s_instance_list_next = (s_instance_list_next + 1) % INSTANCE_LIST_SLOTS;
+
+    /* Wait until the GP has finished replaying the list */
+    uint16_t token = list->sync_token;
+    if (token > _ogx_draw_sync_token) {
+        /* The token counter was reset at the end of the frame */
+        token = send_draw_sync_token();
+        GX_Flush();
+    }
+    while (GX_GetDrawSync() < token);
+
+    /* The vertex data, the GX_Begin() header of each primitive (primitive
+     * restart can split the draw into many) and the vertex cache
+     * invalidation; GX_EndDispList() pads the list to 32 bytes. */
+    u32 count = draw_data->count;
+    u32 num_headers = glparamstate.primitive_restart_enabled ? count : 1;
+    /* Line loops repeat the first vertex of each primitive */
+    if (draw_data->gxmode.loop) count += num_headers;
+    u32 needed = _ogx_vtxdesc_vertex_size() * count + num_headers * 3 + 1;
+    needed = (needed + 31) & ~31;
+    if (list->capacity < needed) {
+        free(list->data);
+        list->data = memalign(32, needed);
+        if (!list->data) {
+            list->capacity = 0;
+            warning("Failed to allocate %u bytes for instancing", needed);
+            return NULL;
+        }
+        list->capacity = needed;
+    }
+
+    DCInvalidateRange(list->data, list->capacity);
+    GX_BeginDispList(list->data, list->capacity);
+    draw(draw_data);
+    list->size = GX_EndDispList();
+    if (list->size == 0) {
+        warning("Instanced draw overflowed its list");
+        return NULL;
+    }
+    return list;
+}
+
+static void draw_instances(const OgxDrawData *draw_data,
+                           GLsizei instancecount, DrawFunc draw)
 {
+    bool has_program = glparamstate.current_program != 0;
+
+    /* All the instances share the same geometry: instead of emitting the
+     * vertex data once per instance, record it into a GX list and call it
+     * after updating the per-instance state. */
+    InstanceList *list = instancecount > 1 ?
+        record_instance_list(draw, draw_data) : NULL;
+    if (!list) {
+        for (GLsizei i = 0; i < instancecount; i++) {
+            if (has_program) _ogx_shader_setup_instance(i);
+            draw(draw_data);
+        }
+        return;
+    }
+
+    for (GLsizei i = 0; i < instancecount; i++) {
+        if (has_program) _ogx_shader_setup_instance(i);
+        GX_CallDispList(list->data, list->size);
+    }
+    list->sync_token = send_draw_sync_token();
+}
+
+static inline bool recording_call_list()
+{
+    return glparamstate.current_call_list.index >= 0 &&
+        glparamstate.current_call_list.execution_depth == 0;
+}
+
+static void draw_arrays(GLenum mode, GLint first, GLsizei count,
+                        GLsizei instancecount)
+{
+    _ogx_immediate_flush();
+
     OgxDrawMode gxmode = _ogx_draw_mode(mode);
     if (gxmode.mode == 0xff)
         return;
@@ -2723,7 +2995,7 @@ void glDrawArrays(GLenum mode, GLint first, GLsizei count)
 
     bool should_draw = setup_draw(&draw_data);
     if (should_draw) {
-        draw_arrays_general(&draw_data);
+        draw_instances(&draw_data, instancecount, draw_arrays_general);
         glparamstate.draw_count++;
     }
     draw_done();
@@ -2731,12 +3003,43 @@ void glDrawArrays(GLenum mode, GLint first, GLsizei count)
     _ogx_gpu_resources_pop();
 }
 
-void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices)
+void glDrawArrays(GLenum mode, GLint first, GLsizei count)
 {
+    draw_arrays(mode, first, count, 1);
+}
+
+void glDrawArraysInstanced(GLenum mode, GLint first, GLsizei count,
+                           GLsizei instancecount)
+{
+    if (count < 0 || instancecount < 0) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+    if (instancecount == 0) return;
+
+    if (recording_call_list()) {
+        /* Display lists have no notion of instances */
+        for (GLsizei i = 0; i < instancecount; i++) {
+            glDrawArrays(mode, first, count);
+        }
+        return;
+    }
+
+    draw_arrays(mode, first, count, instancecount);
+}
+
+static void draw_elements(GLenum mode, GLsizei count, GLenum type,
+                          const GLvoid *indices,
+                          bool has_range, GLuint start, GLuint end,
+                          GLsizei instancecount)
+{
+    _ogx_immediate_flush();
+
     OgxDrawMode gxmode = _ogx_draw_mode(mode);
     if (gxmode.mode == 0xff)
         return;
 
+    /* The range is just a hint, there's no need to store it in the list */
     HANDLE_CALL_LIST(DRAW_ELEMENTS, mode, count, type, indices);
 
     if (glparamstate.dirty.bits.dirty_attributes ||
@@ -2748,7 +3051,9 @@ void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indic
     ppcsync();
 
     _ogx_update_matrices();
-    OgxDrawData draw_data = { gxmode, count, 0, type, indices };
+    OgxDrawData draw_data = {
+        gxmode, count, 0, type, indices, has_range, start, end
+    };
     if (glparamstate.stencil.enabled) {
         _ogx_gpu_resources_push();
         _ogx_stencil_draw(flat_draw_elements, &draw_data);
@@ -2759,7 +3064,7 @@ void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indic
 
     bool should_draw = setup_draw(&draw_data);
     if (should_draw) {
-        draw_elements_general(&draw_data);
+        draw_instances(&draw_data, instancecount, draw_elements_general);
         glparamstate.draw_count++;
     }
     draw_done();
@@ -2767,6 +3072,669 @@ void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indic
     _ogx_gpu_resources_pop();
 }
 
+void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices)
+{
+    draw_elements(mode, count, type, indices, false, 0, 0, 1);
+}
+
+void glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type,
+                             const void *indices, GLsizei instancecount)
+{
+    if (count < 0 || instancecount < 0) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+    if (instancecount == 0) return;
+
+    if (recording_call_list()) {
+        for (GLsizei i = 0; i < instancecount; i++) {
+            glDrawElements(mode, count, type, indices);
+        }
+        return;
+    }
+
+    draw_elements(mode, count, type, indices, false, 0, 0, instancecount);
+}
+
+void glDrawRangeElements(GLenum mode, GLuint start, GLuint end, GLsizei count,
+                         GLenum type, const GLvoid *indices)
+{
+    if (end < start || count < 0) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+
+    draw_elements(mode, count, type, indices, true, start, end, 1);
+}
+
+static void flat_multi_draw(void *cb_data)
+{
+    OgxMultiDrawData *md = cb_data;
+
+    _ogx_arrays_setup_draw(&md->draw_data, OGX_DRAW_FLAG_FLAT);
+    GX_InvVtxCache();
+    _ogx_arrays_multi_draw(md);
+}
+
+/* Runs the state setup and the stencil pass only once for all the
+ * sub-draws */
+static void multi_draw(GLenum mode, OgxMultiDrawData *md)
+{
+    _ogx_immediate_flush();
+
+    OgxDrawMode gxmode = _ogx_draw_mode(mode);
+    if (gxmode.mode == 0xff)
+        return;
+
+    if (glparamstate.dirty.bits.dirty_attributes ||
+        /* Point sprites need special handling */
+        point_sprites_changed(gxmode.mode))
+        _ogx_update_vertex_array_readers(gxmode);
+
+    md->draw_data.gxmode = gxmode;
+    if (!_ogx_arrays_setup_multi_draw_data(md)) return;
+
+    /* If VBOs are in use, make sure their data has been updated */
+    ppcsync();
+
+    _ogx_update_matrices();
+    if (glparamstate.stencil.enabled) {
+        _ogx_gpu_resources_push();
+        _ogx_stencil_draw(flat_multi_draw, md);
+        _ogx_gpu_resources_pop();
+    }
+
+    _ogx_gpu_resources_push();
+
+    bool should_draw = setup_draw(&md->draw_data);
+    if (should_draw) {
+        if (glparamstate.current_program) _ogx_shader_setup_instance(0);
+        GX_InvVtxCache();
+        _ogx_arrays_multi_draw(md);
+        glparamstate.draw_count++;
+    }
+    draw_done();
+
+    _ogx_gpu_resources_pop();
+}
+
+void glMultiDrawArrays(GLenum mode, const GLint *first, const GLsizei *count,
+                       GLsizei drawcount)
+{
+    if (drawcount < 0) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+
+    if (recording_call_list()) {
+        for (GLsizei i = 0; i < drawcount; i++) {
+            glDrawArrays(mode, first[i], count[i]);
+        }
+        return;
+    }
+
+    OgxMultiDrawData md = {
+        .drawcount = drawcount,
+        .count = count,
+        .first = first,
+    };
+    multi_draw(mode, &md);
+}
+
+void glMultiDrawElementsBaseVertex(GLenum mode, const GLsizei *count,
+                                   GLenum type, const void *const *indices,
+                                   GLsizei drawcount, const GLint *basevertex)
+{
+    if (drawcount < 0) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+    if (type != GL_UNSIGNED_BYTE && type != GL_UNSIGNED_SHORT &&
+        type != GL_UNSIGNED_INT) {
+        set_error(GL_INVALID_ENUM);
+        return;
+    }
+
+    if (recording_call_list()) {
+        if (basevertex) {
+            warning("Base vertex is not supported in display lists");
+        }
+        for (GLsizei i = 0; i < drawcount; i++) {
+            glDrawElements(mode, count[i], type, indices[i]);
+        }
+        return;
+    }
+
+    OgxMultiDrawData md = {
+        .draw_data = { .type = type },
+        .drawcount = drawcount,
+        .count = count,
+        .indices = indices,
+        .basevertex = basevertex,
+    };
+    multi_draw(mode, &md);
+}
+
+void glMultiDrawElements(GLenum mode, const GLsizei *count, GLenum type,
+                         const void *const *indices, GLsizei drawcount)
+{
+    glMultiDrawElementsBaseVertex(mode, count, type, indices, drawcount, NULL);
+}
+
+/* Returns the number of vertices of each primitive, if consecutive primitives
+ * of the given mode can be concatenated into a single draw, or 0 otherwise */
+static int immediate_primitive_size(OgxDrawMode gxmode)
+{
+    if (gxmode.loop) return 0;
+
+    switch (gxmode.mode) {
+    case GX_POINTS: return 1;
+    case GX_LINES: return 2;
+    case GX_TRIANGLES: return 3;
+    case GX_QUADS: return 4;
+    default: return 0;
+    }
+}
+
+static bool can_batch_immediate()
+{
+    return (glparamstate.hints & OGX_HINT_BATCH_IMMEDIATE) &&
+        glparamstate.render_mode == GL_RENDER &&
+        glparamstate.current_call_list.index < 0 &&
+        !glparamstate.current_program &&
+        /* These are set up at every draw, regardless of the dirty bits */
+        !glparamstate.stencil.enabled &&
+        glparamstate.clip_plane_mask == 0;
+}
+
+/* Returns the number of vertices of the current glBegin()/glEnd() block which
+ * form complete primitives, or 0 if they cannot be batched */
+static int batchable_vertices(OgxDrawMode gxmode)
+{
+    int size = immediate_primitive_size(gxmode);
+    if (size == 0 || !can_batch_immediate()) return 0;
+
+    int count = glparamstate.imm_mode.current_numverts -
+        glparamstate.imm_mode.batch_numverts;
+    return count - count % size;
+}
+
+static bool append_to_batch(OgxDrawMode gxmode)
+{
+    int first = glparamstate.imm_mode.batch_numverts;
+    if (first == 0) return false;
+
+    /* The GX state was set up when the batch was started: the new vertices
+     * can only be added if nothing which affects it has changed since. */
+    if (gxmode.mode != glparamstate.imm_mode.batch_gxmode ||
+        glparamstate.imm_mode.has_normal !=
+            glparamstate.imm_mode.batch_has_normal ||
+        glparamstate.imm_mode.has_texcoord !=
+            glparamstate.imm_mode.batch_has_texcoord ||
+        (glparamstate.dirty.all & ~glparamstate.imm_mode.batch_dirty) != 0)
+        return false;
+
+    int count = batchable_vertices(gxmode);
+    if (count == 0 || first + count > OGX_IMM_BATCH_MAX_VERTICES) return false;
+
+    glparamstate.imm_mode.batch_numverts = first + count;
+    glparamstate.imm_mode.current_numverts = first + count;
+    return true;
+}
+
+/* Sets up the GX state for drawing the current glBegin()/glEnd() block, but
+ * defers emitting its vertices, so that the following blocks can be appended
+ * to them */
+static void start_batch(OgxDrawMode gxmode, int count)
+{
+    _ogx_update_vertex_array_readers(gxmode);
+    _ogx_update_matrices();
+
+    OgxDrawData draw_data = { gxmode, count, 0, };
+    _ogx_gpu_resources_push();
+    bool should_draw = setup_draw(&draw_data);
+    _ogx_gpu_resources_pop();
+    if (!should_draw) {
+        draw_done();
+        glparamstate.imm_mode.current_numverts = 0;
+        return;
+    }
+
+    glparamstate.draw_count++;
+    glparamstate.imm_mode.batch_numverts = count;
+    glparamstate.imm_mode.current_numverts = count;
+    glparamstate.imm_mode.batch_gxmode = gxmode.mode;
+    glparamstate.imm_mode.batch_has_normal = glparamstate.imm_mode.has_normal;
+    glparamstate.imm_mode.batch_has_texcoord =
+        glparamstate.imm_mode.has_texcoord;
+}
+
+void _ogx_immediate_flush()
+{
+    int count = glparamstate.imm_mode.batch_numverts;
+    if (count == 0) return;
+
+    glparamstate.imm_mode.batch_numverts = 0;
+    OgxDrawData draw_data = {
+        { glparamstate.imm_mode.batch_gxmode, false }, count, 0,
+    };
+    draw_arrays_general(&draw_data);
+    draw_done();
+
+    /* glColor*() and glNormal*() don't mark the TEV as dirty while a batch is
+     * pending, since the batched vertices carry their own values */
+    glparamstate.dirty.bits.dirty_tev = 1;
+
+    /* Move the vertices of the block being specified, if any, to the start of
+     * the buffer */
+    int numverts = glparamstate.imm_mode.current_numverts - count;
+    if (numverts > 0) {
+        memmove(glparamstate.imm_mode.current_vertices,
+                glparamstate.imm_mode.current_vertices + count,
+                numverts * sizeof(VertexData));
+    }
+    glparamstate.imm_mode.current_numverts = numverts;
+}
+
+/* Immediate mode vertices are streamed into GX display lists as they are
+ * specified. GX_Begin() needs to know the vertex count in advance, so the
+ * lists are recorded with a zero count, which is patched in glEnd() before
+ * calling the list. The lists are allocated from the two halves of a buffer,
+ * each of which is reused once the GP is done reading it. */
+#define STREAM_HALF_SIZE (32 * 1024)
+/* Minimum space for starting a list in the current half */
+#define STREAM_MIN_LIST_SIZE 1024
+
+static struct {
+    u8 *buffer;
+    uint16_t sync_tokens[2];
+    u8 half;
+    u32 offset;
+    /* The list being recorded */
+    u8 *list;
+    u32 list_size;
+    int list_numverts;
+    int vertex_size;
+    OgxDrawMode gxmode;
+    /* Vertices per primitive, or 0 for strips and fans */
+    int prim_size;
+    /* Vertices specified since glBegin() */
+    int numverts;
+    /* The vertex format, frozen when the GX state was set up */
+    unsigned active : 1;
+    unsigned discard : 1;
+    unsigned has_normal : 1;
+    unsigned has_texcoord : MAX_TEXTURE_UNITS;
+    /* The vertices of the current primitive, or those needed to restart the
+     * strip or fan in a new list */
+    VertexData vertices[4];
+} s_stream;
+
+static void setup_immediate_arrays(const VertexData *base)
+{
+    int stride = sizeof(VertexData);
+
+    glVertexPointer(3, GL_FLOAT, stride, base->pos);
+
+    if (glparamstate.imm_mode.has_normal) {
+        glNormalPointer(GL_FLOAT, stride, base->norm);
+    }
+
+    if (glparamstate.imm_mode.has_color) {
+        glColorPointer(4, GL_UNSIGNED_BYTE, stride, &base->color);
+    }
+
+    for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+        if (glparamstate.imm_mode.has_texcoord & (1 << i)) {
+            glparamstate.cs.active_texture = i;
+            glTexCoordPointer(2, GL_FLOAT, stride, base->tex[i]);
+        }
+    }
+
+    glparamstate.cs.texcoord_enabled = glparamstate.imm_mode.has_texcoord;
+    glparamstate.cs.color_enabled = glparamstate.imm_mode.has_color;
+    glparamstate.cs.normal_enabled = glparamstate.imm_mode.has_normal;
+    glparamstate.cs.vertex_enabled = 1;
+    /* The vertices use the current matrix index */
+    glparamstate.cs.matrix_index_enabled = 0;
+}
+
+static bool can_stream(GLenum mode, OgxDrawMode gxmode)
+{
+    if (gxmode.mode == 0xff || gxmode.loop || mode == GL_POLYGON ||
+        /* Batching needs the vertices in the staging buffer */
+        (glparamstate.hints & OGX_HINT_BATCH_IMMEDIATE) ||
+        glparamstate.render_mode != GL_RENDER ||
+        glparamstate.current_call_list.index >= 0 ||
+        glparamstate.current_program ||
+        /* The stencil test draws the geometry twice */
+        glparamstate.stencil.enabled)
+        return false;
+
+    if (!s_stream.buffer) {
+        s_stream.buffer = memalign(32, STREAM_HALF_SIZE * 2);
+        if (!s_stream.buffer) return false;
+        /* The lists are written through the FIFO, bypassing the cache */
+        DCInvalidateRange(s_stream.buffer, STREAM_HALF_SIZE * 2);
+    }
+    return true;
+}
+
+static int stream_slot(int index)
+{
+    if (s_stream.prim_size > 0) return index % s_stream.prim_size;
+
+    switch (s_stream.gxmode.mode) {
+    case GX_TRIANGLESTRIP: return index % 3;
+    case GX_TRIANGLEFAN: return index == 0 ? 0 : 1 + (index - 1) % 2;
+    default: return index % 2; /* GX_LINESTRIP */
+    }
+}
+
+/* Returns the slots of the vertices which must be sent again when a strip or
+ * fan is continued in a new list, before the vertex with the given index */
+static int stream_context(int index, int *slots)
+{
+    int count = 0;
+    switch (s_stream.gxmode.mode) {
+    case GX_TRIANGLESTRIP:
+        if (index >= 2) {
+            /* GX flips the winding of the odd triangles: a degenerate
+             * triangle keeps it unchanged */
+            if ((index - 2) & 1) slots[count++] = stream_slot(index - 2);
+            slots[count++] = stream_slot(index - 2);
+        }
+        if (index >= 1) slots[count++] = stream_slot(index - 1);
+        break;
+    case GX_TRIANGLEFAN:
+        if (index >= 1) slots[count++] = 0;
+        if (index >= 2) slots[count++] = stream_slot(index - 1);
+        break;
+    case GX_LINESTRIP:
+        if (index >= 1) slots[count++] = stream_slot(index - 1);
+        break;
+    default:
+        /* The vertices of an incomplete primitive have not been sent yet */
+        for (int i = 0; i < index % s_stream.prim_size; i++)
+            slots[count++] = i;
+    }
+    return count;
+}
+
+static void stream_begin_list()
+{
+    u32 room = STREAM_HALF_SIZE - s_stream.offset;
+    if (room < STREAM_MIN_LIST_SIZE) {
+        /* Switch to the other half, once the GP is done with it */
+        s_stream.sync_tokens[s_stream.half] = send_draw_sync_token();
+        s_stream.half ^= 1;
+        uint16_t token = s_stream.sync_tokens[s_stream.half];
+        if (token > _ogx_draw_sync_token) {
+            /* The token counter was reset at the end of the frame */
+            token = send_draw_sync_token();
+            GX_Flush();
+        }
+        while (GX_GetDrawSync() < token);
+        s_stream.offset = 0;
+        room = STREAM_HALF_SIZE;
+    }
+
+    s_stream.list = s_stream.buffer + s_stream.half * STREAM_HALF_SIZE +
+        s_stream.offset;
+    s_stream.list_size = room;
+    s_stream.list_numverts = 0;
+    GX_BeginDispList(s_stream.list, room);
+    GX_Begin(s_stream.gxmode.mode, _ogx_vtxdesc_vtxfmt, 0);
+}
+
+static void stream_end_list()
+{
+    GX_End();
+    u32 size = GX_EndDispList();
+    if (size == 0) {
+        /* Cannot happen, since stream_reserve() checks the available room */
+        warning("Immediate mode list overflow");
+        return;
+    }
+    s_stream.offset += size;
+    if (s_stream.list_numverts == 0) return;
+
+    /* Patch the vertex count of the GX_Begin() command */
+    u8 *list = s_stream.list;
+    DCInvalidateRange(list, 32);
+    list[1] = s_stream.list_numverts >> 8;
+    list[2] = s_stream.list_numverts & 0xff;
+    DCFlushRange(list, 32);
+    GX_CallDispList(list, size);
+}
+
+static inline void stream_emit(int slot)
+{
+    _ogx_arrays_process_element(slot);
+    s_stream.list_numverts++;
+}
+
+/* Makes sure that the list has room for the given number of vertices,
+ * continuing the primitive in a new list if needed */
+static void stream_reserve(int index, int count)
+{
+    u32 needed = 3 + (s_stream.list_numverts + count) * s_stream.vertex_size;
+    /* GX_Begin() takes a 16-bit count */
+    if (s_stream.list_numverts + count < 0xffff &&
+        ((needed + 31) & ~31) <= s_stream.list_size) return;
+
+    int slots[3];
+    int context = s_stream.prim_size > 0 ? 0 : stream_context(index, slots);
+    stream_end_list();
+    stream_begin_list();
+    for (int i = 0; i < context; i++) stream_emit(slots[i]);
+}
+
+static void stream_setup()
+{
+    union client_state cs_backup = glparamstate.cs;
+    OgxVertexAttribArray arrays_backup[OGX_ATTR_INDEX_COUNT];
+    memcpy(arrays_backup, glparamstate.arrays, sizeof(arrays_backup));
+
+    /* Colours are always sent per vertex, since glColor*() might be called
+     * after the first vertex */
+    glparamstate.imm_mode.has_color = 1;
+    setup_immediate_arrays(s_stream.vertices);
+
+    _ogx_update_vertex_array_readers(s_stream.gxmode);
+    _ogx_update_matrices();
+
+    OgxDrawData draw_data = { s_stream.gxmode, 4, 0, };
+    _ogx_gpu_resources_push();
+    bool should_draw = setup_draw(&draw_data);
+    _ogx_gpu_resources_pop();
+
+    glparamstate.cs = cs_backup;
+    memcpy(glparamstate.arrays, arrays_backup, sizeof(arrays_backup));
+    glparamstate.dirty.bits.dirty_attributes = 1;
+
+    s_stream.active = 1;
+    s_stream.has_normal = glparamstate.imm_mode.has_normal;
+    s_stream.has_texcoord = glparamstate.imm_mode.has_texcoord;
+    s_stream.discard = !should_draw;
+    if (!should_draw) {
+        draw_done();
+        return;
+    }
+
+    glparamstate.draw_count++;
+    s_stream.vertex_size = _ogx_vtxdesc_vertex_size();
+    stream_begin_list();
+}
+
+void _ogx_immediate_stream_start()
+{
+    glparamstate.imm_mode.streaming = 1;
+    for (int i = 0; i < glparamstate.imm_mode.current_numverts; i++) {
+        *_ogx_immediate_stream_next() = glparamstate.imm_mode.current_vertices[i];
+        _ogx_immediate_stream_vertex();
+    }
+    glparamstate.imm_mode.current_numverts = 0;
+}
+
+VertexData *_ogx_immediate_stream_next()
+{
+    return &s_stream.vertices[stream_slot(s_stream.numverts)];
+}
+
+void _ogx_immediate_stream_vertex()
+{
+    int index = s_stream.numverts++;
+
+    if (!s_stream.active ||
+        glparamstate.imm_mode.has_normal != s_stream.has_normal ||
+        glparamstate.imm_mode.has_texcoord != s_stream.has_texcoord) {
+        /* An attribute was specified for the first time after the first
+         * vertex: the primitive must be continued with a new format */
+        int slots[3];
+        int context = 0;
+        if (s_stream.active) {
+            if (!s_stream.discard) {
+                stream_end_list();
+                draw_done();
+            }
+            if (s_stream.prim_size == 0)
+                context = stream_context(index, slots);
+        }
+        stream_setup();
+        if (s_stream.discard) return;
+        for (int i = 0; i < context; i++) stream_emit(slots[i]);
+    }
+    if (s_stream.discard) return;
+
+    if (s_stream.prim_size > 0) {
+        /* Primitives are only sent when complete, so that a list never ends
+         * with an incomplete one */
+        if (stream_slot(index) != s_stream.prim_size - 1) return;
+        stream_reserve(index, s_stream.prim_size);
+        for (int i = 0; i < s_stream.prim_size; i++) stream_emit(i);
+    } else {
+        stream_reserve(index, 1);
+        stream_emit(stream_slot(index));
+    }
+}
+
+void _ogx_immediate_stream_stop()
+{
+    glparamstate.imm_mode.can_stream = 0;
+    if (!glparamstate.imm_mode.streaming) return;
+    glparamstate.imm_mode.streaming = 0;
+
+    int slots[3];
+    int context = stream_context(s_stream.numverts, slots);
+    if (s_stream.active) {
+        if (!s_stream.discard) {
+            stream_end_list();
+            draw_done();
+        }
+        s_stream.active = 0;
+    }
+
+    /* Continue the current primitive in the staging buffer */
+    if (!glparamstate.imm_mode.current_vertices) context = 0;
+    for (int i = 0; i < context; i++) {
+        glparamstate.imm_mode.current_vertices[i] = s_stream.vertices[slots[i]];
+    }
+    glparamstate.imm_mode.current_numverts = context;
+}
+
+static void stream_end()
+{
+    if (s_stream.active) {
+        if (!s_stream.discard) {
+            stream_end_list();
+            draw_done();
+        }
+        s_stream.active = 0;
+    }
+    glparamstate.imm_mode.can_stream = 0;
+    glparamstate.imm_mode.streaming = 0;
+}
+
+void glBegin(GLenum mode)
+{
+    // Just discard all the data, except for the pending batch
+    glparamstate.imm_mode.current_numverts =
+        glparamstate.imm_mode.batch_numverts;
+    glparamstate.imm_mode.prim_type = mode;
+    glparamstate.imm_mode.in_gl_begin = 1;
+    glparamstate.imm_mode.has_color = 0;
+    glparamstate.imm_mode.has_normal = 0;
+    glparamstate.imm_mode.has_texcoord = 0;
+
+    OgxDrawMode gxmode = _ogx_draw_mode(mode);
+    glparamstate.imm_mode.can_stream = can_stream(mode, gxmode);
+    if (glparamstate.imm_mode.can_stream) {
+        s_stream.gxmode = gxmode;
+        s_stream.prim_size = immediate_primitive_size(gxmode);
+        s_stream.numverts = 0;
+    }
+
+    if (!glparamstate.imm_mode.current_vertices) {
+        int count = 64;
+        warning("First malloc %d", errno);
+        void *buffer = malloc(count * sizeof(VertexData));
+        if (buffer) {
+            glparamstate.imm_mode.current_vertices = buffer;
+            glparamstate.imm_mode.current_vertices_size = count;
+        } else {
+            warning("Failed to allocate memory for vertex buffer (%d)", errno);
+            set_error(GL_OUT_OF_MEMORY);
+        }
+    }
+}
+
+void glEnd()
+{
+    glparamstate.imm_mode.can_stream = 0;
+    if (glparamstate.imm_mode.streaming) {
+        stream_end();
+        glparamstate.imm_mode.in_gl_begin = 0;
+        return;
+    }
+
+    OgxDrawMode gxmode = _ogx_draw_mode(glparamstate.imm_mode.prim_type);
+    if (append_to_batch(gxmode)) {
+        glparamstate.imm_mode.in_gl_begin = 0;
+        return;
+    }
+
+    _ogx_immediate_flush();
+    int batch_count = batchable_vertices(gxmode);
+    if (batch_count > 0) {
+        /* Colours are always stored per vertex, so that glColor*() calls
+         * between the blocks do not break the batch */
+        glparamstate.imm_mode.has_color = 1;
+    }
+
+    union client_state cs_backup = glparamstate.cs;
+    OgxVertexAttribArray arrays_backup[OGX_ATTR_INDEX_COUNT];
+    memcpy(arrays_backup, glparamstate.arrays, sizeof(arrays_backup));
+
+    setup_immediate_arrays(glparamstate.imm_mode.current_vertices);
+    if (batch_count > 0) {
+        start_batch(gxmode, batch_count);
+    } else {
+        glDrawArrays(glparamstate.imm_mode.prim_type, 0, glparamstate.imm_mode.current_numverts);
+    }
+    glparamstate.cs = cs_backup;
+    memcpy(glparamstate.arrays, arrays_backup, sizeof(arrays_backup));
+    glparamstate.imm_mode.in_gl_begin = 0;
+
+    glparamstate.dirty.bits.dirty_attributes = 1;
+    glparamstate.imm_mode.batch_dirty = glparamstate.dirty.all;
+}
+
+void glPrimitiveRestartIndex(GLuint index)
+{
+    glparamstate.primitive_restart_index = index;
+}
+
 void glFrustum(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top,
                GLdouble near, GLdouble far)
 {
@@ -2823,11 +3791,28 @@ void glOrtho(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdou
     glMultMatrixf((float *)newmat);
 }
 
+void glHint(GLenum target, GLenum mode)
+{
+    if (mode != GL_FASTEST && mode != GL_NICEST && mode != GL_DONT_CARE) {
+        set_error(GL_INVALID_ENUM);
+        return;
+    }
+
+    switch (target) {
+    case GL_TEXTURE_COMPRESSION_HINT:
+        /* Selects the high quality mode of the CMPR encoder */
+        glparamstate.texture_compression_nicest = mode == GL_NICEST;
+        break;
+    default:
+        /* The other hints have no GX equivalent */
+        break;
+    }
+}
+
 // NOT GOING TO IMPLEMENT
 
 void glBlendEquation(GLenum mode) {}
 void glShadeModel(GLenum mode) {}  // In theory we don't have GX equivalent?
-void glHint(GLenum target, GLenum mode) {}
 
 // TODO STUB IMPLEMENTATION
 
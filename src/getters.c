@@ -42,8 +42,11 @@ POSSIBILITY OF SUCH DAMAGE.
 static const GLubyte gl_null_string[1] = { 0 };
 /* This is not static because we might modify it in place */
 static GLubyte s_extension_string[] =
+    "GL_ARB_draw_instanced "
+    "GL_ARB_matrix_palette "
     "GL_ARB_multitexture "
-    "GL_ARB_vertex_buffer_object ";
+    "GL_ARB_vertex_buffer_object "
+    "GL_EXT_paletted_texture ";
 
 static int prepare_extension_strings()
 {
@@ -129,12 +132,18 @@ GLboolean glIsEnabled(GLenum cap)
         return glparamstate.lighting.lights[cap - GL_LIGHT0].enabled;
     case GL_LIGHTING:
         return glparamstate.lighting.enabled;
+    case GL_MATRIX_INDEX_ARRAY_ARB:
+        return glparamstate.cs.matrix_index_enabled;
+    case GL_MATRIX_PALETTE_ARB:
+        return glparamstate.matrix_palette.enabled;
     case GL_NORMAL_ARRAY:
         return glparamstate.cs.normal_enabled;
     case GL_POINT_SPRITE:
         return glparamstate.point_sprites_enabled;
     case GL_POLYGON_OFFSET_FILL:
         return glparamstate.polygon_offset_fill;
+    case GL_PRIMITIVE_RESTART:
+        return glparamstate.primitive_restart_enabled;
     case GL_SCISSOR_TEST:
         return glparamstate.scissor_enabled;
     case GL_STENCIL_TEST:
@@ -191,6 +200,7 @@ void glGetBooleanv(GLenum pname, GLboolean *params)
     case GL_NORMAL_ARRAY:
     case GL_POINT_SPRITE:
     case GL_POLYGON_OFFSET_FILL:
+    case GL_PRIMITIVE_RESTART:
     case GL_SCISSOR_TEST:
     case GL_STENCIL_TEST:
     case GL_TEXTURE_2D:
@@ -309,6 +319,12 @@ void glGetIntegerv(GLenum pname, GLint *params)
     case GL_COLOR_ARRAY_TYPE:
         *params = STATE_ARRAY(CLR).type;
         return;
+    case GL_CURRENT_MATRIX_INDEX_ARB:
+        *params = glparamstate.matrix_palette.current_index;
+        return;
+    case GL_CURRENT_PALETTE_MATRIX_ARB:
+        *params = glparamstate.matrix_palette.current;
+        return;
     case GL_ELEMENT_ARRAY_BUFFER_BINDING:
         *params = glparamstate.bound_vbo_element_array;
         break;
@@ -325,9 +341,35 @@ void glGetIntegerv(GLenum pname, GLint *params)
     case GL_INDEX_SHIFT:
         *params = glparamstate.transfer_index_shift;
         break;
+    case GL_MATRIX_INDEX_ARRAY_SIZE_ARB:
+        *params = STATE_ARRAY(MTX).size;
+        return;
+    case GL_MATRIX_INDEX_ARRAY_STRIDE_ARB:
+        *params = STATE_ARRAY(MTX).stride;
+        return;
+    case GL_MATRIX_INDEX_ARRAY_TYPE_ARB:
+        *params = STATE_ARRAY(MTX).type;
+        return;
     case GL_MAX_CLIP_PLANES:
         *params = MAX_CLIP_PLANES;
         return;
+    case GL_MAX_MATRIX_PALETTE_STACK_DEPTH_ARB:
+        /* Palette matrices cannot be pushed */
+        *params = 1;
+        return;
+    case GL_MAX_PALETTE_MATRICES_ARB:
+        *params = matrix_palette_size();
+        return;
+    case GL_MAX_VERTEX_UNITS_ARB:
+        /* Only rigid skinning is supported */
+        *params = 1;
+        return;
+    case GL_MAX_ELEMENTS_INDICES:
+    case GL_MAX_ELEMENTS_VERTICES:
+        /* GX_Begin() takes a 16-bit vertex count, and 0xffff is not a valid
+         * vertex index */
+        *params = 0xffff;
+        return;
     case GL_MAX_TEXTURE_COORDS:
     case GL_MAX_TEXTURE_IMAGE_UNITS:
     case GL_MAX_TEXTURE_UNITS:
@@ -345,6 +387,9 @@ void glGetIntegerv(GLenum pname, GLint *params)
     case GL_PROJECTION_STACK_DEPTH:
         *params = MAX_PROJ_STACK;
         return;
+    case GL_PRIMITIVE_RESTART_INDEX:
+        *params = glparamstate.primitive_restart_index;
+        return;
     case GL_MAX_NAME_STACK_DEPTH:
         *params = MAX_NAME_STACK_DEPTH;
         return;
@@ -514,6 +559,9 @@ void glGetPointerv(GLenum pname, GLvoid **params)
     case GL_COLOR_ARRAY_POINTER:
         *params = (void*)STATE_ARRAY(CLR).pointer;
         return;
+    case GL_MATRIX_INDEX_ARRAY_POINTER_ARB:
+        *params = (void*)STATE_ARRAY(MTX).pointer;
+        return;
     case GL_NORMAL_ARRAY_POINTER:
         *params = (void*)STATE_ARRAY(NRM).pointer;
         return;
@@ -0,0 +1,332 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+/* Vertex cache optimization, following Tom Forsyth's "Linear-Speed Vertex
+ * Cache Optimisation" algorithm: vertices are scored according to their
+ * position in a simulated LRU cache and to the number of triangles still
+ * using them, and the triangle with the highest score is emitted next. */
+
+#include "index_optimizer.h"
+
+#include <math.h>
+#include <ogc/gx.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Size of the LRU cache used for scoring the vertices */
+#define SCORE_CACHE_SIZE 32
+/* Size of the FIFO vertex cache model used to compute the ACMR */
+#define ACMR_CACHE_SIZE 16
+#define MAX_VALENCE_SCORE 32
+
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+typedef struct {
+    float score;
+    int cache_pos; /* -1 if not in the cache */
+    int first_triangle; /* Offset in the adjacency list */
+    int num_active; /* Triangles using this vertex not yet emitted */
+} VertexData;
+
+static float s_cache_scores[SCORE_CACHE_SIZE];
+static float s_valence_scores[MAX_VALENCE_SCORE];
+
+static void init_score_tables()
+{
+    if (s_valence_scores[1] != 0.0f) return;
+
+    for (int i = 0; i < SCORE_CACHE_SIZE; i++) {
+        if (i < 3) {
+            /* The vertices of the last triangle are penalized, so that we
+             * don't keep drawing thin strips */
+            s_cache_scores[i] = LAST_TRIANGLE_SCORE;
+        } else {
+            float scale = 1.0f / (SCORE_CACHE_SIZE - 3);
+            s_cache_scores[i] =
+                powf(1.0f - (i - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+    for (int i = 1; i < MAX_VALENCE_SCORE; i++) {
+        s_valence_scores[i] =
+            VALENCE_BOOST_SCALE * powf(i, -VALENCE_BOOST_POWER);
+    }
+}
+
+static float vertex_score(const VertexData *v)
+{
+    if (v->num_active == 0) return -1.0f;
+
+    float score = v->cache_pos >= 0 ? s_cache_scores[v->cache_pos] : 0.0f;
+    if (v->num_active < MAX_VALENCE_SCORE) {
+        score += s_valence_scores[v->num_active];
+    } else {
+        score += VALENCE_BOOST_SCALE *
+            powf(v->num_active, -VALENCE_BOOST_POWER);
+    }
+    return score;
+}
+
+bool _ogx_optimize_triangle_order(uint16_t *indices, int num_triangles,
+                                  int num_vertices)
+{
+    int num_indices = num_triangles * 3;
+    VertexData *vertices = calloc(num_vertices, sizeof(VertexData));
+    int *adjacency = malloc(num_indices * sizeof(int));
+    uint8_t *emitted = calloc(num_triangles, 1);
+    uint16_t *out = malloc(num_indices * sizeof(uint16_t));
+    bool ok = vertices && adjacency && emitted && out;
+    if (!ok) goto out;
+
+    init_score_tables();
+
+    for (int i = 0; i < num_indices; i++) {
+        vertices[indices[i]].num_active++;
+    }
+    int offset = 0;
+    for (int i = 0; i < num_vertices; i++) {
+        vertices[i].first_triangle = offset;
+        offset += vertices[i].num_active;
+        /* Used as a fill counter for the adjacency list, for now */
+        vertices[i].cache_pos = 0;
+    }
+    for (int i = 0; i < num_indices; i++) {
+        VertexData *v = &vertices[indices[i]];
+        adjacency[v->first_triangle + v->cache_pos++] = i / 3;
+    }
+    for (int i = 0; i < num_vertices; i++) {
+        vertices[i].cache_pos = -1;
+        vertices[i].score = vertex_score(&vertices[i]);
+    }
+
+    int best_triangle = -1;
+    float best_score = -1.0f;
+    for (int t = 0; t < num_triangles; t++) {
+        const uint16_t *tri = indices + t * 3;
+        float score = vertices[tri[0]].score +
+            vertices[tri[1]].score + vertices[tri[2]].score;
+        if (score > best_score) {
+            best_score = score;
+            best_triangle = t;
+        }
+    }
+
+    /* The extra 3 slots hold the vertices pushed out of the cache */
+    int cache[SCORE_CACHE_SIZE + 3];
+    int cache_size = 0;
+    int next_unemitted = 0;
+    for (int n = 0; n < num_triangles; n++) {
+        if (best_triangle < 0) {
+            /* None of the cached vertices is used by the remaining
+             * triangles: just pick the next one */
+            while (emitted[next_unemitted]) next_unemitted++;
+            best_triangle = next_unemitted;
+        }
+
+        const uint16_t *tri = indices + best_triangle * 3;
+        memcpy(out + n * 3, tri, 3 * sizeof(uint16_t));
+        emitted[best_triangle] = 1;
+
+        int new_cache[SCORE_CACHE_SIZE + 3];
+        int new_cache_size = 0;
+        for (int i = 0; i < 3; i++) {
+            VertexData *v = &vertices[tri[i]];
+            /* Remove the triangle from the vertex's active list */
+            int *list = adjacency + v->first_triangle;
+            for (int j = 0; j < v->num_active; j++) {
+                if (list[j] == best_triangle) {
+                    list[j] = list[v->num_active - 1];
+                    break;
+                }
+            }
+            v->num_active--;
+            new_cache[new_cache_size++] = tri[i];
+        }
+        for (int i = 0; i < cache_size; i++) {
+            int vertex = cache[i];
+            if (vertex != tri[0] && vertex != tri[1] && vertex != tri[2]) {
+                new_cache[new_cache_size++] = vertex;
+            }
+        }
+
+        /* Update the scores of the vertices in the cache (and of those which
+         * have just been pushed out of it) and of their triangles, looking
+         * for the best triangle to emit next */
+        best_triangle = -1;
+        best_score = -1.0f;
+        for (int i = 0; i < new_cache_size; i++) {
+            VertexData *v = &vertices[new_cache[i]];
+            v->cache_pos = i < SCORE_CACHE_SIZE ? i : -1;
+            v->score = vertex_score(v);
+        }
+        for (int i = 0; i < new_cache_size; i++) {
+            const VertexData *v = &vertices[new_cache[i]];
+            const int *list = adjacency + v->first_triangle;
+            for (int j = 0; j < v->num_active; j++) {
+                int t = list[j];
+                const uint16_t *other = indices + t * 3;
+                float score = vertices[other[0]].score +
+                    vertices[other[1]].score + vertices[other[2]].score;
+                if (score > best_score) {
+                    best_score = score;
+                    best_triangle = t;
+                }
+            }
+        }
+
+        cache_size = new_cache_size < SCORE_CACHE_SIZE ?
+            new_cache_size : SCORE_CACHE_SIZE;
+        memcpy(cache, new_cache, cache_size * sizeof(int));
+    }
+
+    memcpy(indices, out, num_indices * sizeof(uint16_t));
+
+out:
+    free(vertices);
+    free(adjacency);
+    free(emitted);
+    free(out);
+    return ok;
+}
+
+/* If triangle t has the edge p->q, stores its third vertex into x */
+static bool find_edge(const uint16_t *t, uint16_t p, uint16_t q, uint16_t *x)
+{
+    for (int r = 0; r < 3; r++) {
+        if (t[r] == p && t[(r + 1) % 3] == q) {
+            *x = t[(r + 2) % 3];
+            return true;
+        }
+    }
+    return false;
+}
+
+int _ogx_build_triangle_batches(const uint16_t *indices, int num_triangles,
+                                uint16_t *out_indices,
+                                OgxIndexBatch *out_batches, int *num_batches)
+{
+    uint16_t *out = out_indices;
+    OgxIndexBatch *list = NULL;
+    int nb = 0;
+
+    for (int i = 0; i < num_triangles;) {
+        const uint16_t *t = indices + i * 3;
+        uint8_t mode = GX_TRIANGLES;
+        uint16_t x;
+        if (i + 1 < num_triangles) {
+            const uint16_t *u = t + 3;
+            /* Try all the rotations of the first triangle: a strip continues
+             * on the edge c->b, a fan on the edge a->c */
+            for (int r = 0; r < 3 && mode == GX_TRIANGLES; r++) {
+                uint16_t a = t[r], b = t[(r + 1) % 3], c = t[(r + 2) % 3];
+                if (find_edge(u, c, b, &x)) {
+                    mode = GX_TRIANGLESTRIP;
+                } else if (find_edge(u, a, c, &x)) {
+                    mode = GX_TRIANGLEFAN;
+                } else {
+                    continue;
+                }
+                out[0] = a;
+                out[1] = b;
+                out[2] = c;
+                out[3] = x;
+            }
+        }
+
+        if (mode == GX_TRIANGLES) {
+            if (!list || list->count > 0xffff - 3) {
+                list = &out_batches[nb++];
+                list->mode = GX_TRIANGLES;
+                list->count = 0;
+            }
+            memcpy(out, t, 3 * sizeof(uint16_t));
+            out += 3;
+            list->count += 3;
+            i++;
+            continue;
+        }
+
+        /* Extend the strip or fan as long as the next triangles allow it */
+        list = NULL;
+        int count = 4;
+        for (i += 2; i < num_triangles && count < 0xffff; i++) {
+            const uint16_t *u = indices + i * 3;
+            int k = count - 2; /* Index of the triangle within the batch */
+            uint16_t p, q;
+            if (mode == GX_TRIANGLEFAN) {
+                p = out[0];
+                q = out[count - 1];
+            } else if (k % 2 == 0) {
+                p = out[k];
+                q = out[k + 1];
+            } else {
+                p = out[k + 1];
+                q = out[k];
+            }
+            if (!find_edge(u, p, q, &x)) break;
+            out[count++] = x;
+        }
+        out_batches[nb].mode = mode;
+        out_batches[nb].count = count;
+        nb++;
+        out += count;
+    }
+
+    *num_batches = nb;
+    return out - out_indices;
+}
+
+float _ogx_compute_acmr(const uint16_t *indices, const OgxIndexBatch *batches,
+                        int num_batches, int num_triangles)
+{
+    int cache[ACMR_CACHE_SIZE];
+    int next = 0, misses = 0;
+
+    for (int i = 0; i < ACMR_CACHE_SIZE; i++) cache[i] = -1;
+
+    for (int b = 0; b < num_batches; b++) {
+        for (int i = 0; i < batches[b].count; i++) {
+            int index = *indices++;
+            bool hit = false;
+            for (int j = 0; j < ACMR_CACHE_SIZE; j++) {
+                if (cache[j] == index) {
+                    hit = true;
+                    break;
+                }
+            }
+            if (hit) continue;
+            misses++;
+            cache[next] = index;
+            next = (next + 1) % ACMR_CACHE_SIZE;
+        }
+    }
+    return num_triangles > 0 ? (float)misses / num_triangles : 0.0f;
+}
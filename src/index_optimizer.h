@@ -0,0 +1,70 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef OPENGX_INDEX_OPTIMIZER_H
+#define OPENGX_INDEX_OPTIMIZER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A GX primitive, made of `count` consecutive indices */
+typedef struct {
+    uint8_t mode; /* GX_TRIANGLES, GX_TRIANGLESTRIP or GX_TRIANGLEFAN */
+    uint16_t count;
+} OgxIndexBatch;
+
+/* Reorders the triangles of an indexed triangle list in place, so that
+ * vertices are reused while they are still in the vertex cache. The
+ * triangles keep their winding. Returns false if memory could not be
+ * allocated, in which case the indices are left untouched. */
+bool _ogx_optimize_triangle_order(uint16_t *indices, int num_triangles,
+                                  int num_vertices);
+
+/* Joins consecutive triangles of the list into strips and fans, without
+ * changing their order. `out_indices` must have room for 3 * num_triangles
+ * elements, `out_batches` for num_triangles elements. Returns the number of
+ * indices written into out_indices. */
+int _ogx_build_triangle_batches(const uint16_t *indices, int num_triangles,
+                                uint16_t *out_indices,
+                                OgxIndexBatch *out_batches, int *num_batches);
+
+/* Average number of vertex cache misses per triangle, when drawing the given
+ * batches */
+float _ogx_compute_acmr(const uint16_t *indices, const OgxIndexBatch *batches,
+                        int num_batches, int num_triangles);
+
+#ifdef __cplusplus
+} // extern C
+#endif
+
+#endif /* OPENGX_INDEX_OPTIMIZER_H */
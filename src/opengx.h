@@ -63,6 +63,29 @@ int ogx_enable_double_buffering(int double_buffering);
  */
 int ogx_prepare_swap_buffers(void);
 
+/* The integration library can call this to inform opengx that it copies the
+ * EFB to the XFB with the clear flag set (that is, GX_CopyDisp(xfb, GX_TRUE))
+ * right after ogx_prepare_swap_buffers(), without changing the copy clear
+ * values. opengx will then set them (via GX_SetCopyClear()) to the GL clear
+ * color and depth, and a glClear() at the beginning of the next frame will
+ * not need to draw anything.
+ *
+ * Returns the previous setting; the default is off.
+ */
+int ogx_enable_copy_clear(int copy_clear);
+
+/* If the OPENGX_FAST_OPS environment variable contains "reordered_indices",
+ * the triangle lists stored in GL_STATIC_DRAW element array buffers are drawn
+ * in an order which makes a better use of the vertex cache, and possibly as
+ * triangle strips or fans. This is never done while blending is enabled;
+ * applications relying on the order of the triangles in other ways (for
+ * example, when drawing decals with GL_LEQUAL depth testing) can call this
+ * function to keep the original order of the given buffer.
+ *
+ * Returns the previous setting; the default is off.
+ */
+int ogx_buffer_keep_order(GLuint buffer, int keep_order);
+
 /* This function can be called to register an optimized converter for the
  * texture data (used in glTex*Image* functions).
  *
@@ -74,6 +97,10 @@ int ogx_prepare_swap_buffers(void);
  * - ogx_fast_conv_RGB_RGB565;
  * - ogx_fast_conv_RGBA_RGBA8;
  * - ogx_fast_conv_Intensity_I8;
+ *
+ * Unless opengx was built with OPENGX_TEX_CONVERSIONS=none, most conversions
+ * already have a fast converter built in, so registering one is mostly useful
+ * with that setting.
  */
 void ogx_register_tex_conversion(GLenum format, GLenum internal_format,
                                  uintptr_t converter);
@@ -138,9 +165,11 @@ typedef struct {
     uint8_t texmtx_end;
     uint8_t texmap_first;
     uint8_t texmap_end;
-    /* We could add the VTXFMT here too, if we decided to reserve them for
-     * specific goals; for the time being, we only use GX_VTXFMT0 and set it up
-     * from scratch every time. */
+    /* The VTXFMT are not listed here: opengx uses GX_VTXFMT1-7 as a cache
+     * of vertex formats, and leaves GX_VTXFMT0 alone. The vertex descriptor
+     * is shadowed and only resynchronized in ogx_prepare_swap_buffers(), so
+     * code drawing with GX outside of opengx should not do so in the middle
+     * of a frame. */
 } OgxGpuResources;
 
 extern OgxGpuResources *ogx_gpu_resources;
@@ -157,9 +186,15 @@ typedef struct _OgxDrawData {
     /* for drawing arrays: */
     GLint first;
 
-    /* for drawing elements: */
+    /* for drawing elements (with glMultiDrawElements(), count and indices
+     * are those of the first sub-draw, and has_range covers all of them): */
     GLenum type;
     const GLvoid *indices;
+    /* for glDrawRangeElements(): if has_range is set, all the indices are
+     * within [start, end] */
+    bool has_range;
+    GLuint start;
+    GLuint end;
 } OgxDrawData;
 
 typedef struct {
@@ -207,6 +242,15 @@ typedef void (*OgxCleanupCb)(void *data);
 typedef void (*OgxSetupDrawCb)(GLuint program, const OgxDrawData *draw_data,
                                void *user_data);
 typedef void (*OgxSetupMatricesCb)(GLuint program, void *user_data);
+/* Called before drawing each instance (also for non instanced draws, with
+ * instance 0), after the setup_draw callback. The values of the attributes
+ * having a divisor (see glVertexAttribDivisor()) have been loaded for this
+ * instance and can be retrieved with glGetVertexAttribfv(). Only GX register
+ * writes (such as loading matrices or setting the material color) should be
+ * done here: the geometry is recorded into a GX display list and replayed for
+ * each instance. */
+typedef void (*OgxSetupInstanceCb)(GLuint program, GLint instance,
+                                   void *user_data);
 typedef void (*OgxDrawDoneCb)(GLuint program, void *user_data);
 void ogx_shader_program_set_user_data(GLuint program,
                                       void *data, OgxCleanupCb cleanup);
@@ -214,6 +258,8 @@ void ogx_shader_program_set_setup_matrices_cb(GLuint program,
                                               OgxSetupMatricesCb callback);
 void ogx_shader_program_set_setup_draw_cb(GLuint program,
                                           OgxSetupDrawCb callback);
+void ogx_shader_program_set_setup_instance_cb(GLuint program,
+                                              OgxSetupInstanceCb callback);
 void ogx_shader_program_set_draw_done_cb(GLuint program,
                                          OgxDrawDoneCb callback);
 
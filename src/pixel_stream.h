@@ -155,8 +155,9 @@ struct CompoundPixelStream: public PixelStreamBase {
         uint32_t value = pixel & mask;
         int shift = mask_data.bytes * 8 - offset - 8;
         uint8_t c = shift > 0 ? (value >> shift) : (value << -shift);
-        if (nbits < 8) {
-            c |= (c >> nbits);
+        /* fill the lowest bits by repeating the highest ones */
+        for (int n = nbits; n < 8; n *= 2) {
+            c |= (c >> n);
         }
         return c;
     }
@@ -32,14 +32,18 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "pixels.h"
 
+#include "cmpr.h"
 #include "debug.h"
 #include "opengx.h"
 #include "pixel_stream.h"
 #include "state.h"
 #include "texel.h"
 
+#include <array>
 #include <math.h>
 #include <ogc/gx.h>
+#include <type_traits>
+#include <utility>
 #include <variant>
 
 #define MAX_FAST_CONVERSIONS 8
@@ -66,11 +70,16 @@ static struct FastConversion {
  * to 1/10th), at the expense of a larger code size.
  *
  * Note that this class does not support packed pixel formats: each pixel
- * component must be at least one byte wide.
+ * component must be at least one byte wide. These are handled by PackedReader
+ * below.
  */
 template <typename T, char NUM_ELEMS, GLenum FORMAT>
 struct DataReader {
     typedef T type;
+    static constexpr int num_elems = NUM_ELEMS;
+    /* Position of the red and blue components in the pixel */
+    static constexpr int red = FORMAT == GL_BGR || FORMAT == GL_BGRA ? 2 : 0;
+    static constexpr int blue = 2 - red;
 
     static inline int pitch_for_width(int width) {
         return width * NUM_ELEMS * sizeof(T);
@@ -80,30 +89,64 @@ struct DataReader {
         return static_cast<const T *>(data) + y * pitch / sizeof(T);
     }
 
+    /* Role (0=red, ..., 3=alpha) of the i-th component of the pixel, as in
+     * _ogx_pixels_components_per_format */
+    static constexpr int component_role(int i) {
+        switch (FORMAT) {
+        case GL_RGBA: case GL_RGB: return i;
+        case GL_BGRA: return i == 3 ? 3 : 2 - i;
+        case GL_BGR: return 2 - i;
+        case GL_LUMINANCE_ALPHA: return i == 0 ? 0 : 3;
+        case GL_GREEN: return 1;
+        case GL_BLUE: return 2;
+        case GL_ALPHA: return 3;
+        default: return 0;
+        }
+    }
+
+    /* Returns the same color as GenericPixelStream::read() */
+    static inline GXColor color(const T *data) {
+        uint8_t c[4] = { 0, 0, 0, 255 };
+        for (int i = 0; i < NUM_ELEMS; i++) {
+            c[component_role(i)] = component(data[i]);
+        }
+        if constexpr (FORMAT == GL_INTENSITY || FORMAT == GL_LUMINANCE ||
+                      FORMAT == GL_LUMINANCE_ALPHA) {
+            c[1] = c[2] = c[0];
+            if constexpr (FORMAT == GL_INTENSITY) c[3] = c[0];
+        }
+        return { c[0], c[1], c[2], c[3] };
+    }
+
     template <typename P>
     static inline const T *read(const T *data, P &pixel) {
         if constexpr (NUM_ELEMS == 4 && P::has_rgb && P::has_alpha) {
-            pixel.set_color(component(data[0]),
+            pixel.set_color(component(data[red]),
                             component(data[1]),
-                            component(data[2]),
+                            component(data[blue]),
                             component(data[3]));
         } else if constexpr (NUM_ELEMS >= 3 && P::has_rgb && !P::has_alpha) {
-            pixel.set_color(component(data[0]),
+            pixel.set_color(component(data[red]),
                             component(data[1]),
-                            component(data[2]));
+                            component(data[blue]));
         } else if constexpr (NUM_ELEMS == 3 && P::has_rgb && P::has_alpha) {
-            pixel.set_color(component(data[0]),
+            pixel.set_color(component(data[red]),
                             component(data[1]),
-                            component(data[2]),
-                            1.0f);
+                            component(data[blue]),
+                            255);
+        } else if constexpr (P::has_rgb ||
+                             (NUM_ELEMS == 1 && FORMAT != GL_LUMINANCE &&
+                              FORMAT != GL_ALPHA)) {
+            /* Luminance to RGB, or single components other than luminance
+             * and alpha: go through GXColor like the generic converter */
+            pixel.set_color(color(data));
         } else {
-            /* TODO (maybe) support converting from intensity to RGB */
             uint8_t luminance, alpha;
             if constexpr (P::has_luminance) {
                 if constexpr (NUM_ELEMS >= 3) {
-                    luminance = luminance_from_rgb(component(data[0]),
+                    luminance = luminance_from_rgb(component(data[red]),
                                                    component(data[1]),
-                                                   component(data[2]));
+                                                   component(data[blue]));
                 } else if constexpr (NUM_ELEMS == 2) {
                     luminance = component(data[0]);
                 } else { // Just a single component in the source data
@@ -140,6 +183,73 @@ struct DataReader {
     }
 };
 
+/* Reader for the packed pixel types, where all the components of a pixel are
+ * stored in a single 8, 16 or 32 bit word. The parameters are those of the
+ * type's entry in _ogx_pixels_masks_per_type, and the components are
+ * extracted as in CompoundPixelStream::read(). */
+template <GLenum FORMAT, int BYTES, int RBITS, int GBITS, int BBITS, int ABITS,
+          int ROFF, int GOFF, int BOFF, int AOFF>
+struct PackedReader {
+    typedef uint8_t type;
+    static constexpr int num_elems = BYTES;
+    /* CompoundPixelStream swaps red and blue for the BGR formats */
+    static constexpr bool swap = FORMAT == GL_BGR || FORMAT == GL_BGRA;
+    static constexpr int red_offset = swap ? BOFF : ROFF;
+    static constexpr int blue_offset = swap ? ROFF : BOFF;
+
+    static inline int pitch_for_width(int width) { return width * BYTES; }
+
+    static inline const uint8_t *row_ptr(const void *data, int y, int pitch) {
+        return static_cast<const uint8_t *>(data) + y * pitch;
+    }
+
+    template <int NBITS, int OFFSET>
+    static inline uint8_t extract(uint32_t pixel) {
+        constexpr uint32_t mask =
+            ((1 << NBITS) - 1) << (BYTES * 8 - (NBITS + OFFSET));
+        constexpr int shift = BYTES * 8 - OFFSET - 8;
+        uint32_t value = pixel & mask;
+        uint8_t c;
+        if constexpr (shift > 0) {
+            c = value >> shift;
+        } else {
+            c = value << -shift;
+        }
+        for (int n = NBITS; n < 8; n *= 2) {
+            c |= (c >> n);
+        }
+        return c;
+    }
+
+    template <typename P>
+    static inline const uint8_t *read(const uint8_t *data, P &pixel) {
+        uint32_t word = 0;
+        for (int i = 0; i < BYTES; i++) {
+            word = (word << 8) | data[i];
+        }
+        GXColor c;
+        c.r = extract<RBITS, red_offset>(word);
+        c.g = extract<GBITS, GOFF>(word);
+        c.b = extract<BBITS, blue_offset>(word);
+        if constexpr (ABITS > 0) {
+            c.a = extract<ABITS, AOFF>(word);
+        } else {
+            c.a = 255;
+        }
+        pixel.set_color(c);
+        return data + BYTES;
+    }
+};
+
+template <GLenum FORMAT>
+using PackedReader565 = PackedReader<FORMAT, 2, 5, 6, 5, 0, 0, 5, 11, 0>;
+
+template <GLenum FORMAT>
+using PackedReader4444 = PackedReader<FORMAT, 2, 4, 4, 4, 4, 0, 4, 8, 12>;
+
+template <GLenum FORMAT>
+using PackedReader5551 = PackedReader<FORMAT, 2, 5, 5, 5, 1, 0, 5, 10, 15>;
+
 template <typename T>
 using DataReaderRGBA = DataReader<T, 4, GL_RGBA>;
 
@@ -155,26 +265,267 @@ using DataReaderIntensity = DataReader<T, 1, GL_LUMINANCE>;
 template <typename T>
 using DataReaderAlpha = DataReader<T, 1, GL_ALPHA>;
 
+/* Converts the pixels into the texture walking the destination in GX block
+ * order: each row of a block is assembled in a small buffer and then copied
+ * into the texture as a whole, so that no address needs to be computed for
+ * the single texels. The blocks at the edges of the area which are only
+ * partly covered by it are read back first, to preserve the texels lying
+ * outside of it.
+ *
+ * The SOURCE class provides the pixels: fetch_rows() is called before the
+ * rows of each block row are accessed, pixel() returns the address of a pixel
+ * (with coordinates relative to the area) and read() stores a pixel into the
+ * texel, returning the address of the next one. Sources whose pixels already
+ * have the layout of the texels set copies_texels, and provide copy() to move
+ * a run of them into the row buffer instead. */
+template <typename SOURCE, typename TEXEL> static inline
+void store_blocks(SOURCE &source, int width, int height,
+                  void *dest, int x, int y, int dstpitch)
+{
+    constexpr int block_width = TEXEL::block_width;
+    constexpr int block_height = TEXEL::block_height;
+
+    TEXEL texel;
+    alignas(8) uint8_t row[TEXEL::row_size] = {};
+    int x_end = x + width;
+    int y_end = y + height;
+    int first_block_x = x / block_width;
+    int last_block_x = (x_end - 1) / block_width;
+    for (int block_y = y - y % block_height; block_y < y_end;
+         block_y += block_height) {
+        int row_start = std::max(y - block_y, 0);
+        int row_end = std::min(y_end - block_y, block_height);
+        source.fetch_rows(block_y + row_start - y, row_end - row_start);
+
+        /* The pitch is the size of a row of texels, a block row spans
+         * block_height of them */
+        uint8_t *block = static_cast<uint8_t*>(dest) + block_y * dstpitch +
+            first_block_x * TEXEL::block_size;
+        for (int bx = first_block_x; bx <= last_block_x;
+             bx++, block += TEXEL::block_size) {
+            int block_x = bx * block_width;
+            int col_start = std::max(x - block_x, 0);
+            int col_end = std::min(x_end - block_x, block_width);
+            bool partial = col_start > 0 || col_end < block_width;
+            for (int ry = row_start; ry < row_end; ry++) {
+                auto *src = source.pixel(block_x + col_start - x,
+                                         block_y + ry - y);
+                if (partial) {
+                    TEXEL::load_row(row, block, ry);
+                }
+                if constexpr (SOURCE::copies_texels) {
+                    if (partial) {
+                        SOURCE::copy(src, row, col_start, col_end - col_start);
+                    } else {
+                        SOURCE::copy(src, row, 0, block_width);
+                    }
+                } else if (partial) {
+                    for (int rx = col_start; rx < col_end; rx++) {
+                        src = SOURCE::read(src, texel);
+                        texel.put(row, rx);
+                    }
+                } else {
+                    for (int rx = 0; rx < block_width; rx++) {
+                        src = SOURCE::read(src, texel);
+                        texel.put(row, rx);
+                    }
+                }
+                TEXEL::store_row(row, block, ry);
+            }
+        }
+    }
+}
+
+/* Source for store_blocks() reading the client data with a DataReader */
+template <typename READER>
+struct DataSource {
+    using type = typename READER::type;
+    static constexpr bool copies_texels = false;
+
+    DataSource(const void *data, int pitch): m_data(data), m_pitch(pitch) {}
+
+    void fetch_rows(int y, int count) {}
+
+    const type *pixel(int x, int y) const {
+        return READER::row_ptr(m_data, y, m_pitch) + x * READER::num_elems;
+    }
+
+    template <typename P>
+    static inline const type *read(const type *data, P &pixel) {
+        return READER::read(data, pixel);
+    }
+
+    const void *m_data;
+    int m_pitch;
+};
+
+/* Source for store_blocks() reading the client data with a PixelStreamBase.
+ * Since the stream can only be read sequentially, the rows of a block row are
+ * converted to GXColor in a buffer first. */
+struct ColorRowsSource {
+    using type = GXColor;
+    static constexpr bool copies_texels = false;
+
+    ColorRowsSource(PixelStreamBase *reader, GXColor *rows, int width,
+                    int skip_pixels_after):
+        m_reader(reader), m_rows(rows), m_width(width),
+        m_skip_pixels_after(skip_pixels_after), m_first_row(0) {}
+
+    void fetch_rows(int y, int count) {
+        GXColor *c = m_rows;
+        for (int ry = y; ry < y + count; ry++) {
+            if (ry > 0) {
+                for (int i = 0; i < m_skip_pixels_after; i++) {
+                    m_reader->read();
+                }
+            }
+            for (int rx = 0; rx < m_width; rx++) {
+                *c++ = m_reader->read();
+            }
+        }
+        m_first_row = y;
+    }
+
+    const GXColor *pixel(int x, int y) const {
+        return m_rows + (y - m_first_row) * m_width + x;
+    }
+
+    template <typename P>
+    static inline const GXColor *read(const GXColor *c, P &pixel) {
+        pixel.set_color(*c);
+        return c + 1;
+    }
+
+    PixelStreamBase *m_reader;
+    GXColor *m_rows;
+    int m_width;
+    int m_skip_pixels_after;
+    int m_first_row;
+};
+
+/* Source for store_blocks() for client pixels which are already laid out as
+ * the texels of the GX format, BYTES wide. For 16 bit texels, the client
+ * pixels are read as big endian words like CompoundPixelStream does, or as
+ * little endian ones if REVERSED is set. */
+template <int BYTES, bool REVERSED>
+struct CopySource {
+    using type = uint8_t;
+    static constexpr bool copies_texels = true;
+
+    CopySource(const void *data, int pitch): m_data(data), m_pitch(pitch) {}
+
+    void fetch_rows(int y, int count) {}
+
+    const uint8_t *pixel(int x, int y) const {
+        return static_cast<const uint8_t *>(m_data) + y * m_pitch + x * BYTES;
+    }
+
+    static inline void copy(const uint8_t *src, uint8_t *row, int x,
+                            int count) {
+        if constexpr (BYTES == 1) {
+            memcpy(row + x, src, count);
+        } else {
+            uint16_t *texels = reinterpret_cast<uint16_t*>(row) + x;
+            for (int i = 0; i < count; i++, src += 2) {
+                texels[i] = REVERSED ?
+                    (src[1] << 8) | src[0] : (src[0] << 8) | src[1];
+            }
+        }
+    }
+
+    const void *m_data;
+    int m_pitch;
+};
+
+template <int BYTES, bool REVERSED, typename TEXEL>
+static void copy_texture(const void *data, GLenum type, int width, int height,
+                         void *dst, int x, int y, int dstpitch)
+{
+    int row_length = glparamstate.unpack_row_length > 0 ?
+        glparamstate.unpack_row_length : width;
+    CopySource<BYTES, REVERSED> source(data, row_length * BYTES);
+    store_blocks<CopySource<BYTES, REVERSED>, TEXEL>(source, width, height,
+                                                     dst, x, y, dstpitch);
+}
+
+/* Reader for GL_COLOR_INDEX pixels, which are packed into CI4 texels */
+struct IndexReader {
+    typedef uint8_t type;
+    static constexpr int num_elems = 1;
+
+    static inline int pitch_for_width(int width) { return width; }
+
+    static inline const uint8_t *row_ptr(const void *data, int y, int pitch) {
+        return static_cast<const uint8_t *>(data) + y * pitch;
+    }
+
+    template <typename P>
+    static inline const uint8_t *read(const uint8_t *data, P &pixel) {
+        pixel.set_index(*data);
+        return data + 1;
+    }
+};
+
+static void index_texture(const void *data, GLenum type, int width, int height,
+                          void *dst, int x, int y, int dstpitch)
+{
+    int row_length = glparamstate.unpack_row_length > 0 ?
+        glparamstate.unpack_row_length : width;
+    DataSource<IndexReader> source(data, row_length);
+    store_blocks<DataSource<IndexReader>, TexelI4>(source, width, height,
+                                                   dst, x, y, dstpitch);
+}
+
+/* Returns a converter for the client pixels matching the texels of the GX
+ * format bit for bit, which only need to be rearranged into blocks */
+static FastConverter *find_copy_converter(GLenum format, GLenum type,
+                                          uint8_t gx_format)
+{
+    if (type == GL_BYTE || type == GL_UNSIGNED_BYTE) {
+        switch (gx_format) {
+        case GX_TF_CI8:
+            if (format == GL_COLOR_INDEX)
+                return copy_texture<1, false, TexelI8>;
+            break;
+        case GX_TF_CI4:
+            /* Just two indices per byte */
+            if (format == GL_COLOR_INDEX)
+                return index_texture;
+            break;
+        case GX_TF_I8:
+            if (format == GL_LUMINANCE || format == GL_INTENSITY)
+                return copy_texture<1, false, TexelI8>;
+            break;
+        case GX_TF_A8:
+            if (format == GL_ALPHA || format == GL_INTENSITY)
+                return copy_texture<1, false, TexelA8>;
+            break;
+        case GX_TF_IA8:
+            /* IA8 has the alpha first */
+            if (format == GL_LUMINANCE_ALPHA)
+                return copy_texture<2, true, TexelIA8>;
+            break;
+        }
+    } else if (gx_format == GX_TF_RGB565) {
+        if ((format == GL_RGB && type == GL_UNSIGNED_SHORT_5_6_5) ||
+            (format == GL_BGR && type == GL_UNSIGNED_SHORT_5_6_5_REV))
+            return copy_texture<2, false, TexelRGB565>;
+    }
+    return nullptr;
+}
+
 template <typename READER, typename TEXEL> static inline
 void load_texture_typed(const void *src, int width, int height,
                         void *dest, int x, int y, int dstpitch)
 {
     // TODO: add alignment options
-    using DataType = typename READER::type;
-
     int row_length = glparamstate.unpack_row_length > 0 ?
         glparamstate.unpack_row_length : width;
     int srcpitch = READER::pitch_for_width(row_length);
 
-    TEXEL texel;
-    texel.set_area(dest, x, y, width, height, dstpitch);
-    for (int ry = 0; ry < height; ry++) {
-        const DataType *srcline = READER::row_ptr(src, ry, srcpitch);
-        for (int rx = 0; rx < width; rx++) {
-            srcline = READER::read(srcline, texel);
-            texel.store();
-        }
-    }
+    DataSource<READER> source(src, srcpitch);
+    store_blocks<DataSource<READER>, TEXEL>(source, width, height,
+                                            dest, x, y, dstpitch);
 }
 
 template <template<typename> typename READERBASE, typename TEXEL> static inline
@@ -198,6 +549,148 @@ void load_texture(const void *data, GLenum type, int width, int height,
     }
 }
 
+/* The table of converters generated at compile time, indexed by GL format,
+ * GL type and GX format. OGX_TEX_CONVERSIONS selects its coverage (each
+ * converter takes some code space):
+ * 0: none, only the registered conversions are used
+ * 1: unsigned bytes and the common packed types
+ * 2: also 16 and 32 bit integer and float components
+ */
+#ifndef OGX_TEX_CONVERSIONS
+#define OGX_TEX_CONVERSIONS 1
+#endif
+
+static constexpr GLenum s_table_formats[] = {
+    GL_RGBA, GL_BGRA, GL_RGB, GL_BGR,
+    GL_LUMINANCE_ALPHA, GL_LUMINANCE, GL_INTENSITY, GL_ALPHA,
+};
+static constexpr GLenum s_table_types[] = {
+    GL_UNSIGNED_BYTE,
+    GL_UNSIGNED_SHORT_5_6_5,
+    GL_UNSIGNED_SHORT_4_4_4_4,
+    GL_UNSIGNED_SHORT_5_5_5_1,
+    GL_UNSIGNED_SHORT,
+    GL_UNSIGNED_INT,
+    GL_FLOAT,
+};
+/* The formats produced by _ogx_find_best_gx_format(), plus GX_TF_A8 */
+static constexpr uint8_t s_table_gx_formats[] = {
+    GX_TF_RGBA8, GX_TF_RGB565, GX_TF_RGB5A3, GX_TF_IA8, GX_TF_I8, GX_TF_A8,
+};
+
+template <typename T> static constexpr int table_count(const T &array) {
+    return sizeof(array) / sizeof(array[0]);
+}
+
+template <typename T>
+static inline int table_index(const T *array, int count, T value) {
+    for (int i = 0; i < count; i++) {
+        if (array[i] == value) return i;
+    }
+    return -1;
+}
+
+static constexpr int num_components(GLenum format) {
+    switch (format) {
+    case GL_RGBA: case GL_BGRA: return 4;
+    case GL_RGB: case GL_BGR: return 3;
+    case GL_LUMINANCE_ALPHA: return 2;
+    default: return 1;
+    }
+}
+
+template <GLenum FORMAT, GLenum TYPE> struct TableReader {
+    /* No fast converter for this combination */
+    using reader = void;
+};
+
+#define TABLE_DATA_READER(gl_type, c_type, level) \
+    template <GLenum FORMAT> struct TableReader<FORMAT, gl_type> { \
+        using reader = std::conditional_t< \
+            OGX_TEX_CONVERSIONS >= level, \
+            DataReader<c_type, num_components(FORMAT), FORMAT>, void>; \
+    };
+TABLE_DATA_READER(GL_UNSIGNED_BYTE, uint8_t, 1)
+TABLE_DATA_READER(GL_UNSIGNED_SHORT, uint16_t, 2)
+TABLE_DATA_READER(GL_UNSIGNED_INT, uint32_t, 2)
+TABLE_DATA_READER(GL_FLOAT, float, 2)
+
+#define TABLE_PACKED_READER(gl_type, packed_reader, components) \
+    template <GLenum FORMAT> struct TableReader<FORMAT, gl_type> { \
+        using reader = std::conditional_t< \
+            OGX_TEX_CONVERSIONS >= 1 && \
+            num_components(FORMAT) == components && FORMAT != GL_INTENSITY, \
+            packed_reader<FORMAT>, void>; \
+    };
+TABLE_PACKED_READER(GL_UNSIGNED_SHORT_5_6_5, PackedReader565, 3)
+TABLE_PACKED_READER(GL_UNSIGNED_SHORT_4_4_4_4, PackedReader4444, 4)
+TABLE_PACKED_READER(GL_UNSIGNED_SHORT_5_5_5_1, PackedReader5551, 4)
+
+template <uint8_t GX_FORMAT> struct TableTexel;
+template <> struct TableTexel<GX_TF_RGBA8> { using texel = TexelRGBA8; };
+template <> struct TableTexel<GX_TF_RGB565> { using texel = TexelRGB565; };
+template <> struct TableTexel<GX_TF_RGB5A3> { using texel = TexelRGB5A3; };
+template <> struct TableTexel<GX_TF_IA8> { using texel = TexelIA8; };
+template <> struct TableTexel<GX_TF_I8> { using texel = TexelI8; };
+template <> struct TableTexel<GX_TF_A8> { using texel = TexelA8; };
+
+template <typename READER, typename TEXEL>
+static void table_converter(const void *data, GLenum type,
+                            int width, int height,
+                            void *dst, int x, int y, int dstpitch)
+{
+    load_texture_typed<READER, TEXEL>(data, width, height, dst, x, y, dstpitch);
+}
+
+template <int INDEX>
+static constexpr FastConverter *table_entry()
+{
+    constexpr int num_types = table_count(s_table_types);
+    constexpr int num_gx_formats = table_count(s_table_gx_formats);
+    constexpr GLenum format =
+        s_table_formats[INDEX / (num_types * num_gx_formats)];
+    constexpr GLenum type = s_table_types[INDEX / num_gx_formats % num_types];
+    constexpr uint8_t gx_format = s_table_gx_formats[INDEX % num_gx_formats];
+
+    using Reader = typename TableReader<format, type>::reader;
+    if constexpr (std::is_void_v<Reader>) {
+        return nullptr;
+    } else {
+        return table_converter<Reader,
+                               typename TableTexel<gx_format>::texel>;
+    }
+}
+
+template <int... INDEXES>
+static constexpr auto build_table(std::integer_sequence<int, INDEXES...>)
+{
+    return std::array<FastConverter *, sizeof...(INDEXES)> {
+        table_entry<INDEXES>()...
+    };
+}
+
+static constexpr auto s_table_converters = build_table(
+    std::make_integer_sequence<int, table_count(s_table_formats) *
+                                    table_count(s_table_types) *
+                                    table_count(s_table_gx_formats)>());
+
+static FastConverter *find_table_converter(GLenum format, GLenum type,
+                                           uint8_t gx_format)
+{
+    /* Signed bytes are read as unsigned, like the registered converters do */
+    if (type == GL_BYTE) type = GL_UNSIGNED_BYTE;
+
+    int f = table_index(s_table_formats, table_count(s_table_formats), format);
+    int t = table_index(s_table_types, table_count(s_table_types), type);
+    int g = table_index(s_table_gx_formats, table_count(s_table_gx_formats),
+                        gx_format);
+    if (f < 0 || t < 0 || g < 0) return nullptr;
+
+    int index = (f * table_count(s_table_types) + t) *
+        table_count(s_table_gx_formats) + g;
+    return s_table_converters[index];
+}
+
 static int get_pixel_size_in_bits(GLenum format, GLenum type)
 {
     int type_size = 0;
@@ -243,20 +736,16 @@ static int get_pixel_size_in_bits(GLenum format, GLenum type)
     return c->components_per_pixel * type_size * 8;
 }
 
-void _ogx_bytes_to_texture(const void *data, GLenum format, GLenum type,
-                           int width, int height,
-                           void *dst, uint32_t gx_format,
-                           int x, int y, int dstpitch)
+/* The GL_UNPACK_SKIP_ROWS and GL_UNPACK_SKIP_PIXELS can be handled by
+ * modifiying the source data pointer. */
+static const void *skip_unpack_pixels(const void *data, GLenum format,
+                                      GLenum type, int width,
+                                      bool *need_skip_pixels)
 {
-    /* Skip degenerate cases */
-    if (width <= 0 || height <= 0) return;
-
-    /* The GL_UNPACK_SKIP_ROWS and GL_UNPACK_SKIP_PIXELS can be handled here by
-     * modifiying the source data pointer. */
-    bool need_skip_pixels = false;
-    int row_length = glparamstate.unpack_row_length > 0 ?
-        glparamstate.unpack_row_length : width;
+    *need_skip_pixels = false;
     if (glparamstate.unpack_skip_pixels > 0 || glparamstate.unpack_skip_rows > 0) {
+        int row_length = glparamstate.unpack_row_length > 0 ?
+            glparamstate.unpack_row_length : width;
         int pixel_size_bits = get_pixel_size_in_bits(format, type);
         int row_size_bytes = (row_length * pixel_size_bits + 7) / 8;
         /* For bitmaps, the skip_pixels case is handled in the reader itself,
@@ -265,11 +754,117 @@ void _ogx_bytes_to_texture(const void *data, GLenum format, GLenum type,
         if (pixel_size_bits >= 8) {
             skip_pixels = glparamstate.unpack_skip_pixels * pixel_size_bits;
         } else {
-            need_skip_pixels = true;
+            *need_skip_pixels = true;
         }
         data = static_cast<const uint8_t*>(data) + skip_pixels +
             glparamstate.unpack_skip_rows * row_size_bytes;
     }
+    return data;
+}
+
+typedef std::variant<
+    BitmapPixelStream,
+    CompoundPixelStream,
+    GenericPixelStream<uint8_t>,
+    GenericPixelStream<uint16_t>,
+    GenericPixelStream<uint32_t>,
+    GenericPixelStream<float>
+> PixelStreamVariant;
+
+/* Constructs the generic pixel stream for the GL type into the variant, so
+ * that it can safely live on the stack. Returns NULL if the type is not
+ * supported. */
+static PixelStreamBase *new_pixel_stream(PixelStreamVariant &stream_v,
+                                         GLenum format, GLenum type)
+{
+    switch (type) {
+    case GL_UNSIGNED_BYTE:
+        stream_v = GenericPixelStream<uint8_t>(format, type);
+        return &std::get<GenericPixelStream<uint8_t>>(stream_v);
+    case GL_UNSIGNED_SHORT:
+        stream_v = GenericPixelStream<uint16_t>(format, type);
+        return &std::get<GenericPixelStream<uint16_t>>(stream_v);
+    case GL_UNSIGNED_INT:
+        stream_v = GenericPixelStream<uint32_t>(format, type);
+        return &std::get<GenericPixelStream<uint32_t>>(stream_v);
+    case GL_FLOAT:
+        stream_v = GenericPixelStream<float>(format, type);
+        return &std::get<GenericPixelStream<float>>(stream_v);
+    case GL_UNSIGNED_BYTE_3_3_2:
+    case GL_UNSIGNED_BYTE_2_3_3_REV:
+    case GL_UNSIGNED_SHORT_5_6_5:
+    case GL_UNSIGNED_SHORT_5_6_5_REV:
+    case GL_UNSIGNED_SHORT_4_4_4_4:
+    case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+    case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+    case GL_UNSIGNED_INT_8_8_8_8:
+    case GL_UNSIGNED_INT_8_8_8_8_REV:
+    case GL_UNSIGNED_INT_10_10_10_2:
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+        stream_v = CompoundPixelStream(format, type);
+        return &std::get<CompoundPixelStream>(stream_v);
+    case GL_BITMAP:
+        stream_v = BitmapPixelStream();
+        return &std::get<BitmapPixelStream>(stream_v);
+    default:
+        warning("Unknown texture data type %x\n", type);
+        return nullptr;
+    }
+}
+
+/* Reads the client pixels with the generic reader for their GL type, and
+ * hands them to store() as a ColorRowsSource. */
+template <typename STORE>
+static void read_generic(const void *data, GLenum format, GLenum type,
+                         int width, int height, bool need_skip_pixels,
+                         STORE store)
+{
+    PixelStreamVariant reader_v;
+    PixelStreamBase *reader = new_pixel_stream(reader_v, format, type);
+    if (!reader) return;
+
+    reader->setup_stream(data, width, height);
+
+    /* The stream is read sequentially: the pixels which could not be skipped
+     * by moving the data pointer, and those past the end of each row when
+     * GL_UNPACK_ROW_LENGTH is set, are read and discarded */
+    if (need_skip_pixels) {
+        for (int i = 0; i < glparamstate.unpack_skip_pixels; i++) {
+            reader->read();
+        }
+    }
+    int row_length = glparamstate.unpack_row_length > 0 ?
+        glparamstate.unpack_row_length : width;
+    int skip_pixels_after = row_length - width;
+
+    /* Room for the rows of a block row of the tallest blocks */
+    GXColor *rows = static_cast<GXColor*>(malloc(width * 8 * sizeof(GXColor)));
+    if (!rows) {
+        warning("Failed to allocate memory for texture conversion");
+        return;
+    }
+    ColorRowsSource source(reader, rows, width, skip_pixels_after);
+    store(source);
+    free(rows);
+}
+
+void _ogx_bytes_to_texture(const void *data, GLenum format, GLenum type,
+                           int width, int height,
+                           void *dst, uint32_t gx_format,
+                           int x, int y, int dstpitch)
+{
+    /* Skip degenerate cases */
+    if (width <= 0 || height <= 0) return;
+
+    bool need_skip_pixels;
+    data = skip_unpack_pixels(data, format, type, width, &need_skip_pixels);
+    FastConverter *copy = find_copy_converter(format, type, gx_format);
+    if (copy) {
+        copy(data, type, width, height, dst, x, y, dstpitch);
+        return;
+    }
+
     /* Accelerate the most common transformations by using the specialized
      * readers. We only do this for some transformations, since every
      * instantiation of the template takes some space, and the number of
@@ -287,126 +882,172 @@ void _ogx_bytes_to_texture(const void *data, GLenum format, GLenum type,
         }
     }
 
+    FastConverter *converter = find_table_converter(format, type, gx_format);
+    if (converter) {
+        converter(data, type, width, height, dst, x, y, dstpitch);
+        return;
+    }
+
     debug(OGX_LOG_TEXTURE,
-          "No fast conversion registered for GL format %04x to GX format %d",
-          format, gx_format);
+          "No fast conversion for GL format %04x, type %04x to GX format %d",
+          format, type, gx_format);
 
     /* Here starts the code for the generic converter. We start by selecting
      * the proper Texel subclass for the given GX texture format, then we
      * select the reader based on the GL type parameter, and then we do the
-     * conversion pixel by pixel, by using GXColor as intermediate format.
-     *
-     * We use std::variant so that we can safely construct our objects on the
-     * stack. */
+     * conversion block by block, by using GXColor as intermediate format. */
     std::variant<
         TexelRGBA8,
         TexelRGB565,
+        TexelRGB5A3,
         TexelIA8,
         TexelI8,
         TexelI4,
         TexelA8
     > texel_v;
-    Texel *texel;
-
-    std::variant<
-        BitmapPixelStream,
-        CompoundPixelStream,
-        GenericPixelStream<uint8_t>,
-        GenericPixelStream<uint16_t>,
-        GenericPixelStream<uint32_t>,
-        GenericPixelStream<float>
-    > reader_v;
-    PixelStreamBase *reader;
 
     switch (gx_format) {
     case GX_TF_RGBA8:
         texel_v = TexelRGBA8();
-        texel = &std::get<TexelRGBA8>(texel_v);
         break;
     case GX_TF_RGB565:
         texel_v = TexelRGB565();
-        texel = &std::get<TexelRGB565>(texel_v);
+        break;
+    case GX_TF_RGB5A3:
+        texel_v = TexelRGB5A3();
         break;
     case GX_TF_IA8:
         texel_v = TexelIA8();
-        texel = &std::get<TexelIA8>(texel_v);
         break;
     case GX_TF_I8:
         texel_v = TexelI8();
-        texel = &std::get<TexelI8>(texel_v);
         break;
     case GX_TF_A8:
         texel_v = TexelA8();
-        texel = &std::get<TexelA8>(texel_v);
         break;
     case GX_TF_I4:
         texel_v = TexelI4();
-        texel = &std::get<TexelI4>(texel_v);
-        break;
-    }
-
-    switch (type) {
-    case GL_UNSIGNED_BYTE:
-        reader_v = GenericPixelStream<uint8_t>(format, type);
-        reader = &std::get<GenericPixelStream<uint8_t>>(reader_v);
-        break;
-    case GL_UNSIGNED_SHORT:
-        reader_v = GenericPixelStream<uint16_t>(format, type);
-        reader = &std::get<GenericPixelStream<uint16_t>>(reader_v);
-        break;
-    case GL_UNSIGNED_INT:
-        reader_v = GenericPixelStream<uint32_t>(format, type);
-        reader = &std::get<GenericPixelStream<uint32_t>>(reader_v);
-        break;
-    case GL_FLOAT:
-        reader_v = GenericPixelStream<float>(format, type);
-        reader = &std::get<GenericPixelStream<float>>(reader_v);
-        break;
-    case GL_UNSIGNED_BYTE_3_3_2:
-    case GL_UNSIGNED_BYTE_2_3_3_REV:
-    case GL_UNSIGNED_SHORT_5_6_5:
-    case GL_UNSIGNED_SHORT_5_6_5_REV:
-    case GL_UNSIGNED_SHORT_4_4_4_4:
-    case GL_UNSIGNED_SHORT_4_4_4_4_REV:
-    case GL_UNSIGNED_SHORT_5_5_5_1:
-    case GL_UNSIGNED_SHORT_1_5_5_5_REV:
-    case GL_UNSIGNED_INT_8_8_8_8:
-    case GL_UNSIGNED_INT_8_8_8_8_REV:
-    case GL_UNSIGNED_INT_10_10_10_2:
-    case GL_UNSIGNED_INT_2_10_10_10_REV:
-        reader_v = CompoundPixelStream(format, type);
-        reader = &std::get<CompoundPixelStream>(reader_v);
-        break;
-    case GL_BITMAP:
-        reader_v = BitmapPixelStream();
-        reader = &std::get<BitmapPixelStream>(reader_v);
         break;
     default:
-        warning("Unknown texture data type %x\n", type);
+        warning("Unsupported GX texture format %d", gx_format);
+        return;
     }
 
-    int skip_pixels_after = 0;
-    if (need_skip_pixels) {
-        for (int i = 0; i < glparamstate.unpack_skip_pixels; i++) {
-            reader->read();
-        }
-        skip_pixels_after = row_length - width;
+    read_generic(data, format, type, width, height, need_skip_pixels,
+                 [&](ColorRowsSource &source) {
+        std::visit([&](auto &texel) {
+            using TexelType = std::decay_t<decltype(texel)>;
+            store_blocks<ColorRowsSource, TexelType>(source, width, height,
+                                                     dst, x, y, dstpitch);
+        }, texel_v);
+    });
+}
+
+/* Collects the colours of a block for the CMPR encoder */
+struct CmprPixel {
+    static constexpr bool has_rgb = true;
+    static constexpr bool has_alpha = true;
+    static constexpr bool has_luminance = false;
+
+    void set_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+        color = { r, g, b, a };
     }
+    void set_color(GXColor c) { color = c; }
 
-    reader->setup_stream(data, width, height);
-    texel->set_area(dst, x, y, width, height, dstpitch);
-    for (int ry = 0; ry < height; ry++) {
-        if (ry > 0) {
-            for (int i = 0; i < skip_pixels_after; i++) {
-                reader->read();
+    GXColor color;
+};
+
+/* Compresses the area into CMPR blocks. These are 4x4 texels, and grouped by
+ * four into 8x8 tiles (top left, top right, bottom left, bottom right); the
+ * area must start at a block boundary. Blocks not entirely covered by the
+ * area, and the padding blocks up to padded_width x padded_height, are
+ * filled by repeating the pixels along its right and bottom edges. */
+template <typename SOURCE>
+static void store_cmpr_blocks(SOURCE &source, int width, int height,
+                              void *dest, int x, int y, int dstpitch,
+                              int padded_width, int padded_height,
+                              bool alpha, bool high_quality)
+{
+    CmprPixel pixel;
+    GXColor block[16];
+    for (int by = 0; by < padded_height; by += 4) {
+        /* Padding block rows reuse the last row of the area, which stays in
+         * the source */
+        if (by < height) source.fetch_rows(by, std::min(height - by, 4));
+        int ty = y + by;
+        uint8_t *tile_row = static_cast<uint8_t*>(dest) + (ty / 8) * dstpitch * 8;
+        for (int bx = 0; bx < padded_width; bx += 4) {
+            int first_col = std::min(bx, width - 1);
+            int cols = std::clamp(width - bx, 1, 4);
+            for (int ry = 0; ry < 4; ry++) {
+                GXColor *row = block + ry * 4;
+                if (ry > 0 && by + ry >= height) {
+                    memcpy(row, row - 4, 4 * sizeof(GXColor));
+                    continue;
+                }
+                auto *src = source.pixel(first_col,
+                                         std::min(by + ry, height - 1));
+                for (int rx = 0; rx < cols; rx++) {
+                    src = SOURCE::read(src, pixel);
+                    row[rx] = pixel.color;
+                }
+                for (int rx = cols; rx < 4; rx++) row[rx] = row[cols - 1];
             }
+            int tx = x + bx;
+            uint8_t *out = tile_row + (tx / 8) * 32 +
+                ((ty / 4) % 2 * 2 + (tx / 4) % 2) * 8;
+            _ogx_cmpr_encode_block(block, alpha, high_quality, out);
         }
-        for (int rx = 0; rx < width; rx++) {
-            GXColor c = reader->read();
-            texel->set_color(c);
-            texel->store();
+    }
+}
+
+template <typename READER>
+static void cmpr_from_data(const void *data, int width, int height,
+                           void *dst, int x, int y, int dstpitch,
+                           int padded_width, int padded_height,
+                           bool alpha, bool high_quality)
+{
+    int row_length = glparamstate.unpack_row_length > 0 ?
+        glparamstate.unpack_row_length : width;
+    DataSource<READER> source(data, READER::pitch_for_width(row_length));
+    store_cmpr_blocks(source, width, height, dst, x, y, dstpitch,
+                      padded_width, padded_height, alpha, high_quality);
+}
+
+void _ogx_bytes_to_cmpr(const void *data, GLenum format, GLenum type,
+                        int width, int height, void *dst,
+                        int x, int y, int dstpitch,
+                        int padded_width, int padded_height,
+                        bool alpha, bool high_quality)
+{
+    if (width <= 0 || height <= 0) return;
+
+    bool need_skip_pixels;
+    data = skip_unpack_pixels(data, format, type, width, &need_skip_pixels);
+
+    if (type == GL_BYTE || type == GL_UNSIGNED_BYTE) {
+        switch (format) {
+#define CMPR_FROM_DATA(n, fmt) \
+        case fmt: \
+            cmpr_from_data<DataReader<uint8_t, n, fmt>>( \
+                data, width, height, dst, x, y, dstpitch, \
+                padded_width, padded_height, alpha, high_quality); \
+            return;
+        CMPR_FROM_DATA(3, GL_RGB)
+        CMPR_FROM_DATA(4, GL_RGBA)
+        CMPR_FROM_DATA(3, GL_BGR)
+        CMPR_FROM_DATA(4, GL_BGRA)
+        CMPR_FROM_DATA(1, GL_LUMINANCE)
+        CMPR_FROM_DATA(2, GL_LUMINANCE_ALPHA)
+#undef CMPR_FROM_DATA
         }
     }
+
+    read_generic(data, format, type, width, height, need_skip_pixels,
+                 [&](ColorRowsSource &source) {
+        store_cmpr_blocks(source, width, height, dst, x, y, dstpitch,
+                          padded_width, padded_height, alpha, high_quality);
+    });
 }
 
 int _ogx_pitch_for_width(uint32_t gx_format, int width)
@@ -415,12 +1056,16 @@ int _ogx_pitch_for_width(uint32_t gx_format, int width)
     case GX_TF_RGBA8:
         return TexelRGBA8::compute_pitch(width);
     case GX_TF_RGB565:
+    case GX_TF_RGB5A3:
     case GX_TF_IA8:
         return TexelRGB565::compute_pitch(width);
     case GX_TF_I8:
     case GX_TF_A8:
+    case GX_TF_CI8:
         return TexelI8::compute_pitch(width);
     case GX_TF_I4:
+    case GX_TF_CI4:
+    case GX_TF_CMPR: /* Also 4 bits per texel, in 8x8 tiles */
         return TexelI4::compute_pitch(width);
     default:
         return -1;
@@ -441,11 +1086,27 @@ uint8_t _ogx_gl_format_to_gx(GLenum format)
     case GL_RGBA:
     case GL_RGBA8:
     case GL_BGRA:
-    case GL_COMPRESSED_RGBA_ARB: /* No support for compressed alpha textures */
+    case GL_COMPRESSED_RGBA_ARB: /* CMPR if the alpha is binary */
     case GL_RED:
     case GL_GREEN:
     case GL_BLUE:
         return GX_TF_RGBA8;
+    case GL_RGBA2:
+    case GL_RGBA4:
+    case GL_RGB5_A1:
+        return GX_TF_RGB5A3;
+    case GL_COLOR_INDEX1_EXT:
+    case GL_COLOR_INDEX2_EXT:
+    case GL_COLOR_INDEX4_EXT:
+        return GX_TF_CI4;
+    case GL_COLOR_INDEX8_EXT:
+    case GL_COLOR_INDEX12_EXT: /* Indices are truncated to 8 bits */
+    case GL_COLOR_INDEX16_EXT:
+        return GX_TF_CI8;
+    case GL_COMPRESSED_RGB_ARB:
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: /* With 1 bit alpha */
+        return GX_TF_CMPR;
     case GL_LUMINANCE_ALPHA: return GX_TF_IA8;
     case GL_LUMINANCE: return GX_TF_I8;
     case GL_ALPHA:
@@ -456,8 +1117,7 @@ uint8_t _ogx_gl_format_to_gx(GLenum format)
     }
 }
 
-uint8_t _ogx_find_best_gx_format(GLenum format, GLenum internal_format,
-                                 int width, int height)
+uint8_t _ogx_find_best_gx_format(GLenum format, GLenum internal_format)
 {
     // Simplify and avoid stupid conversions (which waste space for no gain)
     if (format == GL_RGB && internal_format == GL_RGBA)
@@ -466,12 +1126,180 @@ uint8_t _ogx_find_best_gx_format(GLenum format, GLenum internal_format,
     if (format == GL_LUMINANCE_ALPHA && internal_format == GL_RGBA)
         internal_format = GL_LUMINANCE_ALPHA;
 
-    uint8_t gx_format = _ogx_gl_format_to_gx(internal_format);
-    if (gx_format == GX_TF_CMPR && (width < 8 || height < 8)) {
-        // Cannot take compressed textures under 8x8 (4 blocks of 4x4, 32B)
-        gx_format = GX_TF_RGB565;
+    return _ogx_gl_format_to_gx(internal_format);
+}
+
+/* Whether the alpha values of the RGBA pixels all satisfy the predicate */
+template <typename PREDICATE>
+static bool all_alpha_values(const void *data, GLenum format, GLenum type,
+                             int width, int height, PREDICATE predicate)
+{
+    if (format != GL_RGBA && format != GL_BGRA) return false;
+
+    switch (type) {
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+    case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+        /* The alpha is a single bit */
+        return predicate(0) && predicate(255);
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        break;
+    default:
+        /* Not worth scanning */
+        return false;
+    }
+
+    int row_length = glparamstate.unpack_row_length > 0 ?
+        glparamstate.unpack_row_length : width;
+    const uint8_t *row = static_cast<const uint8_t*>(data) +
+        (glparamstate.unpack_skip_rows * row_length +
+         glparamstate.unpack_skip_pixels) * 4;
+    for (int y = 0; y < height; y++, row += row_length * 4) {
+        for (int x = 0; x < width; x++) {
+            if (!predicate(row[x * 4 + 3])) return false;
+        }
+    }
+    return true;
+}
+
+bool _ogx_alpha_fits_rgb5a3(const void *data, GLenum format, GLenum type,
+                            int width, int height)
+{
+    /* Opaque pixels keep their colour */
+    return all_alpha_values(data, format, type, width, height,
+                            TexelRGB5A3::alpha_is_exact);
+}
+
+bool _ogx_alpha_is_binary(const void *data, GLenum format, GLenum type,
+                          int width, int height)
+{
+    return all_alpha_values(data, format, type, width, height,
+                            [](uint8_t alpha) {
+        return alpha == 0 || alpha == 255;
+    });
+}
+
+int _ogx_texels_to_indices(const void *texels, int width, int height,
+                           uint16_t *palette, int num_entries, int max_entries,
+                           uint8_t *indices)
+{
+    /* Open addressing hash table of the palette entries */
+    constexpr int num_slots = 1024;
+    int16_t slots[num_slots];
+    memset(slots, 0xff, sizeof(slots));
+    auto slot_for = [&](uint16_t word) {
+        int h = ((word * 0x9e37u) >> 6) & (num_slots - 1);
+        while (slots[h] >= 0 && palette[slots[h]] != word) {
+            h = (h + 1) & (num_slots - 1);
+        }
+        return h;
+    };
+    for (int i = 0; i < num_entries; i++) {
+        slots[slot_for(palette[i])] = i;
+    }
+
+    /* All 16 bit formats have the same layout */
+    TexelRGB565 texel;
+    texel.set_area(const_cast<void*>(texels), 0, 0, width, height,
+                   TexelRGB565::compute_pitch(width));
+    int last_word = -1, last_index = 0;
+    for (int i = 0; i < width * height; i++) {
+        uint16_t word = *texel.current_address();
+        texel.next();
+        if (word != last_word) {
+            int h = slot_for(word);
+            if (slots[h] < 0) {
+                if (num_entries >= max_entries) return -1;
+                palette[num_entries] = word;
+                slots[h] = num_entries++;
+            }
+            last_word = word;
+            last_index = slots[h];
+        }
+        indices[i] = last_index;
+    }
+    return num_entries;
+}
+
+void _ogx_indices_to_texture(const uint8_t *indices, int width, int height,
+                             void *dst, uint32_t gx_format,
+                             int x, int y, int dstpitch)
+{
+    if (gx_format == GX_TF_CI8) {
+        CopySource<1, false> source(indices, width);
+        store_blocks<CopySource<1, false>, TexelI8>(source, width, height,
+                                                    dst, x, y, dstpitch);
+    } else {
+        DataSource<IndexReader> source(indices, width);
+        store_blocks<DataSource<IndexReader>, TexelI4>(source, width, height,
+                                                       dst, x, y, dstpitch);
+    }
+}
+
+template <typename TEXEL, int SHIFT>
+static void indexed_to_texels(const void *src, int width, int height,
+                              const uint16_t *palette, int num_entries,
+                              void *dst)
+{
+    TEXEL in;
+    in.set_area(const_cast<void*>(src), 0, 0, width, height,
+                TEXEL::compute_pitch(width));
+    /* All 16 bit formats have the same layout */
+    TexelRGB565 out;
+    out.set_area(dst, 0, 0, width, height, TexelRGB565::compute_pitch(width));
+    for (int i = 0; i < width * height; i++) {
+        int index = in.read().r >> SHIFT;
+        out.setWord(index < num_entries ? palette[index] : 0);
+        out.store();
+    }
+}
+
+void _ogx_indexed_to_texels(const void *src, uint32_t gx_format,
+                            int width, int height,
+                            const uint16_t *palette, int num_entries,
+                            void *dst)
+{
+    if (gx_format == GX_TF_CI8) {
+        indexed_to_texels<TexelI8, 0>(src, width, height,
+                                      palette, num_entries, dst);
+    } else {
+        /* The I4 texel returns the index repeated in both nibbles */
+        indexed_to_texels<TexelI4, 4>(src, width, height,
+                                      palette, num_entries, dst);
+    }
+}
+
+template <typename TEXEL>
+static void tlut_to_bytes(const uint16_t *entries, int num_entries,
+                          PixelStreamBase *writer)
+{
+    for (int i = 0; i < num_entries; i++) {
+        writer->write(TEXEL::color_from_word(entries[i]));
+    }
+}
+
+void _ogx_tlut_to_bytes(const uint16_t *entries, int num_entries,
+                        uint8_t tlut_format,
+                        void *data, GLenum format, GLenum type)
+{
+    if (type == GL_BITMAP) {
+        warning("Cannot read a color table as a bitmap");
+        return;
+    }
+
+    PixelStreamVariant writer_v;
+    PixelStreamBase *writer = new_pixel_stream(writer_v, format, type);
+    if (!writer) return;
+
+    writer->setup_stream(data, num_entries, 1);
+    switch (tlut_format) {
+    case GX_TL_RGB565:
+        tlut_to_bytes<TexelRGB565>(entries, num_entries, writer); break;
+    case GX_TL_IA8:
+        tlut_to_bytes<TexelIA8>(entries, num_entries, writer); break;
+    default:
+        tlut_to_bytes<TexelRGB5A3>(entries, num_entries, writer);
     }
-    return gx_format;
 }
 
 #define DEFINE_FAST_CONVERSION(reader, texel) \
@@ -34,6 +34,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #define OPENGX_PIXELS_H
 
 #include <GL/gl.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,10 +46,50 @@ void _ogx_bytes_to_texture(const void *data, GLenum format, GLenum type,
                            void *dst, uint32_t gx_format,
                            int x, int y, int dstpitch);
 
+/* Compresses the pixels into a GX_TF_CMPR texture; x and y must be multiples
+ * of 4. The blocks are padded up to padded_width x padded_height pixels by
+ * repeating the last column and row. If alpha is set, the pixels whose alpha
+ * is below 0.5 become transparent. */
+void _ogx_bytes_to_cmpr(const void *data, GLenum format, GLenum type,
+                        int width, int height, void *dst,
+                        int x, int y, int dstpitch,
+                        int padded_width, int padded_height,
+                        bool alpha, bool high_quality);
+
 int _ogx_pitch_for_width(uint32_t gx_format, int width);
 uint8_t _ogx_gl_format_to_gx(GLenum format);
-uint8_t _ogx_find_best_gx_format(GLenum format, GLenum internal_format,
-                                 int width, int height);
+uint8_t _ogx_find_best_gx_format(GLenum format, GLenum internal_format);
+
+/* Whether the alpha values of the pixels can be stored into a GX_TF_RGB5A3
+ * texture without loss */
+bool _ogx_alpha_fits_rgb5a3(const void *data, GLenum format, GLenum type,
+                            int width, int height);
+/* Whether the pixels are either opaque or fully transparent, as in a
+ * GX_TF_CMPR texture with alpha */
+bool _ogx_alpha_is_binary(const void *data, GLenum format, GLenum type,
+                          int width, int height);
+
+/* Palettized textures: _ogx_texels_to_indices() maps the texels of a
+ * width x height GX_TF_RGB565 or GX_TF_RGB5A3 texture to indices into the
+ * palette, adding the missing colours to it. Returns the new number of
+ * palette entries, or -1 if they would be more than max_entries. */
+int _ogx_texels_to_indices(const void *texels, int width, int height,
+                           uint16_t *palette, int num_entries, int max_entries,
+                           uint8_t *indices);
+/* Stores the indices into a GX_TF_CI4 or GX_TF_CI8 texture */
+void _ogx_indices_to_texture(const uint8_t *indices, int width, int height,
+                             void *dst, uint32_t gx_format,
+                             int x, int y, int dstpitch);
+/* Converts the palette entries, stored in the GX_TL_* tlut_format, into
+ * client pixels of the given format and type */
+void _ogx_tlut_to_bytes(const uint16_t *entries, int num_entries,
+                        uint8_t tlut_format,
+                        void *data, GLenum format, GLenum type);
+/* Converts a GX_TF_CI4 or GX_TF_CI8 texture back to 16 bit texels */
+void _ogx_indexed_to_texels(const void *src, uint32_t gx_format,
+                            int width, int height,
+                            const uint16_t *palette, int num_entries,
+                            void *dst);
 
 #ifdef __cplusplus
 } // extern C
@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "stencil.h"
 #include "texel.h"
 #include "utils.h"
+#include "vertex_desc.h"
 
 #include <GL/gl.h>
 #include <malloc.h>
@@ -218,11 +219,10 @@ static void draw_raster_texture(GXTexObj *texture, int width, int height,
 
     GX_LoadTexObj(texture, GX_TEXMAP0);
 
-    GX_ClearVtxDesc();
-    GX_SetVtxDesc(GX_VA_POS, GX_DIRECT);
-    GX_SetVtxDesc(GX_VA_TEX0, GX_DIRECT);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_POS, GX_POS_XYZ, GX_F32, 0);
-    GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_TEX0, GX_TEX_ST, GX_U8, 0);
+    _ogx_vtxdesc_begin();
+    _ogx_vtxdesc_add(GX_VA_POS, GX_DIRECT, GX_POS_XYZ, GX_F32, 0);
+    _ogx_vtxdesc_add(GX_VA_TEX0, GX_DIRECT, GX_TEX_ST, GX_U8, 0);
+    u8 vtxfmt = _ogx_vtxdesc_commit();
     GX_SetTexCoordGen(GX_TEXCOORD0, GX_TG_MTX2x4, GX_TG_TEX0, GX_IDENTITY);
     GX_SetNumTexGens(1);
     GX_SetNumTevStages(1);
@@ -246,7 +246,7 @@ static void draw_raster_texture(GXTexObj *texture, int width, int height,
         y0 = screen_y;
         y1 = screen_y - height * glparamstate.pixel_zoom_y;
     }
-    GX_Begin(GX_QUADS, GX_VTXFMT0, 4);
+    GX_Begin(GX_QUADS, vtxfmt, 4);
     GX_Position3f32(screen_x, y0, screen_z);
     GX_TexCoord2u8(0, 0);
     GX_Position3f32(screen_x, y1, screen_z);
@@ -256,6 +256,8 @@ static void draw_raster_texture(GXTexObj *texture, int width, int height,
     GX_Position3f32(screen_x + width * glparamstate.pixel_zoom_x, y0, screen_z);
     GX_TexCoord2u8(1, 0);
     GX_End();
+
+    glparamstate.draw_count++;
 }
 
 void glBitmap(GLsizei width, GLsizei height,
@@ -263,6 +265,8 @@ void glBitmap(GLsizei width, GLsizei height,
               GLfloat xmove, GLfloat ymove,
               const GLubyte *bitmap)
 {
+    _ogx_immediate_flush();
+
     if (width < 0 || height < 0) {
         set_error(GL_INVALID_VALUE);
         return;
@@ -447,6 +451,8 @@ struct PixelWriter {
 void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height,
                   GLenum format, GLenum type, GLvoid *data)
 {
+    _ogx_immediate_flush();
+
     uint8_t gxformat = 0xff;
     const ReadPixelFormat *read_format = NULL;
     ReadPixelFormat stencil_format;
@@ -500,6 +506,8 @@ void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height,
 void glDrawPixels(GLsizei width, GLsizei height, GLenum format, GLenum type,
                   const GLvoid *pixels)
 {
+    _ogx_immediate_flush();
+
     if (width < 0 || height < 0) {
         set_error(GL_INVALID_VALUE);
         return;
@@ -512,8 +520,7 @@ void glDrawPixels(GLsizei width, GLsizei height, GLenum format, GLenum type,
                       (glparamstate.raster_pos[1]));
     float pos_z = -glparamstate.raster_pos[2];
 
-    uint8_t gx_format = _ogx_find_best_gx_format(format, format,
-                                                 width, height);
+    uint8_t gx_format = _ogx_find_best_gx_format(format, format);
     u32 size = GX_GetTexBufferSize(width, height, gx_format, 0, GX_FALSE);
     void *texels = memalign(32, size);
     int dstpitch = _ogx_pitch_for_width(gx_format, width);
@@ -550,6 +557,8 @@ void glDrawPixels(GLsizei width, GLsizei height, GLenum format, GLenum type,
 
 void glCopyPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum type)
 {
+    _ogx_immediate_flush();
+
     if (type != GL_COLOR) {
         warning("glCopyPixels() only implemented for color copies");
         return;
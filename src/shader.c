@@ -292,14 +292,31 @@ void glCompileShader(GLuint shader)
     }
 }
 
+/* Returns a name not used by any shader or program, or 0 */
+static GLuint find_free_name()
+{
+    for (int i = 0; i < MAX_SHADER_OBJECTS; i++) {
+        if (!_ogx_shader_state.shader_names[i] &&
+            !_ogx_shader_state.program_names[i]) return i + 1;
+    }
+    warning("Could not allocate a shader object name");
+    set_error(GL_OUT_OF_MEMORY);
+    return 0;
+}
+
 GLuint glCreateProgram(void)
 {
     if (!s_processor) return 0;
 
+    GLuint name = find_free_name();
+    if (name == 0) return 0;
+
     OgxProgram *p = calloc(1, sizeof(OgxProgram));
+    p->name = name;
     p->next = _ogx_shader_state.programs;
     _ogx_shader_state.programs = p;
-    return PROGRAM_TO_INT(p);
+    _ogx_shader_state.program_names[name - 1] = p;
+    return name;
 }
 
 GLuint glCreateShader(GLenum type)
@@ -315,11 +332,16 @@ GLuint glCreateShader(GLenum type)
         return 0;
     }
 
+    GLuint name = find_free_name();
+    if (name == 0) return 0;
+
     OgxShader *s = calloc(1, sizeof(OgxShader));
+    s->name = name;
     s->next = _ogx_shader_state.shaders;
     _ogx_shader_state.shaders = s;
+    _ogx_shader_state.shader_names[name - 1] = s;
     s->type = type;
-    return SHADER_TO_INT(s);
+    return name;
 }
 
 void glDeleteProgram(GLuint program)
@@ -340,6 +362,7 @@ void glDeleteProgram(GLuint program)
     if (p->user_data && p->cleanup_user_data_cb) {
         p->cleanup_user_data_cb(p->user_data);
     }
+    _ogx_shader_state.program_names[program - 1] = NULL;
     free(p->uniform_data_base);
     free(p);
 }
@@ -347,12 +370,15 @@ void glDeleteProgram(GLuint program)
 void glDeleteShader(GLuint shader)
 {
     OgxShader *s = SHADER_FROM_INT(shader);
+    if (!s) return;
+
     if (s->attach_count > 0) {
         s->deletion_requested = true;
     } else {
         OgxShader **prev = &_ogx_shader_state.shaders;
         while (*prev != s) *prev = (*prev)->next;
         *prev = s->next;
+        _ogx_shader_state.shader_names[shader - 1] = NULL;
         free(s);
     }
 }
@@ -668,6 +694,9 @@ void glGetVertexAttribiv(GLuint index, GLenum pname, GLint *params)
     case GL_VERTEX_ATTRIB_ARRAY_NORMALIZED:
         *params = v->array.normalized;
         return;
+    case GL_VERTEX_ATTRIB_ARRAY_DIVISOR:
+        *params = v->divisor;
+        return;
     }
 }
 
@@ -945,6 +974,20 @@ void glVertexAttribPointer(GLuint index, GLint size, GLenum type,
     glparamstate.dirty.bits.dirty_attributes = 1;
 }
 
+void glVertexAttribDivisor(GLuint index, GLuint divisor)
+{
+    OgxVertexAttribState *v = get_vertex_attrib(index);
+    if (!v) return;
+
+    v->divisor = divisor;
+    if (divisor) {
+        _ogx_shader_state.instanced_attribs |= 1 << index;
+    } else {
+        _ogx_shader_state.instanced_attribs &= ~(1 << index);
+    }
+    glparamstate.dirty.bits.dirty_attributes = 1;
+}
+
 void _ogx_shader_initialize()
 {
     for (int i = 0; i < MAX_VERTEX_ATTRIBS; i++) {
@@ -1031,6 +1074,13 @@ void ogx_shader_program_set_setup_matrices_cb(
     p->setup_matrices_cb = setup_matrices;
 }
 
+void ogx_shader_program_set_setup_instance_cb(
+    GLuint program, OgxSetupInstanceCb setup_instance)
+{
+    OgxProgram *p = PROGRAM_FROM_INT(program);
+    p->setup_instance_cb = setup_instance;
+}
+
 void ogx_shader_program_set_draw_done_cb(
     GLuint program, OgxDrawDoneCb draw_done)
 {
@@ -1065,7 +1115,11 @@ void _ogx_shader_update_vertex_array_readers(OgxDrawMode mode)
         OgxAttributeVar *v = get_attr_variable_for_location(p, index);
         OgxVertexAttribState *attr = &_ogx_shader_state.vertex_attribs[index];
 
-        if (attr->array_enabled) {
+        if (attr->array_enabled && attr->divisor) {
+            /* Per-instance attributes are not sent to GX: their values are
+             * loaded by _ogx_shader_setup_instance() */
+            continue;
+        } else if (attr->array_enabled) {
             _ogx_array_add(v->gx_attribute, &attr->array);
         } else {
             /* TODO: add an example to test this */
@@ -1087,6 +1141,24 @@ void _ogx_shader_update_vertex_array_readers(OgxDrawMode mode)
     }
 }
 
+void _ogx_shader_setup_instance(GLint instance)
+{
+    OgxProgram *p = PROGRAM_FROM_INT(glparamstate.current_program);
+
+    uint32_t mask = _ogx_shader_state.instanced_attribs;
+    while (mask) {
+        int index = __builtin_ctz(mask);
+        mask &= mask - 1;
+        OgxVertexAttribState *attr = &_ogx_shader_state.vertex_attribs[index];
+        if (!attr->array_enabled) continue;
+        _ogx_shader_load_instance_attribute(index, instance / attr->divisor);
+    }
+
+    if (p->setup_instance_cb) {
+        p->setup_instance_cb(PROGRAM_TO_INT(p), instance, p->user_data);
+    }
+}
+
 void _ogx_shader_draw_done()
 {
     OgxProgram *p = PROGRAM_FROM_INT(glparamstate.current_program);
@@ -38,6 +38,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #ifdef BUILDING_SHADER_CODE
 
+#define MAX_SHADER_OBJECTS 256
+
 typedef struct _OgxBoundAttribute OgxBoundAttribute;
 /* This must be large enough to hold up to MAX_VERTEX_ATTRIBS + 1 values */
 typedef uint8_t OgxAttrLocation;
@@ -78,6 +80,7 @@ struct _OgxBoundAttribute {
 
 struct _OgxShader {
     OgxShader *next;
+    GLuint name;
     GLenum type;
     char attach_count;
     unsigned deletion_requested : 1;
@@ -95,6 +98,7 @@ struct _OgxShader {
 
 struct _OgxProgram {
     OgxProgram *next;
+    GLuint name;
     OgxShader *vertex_shader;
     OgxShader *fragment_shader;
     unsigned deletion_requested : 1;
@@ -132,6 +136,7 @@ struct _OgxProgram {
     void *user_data;
     OgxSetupDrawCb setup_draw_cb;
     OgxSetupMatricesCb setup_matrices_cb;
+    OgxSetupInstanceCb setup_instance_cb;
     OgxDrawDoneCb draw_done_cb;
     OgxCleanupCb cleanup_user_data_cb;
 };
@@ -140,13 +145,24 @@ typedef struct {
     /* Use these to navigate shaders and programs as a list */
     OgxShader *shaders;
     OgxProgram *programs;
+    /* Shader and program names index these tables (name - 1). The two share
+     * the same namespace, as in OpenGL: a name is used by at most one of
+     * them. */
+    OgxShader *shader_names[MAX_SHADER_OBJECTS];
+    OgxProgram *program_names[MAX_SHADER_OBJECTS];
 
     struct _OgxVertexAttribState {
         unsigned array_enabled : 1;
         /* Used when array_enabled is true: */
         OgxVertexAttribArray array;
+        /* Set by glVertexAttribDivisor(): if nonzero, the array advances once
+         * every `divisor` instances instead of once per vertex */
+        GLuint divisor;
     } vertex_attribs[MAX_VERTEX_ATTRIBS];
 
+    /* Bitmask of the attributes having a nonzero divisor */
+    uint32_t instanced_attribs;
+
     /* Data fields (used when array_enabled is false). We keep these in a
      * separate array so that we can use consecutive elements as matrix
      * columns. */
@@ -159,10 +175,12 @@ typedef struct {
 
 typedef struct _OgxVertexAttribState OgxVertexAttribState;
 
-#define PROGRAM_TO_INT(p) ((GLuint)p)
-#define PROGRAM_FROM_INT(p) ((OgxProgram *)p)
-#define SHADER_TO_INT(s) ((GLuint)s)
-#define SHADER_FROM_INT(s) ((OgxShader *)s)
+#define PROGRAM_TO_INT(p) ((p)->name)
+#define PROGRAM_FROM_INT(p) ((GLuint)(p) - 1 < MAX_SHADER_OBJECTS ? \
+    _ogx_shader_state.program_names[(GLuint)(p) - 1] : NULL)
+#define SHADER_TO_INT(s) ((s)->name)
+#define SHADER_FROM_INT(s) ((GLuint)(s) - 1 < MAX_SHADER_OBJECTS ? \
+    _ogx_shader_state.shader_names[(GLuint)(s) - 1] : NULL)
 
 extern OgxFunctions _ogx_shader_functions;
 extern OgxShaderState _ogx_shader_state;
@@ -170,8 +188,10 @@ extern OgxShaderState _ogx_shader_state;
 void _ogx_shader_initialize();
 void _ogx_shader_setup_draw(const OgxDrawData *draw_data);
 void _ogx_shader_update_vertex_array_readers(OgxDrawMode mode);
+void _ogx_shader_setup_instance(GLint instance);
 void _ogx_shader_draw_done();
 
+void _ogx_shader_load_instance_attribute(GLuint index, int element);
 size_t _ogx_size_for_type(GLenum type);
 
 #else /* BUILDING_SHADER_CODE not defined */
@@ -196,6 +216,8 @@ void __attribute__((weak)) _ogx_shader_update_vertex_array_readers(OgxDrawMode)
 {
 }
 
+void __attribute__((weak)) _ogx_shader_setup_instance(GLint) {}
+
 void __attribute__((weak)) _ogx_shader_draw_done() {}
 
 OgxFunctions _ogx_shader_functions __attribute__((weak)) = { 0, NULL };
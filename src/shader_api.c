@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "opengx.h"
 #include "shader.h"
 #include "state.h"
+#include "texture.h"
 #include "utils.h"
 
 #include <GL/gl.h>
@@ -122,5 +123,7 @@ void ogx_shader_set_mvp_gl(const GLfloat *matrix)
 GXTexObj *ogx_shader_get_texobj(int texture_unit)
 {
     OgxTextureUnit *tu = &glparamstate.texture_unit[texture_unit];
+    /* The caller is going to load it for drawing */
+    _ogx_texture_set_in_use(tu->glcurtex);
     return &texture_list[tu->glcurtex].texobj;
 }
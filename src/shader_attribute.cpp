@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "debug.h"
 #include "shader.h"
 #include "utils.h"
+#include "vbo.h"
 
 #include <GL/gl.h>
 #include <GL/glext.h>
@@ -267,3 +268,52 @@ void glVertexAttrib4usv(GLuint index, const GLushort *v)
 {
     set_attribute<4>(index, v);
 }
+
+template <typename T>
+static void load_instance_attribute(GLuint index,
+                                    const OgxVertexAttribArray *array,
+                                    const void *data)
+{
+    const T *v = static_cast<const T *>(data);
+    float values[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    for (int i = 0; i < array->size; i++) {
+        if constexpr (std::is_integral_v<T>) {
+            values[i] = array->normalized ? normalize(v[i]) : float(v[i]);
+        } else {
+            values[i] = v[i];
+        }
+    }
+    set_attribute<4>(index, values);
+}
+
+void _ogx_shader_load_instance_attribute(GLuint index, int element)
+{
+    const OgxVertexAttribArray *array =
+        &_ogx_shader_state.vertex_attribs[index].array;
+    const char *data = static_cast<const char *>(array->vbo ?
+        _ogx_vbo_get_data(array->vbo, array->pointer) : array->pointer);
+    int stride = array->stride ?
+        array->stride : array->size * sizeof_gl_type(array->type);
+    data += element * stride;
+
+    switch (array->type) {
+    case GL_BYTE:
+        load_instance_attribute<GLbyte>(index, array, data); break;
+    case GL_UNSIGNED_BYTE:
+        load_instance_attribute<GLubyte>(index, array, data); break;
+    case GL_SHORT:
+        load_instance_attribute<GLshort>(index, array, data); break;
+    case GL_UNSIGNED_SHORT:
+        load_instance_attribute<GLushort>(index, array, data); break;
+    case GL_INT:
+        load_instance_attribute<GLint>(index, array, data); break;
+    case GL_UNSIGNED_INT:
+        load_instance_attribute<GLuint>(index, array, data); break;
+    case GL_FLOAT:
+        load_instance_attribute<GLfloat>(index, array, data); break;
+    case GL_DOUBLE:
+        load_instance_attribute<GLdouble>(index, array, data); break;
+    default:
+        warning("Unsupported instance attribute type %04x", array->type);
+    }
+}
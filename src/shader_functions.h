@@ -120,6 +120,7 @@ static const OgxProcMap s_proc_map[] = {
     PROC(glVertexAttrib4ubv),
     PROC(glVertexAttrib4uiv),
     PROC(glVertexAttrib4usv),
+    PROC(glVertexAttribDivisor),
     PROC(glVertexAttribPointer),
 };
 #define NUM_PROCS (sizeof(s_proc_map) / sizeof(s_proc_map[0]))
@@ -68,6 +68,10 @@ extern "C" {
  * The choise of 10 is arbitrary here, we could set it up to 16
  * (GX_TEVSTAGE15 - GX_TEVSTAGE0). */
 #define MAX_TEXCOORD_ARRAYS 10
+/* GL_ARB_matrix_palette: at most one matrix for each position/normal matrix
+ * slot, from GX_PNMTX0 to GX_PNMTX9; only those in the pnmtx range of
+ * ogx_gpu_resources are actually available. */
+#define MAX_PALETTE_MATRICES 10
 
 #define STATE_ARRAY(attribute) \
     (glparamstate.arrays[OGX_ATTR_INDEX_##attribute])
@@ -78,14 +82,44 @@ typedef enum {
     OGX_HINT_NONE = 0,
     /* Enables fast (but wrong) GPU-accelerated GL_SPHERE_MAP */
     OGX_HINT_FAST_SPHERE_MAP = 1 << 0,
+    /* Lets GX read client-side vertex arrays directly, instead of copying
+     * them into the FIFO. The client must not modify the arrays until the
+     * GPU is done drawing them. */
+    OGX_HINT_INDEXED_CLIENT_ARRAYS = 1 << 1,
+    /* Converts the float vertex arrays stored in GL_STATIC_DRAW buffers to
+     * 8 or 16 bit fixed point formats, when the loss of precision is
+     * small. */
+    OGX_HINT_QUANTIZE_STATIC_VBOS = 1 << 2,
+    /* Keeps a GX-native copy of the client-side vertex arrays which do not
+     * change across frames. Changes are detected by hashing a sample of the
+     * array at every draw, so they might go unnoticed for a few draws. */
+    OGX_HINT_CACHE_CLIENT_ARRAYS = 1 << 3,
+    /* Draws the triangles of static element array buffers in the order which
+     * makes the best use of the vertex cache (see ogx_buffer_keep_order()) */
+    OGX_HINT_REORDER_INDICES = 1 << 4,
+    /* Accumulates the vertices of consecutive glBegin()/glEnd() blocks into a
+     * single draw, as long as the GL state does not change in between. The
+     * client must not draw with GX directly while a batch is pending. */
+    OGX_HINT_BATCH_IMMEDIATE = 1 << 5,
+    /* Stores the RGB, RGBA and luminance-alpha textures having at most 256
+     * distinct colours (after their conversion to 16 bit texels) as
+     * paletted textures. */
+    OGX_HINT_PALETTIZE_TEXTURES = 1 << 6,
 } OgxHints;
 
+/* Maximum number of vertices accumulated by the immediate mode batcher */
+#define OGX_IMM_BATCH_MAX_VERTICES 2048
+/* Smaller glBegin()/glEnd() blocks are drawn from the staging buffer, since
+ * streaming them would cost a display list each */
+#define OGX_IMM_STREAM_MIN_VERTICES 64
+
 typedef enum {
     OGX_ATTR_INDEX_POS = 0,
     OGX_ATTR_INDEX_NRM,
     OGX_ATTR_INDEX_CLR,
     OGX_ATTR_INDEX_TEX0,
     OGX_ATTR_INDEX_TEX_LAST = OGX_ATTR_INDEX_TEX0 + MAX_TEXTURE_UNITS - 1,
+    OGX_ATTR_INDEX_MTX,
     OGX_ATTR_INDEX_COUNT
 } OgxAttrIndex;
 
@@ -101,6 +135,22 @@ typedef float ClipPlane[4];
 typedef struct gltexture_
 {
     GXTexObj texobj;
+    /* The first draw sync token sent after the last draw using this texture,
+     * or 0 if the GPU is not using it */
+    uint16_t draw_sync_token;
+    /* Bitmask of the TMEM cache regions which might hold the texels */
+    uint8_t tmem_regions;
+    /* Whether the texture has been loaded since the TMEM was last
+     * invalidated */
+    uint8_t tmem_loaded : 1;
+    /* Whether the palette was computed by opengx, rather than set with
+     * glColorTableEXT() */
+    uint8_t auto_palette : 1;
+    /* The GX_TL_* format of the palette */
+    uint8_t tlut_format;
+    uint16_t palette_entries;
+    /* The TLUT of paletted (GX_TF_CI4 and GX_TF_CI8) textures */
+    uint16_t *palette;
 } gltexture_;
 
 typedef enum {
@@ -174,6 +224,10 @@ typedef struct glparams_
     bool scissor_enabled;
     unsigned point_sprites_enabled : 1;
     unsigned point_sprites_coord_replace : 1;
+    unsigned primitive_restart_enabled : 1;
+    unsigned copy_clear_enabled : 1;
+    unsigned texture_compression_nicest : 1;
+    GLuint primitive_restart_index;
     char active_texture;
     uint8_t alpha_func, alpha_ref, alphatest_enabled;
     uint8_t clip_plane_mask;
@@ -214,6 +268,7 @@ typedef struct glparams_
             unsigned color_enabled : 1;
             unsigned texcoord_enabled : MAX_TEXTURE_UNITS;
             char active_texture;
+            unsigned matrix_index_enabled : 1;
         };
         uint32_t as_int;
     } cs;
@@ -252,6 +307,19 @@ typedef struct glparams_
         unsigned has_color : 1;
         unsigned has_normal : 1;
         unsigned has_texcoord : MAX_TEXTURE_UNITS;
+        /* Set by glBegin() if the vertices can be streamed to GX as they are
+         * specified, rather than collected in current_vertices; streaming
+         * starts once the block has OGX_IMM_STREAM_MIN_VERTICES vertices */
+        unsigned can_stream : 1;
+        unsigned streaming : 1;
+        /* Vertices [0, batch_numverts) belong to glBegin()/glEnd() blocks
+         * whose draw has been deferred; the GX state has already been set up
+         * for them, and _ogx_immediate_flush() will emit them. */
+        int batch_numverts;
+        uint8_t batch_gxmode;
+        unsigned batch_dirty;
+        unsigned batch_has_normal : 1;
+        unsigned batch_has_texcoord : MAX_TEXTURE_UNITS;
     } imm_mode;
 
     union dirty_union
@@ -317,6 +385,15 @@ typedef struct glparams_
         float end;
     } fog;
 
+    struct _matrix_palette {
+        Mtx matrices[MAX_PALETTE_MATRICES];
+        /* Matrices which have not been loaded into GX yet */
+        uint16_t dirty_mask;
+        uint8_t current; /* set by glCurrentPaletteMatrixARB() */
+        uint8_t current_index; /* set by glMatrixIndex*vARB() */
+        bool enabled;
+    } matrix_palette;
+
     struct _stencil {
         bool enabled;
         uint8_t func;
@@ -362,6 +439,23 @@ void _ogx_scene_save_from_efb(void);
 void _ogx_scene_load_into_efb(void);
 void _ogx_update_matrices(void);
 void _ogx_update_matrices_fixed_pipeline(void);
+/* Emits the pending immediate mode batch, if any. This must be called before
+ * sending anything else to GX, or modifying any data the batch depends on. */
+void _ogx_immediate_flush(void);
+/* When imm_mode.streaming is set, glVertex*() fills the VertexData returned
+ * by _ogx_immediate_stream_next() and then calls
+ * _ogx_immediate_stream_vertex() to send it to GX.
+ * _ogx_immediate_stream_start() streams the vertices already collected in
+ * current_vertices, and sets imm_mode.streaming. */
+void _ogx_immediate_stream_start(void);
+VertexData *_ogx_immediate_stream_next(void);
+void _ogx_immediate_stream_vertex(void);
+/* Stops streaming the current primitive, moving the vertices still needed to
+ * complete it into current_vertices */
+void _ogx_immediate_stream_stop(void);
+/* Loads the given modelview matrix and its normal matrix into a position/normal
+ * matrix slot */
+void _ogx_load_modelview_matrix(Mtx modelview, u32 pnidx);
 
 #ifdef __cplusplus
 } // extern C
@@ -36,6 +36,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <algorithm>
 #include <math.h>
+#include <string.h>
 #include <ogc/gx.h>
 
 static inline uint8_t luminance_from_rgb(uint8_t r, uint8_t g, uint8_t b)
@@ -128,6 +129,31 @@ struct TexelRGBA8: public Texel {
 
     int pitch_for_width(int width) override { return compute_pitch(width); }
 
+    /* Block-tiled access, used by the converters in pixels.cpp: a row of a
+     * block is assembled in a buffer of row_size bytes, holding the AR texels
+     * followed by the GB ones. */
+    static constexpr int block_width = 4;
+    static constexpr int block_height = 4;
+    static constexpr int block_size = 64;
+    static constexpr int row_size = 16;
+
+    static inline void load_row(uint8_t *row, const uint8_t *block, int y) {
+        memcpy(row, block + y * 8, 8);
+        memcpy(row + 8, block + 32 + y * 8, 8);
+    }
+
+    static inline void store_row(const uint8_t *row, uint8_t *block, int y) {
+        memcpy(block + y * 8, row, 8);
+        memcpy(block + 32 + y * 8, row + 8, 8);
+    }
+
+    void put(uint8_t *row, int x) const {
+        row[x * 2] = a;
+        row[x * 2 + 1] = r;
+        row[8 + x * 2] = g;
+        row[8 + x * 2 + 1] = b;
+    }
+
     uint8_t r;
     uint8_t g;
     uint8_t b;
@@ -158,6 +184,23 @@ struct Texel16: public Texel {
 
     int pitch_for_width(int width) override { return compute_pitch(width); }
 
+    static constexpr int block_width = 4;
+    static constexpr int block_height = 4;
+    static constexpr int block_size = 32;
+    static constexpr int row_size = 8;
+
+    static inline void load_row(uint8_t *row, const uint8_t *block, int y) {
+        memcpy(row, block + y * row_size, row_size);
+    }
+
+    static inline void store_row(const uint8_t *row, uint8_t *block, int y) {
+        memcpy(block + y * row_size, row, row_size);
+    }
+
+    void put(uint8_t *row, int x) const {
+        reinterpret_cast<uint16_t*>(row)[x] = word;
+    }
+
     uint16_t word;
 };
 
@@ -176,12 +219,16 @@ struct TexelIA8: public Texel16 {
         set_luminance_alpha(luminance, c.a);
     }
 
+    static inline GXColor color_from_word(uint16_t w) {
+        uint8_t alpha = w >> 8;
+        uint8_t luminance = w & 0xff;
+        return { luminance, luminance, luminance, alpha };
+    }
+
     GXColor read() override {
         uint16_t *d = current_address();
         next();
-        uint8_t alpha = *d >> 8;
-        uint8_t luminance = *d & 0xff;
-        return { luminance, luminance, luminance, alpha };
+        return color_from_word(*d);
     }
 };
 
@@ -198,12 +245,10 @@ struct TexelRGB565: public Texel16 {
 
     void set_color(GXColor c) override { set_color(c.r, c.g, c.b); }
 
-    GXColor read() override {
-        uint16_t *d = current_address();
-        next();
-        uint8_t red = (*d >> 8) & 0xf8;
-        uint8_t green = (*d >> 3) & 0xfc;
-        uint8_t blue = (*d << 3) & 0xf8;
+    static inline GXColor color_from_word(uint16_t w) {
+        uint8_t red = (w >> 8) & 0xf8;
+        uint8_t green = (w >> 3) & 0xfc;
+        uint8_t blue = (w << 3) & 0xf8;
         /* fill the lowest bits by repeating the highest ones */
         return {
             uint8_t(red | (red >> 5)),
@@ -212,6 +257,73 @@ struct TexelRGB565: public Texel16 {
             255
         };
     }
+
+    GXColor read() override {
+        uint16_t *d = current_address();
+        next();
+        return color_from_word(*d);
+    }
+};
+
+/* Opaque texels are stored as 1RRRRRGGGGGBBBBB, translucent ones as
+ * 0AAARRRRGGGGBBBB */
+struct TexelRGB5A3: public Texel16 {
+    static constexpr bool has_alpha = true;
+    static constexpr bool has_rgb = true;
+
+    TexelRGB5A3() = default;
+    void set_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+        if (a >= 0xe0) {
+            setWord(0x8000 |
+                    ((r & 0xf8) << 7) |
+                    ((g & 0xf8) << 2) |
+                    ((b & 0xf8) >> 3));
+        } else {
+            setWord(((a & 0xe0) << 7) |
+                    ((r & 0xf0) << 4) |
+                    (g & 0xf0) |
+                    ((b & 0xf0) >> 4));
+        }
+    }
+
+    void set_color(GXColor c) override { set_color(c.r, c.g, c.b, c.a); }
+
+    static inline GXColor color_from_word(uint16_t w) {
+        if (w & 0x8000) {
+            uint8_t red = (w >> 7) & 0xf8;
+            uint8_t green = (w >> 2) & 0xf8;
+            uint8_t blue = (w << 3) & 0xf8;
+            return {
+                uint8_t(red | (red >> 5)),
+                uint8_t(green | (green >> 5)),
+                uint8_t(blue | (blue >> 5)),
+                255
+            };
+        } else {
+            uint8_t alpha = (w >> 7) & 0xe0;
+            uint8_t red = (w >> 4) & 0xf0;
+            uint8_t green = w & 0xf0;
+            uint8_t blue = (w << 4) & 0xf0;
+            return {
+                uint8_t(red | (red >> 4)),
+                uint8_t(green | (green >> 4)),
+                uint8_t(blue | (blue >> 4)),
+                uint8_t(alpha | (alpha >> 3) | (alpha >> 6))
+            };
+        }
+    }
+
+    /* Whether the alpha value survives the conversion to this format */
+    static inline bool alpha_is_exact(uint8_t a) {
+        uint8_t high = a & 0xe0;
+        return a == (high | (high >> 3) | (high >> 6));
+    }
+
+    GXColor read() override {
+        uint16_t *d = current_address();
+        next();
+        return color_from_word(*d);
+    }
 };
 
 struct Texel8: public Texel {
@@ -238,6 +350,21 @@ struct Texel8: public Texel {
 
     int pitch_for_width(int width) override { return compute_pitch(width); }
 
+    static constexpr int block_width = 8;
+    static constexpr int block_height = 4;
+    static constexpr int block_size = 32;
+    static constexpr int row_size = 8;
+
+    static inline void load_row(uint8_t *row, const uint8_t *block, int y) {
+        memcpy(row, block + y * row_size, row_size);
+    }
+
+    static inline void store_row(const uint8_t *row, uint8_t *block, int y) {
+        memcpy(block + y * row_size, row, row_size);
+    }
+
+    void put(uint8_t *row, int x) const { row[x] = value; }
+
     uint8_t value;
 };
 
@@ -278,6 +405,8 @@ struct TexelA8: public Texel8 {
 struct TexelI4: public Texel {
     TexelI4() = default;
     void set_luminance(uint8_t luminance) { value = luminance >> 4; }
+    /* CI4 textures share the layout of I4 ones */
+    void set_index(uint8_t index) { value = index & 0xf; }
 
     uint8_t *current_address() const {
         int block_x = m_x / 8;
@@ -344,6 +473,24 @@ struct TexelI4: public Texel {
 
     int pitch_for_width(int width) override { return compute_pitch(width); }
 
+    static constexpr int block_width = 8;
+    static constexpr int block_height = 8;
+    static constexpr int block_size = 32;
+    static constexpr int row_size = 4;
+
+    static inline void load_row(uint8_t *row, const uint8_t *block, int y) {
+        memcpy(row, block + y * row_size, row_size);
+    }
+
+    static inline void store_row(const uint8_t *row, uint8_t *block, int y) {
+        memcpy(block + y * row_size, row, row_size);
+    }
+
+    void put(uint8_t *row, int x) const {
+        uint8_t &d = row[x / 2];
+        d = x % 2 == 0 ? (d & 0x0f) | (value << 4) : (d & 0xf0) | (value & 0xf);
+    }
+
     void set_color(GXColor c) override { set_luminance(c.r); }
 
     uint8_t value;
@@ -30,16 +30,36 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 POSSIBILITY OF SUCH DAMAGE.
 *****************************************************************************/
 
+#define GL_GLEXT_PROTOTYPES
 #include "texture.h"
 
 #include "call_lists.h"
 #include "debug.h"
-#include "image_DXT.h"
 #include "pixels.h"
 #include "state.h"
 #include "utils.h"
 
 #include <malloc.h>
+#include <stddef.h>
+
+#define MAX_TEX_REGIONS 8
+
+/* Texel buffers which were replaced while the GPU might still be reading
+ * them: they are freed once the GPU is done with them. */
+typedef struct RetiredTexels {
+    struct RetiredTexels *next;
+    void *texels;
+    uint16_t draw_sync_token;
+} RetiredTexels;
+
+static RetiredTexels *s_retired_texels = NULL;
+static GXTexRegionCallback s_default_tex_region_cb;
+static GXTexRegion *s_tex_regions[MAX_TEX_REGIONS];
+static int s_num_tex_regions = 0;
+/* Names of the textures with a non-zero draw_sync_token */
+static GLuint *s_busy_textures = NULL;
+static int s_num_busy_textures = 0;
+static int s_max_busy_textures = 0;
 
 static inline int curr_tex()
 {
@@ -126,6 +146,299 @@ static void texture_get_info(const GXTexObj *obj, OgxTextureInfo *info)
         info->format = GX_TF_A8;
 }
 
+/* GX_LoadTexObj() uses this callback to pick the TMEM region where the
+ * texture will be cached. We use it to remember which regions need to be
+ * invalidated when the texels of a texture change. */
+static GXTexRegion *tex_region_cb(const GXTexObj *obj, u8 mapid)
+{
+    GXTexRegion *region = s_default_tex_region_cb(obj, mapid);
+
+    if (obj < &texture_list[0].texobj ||
+        obj > &texture_list[_MAX_GL_TEX - 1].texobj) return region;
+
+    gltexture_ *texture =
+        (gltexture_ *)((char *)obj - offsetof(gltexture_, texobj));
+    texture->tmem_loaded = 1;
+
+    for (int i = 0; i < s_num_tex_regions; i++) {
+        if (s_tex_regions[i] == region) {
+            texture->tmem_regions |= 1 << i;
+            return region;
+        }
+    }
+    if (s_num_tex_regions < MAX_TEX_REGIONS) {
+        s_tex_regions[s_num_tex_regions] = region;
+        texture->tmem_regions |= 1 << s_num_tex_regions++;
+    }
+    /* Otherwise, the tmem_loaded flag will cause a full invalidation */
+    return region;
+}
+
+static void invalidate_tmem(gltexture_ *texture)
+{
+    if (texture->tmem_regions != 0) {
+        for (int i = 0; i < s_num_tex_regions; i++) {
+            if (texture->tmem_regions & (1 << i))
+                GX_InvalidateTexRegion(s_tex_regions[i]);
+        }
+        /* The texture might still have been cached into an unknown region */
+        if (texture->tmem_loaded &&
+            s_num_tex_regions == MAX_TEX_REGIONS) GX_InvalidateTexAll();
+    } else if (texture->tmem_loaded) {
+        /* Someone replaced our region callback */
+        GX_InvalidateTexAll();
+    }
+    texture->tmem_regions = 0;
+    texture->tmem_loaded = 0;
+}
+
+static bool texture_is_busy(const gltexture_ *texture)
+{
+    /* The pending immediate mode batch might use this texture */
+    _ogx_immediate_flush();
+
+    uint16_t token = texture->draw_sync_token;
+    return token != 0 &&
+        (token > _ogx_draw_sync_token || GX_GetDrawSync() < token);
+}
+
+static void wait_texture_idle(gltexture_ *texture)
+{
+    _ogx_immediate_flush();
+
+    uint16_t token = texture->draw_sync_token;
+    if (token == 0) return;
+
+    if (token > _ogx_draw_sync_token) {
+        /* No token was sent after the last draw using the texture */
+        token = send_draw_sync_token();
+        GX_Flush();
+    }
+    while (GX_GetDrawSync() < token);
+    texture->draw_sync_token = 0;
+}
+
+static void check_releasable_texels(bool release_all)
+{
+    RetiredTexels **prev_ptr = &s_retired_texels;
+    RetiredTexels *retired = s_retired_texels;
+    while (retired) {
+        RetiredTexels *next = retired->next;
+        if (release_all || GX_GetDrawSync() >= retired->draw_sync_token) {
+            free(retired->texels);
+            free(retired);
+            *prev_ptr = next;
+        } else {
+            prev_ptr = &retired->next;
+        }
+        retired = next;
+    }
+}
+
+/* Free a buffer (texels or palette) of the texture: if the GPU is still
+ * using it, freeing it is deferred. */
+static void retire_buffer(gltexture_ *texture, void *buffer)
+{
+    if (texture_is_busy(texture)) {
+        RetiredTexels *retired = malloc(sizeof(RetiredTexels));
+        if (retired) {
+            uint16_t token = texture->draw_sync_token;
+            if (token > _ogx_draw_sync_token) {
+                token = send_draw_sync_token();
+                texture->draw_sync_token = token;
+            }
+            retired->texels = buffer;
+            retired->draw_sync_token = token;
+            retired->next = s_retired_texels;
+            s_retired_texels = retired;
+            return;
+        }
+        wait_texture_idle(texture);
+    }
+    free(buffer);
+}
+
+/* Release the texel buffer of the texture, which is about to be replaced */
+static void release_texels(gltexture_ *texture, void *texels)
+{
+    invalidate_tmem(texture);
+    retire_buffer(texture, texels);
+    /* The pending draws might still need the palette */
+    if (!texture->palette) texture->draw_sync_token = 0;
+}
+
+static void release_palette(gltexture_ *texture)
+{
+    if (!texture->palette) return;
+
+    retire_buffer(texture, texture->palette);
+    texture->palette = NULL;
+    texture->palette_entries = 0;
+    texture->auto_palette = 0;
+}
+
+/* The TLUT is loaded in blocks of 16 entries */
+static inline int palette_size(int entries)
+{
+    return (entries + 15) & ~15;
+}
+
+/* Replaces the palette of the texture with the given TLUT entries */
+static bool set_palette(gltexture_ *texture, const uint16_t *entries,
+                        int num_entries, uint8_t tlut_format, bool automatic)
+{
+    int size = palette_size(num_entries);
+    uint16_t *palette = memalign(32, size * sizeof(uint16_t));
+    if (!palette) {
+        warning("Failed to allocate memory for the palette");
+        set_error(GL_OUT_OF_MEMORY);
+        return false;
+    }
+    memcpy(palette, entries, num_entries * sizeof(uint16_t));
+    memset(palette + num_entries, 0,
+           (size - num_entries) * sizeof(uint16_t));
+    DCFlushRange(palette, size * sizeof(uint16_t));
+
+    release_palette(texture);
+    texture->palette = palette;
+    texture->palette_entries = num_entries;
+    texture->tlut_format = tlut_format;
+    texture->auto_palette = automatic;
+    glparamstate.dirty.bits.dirty_tev = 1;
+    return true;
+}
+
+/* The GX format of the palette entries */
+static uint8_t tlut_texel_format(uint8_t tlut_format)
+{
+    switch (tlut_format) {
+    case GX_TL_IA8: return GX_TF_IA8;
+    case GX_TL_RGB565: return GX_TF_RGB565;
+    default: return GX_TF_RGB5A3;
+    }
+}
+
+static void init_texobj(gltexture_ *texture, const OgxTextureInfo *ti)
+{
+    GXTexObj *texobj = &texture->texobj;
+    GX_InitTexObj(texobj, ti->texels,
+                  ti->width, ti->height, ti->format, ti->wraps, ti->wrapt,
+                  GX_TRUE);
+    GX_InitTexObjLOD(texobj, ti->min_filter, ti->mag_filter,
+                     ti->minlevel, ti->maxlevel, 0,
+                     GX_ENABLE, GX_ENABLE, GX_ANISO_1);
+    GX_InitTexObjUserData(texobj, ti->ud.ptr);
+}
+
+/* Converts the pixels to the 16 bit format of the palette entries, and maps
+ * them to indices into the palette, which gets the missing colours added.
+ * Returns NULL if the palette cannot hold more than max_entries colours. */
+static uint8_t *palettize(const void *data, GLenum format, GLenum type,
+                          int width, int height, uint8_t tlut_format,
+                          uint16_t *palette, int *num_entries,
+                          int max_entries)
+{
+    uint8_t gx_format = tlut_texel_format(tlut_format);
+    void *texels = malloc(calc_memory(width, height, gx_format));
+    uint8_t *indices = malloc(width * height);
+    if (!texels || !indices) {
+        free(texels);
+        free(indices);
+        return NULL;
+    }
+
+    _ogx_bytes_to_texture(data, format, type, width, height, texels, gx_format,
+                          0, 0, _ogx_pitch_for_width(gx_format, width));
+    int count = _ogx_texels_to_indices(texels, width, height, palette,
+                                       *num_entries, max_entries, indices);
+    free(texels);
+    if (count < 0) {
+        free(indices);
+        return NULL;
+    }
+    *num_entries = count;
+    return indices;
+}
+
+/* Stores the texels of an automatically palettized texture in the format of
+ * its palette entries again, once they don't fit the palette anymore */
+static bool unpalettize(gltexture_ *texture, OgxTextureInfo *ti)
+{
+    uint8_t format = tlut_texel_format(texture->tlut_format);
+    bool onelevel = ti->minlevel == 0 && ti->maxlevel == 0;
+    uint32_t size = onelevel ?
+        calc_memory(ti->width, ti->height, format) :
+        calc_tex_size(ti->width, ti->height, format);
+    unsigned char *texels = memalign(32, size);
+    if (!texels) {
+        warning("Failed to allocate %u bytes for texture", size);
+        set_error(GL_OUT_OF_MEMORY);
+        return false;
+    }
+
+    int num_levels = onelevel ? 1 : ti->maxlevel + 1;
+    for (int level = 0; level < num_levels; level++) {
+        int width = ti->width >> level;
+        int height = ti->height >> level;
+        if (width == 0) width = 1;
+        if (height == 0) height = 1;
+        const unsigned char *src = (unsigned char *)ti->texels +
+            calc_mipmap_offset(level, ti->width, ti->height, ti->format);
+        unsigned char *dst = texels +
+            calc_mipmap_offset(level, ti->width, ti->height, format);
+        _ogx_indexed_to_texels(src, ti->format, width, height,
+                               texture->palette, texture->palette_entries,
+                               dst);
+    }
+    DCFlushRange(texels, size);
+
+    release_palette(texture);
+    release_texels(texture, ti->texels);
+    ti->texels = texels;
+    ti->format = format;
+    init_texobj(texture, ti);
+    return true;
+}
+
+void _ogx_texture_init()
+{
+    s_default_tex_region_cb = GX_SetTexRegionCallback(tex_region_cb);
+}
+
+void _ogx_texture_set_in_use(GLuint texture_name)
+{
+    gltexture_ *texture = &texture_list[texture_name];
+
+    if (texture->draw_sync_token == 0) {
+        if (s_num_busy_textures >= s_max_busy_textures) {
+            int max = s_max_busy_textures > 0 ? s_max_busy_textures * 2 : 32;
+            GLuint *names = realloc(s_busy_textures, max * sizeof(GLuint));
+            if (names) {
+                s_busy_textures = names;
+                s_max_busy_textures = max;
+            }
+        }
+        /* If this fails, the token won't be reset on the next frame, and the
+         * texture will be just waited for when modified */
+        if (s_num_busy_textures < s_max_busy_textures)
+            s_busy_textures[s_num_busy_textures++] = texture_name;
+    }
+    /* The next draw sync token will tell when the GPU is done with it */
+    texture->draw_sync_token = _ogx_draw_sync_token + 1;
+    texture->tmem_loaded = 1;
+}
+
+void _ogx_texture_clear_retired()
+{
+    check_releasable_texels(true);
+
+    /* The draw sync tokens are restarting from zero */
+    for (int i = 0; i < s_num_busy_textures; i++) {
+        texture_list[s_busy_textures[i]].draw_sync_token = 0;
+    }
+    s_num_busy_textures = 0;
+}
+
 bool _ogx_texture_get_info(GLuint texture_name, OgxTextureInfo *info)
 {
     if (!TEXTURE_IS_RESERVED(texture_list[texture_name]))
@@ -144,6 +457,23 @@ bool _ogx_texture_get_texobj(GLuint texture_name, GXTexObj *texobj)
     return true;
 }
 
+void _ogx_texture_load_tlut(GLuint texture_name, u8 tex_map)
+{
+    gltexture_ *texture = &texture_list[texture_name];
+    if (!texture->palette) return;
+
+    u8 format = GX_GetTexObjFmt(&texture->texobj);
+    if (format != GX_TF_CI4 && format != GX_TF_CI8) return;
+
+    /* Each texture map gets its own TLUT */
+    u32 tlut_name = GX_TLUT0 + tex_map;
+    GXTlutObj tlut;
+    GX_InitTlutObj(&tlut, texture->palette, texture->tlut_format,
+                   palette_size(texture->palette_entries));
+    GX_LoadTlut(&tlut, tlut_name);
+    GX_InitTexObjTlut(&texture->texobj, tlut_name);
+}
+
 void glTexParameterf(GLenum target, GLenum pname, GLfloat param)
 {
     /* For the time being, all the parameters we support take integer values */
@@ -386,11 +716,59 @@ void glTexImage1D(GLenum target, GLint level, GLint internalFormat,
                  border, format, type, pixels);
 }
 
+static void update_indices(const uint8_t *indices, int level,
+                           int width, int height,
+                           gltexture_ *texture, OgxTextureInfo *ti, int x, int y)
+{
+    unsigned char *dst_addr = ti->texels;
+
+    wait_texture_idle(texture);
+
+    uint32_t offset = calc_mipmap_offset(level, ti->width, ti->height, ti->format);
+    dst_addr += offset;
+    int dstpitch = _ogx_pitch_for_width(ti->format, ti->width >> level);
+    _ogx_indices_to_texture(indices, width, height,
+                            dst_addr, ti->format, x, y, dstpitch);
+
+    DCFlushRange(dst_addr, calc_memory(width, height, ti->format));
+    invalidate_tmem(texture);
+    glparamstate.dirty.bits.dirty_tev = 1;
+}
+
 static void update_texture(const void *data, int level, GLenum format, GLenum type,
                            int width, int height,
-                           GXTexObj *obj, OgxTextureInfo *ti, int x, int y)
+                           gltexture_ *texture, OgxTextureInfo *ti, int x, int y)
 {
+    if (texture->auto_palette) {
+        /* Keep the texture palettized if its palette has room for the new
+         * colours */
+        uint16_t palette[256];
+        int num_entries = texture->palette_entries;
+        memcpy(palette, texture->palette, num_entries * sizeof(uint16_t));
+        uint8_t *indices =
+            palettize(data, format, type, width, height, texture->tlut_format,
+                      palette, &num_entries,
+                      ti->format == GX_TF_CI4 ? 16 : 256);
+        if (indices) {
+            if (num_entries == texture->palette_entries ||
+                set_palette(texture, palette, num_entries,
+                            texture->tlut_format, true)) {
+                update_indices(indices, level, width, height,
+                               texture, ti, x, y);
+            }
+            free(indices);
+            return;
+        }
+        if (!unpalettize(texture, ti)) return;
+    }
+
     unsigned char *dst_addr = ti->texels;
+    unsigned char *flush_addr;
+    uint32_t flush_size;
+
+    /* We cannot modify the texels while the GPU is reading them */
+    wait_texture_idle(texture);
+
     // Inconditionally convert to 565 all inputs without alpha channel
     // Alpha inputs may be stripped if the user specifies an alpha-free internal format
     if (ti->format != GX_TF_CMPR) {
@@ -405,10 +783,22 @@ static void update_texture(const void *data, int level, GLenum format, GLenum ty
             gx_format = GX_TF_A8;
         _ogx_bytes_to_texture(data, format, type, width, height,
                               dst_addr, gx_format, x, y, dstpitch);
+        flush_addr = dst_addr;
+        flush_size = calc_memory(width, height, ti->format);
     } else {
-        // Compressed texture
-        if (x != 0 || y != 0 || ti->width != width) {
-            warning("Update of compressed textures not implemented!");
+        /* Compressed textures can only be updated by whole 4x4 blocks, save
+         * for those at the right and bottom edges */
+        int level_width = ti->width >> level;
+        int level_height = ti->height >> level;
+        if (level_width == 0) level_width = 1;
+        if (level_height == 0) level_height = 1;
+        bool to_right_edge = x + width == level_width;
+        bool to_bottom_edge = y + height == level_height;
+        if (x % 4 != 0 || y % 4 != 0 ||
+            (width % 4 != 0 && !to_right_edge) ||
+            (height % 4 != 0 && !to_bottom_edge)) {
+            warning("Compressed texture update not aligned to 4x4 blocks");
+            set_error(GL_INVALID_OPERATION);
             return;
         }
 
@@ -416,25 +806,28 @@ static void update_texture(const void *data, int level, GLenum format, GLenum ty
         uint32_t offset = calc_mipmap_offset(level, ti->width, ti->height, ti->format);
         dst_addr += offset;
 
-        // Simplify but keep in mind the swapping
-        int needswap = 0;
-        if (format == GL_BGR) {
-            format = GL_RGB;
-            needswap = 1;
-        }
-        if (format == GL_BGRA) {
-            format = GL_RGBA;
-            needswap = 1;
-        }
-
-        _ogx_convert_rgb_image_to_DXT1((unsigned char *)data, dst_addr,
-                                       width, height, needswap);
+        /* The 8x8 tiles at the edges of the texture get filled up */
+        int padded_width = to_right_edge ?
+            ((level_width + 7) & ~7) - x : width;
+        int padded_height = to_bottom_edge ?
+            ((level_height + 7) & ~7) - y : height;
+        int dstpitch = _ogx_pitch_for_width(ti->format, level_width);
+        _ogx_bytes_to_cmpr(data, format, type, width, height, dst_addr,
+                           x, y, dstpitch, padded_width, padded_height,
+                           ti->ud.d.cmpr_alpha,
+                           glparamstate.texture_compression_nicest);
+
+        /* Only flush the rows of tiles which were written */
+        int first_row = y & ~7;
+        int end_row = (y + padded_height + 7) & ~7;
+        flush_addr = dst_addr + first_row * dstpitch;
+        flush_size = (end_row - first_row) * dstpitch;
     }
 
-    DCFlushRange(dst_addr, calc_memory(width, height, ti->format));
+    DCFlushRange(flush_addr, flush_size);
 
-    // Slow but necessary! The new textures may be in the same region of some old cached textures
-    GX_InvalidateTexAll();
+    /* The old texels might still be in the TMEM cache */
+    invalidate_tmem(texture);
 
     glparamstate.dirty.bits.dirty_tev = 1;
 }
@@ -449,14 +842,10 @@ void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei widt
     if (target != GL_TEXTURE_2D)
         return; // FIXME Implement non 2D textures
 
-    GX_DrawDone(); // Very ugly, we should have a list of used textures and only wait if we are using the curr tex.
-                   // This way we are sure that we are not modifying a texture which is being drawn
-
     gltexture_ *currtex = &texture_list[tex_id];
     GXTexObj *texobj = &currtex->texobj;
 
-    uint8_t gx_format = _ogx_find_best_gx_format(format, internalFormat,
-                                                 width, height);
+    uint8_t gx_format = _ogx_find_best_gx_format(format, internalFormat);
     if (!data) {
         /* This typically happens when setting up a texture for attaching it to
          * a FBO; in this case, make sure that the format is not compressed,
@@ -465,16 +854,84 @@ void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei widt
         if (gx_format == GX_TF_CMPR) gx_format = GX_TF_RGB565;
     }
 
+    /* Unless 8 bits were asked for, RGBA textures whose alpha values fit in 3
+     * bits (like those having only opaque and transparent texels) are stored
+     * as RGB5A3, which takes half the memory */
+    bool unsized_rgba = internalFormat == 4 || internalFormat == GL_RGBA ||
+        internalFormat == GL_BGRA;
+    if (gx_format == GX_TF_RGBA8 && unsized_rgba && data &&
+        _ogx_alpha_fits_rgb5a3(data, format, type, width, height))
+        gx_format = GX_TF_RGB5A3;
+
     // We *may* need to delete and create a new texture, depending if the user wants to add some mipmap levels
     // or wants to create a new texture from scratch
     int wi = calc_original_size(level, width);
     int he = calc_original_size(level, height);
 
+    check_releasable_texels(false);
+
     OgxTextureInfo ti;
     texture_get_info(texobj, &ti);
+    /* A8 textures are stored as I8 */
+    uint8_t old_format = ti.format == GX_TF_A8 ? GX_TF_I8 : ti.format;
+    bool same_geometry = wi == ti.width && he == ti.height;
+
+    /* Compressed RGBA textures whose pixels are all either opaque or
+     * transparent can be stored as CMPR; the base level decides for the
+     * others */
+    bool cmpr_alpha = internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    if (internalFormat == GL_COMPRESSED_RGBA_ARB && data &&
+        (level == 0 ?
+         _ogx_alpha_is_binary(data, format, type, width, height) :
+         same_geometry && old_format == GX_TF_CMPR)) {
+        gx_format = GX_TF_CMPR;
+        cmpr_alpha = true;
+    }
+
+    if (level != 0 && same_geometry && unsized_rgba) {
+        /* The base level decides between RGBA8 and RGB5A3 */
+        uint8_t base_format = currtex->auto_palette ?
+            tlut_texel_format(currtex->tlut_format) : old_format;
+        if ((gx_format == GX_TF_RGBA8 || gx_format == GX_TF_RGB5A3) &&
+            (base_format == GX_TF_RGBA8 || base_format == GX_TF_RGB5A3))
+            gx_format = base_format;
+    }
+
+    if (currtex->auto_palette) {
+        if (same_geometry && level != 0 &&
+            gx_format == tlut_texel_format(currtex->tlut_format)) {
+            /* update_texture() keeps the texture palettized, if it can */
+            gx_format = old_format;
+        } else if (same_geometry && ti.maxlevel > 0) {
+            /* Preserve the other levels */
+            if (unpalettize(currtex, &ti)) old_format = ti.format;
+        } else {
+            release_palette(currtex);
+        }
+    }
+
+    uint8_t *indices = NULL;
+    uint16_t palette[256];
+    int palette_entries = 0;
+    uint8_t tlut_format = GX_TL_RGB5A3;
+    if (gx_format == GX_TF_RGB565) tlut_format = GX_TL_RGB565;
+    else if (gx_format == GX_TF_IA8) tlut_format = GX_TL_IA8;
+    if ((glparamstate.hints & OGX_HINT_PALETTIZE_TEXTURES) &&
+        level == 0 && data && !currtex->palette &&
+        (!same_geometry || ti.maxlevel == 0) &&
+        (gx_format == GX_TF_RGB565 || gx_format == GX_TF_RGB5A3 ||
+         gx_format == GX_TF_IA8)) {
+        indices = palettize(data, format, type, width, height, tlut_format,
+                            palette, &palette_entries, 256);
+        if (indices)
+            gx_format = palette_entries <= 16 ? GX_TF_CI4 : GX_TF_CI8;
+    }
+
     ti.format = gx_format;
     /* GX_TF_A8 is not supported by Dolphin and it's not properly handed by
      * a real Wii either. */
+    ti.ud.d.is_alpha = 0;
+    ti.ud.d.cmpr_alpha = gx_format == GX_TF_CMPR && cmpr_alpha;
     if (ti.format == GX_TF_A8) {
         ti.format = gx_format = GX_TF_I8;
         ti.ud.d.is_alpha = 1; /* Remember that we wanted alpha, though */
@@ -483,11 +940,12 @@ void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei widt
     ti.ud.d.is_reserved = 1;
     char onelevel = ti.minlevel == 0 && ti.maxlevel == 0;
 
-    // Check if the texture has changed its geometry and proceed to delete it
-    // If the specified level is zero, create a onelevel texture to save memory
-    if (wi != ti.width || he != ti.height) {
+    // Check if the texture has changed its geometry (or format) and proceed to
+    // delete it. If the specified level is zero, create a onelevel texture to
+    // save memory
+    if (!same_geometry || ti.format != old_format) {
         if (ti.texels != 0)
-            free(ti.texels);
+            release_texels(currtex, ti.texels);
         uint32_t required_size;
         if (level == 0) {
             required_size = calc_memory(width, height, ti.format);
@@ -500,12 +958,26 @@ void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei widt
         if (!ti.texels) {
             warning("Failed to allocate %u bytes for texture", required_size);
             set_error(GL_OUT_OF_MEMORY);
+            free(indices);
             return;
         }
         ti.minlevel = level;
         ti.maxlevel = level;
         ti.width = wi;
         ti.height = he;
+    } else if (data && texture_is_busy(currtex)) {
+        /* Rather than waiting for the GPU to be done with the texture, write
+         * the new texels into a new buffer */
+        uint32_t size = onelevel ?
+            calc_memory(wi, he, ti.format) : calc_tex_size(wi, he, ti.format);
+        void *texels = memalign(32, size);
+        if (texels) {
+            /* Preserve the other levels */
+            if (ti.format == old_format && (!onelevel || level != 0))
+                memcpy(texels, ti.texels, size);
+            release_texels(currtex, ti.texels);
+            ti.texels = texels;
+        }
     }
     if (ti.maxlevel < level)
         ti.maxlevel = level;
@@ -524,23 +996,24 @@ void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei widt
         if (!ti.texels) {
             warning("Failed to allocate memory for texture mipmap (%d)", errno);
             set_error(GL_OUT_OF_MEMORY);
+            free(indices);
             return;
         }
 
         memcpy(ti.texels, oldbuf, tsize);
-        free(oldbuf);
+        release_texels(currtex, oldbuf);
     }
 
-    if (data) {
+    if (indices) {
+        if (set_palette(currtex, palette, palette_entries, tlut_format, true))
+            update_indices(indices, level, width, height, currtex, &ti, 0, 0);
+        free(indices);
+    } else if (data) {
         update_texture(data, level, format, type, width, height,
-                       texobj, &ti, 0, 0);
+                       currtex, &ti, 0, 0);
     }
 
-    GX_InitTexObj(texobj, ti.texels,
-                  ti.width, ti.height, ti.format, ti.wraps, ti.wrapt, GX_TRUE);
-    GX_InitTexObjLOD(texobj, ti.min_filter, ti.mag_filter,
-                     ti.minlevel, ti.maxlevel, 0, GX_ENABLE, GX_ENABLE, GX_ANISO_1);
-    GX_InitTexObjUserData(texobj, ti.ud.ptr);
+    init_texobj(currtex, &ti);
 }
 
 void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset,
@@ -572,7 +1045,117 @@ void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset,
     }
 
     update_texture(data, level, format, type, width, height,
-                   &currtex->texobj, &ti, xoffset, yoffset);
+                   currtex, &ti, xoffset, yoffset);
+}
+
+void glColorTableEXT(GLenum target, GLenum internalFormat, GLsizei width,
+                     GLenum format, GLenum type, const GLvoid *table)
+{
+    if (target != GL_TEXTURE_2D) {
+        warning("glColorTableEXT with target 0x%04x not supported", target);
+        return;
+    }
+
+    /* CI8 textures can address at most 256 entries */
+    if (width <= 0 || (width & (width - 1)) != 0) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+    if (width > 256) {
+        set_error(GL_TABLE_TOO_LARGE);
+        return;
+    }
+
+    int tex_id = curr_tex();
+    if (!TEXTURE_IS_RESERVED(texture_list[tex_id]))
+        return;
+    gltexture_ *currtex = &texture_list[tex_id];
+
+    uint8_t tlut_format;
+    switch (_ogx_gl_format_to_gx(internalFormat)) {
+    case GX_TF_RGB565:
+        tlut_format = GX_TL_RGB565; break;
+    case GX_TF_IA8:
+    case GX_TF_I8:
+    case GX_TF_A8:
+        tlut_format = GX_TL_IA8; break;
+    default:
+        tlut_format = GX_TL_RGB5A3;
+    }
+
+    /* Convert the table as a one row texture, then pick the texels out of
+     * their 4x4 blocks */
+    uint8_t gx_format = tlut_texel_format(tlut_format);
+    int pitch = _ogx_pitch_for_width(gx_format, width);
+    uint16_t *texels = calloc(1, pitch * 4);
+    if (!texels) {
+        set_error(GL_OUT_OF_MEMORY);
+        return;
+    }
+    if (table)
+        _ogx_bytes_to_texture(table, format, type, width, 1, texels, gx_format,
+                          0, 0, pitch);
+    uint16_t entries[256];
+    for (int i = 0; i < width; i++) {
+        entries[i] = texels[(i / 4) * 16 + i % 4];
+    }
+    free(texels);
+
+    /* The indices of an automatically palettized texture are only meaningful
+     * with its own palette */
+    if (currtex->auto_palette) {
+        OgxTextureInfo ti;
+        texture_get_info(&currtex->texobj, &ti);
+        if (!unpalettize(currtex, &ti)) return;
+    }
+
+    set_palette(currtex, entries, width, tlut_format, false);
+}
+
+void glGetColorTableEXT(GLenum target, GLenum format, GLenum type,
+                        GLvoid *data)
+{
+    if (target != GL_TEXTURE_2D) {
+        set_error(GL_INVALID_ENUM);
+        return;
+    }
+
+    /* Automatic palettes are an implementation detail, not a color table */
+    const gltexture_ *currtex = &texture_list[curr_tex()];
+    if (!currtex->palette || currtex->auto_palette) return;
+
+    _ogx_tlut_to_bytes(currtex->palette, currtex->palette_entries,
+                       currtex->tlut_format, data, format, type);
+}
+
+void glGetColorTableParameterivEXT(GLenum target, GLenum pname,
+                                   GLint *params)
+{
+    if (target != GL_TEXTURE_2D) {
+        set_error(GL_INVALID_ENUM);
+        return;
+    }
+
+    const gltexture_ *currtex = &texture_list[curr_tex()];
+    switch (pname) {
+    case GL_COLOR_TABLE_WIDTH:
+        *params = currtex->palette && !currtex->auto_palette ?
+            currtex->palette_entries : 0;
+        break;
+    case GL_COLOR_TABLE_FORMAT:
+        if (!currtex->palette || currtex->auto_palette) {
+            *params = GL_RGBA;
+            break;
+        }
+        switch (currtex->tlut_format) {
+        case GX_TL_RGB565: *params = GL_RGB; break;
+        case GX_TL_IA8: *params = GL_LUMINANCE_ALPHA; break;
+        default: *params = GL_RGBA;
+        }
+        break;
+    default:
+        set_error(GL_INVALID_ENUM);
+    }
 }
 
 void glBindTexture(GLenum target, GLuint texture)
@@ -605,13 +1188,13 @@ void glTexImage3D(GLenum target, GLint level, GLint internalFormat,
 void glDeleteTextures(GLsizei n, const GLuint *textures)
 {
     const GLuint *texlist = textures;
-    GX_DrawDone();
     while (n-- > 0) {
         int i = *texlist++;
         if (i > 0 && i < _MAX_GL_TEX) {
             void *data = GX_GetTexObjData(&texture_list[i].texobj);
+            release_palette(&texture_list[i]);
             if (data != 0)
-                free(MEM_PHYSICAL_TO_K0(data));
+                release_texels(&texture_list[i], MEM_PHYSICAL_TO_K0(data));
             memset(&texture_list[i], 0, sizeof(texture_list[i]));
         }
     }
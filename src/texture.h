@@ -49,6 +49,7 @@ typedef union {
     struct {
         unsigned is_reserved: 1;
         unsigned is_alpha: 1;
+        unsigned cmpr_alpha: 1; /* GX_TF_CMPR texture with 1 bit alpha */
     } d;
 } OgxTextureUserData;
 
@@ -76,8 +77,16 @@ typedef struct {
     OgxTextureUserData ud;
 } OgxTextureInfo;
 
+void _ogx_texture_init(void);
+/* To be called after every draw which might have used the texture */
+void _ogx_texture_set_in_use(GLuint texture_name);
+/* Release the texel buffers replaced while in use by the GPU */
+void _ogx_texture_clear_retired(void);
+
 bool _ogx_texture_get_info(GLuint texture_name, OgxTextureInfo *info);
 bool _ogx_texture_get_texobj(GLuint texture_name, GXTexObj *texobj);
+/* Loads the palette of paletted textures, before the texture is loaded */
+void _ogx_texture_load_tlut(GLuint texture_name, u8 tex_map);
 
 #ifdef __cplusplus
 } // extern C
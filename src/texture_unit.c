@@ -31,6 +31,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "debug.h"
 #include "gpu_resources.h"
+#include "texture.h"
 #include "texture_gen_sw.h"
 #include "utils.h"
 
@@ -431,7 +432,9 @@ static void setup_texture_stage(const OgxTextureUnit *tu,
     bool points_enabled = glparamstate.point_sprites_enabled &&
         glparamstate.point_sprites_coord_replace;
     GX_EnableTexOffsets(tex_coord, GX_DISABLE, points_enabled);
+    _ogx_texture_load_tlut(tu->glcurtex, tex_map);
     GX_LoadTexObj(&texture_list[tu->glcurtex].texobj, tex_map);
+    _ogx_texture_set_in_use(tu->glcurtex);
 }
 
 static void setup_texture_stage_matrix(const OgxTextureUnit *tu,
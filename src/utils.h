@@ -32,6 +32,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef OGX_UTILS_H
 #define OGX_UTILS_H
 
+#include "opengx.h"
 #include "state.h"
 
 #include <gctypes.h>
@@ -143,6 +144,30 @@ static inline Mtx *current_tex_matrix()
     return &tu->matrix[tu->matrix_index];
 }
 
+/* Returns the palette matrix selected by glCurrentPaletteMatrixARB(), marking
+ * it as modified */
+static inline Mtx *current_palette_matrix()
+{
+    int current = glparamstate.matrix_palette.current;
+    glparamstate.matrix_palette.dirty_mask |= 1 << current;
+    return &glparamstate.matrix_palette.matrices[current];
+}
+
+/* Number of palette matrices: entry i of the palette is loaded into the
+ * position/normal matrix slot pnmtx_first + i, so that the slots reserved by
+ * the integration library are left alone. */
+static inline int matrix_palette_size()
+{
+    int size = ogx_gpu_resources->pnmtx_end - ogx_gpu_resources->pnmtx_first;
+    if (size > MAX_PALETTE_MATRICES) size = MAX_PALETTE_MATRICES;
+    return size > 0 ? size : 0;
+}
+
+static inline uint32_t matrix_palette_pnmtx(int index)
+{
+    return GX_PNMTX0 + (ogx_gpu_resources->pnmtx_first + index) * 3;
+}
+
 static inline bool gxcol_equal(GXColor a, GXColor b)
 {
     return *(int32_t*)&a == *(int32_t*)&b;
@@ -29,29 +29,85 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 POSSIBILITY OF SUCH DAMAGE.
 *****************************************************************************/
 
+#include "vbo.h"
+
 #include "debug.h"
 #include "state.h"
 #include "utils.h"
 
 #include <malloc.h>
+#include <math.h>
+
+/* Number of copies of the buffer data kept for buffers which are updated
+ * often: while the GPU reads from one of them, the CPU can write into the
+ * next. */
+#define MAX_RING_SLOTS 3
 
 typedef struct _VertexBuffer VertexBuffer;
+typedef struct _QuantizedArray QuantizedArray;
+typedef struct _OptimizedIndices OptimizedIndices;
+
+/* A copy of a float array stored in a VBO, converted to a fixed point
+ * format */
+struct _QuantizedArray {
+    QuantizedArray *next;
+    /* The layout of the source array */
+    uintptr_t offset;
+    uint16_t src_stride;
+    uint8_t attribute;
+    uint8_t num_components;
+    /* The GX format of the copy; size is 0xff if the array could not be
+     * quantized */
+    uint8_t size;
+    uint8_t frac;
+    uint8_t stride;
+    _Alignas(32) uint8_t data[0];
+};
+
+/* A triangle list stored in an element array buffer, optimized for the vertex
+ * cache. Only the CPU reads these indices, so they can be freed at any
+ * time. */
+struct _OptimizedIndices {
+    OptimizedIndices *next;
+    /* The source triangle list */
+    uintptr_t offset;
+    GLsizei count;
+    GLenum type;
+    /* 0 if the list has not been optimized */
+    int num_batches;
+    OgxIndexBatch *batches;
+    uint16_t indices[0];
+};
 
 struct _VertexBuffer {
     size_t size;
+    GLenum usage;
     unsigned mapped : 1;
+    GLbitfield map_access;
+    GLintptr map_offset;
+    GLsizeiptr map_length;
     uint16_t last_sync_token_sent;
+    uint8_t num_slots;
+    uint8_t current_slot;
+    /* The draw sync token sent after the last draw reading from each slot */
+    uint16_t slot_sync_tokens[MAX_RING_SLOTS];
     VertexBuffer *next_unbound;
-
-    /* The buffer data are stored in the same memory block at the end of this
-     * struct */
-    _Alignas(4) uint8_t data[0];
+    QuantizedArray *quantized;
+    OptimizedIndices *optimized;
+    /* Points to the data of the current slot */
+    uint8_t *data;
+
+    /* The buffer data (all the slots) are stored in the same memory block at
+     * the end of this struct */
+    _Alignas(32) uint8_t storage[0];
 };
 
 #define MAX_VBOS 256 /* Check the size of _ogx_state.bound_vbo_* members if
                         increasing this! */
 
 static VertexBuffer *s_buffers[MAX_VBOS];
+/* Buffers whose triangles must be drawn in the original order */
+static uint32_t s_keep_order[MAX_VBOS / 32];
 /* List of unbound buffers; we can free them once their sync token has been
  * received */
 static VertexBuffer *s_unbound_buffers = NULL;
@@ -93,6 +149,82 @@ static int get_index_for_target(GLenum target)
     return active_vbo - 1;
 }
 
+/* How many copies of the data we keep, depending on how often the
+ * application is going to modify them */
+static int slots_for_usage(GLenum usage)
+{
+    switch (usage) {
+    case GL_STREAM_DRAW:
+    case GL_STREAM_READ:
+    case GL_STREAM_COPY:
+        return MAX_RING_SLOTS;
+    case GL_DYNAMIC_DRAW:
+    case GL_DYNAMIC_READ:
+    case GL_DYNAMIC_COPY:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+static inline bool slot_is_busy(const VertexBuffer *buffer, int slot)
+{
+    uint16_t token = buffer->slot_sync_tokens[slot];
+    return token != 0 && GX_GetDrawSync() < token;
+}
+
+static void wait_slot(VertexBuffer *buffer, int slot)
+{
+    uint16_t token = buffer->slot_sync_tokens[slot];
+    if (token != 0) {
+        /* We must wait for the draw operation to complete */
+        while (GX_GetDrawSync() < token);
+        buffer->slot_sync_tokens[slot] = 0;
+    }
+}
+
+static void drop_quantized_arrays(VertexBuffer *buffer)
+{
+    QuantizedArray *q = buffer->quantized;
+    if (!q) return;
+
+    /* The GPU might still be reading the old copies */
+    if (buffer->last_sync_token_sent != 0)
+        while (GX_GetDrawSync() < buffer->last_sync_token_sent);
+
+    while (q) {
+        QuantizedArray *next = q->next;
+        free(q);
+        q = next;
+    }
+    buffer->quantized = NULL;
+    /* The readers might be pointing to the copies */
+    glparamstate.dirty.bits.dirty_attributes = 1;
+}
+
+static void drop_optimized_indices(VertexBuffer *buffer)
+{
+    OptimizedIndices *o = buffer->optimized;
+    while (o) {
+        OptimizedIndices *next = o->next;
+        free(o);
+        o = next;
+    }
+    buffer->optimized = NULL;
+}
+
+static void free_buffer(VertexBuffer *buffer)
+{
+    QuantizedArray *q = buffer->quantized;
+    while (q) {
+        QuantizedArray *next = q->next;
+        free(q);
+        q = next;
+    }
+    drop_optimized_indices(buffer);
+    free(buffer);
+}
+
 static void check_releasable_unbound_buffers(bool delete_all)
 {
     VertexBuffer **prev_ptr = &s_unbound_buffers;
@@ -102,7 +234,7 @@ static void check_releasable_unbound_buffers(bool delete_all)
         if (delete_all ||
             _ogx_draw_sync_token_received >= buffer->last_sync_token_sent) {
             /* Buffer is done, we can release it */
-            free(buffer);
+            free_buffer(buffer);
             *prev_ptr = next;
         } else {
             prev_ptr = &buffer->next_unbound;
@@ -117,6 +249,104 @@ static void move_to_unbound_list(VertexBuffer *buffer)
     s_unbound_buffers = buffer;
 }
 
+/* Frees the buffer, or defers it if the GPU might still be using it */
+static void release_buffer(VertexBuffer *buffer)
+{
+    if (buffer->last_sync_token_sent > _ogx_draw_sync_token_received) {
+        /* Buffer is still in use by the GPU, we can't free it right now */
+        move_to_unbound_list(buffer);
+    } else {
+        free_buffer(buffer);
+    }
+}
+
+static VertexBuffer *allocate_buffer(int index, GLsizeiptr size, GLenum usage)
+{
+    if (s_unbound_buffers)
+        check_releasable_unbound_buffers(false);
+
+    VertexBuffer *buffer = s_buffers[index];
+    if (buffer && buffer != RESERVED_PTR) {
+        release_buffer(buffer);
+    }
+
+    int num_slots = slots_for_usage(usage);
+    size_t slot_size = (size + 31) / 32 * 32;
+    buffer = memalign(32, sizeof(VertexBuffer) + slot_size * num_slots);
+    if (!buffer && num_slots > 1) {
+        /* Try again without the ring */
+        num_slots = 1;
+        buffer = memalign(32, sizeof(VertexBuffer) + slot_size);
+    }
+    s_buffers[index] = buffer;
+    if (!buffer) {
+        warning("Out of memory allocating a VBO");
+        set_error(GL_OUT_OF_MEMORY);
+        return NULL;
+    }
+    buffer->size = size;
+    buffer->usage = usage;
+    buffer->mapped = false;
+    buffer->last_sync_token_sent = 0;
+    buffer->num_slots = num_slots;
+    buffer->current_slot = 0;
+    memset(buffer->slot_sync_tokens, 0, sizeof(buffer->slot_sync_tokens));
+    buffer->next_unbound = NULL;
+    buffer->quantized = NULL;
+    buffer->optimized = NULL;
+    buffer->data = buffer->storage;
+    glparamstate.dirty.bits.dirty_attributes = 1;
+    return buffer;
+}
+
+/* Makes sure that the buffer data can be written without disturbing the
+ * GPU. If the buffer is in use, we switch to the next slot of the ring (if
+ * the buffer has one) rather than waiting for the GPU; the data outside of
+ * the given range, which the caller is going to overwrite, is carried over
+ * to the new slot. */
+static void prepare_for_write(VertexBuffer *buffer,
+                              GLintptr offset, GLsizeiptr size)
+{
+    int slot = buffer->current_slot;
+    drop_quantized_arrays(buffer);
+    drop_optimized_indices(buffer);
+    if (!slot_is_busy(buffer, slot)) {
+        buffer->slot_sync_tokens[slot] = 0;
+        return;
+    }
+
+    if (buffer->num_slots == 1) {
+        wait_slot(buffer, slot);
+        return;
+    }
+
+    /* Pick the first free slot; if there's none, the oldest one is the next
+     * in the ring and we'll have to wait for it. */
+    int next = (slot + 1) % buffer->num_slots;
+    for (int i = next; i != slot; i = (i + 1) % buffer->num_slots) {
+        if (!slot_is_busy(buffer, i)) {
+            next = i;
+            break;
+        }
+    }
+    wait_slot(buffer, next);
+
+    size_t slot_size = (buffer->size + 31) / 32 * 32;
+    uint8_t *old_data = buffer->data;
+    buffer->data = buffer->storage + slot_size * next;
+    buffer->current_slot = next;
+    if (offset > 0) {
+        memcpy(buffer->data, old_data, offset);
+        DCStoreRangeNoSync(buffer->data, offset);
+    }
+    GLintptr end = offset + size;
+    if (end < buffer->size) {
+        memcpy(buffer->data + end, old_data + end, buffer->size - end);
+        DCStoreRangeNoSync(buffer->data + end, buffer->size - end);
+    }
+    glparamstate.dirty.bits.dirty_attributes = 1;
+}
+
 void glBindBuffer(GLenum target, GLuint buffer)
 {
     VboType *target_buffer = get_buffer_for_target(target);
@@ -126,11 +356,11 @@ void glBindBuffer(GLenum target, GLuint buffer)
 void glDeleteBuffers(GLsizei n, const GLuint *buffers)
 {
     const GLuint *vbolist = buffers;
-    GX_DrawDone();
     while (n-- > 0) {
         int i = *vbolist++ - 1;
+        if (i >= 0 && i < MAX_VBOS) s_keep_order[i / 32] &= ~(1u << (i % 32));
         if (i >= 0 && i < MAX_VBOS && VBO_IS_USED(i)) {
-            free(s_buffers[i]);
+            release_buffer(s_buffers[i]);
             s_buffers[i] = NULL;
         }
     }
@@ -168,8 +398,8 @@ GLboolean glIsBuffer(GLuint buffer)
     return VBO_IS_RESERVED_OR_USED(index);
 }
 
-static void set_buffer_data(GLenum target, GLintptr offset, GLsizeiptr size,
-                            const void *data, bool must_allocate)
+void glBufferData(GLenum target, GLsizeiptr size, const void *data,
+                  GLenum usage)
 {
     int index = get_index_for_target(target);
     if (index < 0) return;
@@ -180,58 +410,44 @@ static void set_buffer_data(GLenum target, GLintptr offset, GLsizeiptr size,
     }
 
     VertexBuffer *buffer = s_buffers[index];
-    if (must_allocate) {
-        if (s_unbound_buffers)
-            check_releasable_unbound_buffers(false);
-
-        if (buffer && buffer != RESERVED_PTR) {
-            if (buffer->last_sync_token_sent > _ogx_draw_sync_token_received) {
-                /* Buffer is still in use by the GPU, we can't free it right
-                 * now */
-                move_to_unbound_list(buffer);
-            } else {
-                free(buffer);
-            }
-        }
-        size = (size + 31) / 32 * 32;
-        buffer = s_buffers[index] = memalign(32, sizeof(VertexBuffer) + size);
-        if (!buffer) {
-            warning("Out of memory allocating a VBO");
-            set_error(GL_OUT_OF_MEMORY);
+    if (VBO_IS_USED(index) && buffer->size == size && buffer->usage == usage &&
+        buffer->num_slots > 1) {
+        /* The application is respecifying the whole buffer: this is an
+         * orphaning operation, and the ring lets us avoid a reallocation. */
+        if (buffer->mapped) {
+            set_error(GL_INVALID_OPERATION);
             return;
         }
-        buffer->size = size;
-        buffer->mapped = false;
-        buffer->last_sync_token_sent = 0;
-        buffer->next_unbound = NULL;
-        glparamstate.dirty.bits.dirty_attributes = 1;
+        prepare_for_write(buffer, 0, size);
+    } else {
+        buffer = allocate_buffer(index, size, usage);
+        if (!buffer) return;
     }
 
-    if (!buffer) {
-        set_error(GL_INVALID_VALUE);
-        return;
-    }
     if (data) {
-        if (buffer->last_sync_token_sent != 0) {
-            /* We must wait for the draw operation to complete */
-            while (GX_GetDrawSync() < buffer->last_sync_token_sent);
-            buffer->last_sync_token_sent = 0;
-        }
-        memcpy(buffer->data + offset, data, size);
-        DCStoreRangeNoSync(buffer->data + offset, size);
+        memcpy(buffer->data, data, size);
+        DCStoreRangeNoSync(buffer->data, size);
     }
 }
 
-void glBufferData(GLenum target, GLsizeiptr size, const void *data,
-                  GLenum usage)
-{
-    set_buffer_data(target, 0, size, data, true);
-}
-
 void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
                      const void *data)
 {
-    set_buffer_data(target, offset, size, data, false);
+    int index = get_index_for_target(target);
+    if (index < 0) return;
+
+    if (!VBO_IS_USED(index) || offset < 0 || size < 0 ||
+        offset + size > s_buffers[index]->size) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+
+    VertexBuffer *buffer = s_buffers[index];
+    if (size == 0 || !data) return;
+
+    prepare_for_write(buffer, offset, size);
+    memcpy(buffer->data + offset, data, size);
+    DCStoreRangeNoSync(buffer->data + offset, size);
 }
 
 void glGetBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, void *data)
@@ -246,19 +462,103 @@ void glGetBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, void *d
     }
 }
 
-void *glMapBuffer(GLenum target, GLenum access)
+void *glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length,
+                       GLbitfield access)
 {
     int index = get_index_for_target(target);
     if (index < 0) return NULL;
 
-    if (!VBO_IS_USED(index)) {
+    if (!VBO_IS_USED(index) || offset < 0 || length <= 0 ||
+        offset + length > s_buffers[index]->size ||
+        !(access & (GL_MAP_READ_BIT | GL_MAP_WRITE_BIT))) {
         set_error(GL_INVALID_VALUE);
         return NULL;
     }
 
     VertexBuffer *buffer = s_buffers[index];
+    if (buffer->mapped) {
+        set_error(GL_INVALID_OPERATION);
+        return NULL;
+    }
+
+    if (!(access & GL_MAP_WRITE_BIT)) {
+        /* The CPU reading the data does not disturb the GPU */
+    } else if (access & GL_MAP_UNSYNCHRONIZED_BIT) {
+        /* The application takes care of not overwriting data in use */
+        drop_quantized_arrays(buffer);
+        drop_optimized_indices(buffer);
+        buffer->slot_sync_tokens[buffer->current_slot] = 0;
+    } else if (access & GL_MAP_INVALIDATE_BUFFER_BIT) {
+        if (buffer->num_slots == 1 &&
+            slot_is_busy(buffer, buffer->current_slot)) {
+            /* Orphan the buffer, rather than waiting for the GPU */
+            VertexBuffer *new_buffer =
+                allocate_buffer(index, buffer->size, buffer->usage);
+            if (!new_buffer) return NULL;
+            buffer = new_buffer;
+        } else {
+            prepare_for_write(buffer, 0, buffer->size);
+        }
+    } else if (access & GL_MAP_INVALIDATE_RANGE_BIT) {
+        prepare_for_write(buffer, offset, length);
+    } else {
+        /* The mapped range must be preserved as well */
+        prepare_for_write(buffer, 0, 0);
+    }
+
     buffer->mapped = true;
-    return buffer->data;
+    buffer->map_access = access;
+    buffer->map_offset = offset;
+    buffer->map_length = length;
+    return buffer->data + offset;
+}
+
+void glFlushMappedBufferRange(GLenum target, GLintptr offset,
+                              GLsizeiptr length)
+{
+    int index = get_index_for_target(target);
+    if (index < 0) return;
+
+    if (!VBO_IS_USED(index)) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+
+    VertexBuffer *buffer = s_buffers[index];
+    if (!buffer->mapped || !(buffer->map_access & GL_MAP_FLUSH_EXPLICIT_BIT)) {
+        set_error(GL_INVALID_OPERATION);
+        return;
+    }
+
+    if (offset < 0 || length < 0 || offset + length > buffer->map_length) {
+        set_error(GL_INVALID_VALUE);
+        return;
+    }
+
+    DCStoreRangeNoSync(buffer->data + buffer->map_offset + offset, length);
+}
+
+void *glMapBuffer(GLenum target, GLenum access)
+{
+    GLbitfield flags;
+    switch (access) {
+    case GL_READ_ONLY: flags = GL_MAP_READ_BIT; break;
+    case GL_WRITE_ONLY: flags = GL_MAP_WRITE_BIT; break;
+    case GL_READ_WRITE: flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT; break;
+    default:
+        set_error(GL_INVALID_ENUM);
+        return NULL;
+    }
+
+    int index = get_index_for_target(target);
+    if (index < 0) return NULL;
+
+    if (!VBO_IS_USED(index)) {
+        set_error(GL_INVALID_VALUE);
+        return NULL;
+    }
+
+    return glMapBufferRange(target, 0, s_buffers[index]->size, flags);
 }
 
 GLboolean glUnmapBuffer(GLenum target)
@@ -277,7 +577,12 @@ GLboolean glUnmapBuffer(GLenum target)
         return GL_FALSE;
     }
 
-    DCStoreRangeNoSync(buffer->data, buffer->size);
+    if ((buffer->map_access & GL_MAP_WRITE_BIT) &&
+        !(buffer->map_access & GL_MAP_FLUSH_EXPLICIT_BIT)) {
+        DCStoreRangeNoSync(buffer->data + buffer->map_offset,
+                           buffer->map_length);
+    }
+    buffer->mapped = false;
     return GL_TRUE;
 }
 
@@ -286,6 +591,11 @@ void glGetBufferParameteriv(GLenum target, GLenum pname, GLint *params)
     int index = get_index_for_target(target);
     if (index < 0) return;
 
+    if (!VBO_IS_USED(index)) {
+        set_error(GL_INVALID_OPERATION);
+        return;
+    }
+
     switch (pname) {
     case GL_BUFFER_MAPPED:
         *params = s_buffers[index]->mapped;
@@ -293,6 +603,18 @@ void glGetBufferParameteriv(GLenum target, GLenum pname, GLint *params)
     case GL_BUFFER_SIZE:
         *params = s_buffers[index]->size;
         break;
+    case GL_BUFFER_USAGE:
+        *params = s_buffers[index]->usage;
+        break;
+    case GL_BUFFER_ACCESS_FLAGS:
+        *params = s_buffers[index]->mapped ? s_buffers[index]->map_access : 0;
+        break;
+    case GL_BUFFER_MAP_OFFSET:
+        *params = s_buffers[index]->mapped ? s_buffers[index]->map_offset : 0;
+        break;
+    case GL_BUFFER_MAP_LENGTH:
+        *params = s_buffers[index]->mapped ? s_buffers[index]->map_length : 0;
+        break;
     default:
         warning("Unhandled buffer parameter %04x", pname);
     }
@@ -313,22 +635,382 @@ void glGetBufferPointerv(GLenum target, GLenum pname, void **params)
         return;
     }
     VertexBuffer *buffer = s_buffers[index];
-    *params = buffer->mapped ? buffer->data : NULL;
+    *params = buffer->mapped ? buffer->data + buffer->map_offset : NULL;
 }
 
 void *_ogx_vbo_get_data(VboType vbo, const void *offset)
 {
-    return s_buffers[vbo - 1]->data + (int)offset;
+    return s_buffers[vbo - 1]->data + (uintptr_t)offset;
+}
+
+/* Finds the largest number of fractional bits allowing all values (ranging
+ * from -abs_max to abs_max, or 0 to abs_max if is_signed is false) to be
+ * represented with the given number of bits; returns -1 if none is possible.
+ */
+static int max_frac_bits(float abs_max, int bits, bool is_signed)
+{
+    float limit = is_signed ? (1 << (bits - 1)) - 1 : (1 << bits) - 1;
+    if (abs_max > limit) return -1;
+    int frac = 0;
+    while (frac < 31 && abs_max * (1u << (frac + 1)) <= limit) frac++;
+    return frac;
+}
+
+static bool is_exact(const uint8_t *data, int count, int stride,
+                     int num_components, int frac)
+{
+    float scale = 1u << frac;
+    for (int i = 0; i < count; i++) {
+        const float *v = (const float *)(data + stride * i);
+        for (int c = 0; c < num_components; c++) {
+            float f = v[c] * scale;
+            if (f != rintf(f)) return false;
+        }
+    }
+    return true;
+}
+
+/* Choose the GX component size and the fractional bits for the array;
+ * returns false if the data cannot be represented in a fixed point format
+ * with a good enough accuracy. */
+static bool choose_fixed_point_format(uint8_t attribute,
+                                      const uint8_t *data, int count,
+                                      int stride, int num_components,
+                                      uint8_t *size, uint8_t *frac)
+{
+    float min = INFINITY, max = -INFINITY, extent = 0.0f;
+    for (int c = 0; c < num_components; c++) {
+        float c_min = INFINITY, c_max = -INFINITY;
+        for (int i = 0; i < count; i++) {
+            float v = ((const float *)(data + stride * i))[c];
+            if (!isfinite(v)) return false;
+            if (v < c_min) c_min = v;
+            if (v > c_max) c_max = v;
+        }
+        if (c_min < min) min = c_min;
+        if (c_max > max) max = c_max;
+        if (c_max - c_min > extent) extent = c_max - c_min;
+    }
+    float abs_max = fmaxf(fabsf(min), fabsf(max));
+
+    if (attribute == GX_VA_NRM) {
+        /* For normals the hardware uses a fixed number of fractional bits */
+        if (abs_max <= 127.0f / 64) {
+            *size = GX_S8;
+            *frac = 6;
+        } else if (abs_max <= 32767.0f / 16384) {
+            *size = GX_S16;
+            *frac = 14;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    /* The quantization error must be small compared to the size of the
+     * object; for texture coordinates, below half a texel of a 1024x1024
+     * texture. */
+    float tolerance = attribute == GX_VA_POS ? extent / 4096 : 1.0f / 2048;
+    bool is_signed = min < 0;
+    static const struct {
+        uint8_t bits;
+        uint8_t gx_signed, gx_unsigned;
+    } candidates[] = {
+        { 8, GX_S8, GX_U8 },
+        { 16, GX_S16, GX_U16 },
+    };
+    for (int i = 0; i < 2; i++) {
+        int f = max_frac_bits(abs_max, candidates[i].bits, is_signed);
+        if (f < 0) continue;
+        float max_error = 0.5f / (1u << f);
+        if (max_error <= tolerance ||
+            is_exact(data, count, stride, num_components, f)) {
+            *size = is_signed ?
+                candidates[i].gx_signed : candidates[i].gx_unsigned;
+            *frac = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+static QuantizedArray *quantize_array(const uint8_t *data, int count,
+                                      int stride, uint8_t attribute,
+                                      int num_components)
+{
+    uint8_t size, frac;
+    if (!choose_fixed_point_format(attribute, data, count, stride,
+                                   num_components, &size, &frac)) {
+        return NULL;
+    }
+
+    int component_size = (size == GX_S16 || size == GX_U16) ? 2 : 1;
+    int dst_stride = component_size * num_components;
+    QuantizedArray *q = memalign(32, sizeof(QuantizedArray) +
+                                 dst_stride * count);
+    if (!q) return NULL;
+    q->size = size;
+    q->frac = frac;
+    q->stride = dst_stride;
+
+    float scale = 1u << frac;
+    uint8_t *dst = q->data;
+    for (int i = 0; i < count; i++) {
+        const float *v = (const float *)(data + stride * i);
+        for (int c = 0; c < num_components; c++) {
+            long value = lrintf(v[c] * scale);
+            switch (size) {
+            case GX_S8: *(int8_t *)dst = value; break;
+            case GX_U8: *dst = value; break;
+            case GX_S16: *(int16_t *)dst = value; break;
+            case GX_U16: *(uint16_t *)dst = value; break;
+            }
+            dst += component_size;
+        }
+    }
+    DCStoreRange(q->data, dst_stride * count);
+    return q;
+}
+
+bool _ogx_vbo_get_quantized(VboType vbo, const void *offset, int stride,
+                            uint8_t attribute, int num_components,
+                            OgxQuantizedArray *out)
+{
+    int index = vbo - 1;
+    if (!VBO_IS_USED(index)) return false;
+
+    VertexBuffer *buffer = s_buffers[index];
+    if (buffer->usage != GL_STATIC_DRAW || buffer->num_slots != 1 ||
+        buffer->mapped) return false;
+
+    uintptr_t start = (uintptr_t)offset;
+    QuantizedArray *q;
+    for (q = buffer->quantized; q != NULL; q = q->next) {
+        if (q->offset == start && q->src_stride == stride &&
+            q->attribute == attribute && q->num_components == num_components)
+            break;
+    }
+
+    if (!q) {
+        int elem_size = num_components * sizeof(float);
+        if ((start & 3) || (stride & 3) || stride <= 0 ||
+            start + elem_size > buffer->size) return false;
+
+        /* We don't know how many vertices the application will use, so we
+         * convert all the elements in the buffer */
+        int count = (buffer->size - start - elem_size) / stride + 1;
+        q = quantize_array(buffer->data + start, count, stride,
+                           attribute, num_components);
+        if (!q) {
+            /* Remember that this array cannot be quantized */
+            q = malloc(sizeof(QuantizedArray));
+            if (!q) return false;
+            q->size = 0xff;
+        }
+        q->offset = start;
+        q->src_stride = stride;
+        q->attribute = attribute;
+        q->num_components = num_components;
+        q->next = buffer->quantized;
+        buffer->quantized = q;
+    }
+
+    if (q->size == 0xff) return false;
+    out->data = q->data;
+    out->stride = q->stride;
+    out->size = q->size;
+    out->frac = q->frac;
+    return true;
+}
+
+/* A way of drawing a triangle list */
+typedef struct {
+    uint16_t *indices;
+    OgxIndexBatch *batches;
+    int num_indices;
+    int num_batches;
+    float acmr;
+} TriangleLayout;
+
+/* Estimated cost of drawing the layout: every index goes through the FIFO,
+ * starting a primitive costs about as much as two indices, and every vertex
+ * cache miss about as much as an index. */
+static float layout_cost(const TriangleLayout *layout, int num_triangles)
+{
+    return layout->num_indices + 2 * layout->num_batches +
+        layout->acmr * num_triangles;
+}
+
+static void make_layout(TriangleLayout *layout, const uint16_t *triangles,
+                        int num_triangles, bool use_strips)
+{
+    int count = num_triangles * 3;
+    if (use_strips) {
+        layout->num_indices =
+            _ogx_build_triangle_batches(triangles, num_triangles,
+                                        layout->indices, layout->batches,
+                                        &layout->num_batches);
+    } else {
+        memcpy(layout->indices, triangles, count * sizeof(uint16_t));
+        /* A GX primitive has at most 0xffff vertices, a multiple of 3 */
+        int nb = 0;
+        for (int i = 0; i < count; i += 0xffff) {
+            layout->batches[nb].mode = GX_TRIANGLES;
+            layout->batches[nb].count = count - i > 0xffff ? 0xffff : count - i;
+            nb++;
+        }
+        layout->num_indices = count;
+        layout->num_batches = nb;
+    }
+    layout->acmr = _ogx_compute_acmr(layout->indices, layout->batches,
+                                     layout->num_batches, num_triangles);
+}
+
+static OptimizedIndices *optimize_indices(const void *data, GLenum type,
+                                          int count)
+{
+    int num_triangles = count / 3;
+    size_t layout_size = count * sizeof(uint16_t) +
+        num_triangles * sizeof(OgxIndexBatch);
+    OptimizedIndices *o = malloc(sizeof(OptimizedIndices) + layout_size);
+    if (!o) return NULL;
+    o->num_batches = 0;
+    o->batches = (OgxIndexBatch *)(o->indices + count);
+
+    /* Room for the original and reordered triangles, and for a candidate
+     * layout */
+    uint16_t *original = malloc(count * sizeof(uint16_t) * 2 + layout_size);
+    if (!original) return o;
+    uint16_t *reordered = original + count;
+    TriangleLayout best = { .indices = o->indices, .batches = o->batches };
+    TriangleLayout candidate = {
+        .indices = reordered + count,
+        .batches = (OgxIndexBatch *)(reordered + count * 2),
+    };
+
+    uint32_t max_index = 0;
+    for (int i = 0; i < count; i++) {
+        uint32_t index = type == GL_UNSIGNED_BYTE ? ((const uint8_t *)data)[i] :
+            type == GL_UNSIGNED_SHORT ? ((const uint16_t *)data)[i] :
+            ((const uint32_t *)data)[i];
+        /* GX cannot use larger indices anyway */
+        if (index > 0xffff) goto out;
+        if (index > max_index) max_index = index;
+        original[i] = index;
+    }
+
+    memcpy(reordered, original, count * sizeof(uint16_t));
+    if (!_ogx_optimize_triangle_order(reordered, num_triangles,
+                                      max_index + 1)) goto out;
+
+    /* The original order might be better suited for strips */
+    make_layout(&best, original, num_triangles, false);
+    float acmr_before = best.acmr;
+    float best_cost = layout_cost(&best, num_triangles);
+    bool improved = false;
+    for (int i = 0; i < 3; i++) {
+        make_layout(&candidate, i == 0 ? original : reordered,
+                    num_triangles, i != 1);
+        float cost = layout_cost(&candidate, num_triangles);
+        if (cost < best_cost) {
+            TriangleLayout tmp = best;
+            best = candidate;
+            candidate = tmp;
+            best_cost = cost;
+            improved = true;
+        }
+    }
+    if (!improved) goto out;
+
+    if (best.indices != o->indices) {
+        memcpy(o->indices, best.indices, best.num_indices * sizeof(uint16_t));
+        memcpy(o->batches, best.batches,
+               best.num_batches * sizeof(OgxIndexBatch));
+    }
+    o->num_batches = best.num_batches;
+    debug(OGX_LOG_VBO, "Reordered %d triangles: ACMR %.3f -> %.3f, "
+          "%d -> %d indices in %d primitives", num_triangles,
+          acmr_before, best.acmr, count, best.num_indices, best.num_batches);
+
+out:
+    free(original);
+    return o;
+}
+
+bool _ogx_vbo_get_optimized_indices(VboType vbo, const void *offset,
+                                    GLenum type, int count,
+                                    OgxOptimizedIndices *out)
+{
+    int index = vbo - 1;
+    if (!VBO_IS_USED(index) ||
+        s_keep_order[index / 32] & (1u << (index % 32))) return false;
+
+    VertexBuffer *buffer = s_buffers[index];
+    if (buffer->usage != GL_STATIC_DRAW || buffer->num_slots != 1 ||
+        buffer->mapped) return false;
+
+    uintptr_t start = (uintptr_t)offset;
+    OptimizedIndices *o;
+    for (o = buffer->optimized; o != NULL; o = o->next) {
+        if (o->offset == start && o->count == count && o->type == type)
+            break;
+    }
+
+    if (!o) {
+        int index_size = sizeof_gl_type(type);
+        if (count < 6 || count % 3 != 0 || start % index_size != 0 ||
+            start + count * index_size > buffer->size) return false;
+
+        o = optimize_indices(buffer->data + start, type, count);
+        if (!o) return false;
+        o->offset = start;
+        o->count = count;
+        o->type = type;
+        o->next = buffer->optimized;
+        buffer->optimized = o;
+    }
+
+    if (o->num_batches == 0) return false;
+    out->indices = o->indices;
+    out->batches = o->batches;
+    out->num_batches = o->num_batches;
+    return true;
+}
+
+int ogx_buffer_keep_order(GLuint buffer, int keep_order)
+{
+    int index = buffer - 1;
+    if (index < 0 || index >= MAX_VBOS) return 0;
+
+    uint32_t bit = 1u << (index % 32);
+    int had_keep_order = (s_keep_order[index / 32] & bit) != 0;
+    if (keep_order) {
+        s_keep_order[index / 32] |= bit;
+    } else {
+        s_keep_order[index / 32] &= ~bit;
+    }
+    return had_keep_order;
 }
 
 void _ogx_vbo_set_in_use(VboType vbo)
 {
     int index = vbo - 1;
     if (!VBO_IS_USED(index)) return;
-    s_buffers[index]->last_sync_token_sent = send_draw_sync_token();
+    VertexBuffer *buffer = s_buffers[index];
+    uint16_t token = send_draw_sync_token();
+    buffer->slot_sync_tokens[buffer->current_slot] = token;
+    buffer->last_sync_token_sent = token;
 }
 
 void _ogx_vbo_clear_unbound_buffers()
 {
     check_releasable_unbound_buffers(true);
+
+    /* The draw sync tokens are restarting from zero */
+    for (int i = 0; i < MAX_VBOS; i++) {
+        if (!VBO_IS_USED(i)) continue;
+        VertexBuffer *buffer = s_buffers[i];
+        buffer->last_sync_token_sent = 0;
+        memset(buffer->slot_sync_tokens, 0, sizeof(buffer->slot_sync_tokens));
+    }
 }
@@ -32,6 +32,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef OPENGX_VBO_H
 #define OPENGX_VBO_H
 
+#include "index_optimizer.h"
 #include "types.h"
 
 #ifdef __cplusplus
@@ -41,6 +42,34 @@ extern "C" {
 /* The offset is a void* because that's how it is specified in most OpenGL APIs
  * due to compatibility reasons. */
 void *_ogx_vbo_get_data(VboType vbo, const void *offset);
+
+typedef struct {
+    const void *data;
+    uint8_t stride;
+    /* GX component size (GX_S16, GX_U8, etc.) and fractional bits */
+    uint8_t size;
+    uint8_t frac;
+} OgxQuantizedArray;
+
+/* Returns a copy of the float array stored in the VBO at the given offset,
+ * converted to the most compact fixed point format which represents it with
+ * a good accuracy. Only GL_STATIC_DRAW buffers are handled. */
+bool _ogx_vbo_get_quantized(VboType vbo, const void *offset, int stride,
+                            uint8_t attribute, int num_components,
+                            OgxQuantizedArray *out);
+typedef struct {
+    const uint16_t *indices;
+    const OgxIndexBatch *batches;
+    int num_batches;
+} OgxOptimizedIndices;
+
+/* Returns the triangle list found at the given offset of an element array
+ * buffer, reordered for the vertex cache and possibly joined into strips
+ * and fans. Only GL_STATIC_DRAW buffers are handled, and not those for which
+ * ogx_buffer_keep_order() has been called. */
+bool _ogx_vbo_get_optimized_indices(VboType vbo, const void *offset,
+                                    GLenum type, int count,
+                                    OgxOptimizedIndices *out);
 /* Mark the given VBO as in use by the GPU */
 void _ogx_vbo_set_in_use(VboType vbo);
 void _ogx_vbo_clear_unbound_buffers(void);
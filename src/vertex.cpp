@@ -77,7 +77,9 @@ void set_current_color(T red, T green, T blue, T alpha = full_color<T>())
     }
 
     floatcpy(glparamstate.imm_mode.current_color, c, 4);
-    glparamstate.dirty.bits.dirty_tev = 1;
+    /* The vertices of a pending batch carry their own color */
+    if (glparamstate.imm_mode.batch_numverts == 0)
+        glparamstate.dirty.bits.dirty_tev = 1;
 }
 
 static inline void set_current_tex_unit_coords(int unit, float s, float t = 0)
@@ -110,6 +112,24 @@ static inline void set_current_tex_coords(float s, float t, float r, float q = 1
     set_current_tex_unit_coords(0, s, t, r, q);
 }
 
+static inline void fill_vertex(VertexData *vert, GLfloat x, GLfloat y, GLfloat z)
+{
+    for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+        if (glparamstate.imm_mode.has_texcoord & (1 << i)) {
+            vert->tex[i][0] = glparamstate.imm_mode.current_texcoord[i][0];
+            vert->tex[i][1] = glparamstate.imm_mode.current_texcoord[i][1];
+        }
+    }
+
+    vert->color = gxcol_new_fv(glparamstate.imm_mode.current_color);
+
+    floatcpy(vert->norm, glparamstate.imm_mode.current_normal, 3);
+
+    vert->pos[0] = x;
+    vert->pos[1] = y;
+    vert->pos[2] = z;
+}
+
 void glVertex2d(GLdouble x, GLdouble y)
 {
     glVertex3f(x, y, 0.0f);
@@ -137,36 +157,41 @@ void glVertex3d(GLdouble x, GLdouble y, GLdouble z)
 
 void glVertex3f(GLfloat x, GLfloat y, GLfloat z)
 {
+    if (glparamstate.imm_mode.can_stream && !glparamstate.imm_mode.streaming &&
+        glparamstate.imm_mode.current_numverts >= OGX_IMM_STREAM_MIN_VERTICES) {
+        _ogx_immediate_stream_start();
+    }
+
+    if (glparamstate.imm_mode.streaming) {
+        fill_vertex(_ogx_immediate_stream_next(), x, y, z);
+        _ogx_immediate_stream_vertex();
+        return;
+    }
+
     if (glparamstate.imm_mode.current_numverts >= glparamstate.imm_mode.current_vertices_size) {
         if (!glparamstate.imm_mode.current_vertices) return;
+        /* The pending batch must be drawn before the buffer moves; the buffer
+         * is then grown, until it can hold a full batch. */
+        bool batching = glparamstate.imm_mode.batch_numverts > 0;
+        _ogx_immediate_flush();
         int current_size = glparamstate.imm_mode.current_vertices_size;
-        int new_size = current_size < 256 ? (current_size * 2) : (current_size + 256);
-        void *new_buffer = realloc(glparamstate.imm_mode.current_vertices,
-                                   new_size * sizeof(VertexData));
-        if (!new_buffer) {
-            warning("Failed to reallocate memory for vertex buffer (%d)", errno);
-            set_error(GL_OUT_OF_MEMORY);
-            return;
+        if (glparamstate.imm_mode.current_numverts >= current_size ||
+            (batching && current_size < OGX_IMM_BATCH_MAX_VERTICES)) {
+            int new_size = current_size < 256 ? (current_size * 2) : (current_size + 256);
+            void *new_buffer = realloc(glparamstate.imm_mode.current_vertices,
+                                       new_size * sizeof(VertexData));
+            if (!new_buffer) {
+                warning("Failed to reallocate memory for vertex buffer (%d)", errno);
+                set_error(GL_OUT_OF_MEMORY);
+                return;
+            }
+            glparamstate.imm_mode.current_vertices_size = new_size;
+            glparamstate.imm_mode.current_vertices = (VertexData*)new_buffer;
         }
-        glparamstate.imm_mode.current_vertices_size = new_size;
-        glparamstate.imm_mode.current_vertices = (VertexData*)new_buffer;
     }
 
-    VertexData *vert = &glparamstate.imm_mode.current_vertices[glparamstate.imm_mode.current_numverts++];
-    for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
-        if (glparamstate.imm_mode.has_texcoord & (1 << i)) {
-            vert->tex[i][0] = glparamstate.imm_mode.current_texcoord[i][0];
-            vert->tex[i][1] = glparamstate.imm_mode.current_texcoord[i][1];
-        }
-    }
-
-    vert->color = gxcol_new_fv(glparamstate.imm_mode.current_color);
-
-    floatcpy(vert->norm, glparamstate.imm_mode.current_normal, 3);
-
-    vert->pos[0] = x;
-    vert->pos[1] = y;
-    vert->pos[2] = z;
+    fill_vertex(&glparamstate.imm_mode.current_vertices[glparamstate.imm_mode.current_numverts++],
+                x, y, z);
 }
 
 void glVertex3i(GLint x, GLint y, GLint z)
@@ -303,7 +328,8 @@ void glNormal3fv(const GLfloat *v)
         HANDLE_CALL_LIST(NORMAL, v);
     }
     floatcpy(glparamstate.imm_mode.current_normal, v, 3);
-    glparamstate.dirty.bits.dirty_tev = 1;
+    if (glparamstate.imm_mode.batch_numverts == 0)
+        glparamstate.dirty.bits.dirty_tev = 1;
 }
 
 void glNormal3iv(const GLint *v)
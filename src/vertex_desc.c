@@ -0,0 +1,212 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "vertex_desc.h"
+
+#include <ogc/gx.h>
+#include <string.h>
+
+#define FIRST_VTXFMT GX_VTXFMT1
+#define NUM_VTXFMTS (GX_MAXVTXFMT - FIRST_VTXFMT)
+/* Only the attributes starting from GX_VA_POS have an entry in the VAT */
+#define FIRST_VAT_ATTR GX_VA_POS
+#define NUM_VAT_ATTRS (GX_VA_TEX7 - GX_VA_POS + 1)
+#define NUM_VCD_ATTRS (GX_VA_TEX7 + 1)
+
+/* Component type (4 bits), size (4 bits) and fractional bits (5 bits) of an
+ * attribute, packed together so that they can be compared in one go */
+typedef uint16_t AttrFormat;
+#define ATTR_FORMAT(type, size, frac) \
+    ((AttrFormat)(((type) & 0xf) | (((size) & 0xf) << 4) | (((frac) & 0x1f) << 8)))
+#define ATTR_FORMAT_INVALID 0xffff
+
+typedef struct {
+    AttrFormat formats[NUM_VAT_ATTRS];
+    uint32_t last_used;
+} VtxFmtSlot;
+
+uint8_t _ogx_vtxdesc_vtxfmt = FIRST_VTXFMT;
+
+/* The descriptor as currently programmed into GX */
+static uint8_t s_vcd[NUM_VCD_ATTRS];
+static bool s_vcd_is_valid = false;
+static VtxFmtSlot s_slots[NUM_VTXFMTS];
+static uint32_t s_usage_counter = 0;
+
+/* The descriptor being built by the current draw operation */
+static uint8_t s_pending_vcd[NUM_VCD_ATTRS];
+static AttrFormat s_pending_formats[NUM_VAT_ATTRS];
+static uint16_t s_pending_attr_mask;
+
+void _ogx_vtxdesc_invalidate()
+{
+    s_vcd_is_valid = false;
+    for (int i = 0; i < NUM_VTXFMTS; i++) {
+        memset(s_slots[i].formats, 0xff, sizeof(s_slots[i].formats));
+        s_slots[i].last_used = 0;
+    }
+}
+
+void _ogx_vtxdesc_begin()
+{
+    memset(s_pending_vcd, GX_NONE, sizeof(s_pending_vcd));
+    s_pending_attr_mask = 0;
+}
+
+void _ogx_vtxdesc_add(uint8_t attribute, uint8_t inputmode,
+                      uint8_t type, uint8_t size, uint8_t frac)
+{
+    s_pending_vcd[attribute] = inputmode;
+    if (attribute >= FIRST_VAT_ATTR) {
+        int i = attribute - FIRST_VAT_ATTR;
+        s_pending_formats[i] = ATTR_FORMAT(type, size, frac);
+        s_pending_attr_mask |= 1 << i;
+    }
+}
+
+static bool slot_matches(const VtxFmtSlot *slot)
+{
+    for (uint16_t mask = s_pending_attr_mask; mask != 0; mask &= mask - 1) {
+        int i = __builtin_ctz(mask);
+        if (slot->formats[i] != s_pending_formats[i]) return false;
+    }
+    return true;
+}
+
+static uint8_t select_vtxfmt()
+{
+    int current = _ogx_vtxdesc_vtxfmt - FIRST_VTXFMT;
+    VtxFmtSlot *slot = &s_slots[current];
+
+    /* Most often the format is the same as in the previous draw */
+    if (!slot_matches(slot)) {
+        int lru = current;
+        slot = NULL;
+        for (int i = 0; i < NUM_VTXFMTS; i++) {
+            if (slot_matches(&s_slots[i])) {
+                slot = &s_slots[i];
+                current = i;
+                break;
+            }
+            if (s_slots[i].last_used < s_slots[lru].last_used) lru = i;
+        }
+
+        if (!slot) {
+            /* Reprogram the least recently used format; only the attributes
+             * whose format differs need to be written. */
+            current = lru;
+            slot = &s_slots[lru];
+            for (uint16_t mask = s_pending_attr_mask; mask != 0;
+                 mask &= mask - 1) {
+                int i = __builtin_ctz(mask);
+                AttrFormat f = s_pending_formats[i];
+                if (slot->formats[i] == f) continue;
+                GX_SetVtxAttrFmt(FIRST_VTXFMT + lru, FIRST_VAT_ATTR + i,
+                                 f & 0xf, (f >> 4) & 0xf, f >> 8);
+                slot->formats[i] = f;
+            }
+        }
+    }
+
+    slot->last_used = ++s_usage_counter;
+    return FIRST_VTXFMT + current;
+}
+
+static int component_size(uint8_t type)
+{
+    switch (type) {
+    case GX_U8:
+    case GX_S8: return 1;
+    case GX_U16:
+    case GX_S16: return 2;
+    default: return 4;
+    }
+}
+
+static int attribute_size(int attribute, AttrFormat f)
+{
+    /* Like in GX_SetVtxAttrFmt(), the "type" is the number of components and
+     * the "size" is the type of each component */
+    uint8_t count = f & 0xf, type = (f >> 4) & 0xf;
+
+    switch (attribute) {
+    case GX_VA_POS:
+        return component_size(type) * (count == GX_POS_XY ? 2 : 3);
+    case GX_VA_NRM:
+        return component_size(type) * (count == GX_NRM_XYZ ? 3 : 9);
+    case GX_VA_CLR0:
+    case GX_VA_CLR1:
+        switch (type) {
+        case GX_RGB565:
+        case GX_RGBA4: return 2;
+        case GX_RGB8:
+        case GX_RGBA6: return 3;
+        default: return 4;
+        }
+    default:
+        return component_size(type) * (count == GX_TEX_S ? 1 : 2);
+    }
+}
+
+int _ogx_vtxdesc_vertex_size()
+{
+    const VtxFmtSlot *slot = &s_slots[_ogx_vtxdesc_vtxfmt - FIRST_VTXFMT];
+    int vertex_size = 0;
+    for (int i = 0; i < NUM_VCD_ATTRS; i++) {
+        switch (s_vcd[i]) {
+        case GX_NONE: break;
+        case GX_INDEX8: vertex_size += 1; break;
+        case GX_INDEX16: vertex_size += 2; break;
+        default:
+            /* The matrix indices are always direct, one byte each */
+            vertex_size += i < FIRST_VAT_ATTR ? 1 :
+                attribute_size(i, slot->formats[i - FIRST_VAT_ATTR]);
+        }
+    }
+    return vertex_size;
+}
+
+uint8_t _ogx_vtxdesc_commit()
+{
+    if (!s_vcd_is_valid) {
+        GX_ClearVtxDesc();
+        memset(s_vcd, GX_NONE, sizeof(s_vcd));
+        s_vcd_is_valid = true;
+    }
+
+    for (int i = 0; i < NUM_VCD_ATTRS; i++) {
+        if (s_pending_vcd[i] != s_vcd[i]) {
+            GX_SetVtxDesc(i, s_pending_vcd[i]);
+            s_vcd[i] = s_pending_vcd[i];
+        }
+    }
+
+    _ogx_vtxdesc_vtxfmt = select_vtxfmt();
+    return _ogx_vtxdesc_vtxfmt;
+}
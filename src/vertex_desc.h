@@ -0,0 +1,70 @@
+/*****************************************************************************
+Copyright (c) 2024  Alberto Mardegan (mardy@users.sourceforge.net)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. Neither the name of copyright holders nor the names of its
+   contributors may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef OPENGX_VERTEX_DESC_H
+#define OPENGX_VERTEX_DESC_H
+
+#include <gctypes.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shadow of the GX vertex descriptor (VCD) and of the vertex attribute format
+ * tables (VAT).
+ *
+ * A draw operation describes its vertex layout between a call to
+ * _ogx_vtxdesc_begin() and a call to _ogx_vtxdesc_commit(); the latter only
+ * sends to GX the descriptor entries which differ from what was last
+ * programmed, and picks one of the GX_VTXFMT1-7 formats (kept in LRU order)
+ * whose attribute formats match the requested ones. The VAT is only rewritten
+ * when none of them does. GX_VTXFMT0 is left for the integration library.
+ *
+ * The returned vertex format must be passed to GX_Begin(). */
+extern uint8_t _ogx_vtxdesc_vtxfmt;
+
+void _ogx_vtxdesc_begin(void);
+void _ogx_vtxdesc_add(uint8_t attribute, uint8_t inputmode,
+                      uint8_t type, uint8_t size, uint8_t frac);
+uint8_t _ogx_vtxdesc_commit(void);
+
+/* Returns the size in bytes of a vertex described by the committed
+ * descriptor */
+int _ogx_vtxdesc_vertex_size(void);
+
+/* To be called when some code outside of this module might have changed the
+ * GX vertex descriptor or the attribute formats. */
+void _ogx_vtxdesc_invalidate(void);
+
+#ifdef __cplusplus
+} // extern C
+#endif
+
+#endif /* OPENGX_VERTEX_DESC_H */